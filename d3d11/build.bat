@@ -35,15 +35,16 @@ if "%preprocess%"=="1" (
 	echo [preprocessor output only]
 )
 
+:: Every target includes the shared code in ..\..\opengl_deps\src\ (basic\, gfx\, texture\, ...) through the common flags below.
 :: --- Clang 
-set clang_common=   -I..\src\ -Wall -std=c++11 -march=x86-64-v3 -ferror-limit=15 -gcodeview -fdiagnostics-absolute-paths -fno-exceptions -Wno-initializer-overrides -Wno-unused-function -Wno-missing-braces -Wno-unused-variable -Wno-writable-strings -Wno-address-of-temporary -Wno-switch -Wno-return-type -Wno-unused-command-line-argument -Wno-unused-but-set-variable
+set clang_common=   -I..\src\ -I..\..\opengl_deps\src\ -Wall -std=c++11 -march=x86-64-v3 -ferror-limit=15 -gcodeview -fdiagnostics-absolute-paths -fno-exceptions -Wno-initializer-overrides -Wno-unused-function -Wno-missing-braces -Wno-unused-variable -Wno-writable-strings -Wno-address-of-temporary -Wno-switch -Wno-return-type -Wno-unused-command-line-argument -Wno-unused-but-set-variable
 set clang_debug=    call clang -g -O0 -DBUILD_DEBUG=1 %clang_common% %auto_compile_flags% %preprocessor_flags%
 set clang_release=  call clang -g -O2 -DBUILD_DEBUG=0 -DBUILD_RELEASE=1 %clang_common% %auto_compile_flags%
 set clang_link=     -fuse-ld=lld -Xlinker /MANIFEST:EMBED -Xlinker /pdbaltpath:%%%%_PDB%%%% -Wl,/ignore:4099
 set clang_out=      -o
 
 :: --- MSVC
-set cl_common=     /I..\src\ /nologo /FC /Z7 /EHsc /W1 /GR- /MT /arch:AVX2
+set cl_common=     /I..\src\ /I..\..\opengl_deps\src\ /nologo /FC /Z7 /EHsc /W1 /GR- /MT /arch:AVX2
 set cl_debug=      call cl /Od /DBUILD_DEBUG=1 %cl_common% %auto_compile_flags% %preprocessor_flags%
 set cl_release=    call cl /O2 /DBUILD_DEBUG=0 -DBUILD_RELEASE=1 %cl_common% %auto_compile_flags%
 set cl_link=       /link /MANIFEST:EMBED /DEBUG:FULL /INCREMENTAL:NO /PDBALTPATH:%%%%_PDB%%%% /ignore:4099
@@ -136,6 +137,24 @@ REM 	REM --- Delete previous build related files before compiling
 	if "%triangle%"=="1"			set didbuild=1 && %compile% ..\src\triangle.cc %compile_link% %link_resource% %out%edgerunner.exe || exit /b 1
 	if "%textured%"=="1"			set didbuild=1 && %compile% ..\src\textured.cc %compile_link% %link_resource% %out%edgerunner.exe || exit /b 1
 
+	:: Cook every TGA in data\ into a BC7 .ctex next to it with the shared texture cooker.
+	if "%cook%"=="1" (
+		set didbuild=1
+		%compile% ..\..\opengl_deps\src\tools\texture_cooker.cc %compile_link% %out%texture_cooker.exe || exit /b 1
+		for %%f in ("data\*.tga") do (
+			texture_cooker.exe %%f data\%%~nf.ctex --format=bc7 || exit /b 1
+		)
+	)
+
+	:: Pack the shaders and textures textured.exe loads into data.pak, it maps that one file at startup.
+	set pack=
+	if "%textured%"=="1"			set pack=1
+	if "%cook%"=="1"					set pack=1
+	if "%pack%"=="1" (
+		%compile% ..\..\opengl_deps\src\tools\asset_packer.cc %compile_link% %out%asset_packer.exe || exit /b 1
+		asset_packer.exe data data.pak --ext=.cso --ext=.ctex --ext=.tga || exit /b 1
+	)
+
 
 popd
 
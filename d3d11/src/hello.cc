@@ -2,11 +2,14 @@
 
 #include <d3d11.h>
 #include <d3dcompiler.h>
-#include <directxmath.h>
 
+#include <cassert>
 #include <iostream>
 #include <string>
 
+#include "basic/types.h"
+#include "basic/vecmath.h"
+
 // Static libs
 #pragma comment(lib, "d3d11")
 #pragma comment(lib, "dxgi")
@@ -14,32 +17,6 @@
 #pragma comment(lib, "user32")
 #pragma comment(lib, "Winmm")
 
-// Keywords Macros
-#define global static
-#define internal static
-#define local static
-
-// Base Types
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-
-typedef int8_t s8;
-typedef int16_t s16;
-typedef int32_t s32;
-typedef int64_t s64;
-
-typedef s8 b8;
-typedef s16 b16;
-typedef s32 b32;
-typedef s64 b64;
-
-typedef float f32;
-typedef double f64;
-
-using namespace DirectX;
-
 // For releasing COM objects
 template <typename T> inline void SafeRelease(T &ptr) {
   if (ptr != NULL) {
@@ -97,25 +74,25 @@ enum ConstantBuffer : u64 {
 
 ID3D11Buffer *g_constant_buffers[ConstantBuffer_COUNT];
 
-XMMATRIX g_world_matrix;      // Stores every single object world matrix being rendererd.
-XMMATRIX g_view_matrix;       // Stores the camera view matrix, updated onces every frame
-XMMATRIX g_projection_matrix; // Stores the projection matrix, updated at window creation
+Mat4 g_world_matrix;      // Stores every single object world matrix being rendererd.
+Mat4 g_view_matrix;       // Stores the camera view matrix, updated onces every frame
+Mat4 g_projection_matrix; // Stores the projection matrix, updated at window creation
 
 // Vertex data for a colored cube.
 struct VertexPosColour {
-  XMFLOAT3 position;
-  XMFLOAT3 colour;
+  Vec3 position;
+  Vec3 colour;
 };
 
 VertexPosColour g_vertices[8] = {
-    {XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, 0.0f)}, // 0
-    {XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)},  // 1
-    {XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT3(1.0f, 1.0f, 0.0f)},   // 2
-    {XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f)},  // 3
-    {XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 1.0f)},  // 4
-    {XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 1.0f)},   // 5
-    {XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)},    // 6
-    {XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 1.0f)}    // 7
+    {{ -1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f, 0.0f }}, // 0
+    {{ -1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }},  // 1
+    {{ 1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f, 0.0f }},   // 2
+    {{ 1.0f, -1.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }},  // 3
+    {{ -1.0f, -1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }},  // 4
+    {{ -1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f, 1.0f }},   // 5
+    {{ 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }},    // 6
+    {{ 1.0f, -1.0f, 1.0f }, { 1.0f, 0.0f, 1.0f }}    // 7
 };
 
 WORD g_indicies[36] = {
@@ -340,7 +317,7 @@ bool load_content() {
   // Initialize the content of the constant buffer defined in the vertex shader.
   D3D11_BUFFER_DESC constant_buffer_desc = {};
   constant_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-  constant_buffer_desc.ByteWidth = sizeof(XMMATRIX);
+  constant_buffer_desc.ByteWidth = sizeof(Mat4);
   constant_buffer_desc.CPUAccessFlags = 0;
   constant_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
 
@@ -390,7 +367,7 @@ bool load_content() {
   float client_height = static_cast<float>(client_rect.bottom - client_rect.top);
 	float aspect_ratio = client_width / client_height;
 
-	g_projection_matrix = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.0f), aspect_ratio, 0.1f, 1000.0f);
+	g_projection_matrix = mat4_perspective_fov_lh(3.14159265f / 2.0f, aspect_ratio, 0.1f, 1000.0f);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Application], 0, nullptr, &g_projection_matrix, 0, 0);
 
   return true;
@@ -398,18 +375,16 @@ bool load_content() {
 
 void Update(float dt) {
 	// --- Camera ---
-	XMVECTOR eye   = XMVectorSet(0, 0, -10, 1);
-	XMVECTOR focus = XMVectorSet(0, 0, 0, 1);
-	XMVECTOR up    = XMVectorSet(0, 1, 0, 0);
-	g_view_matrix = XMMatrixLookAtLH(eye, focus, up);
+	Vec4 eye   = vec4(0, 0, -10, 1);
+	Vec4 focus = vec4(0, 0, 0, 1);
+	Vec4 up    = vec4(0, 1, 0, 0);
+	g_view_matrix = mat4_look_at_lh(eye, focus, up);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Frame], 0, nullptr, &g_view_matrix, 0, 0);
 
 	// --- Object world matrix ---
 	static f32 angle = 0.0f;
 	angle += 90.0f * dt;
-	XMVECTOR rotation_axis = XMVectorSet(2, 1, 0, 0);
-	g_world_matrix = XMMatrixRotationAxis(rotation_axis, XMConvertToRadians(angle));
-	//g_world_matrix = XMMatrixIdentity();
+	g_world_matrix = mat4_rotation_axis(2, 1, 0, angle * 3.14159265f / 180.0f);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Object], 0, nullptr, &g_world_matrix, 0, 0);
 }
 
@@ -516,12 +491,6 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
   UNREFERENCED_PARAMETER(prevInstance);
   UNREFERENCED_PARAMETER(cmdLine);
 
-  // Check for DirectX Math library support.
-  if (!XMVerifyCPUSupport()) {
-    MessageBox(nullptr, TEXT("Failed to verify DirectX Math library support."), TEXT("Error"), MB_OK);
-    return -1;
-  }
-
   if (InitApplication(hInstance, cmdShow) != 0) {
     MessageBox(nullptr, TEXT("Failed to create applicaiton window."), TEXT("Error"), MB_OK);
     return -1;
@@ -1,44 +1,27 @@
 
 #include <windows.h>
 #include <d3d11.h>
-#include <d3dcompiler.h>
-#include <directxmath.h>
 
-#include <iostream>
-#include <string>
+#include <cassert>
+#include <cstdio>
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "texture/tga.h"
+#include "texture/mips.h"
+#include "texture/cooked.h"
+#include "asset/pack.h"
+#include "asset/stream.h"
+#include "gfx/resources.h"
+#include "gfx/queue.h"
+#include "gfx/state.h"
 
 // Static libs
 #pragma comment(lib, "user32")
 #pragma comment(lib, "Winmm")
 #pragma comment(lib, "d3d11")
 #pragma comment(lib, "dxgi")
-#pragma comment(lib, "d3dcompiler")
-
-// Keywords Macros
-#define global static
-#define internal static
-#define local static
-
-// Base Types
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-
-typedef int8_t s8;
-typedef int16_t s16;
-typedef int32_t s32;
-typedef int64_t s64;
-
-typedef s8 b8;
-typedef s16 b16;
-typedef s32 b32;
-typedef s64 b64;
-
-typedef float f32;
-typedef double f64;
-
-using namespace DirectX;
 
 // For releasing COM objects
 template <typename T> inline void SafeRelease(T &ptr) {
@@ -57,10 +40,16 @@ LPCSTR g_window_class_name 				 = "[edgerunner-gfx-class]";
 const BOOL g_enable_vsync					 = false;
 global b32 g_is_fullscreen 				 = false;
 
-global s16 g_texture_width 				 = 0;
-global s16 g_texture_height 			 = 0;
-global u32 row_pitch							 = 0;
-global u8* g_texture_data = nullptr;
+// Every runtime asset comes out of data.pak (build.bat packs it), mapped once.
+global Pack g_pack = {};
+
+// Textures are loaded and decoded on worker threads. Each frame uploads at most
+// g_stream_upload_budget bytes of them and draws with a placeholder until the
+// first (smallest) mip level is on the GPU, so the frame loop never waits on disk.
+global Streamer g_streamer;
+global StreamHandle g_stone_texture = 0;
+global b32 g_stone_fallback = false;
+global const u64 g_stream_upload_budget = KB(512);
 
 
 WINDOWPLACEMENT g_last_window_placement;
@@ -80,25 +69,16 @@ ID3D11RasterizerState*		g_rasterizer_state = nullptr;
 
 D3D11_VIEWPORT 						g_viewport = {};
 
-// Vertex buffer data
-ID3D11Buffer*							g_vertex_buffer = nullptr;
-ID3D11Buffer*							g_index_buffer  = nullptr;
 ID3D11InputLayout*				g_input_layout  = nullptr;
-ID3D11ShaderResourceView* g_shader_rsv		= nullptr;
 
 // Shader data
 ID3D11PixelShader*				g_pixel_shader  = nullptr;
 ID3D11VertexShader*				g_vertex_shader = nullptr;
 
-// Texture
-ID3D11Texture2D*					g_texture 			= nullptr;
-
-
 
 // Projection related
-XMMATRIX g_world_matrix;
-XMMATRIX g_view_matrix; 
-XMMATRIX g_projection_matrix;
+Mat4 g_world_matrix;
+Mat4 g_view_matrix;
 
 enum ConstantBuffer : u64 {
   ConstantBuffer_Application,
@@ -107,29 +87,41 @@ enum ConstantBuffer : u64 {
   ConstantBuffer_COUNT
 };
 
-ID3D11Buffer *g_constant_buffers[ConstantBuffer_COUNT];
+// Buffers, meshes and textures live in g_gfx's pools and are named by handles.
+// Streamed textures keep theirs in StreamTexture::user.
+global GfxResources g_gfx;
+global GfxMeshHandle g_triangle_mesh;
+global GfxTextureHandle g_placeholder_texture;
+global GfxBufferHandle g_constant_buffers[ConstantBuffer_COUNT];
+
+// Draws go through a render queue (gfx/queue.h), sorted to bind as little as
+// possible. The shader of a packet is one of these.
+enum Shader : u32 {
+	Shader_Textured,
+	Shader_COUNT
+};
+
+global GfxRenderQueue g_render_queue;
+global GfxDrawFuncs g_draw_funcs;
+
+// What is bound on g_device_context. Binds go through the d3d11_set_*()
+// functions, which skip the call when it would bind what already is.
+global GfxStateCache g_state_cache;
+global f64 g_render_stats_shown_at = 0.0;
 
 //------------------------------------------------------------------------
 // DATA
 //------------------------------------------------------------------------
 
 struct Vertex {
-  XMFLOAT3 position;
-  XMFLOAT2 texture;
+  Vec3 position;
+  f32 texture[2];
 };
 
-//Vertex g_vertices[3] = {
-//	{ XMFLOAT3(1.0f, -1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f) },
-//	{ XMFLOAT3(0.0f, 1.0f, 0.0f),  XMFLOAT2(0.5f, 0.0f) },
-//	{ XMFLOAT3(1.0f, -1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) }
-//};
-
-//u16 g_indices[3] = { 0, 1, 2 };
-
 Vertex g_vertices[3] = {
-	{ XMFLOAT3(-1.0f, -1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f) }, // Bottom-left
-	{ XMFLOAT3( 0.0f,  1.0f, 0.0f), XMFLOAT2(0.5f, 0.0f) }, // Top-center
-	{ XMFLOAT3( 1.0f, -1.0f, 0.0f), XMFLOAT2(1.0f, 1.0f) }  // Bottom-right
+	{ { -1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f } }, // Bottom-left
+	{ {  0.0f,  1.0f, 0.0f }, { 0.5f, 0.0f } }, // Top-center
+	{ {  1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f } }  // Bottom-right
 };
 
 u16 g_indices[3] = { 0, 1, 2 };
@@ -238,7 +230,8 @@ int init_directx(HINSTANCE hInstance, BOOL vsync) {
   swapchain_desc.BufferCount = 1;
   swapchain_desc.BufferDesc.Width = client_width;
   swapchain_desc.BufferDesc.Height = client_height;
-  swapchain_desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+  // sRGB so the linear colours the pixel shader gets from sRGB textures are encoded back on write.
+  swapchain_desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
   // swapchain_desc.BufferDesc.RefreshRate = QueryRefereshRate(client_width, client_height, vsync);
   swapchain_desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
   swapchain_desc.OutputWindow = g_window_handle;
@@ -351,41 +344,232 @@ int init_directx(HINSTANCE hInstance, BOOL vsync) {
   return 0;
 }
 
+internal DXGI_FORMAT dxgi_format_from_cooked(const GfxTextureDesc* desc) {
+	switch(desc->format) {
+		case CookedFormat_BC1: return desc->srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+		case CookedFormat_BC3: return desc->srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+		case CookedFormat_BC7: return desc->srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+		default:               return desc->srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+//------------------------------------------------------------------------
+// GfxBackend (gfx/resources.h) on g_device
+//------------------------------------------------------------------------
+
+internal b32 d3d11_create_buffer(void* user, const GfxBufferDesc* desc, const void* data, GfxNative* native) {
+	const UINT bind_flags[GfxBuffer_COUNT] = { D3D11_BIND_VERTEX_BUFFER, D3D11_BIND_INDEX_BUFFER, D3D11_BIND_CONSTANT_BUFFER };
+	D3D11_BUFFER_DESC buffer_desc = {};
+	buffer_desc.BindFlags = bind_flags[desc->kind];
+	buffer_desc.ByteWidth = desc->size;
+	buffer_desc.CPUAccessFlags = 0;
+	buffer_desc.Usage = D3D11_USAGE_DEFAULT;
+
+	D3D11_SUBRESOURCE_DATA resource_data = {};
+	resource_data.pSysMem = data;
+	ID3D11Buffer* buffer = nullptr;
+	HRESULT hr = g_device->CreateBuffer(&buffer_desc, data ? &resource_data : nullptr, &buffer);
+	native->pointer = buffer;
+	return SUCCEEDED(hr);
+}
+
+internal void d3d11_update_buffer(void* user, const GfxBufferDesc* desc, GfxNative native, u32 offset, u32 size, const void* data) {
+	// Constant buffers can only be updated whole, gfx_buffer_update() sees to it.
+	if(desc->kind == GfxBuffer_Constant) {
+		assert(offset == 0 && size == desc->size);
+		g_device_context->UpdateSubresource((ID3D11Buffer*)native.pointer, 0, nullptr, data, 0, 0);
+	} else {
+		D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+		g_device_context->UpdateSubresource((ID3D11Buffer*)native.pointer, 0, &box, data, 0, 0);
+	}
+}
+
+// A released object's address can come back as a new one; the cache must not take it for the old.
+internal void d3d11_destroy_buffer(void* user, GfxNative native) {
+	gfx_state_forget_value(&g_state_cache, gfx_state_vertex_buffer(0), GFX_STATE_VERTEX_BUFFERS, native.value);
+	gfx_state_forget_value(&g_state_cache, gfx_state_constant_buffer(GfxStage_Vertex, 0), GFX_STATE_CONSTANT_BUFFERS, native.value);
+	gfx_state_forget_value(&g_state_cache, GfxState_IndexBuffer, 1, native.value);
+	((ID3D11Buffer*)native.pointer)->Release();
+}
+
+// The view is made right away; Render() samples the texture once levels_ready says so.
+internal b32 d3d11_create_texture(void* user, const GfxTextureDesc* desc, GfxNative* native, GfxNative* view) {
+	D3D11_TEXTURE2D_DESC texture_desc = {};
+	texture_desc.Width = desc->width;
+	texture_desc.Height = desc->height;
+	texture_desc.MipLevels = desc->level_count;
+	texture_desc.ArraySize = 1;
+	texture_desc.Format = dxgi_format_from_cooked(desc);
+	texture_desc.SampleDesc.Count = 1;
+	texture_desc.Usage = D3D11_USAGE_DEFAULT;
+	texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ID3D11Texture2D* texture = nullptr;
+	ID3D11ShaderResourceView* texture_view = nullptr;
+	HRESULT hr = g_device->CreateTexture2D(&texture_desc, nullptr, &texture);
+	if(SUCCEEDED(hr)) hr = g_device->CreateShaderResourceView(texture, nullptr, &texture_view);
+	if(FAILED(hr)) {
+		SafeRelease(texture);
+		return false;
+	}
+	native->pointer = texture;
+	view->pointer = texture_view;
+	return true;
+}
+
+internal void d3d11_upload_texture(void* user, const GfxTextureDesc* desc, GfxNative native, u32 level, u32 row, u32 row_count,
+																	 const u8* data, u32 row_pitch, b32 level_complete) {
+	// Rows are rows of 4x4 blocks for BCn, whose boxes are in the padded block size.
+	ID3D11Texture2D* texture = (ID3D11Texture2D*)native.pointer;
+	u32 row_height = cooked_format_is_block_compressed(desc->format) ? 4 : 1;
+	u32 level_width = Max(desc->width >> level, 1u);
+	u32 width = row_height == 4 ? AlignPow2(level_width, 4u) : level_width;
+	u32 height = gfx_texture_level_rows(desc, level) * row_height;
+	D3D11_BOX box = { 0, row * row_height, 0, width, Min((row + row_count) * row_height, height), 1 };
+	g_device_context->UpdateSubresource(texture, level, &box, data, row_pitch, 0);
+
+	// Level complete, let the sampler use it.
+	if(level_complete) g_device_context->SetResourceMinLOD(texture, (f32)level);
+}
+
+internal void d3d11_destroy_texture(void* user, GfxNative native, GfxNative view) {
+	gfx_state_forget_value(&g_state_cache, gfx_state_texture(GfxStage_Pixel, 0), GFX_STATE_TEXTURES, view.value);
+	((ID3D11ShaderResourceView*)view.pointer)->Release();
+	((ID3D11Texture2D*)native.pointer)->Release();
+}
+
+internal GfxBackend d3d11_gfx_backend() {
+	GfxBackend backend = {};
+	backend.name = "d3d11";
+	backend.create_buffer = d3d11_create_buffer;
+	backend.update_buffer = d3d11_update_buffer;
+	backend.destroy_buffer = d3d11_destroy_buffer;
+	backend.create_texture = d3d11_create_texture;
+	backend.upload_texture = d3d11_upload_texture;
+	backend.destroy_texture = d3d11_destroy_texture;
+	return backend;
+}
+
+internal ID3D11Buffer* d3d11_buffer(GfxBufferHandle handle) {
+	GfxBuffer* buffer = gfx_buffer_get(&g_gfx, handle);
+	return buffer ? (ID3D11Buffer*)buffer->native.pointer : nullptr;
+}
+
+//------------------------------------------------------------------------
+// Binds on g_device_context through g_state_cache (gfx/state.h)
+//------------------------------------------------------------------------
+
+internal void d3d11_set_input_layout(ID3D11InputLayout* layout) {
+	if(gfx_state_set(&g_state_cache, GfxState_InputLayout, (u64)layout)) g_device_context->IASetInputLayout(layout);
+}
+
+internal void d3d11_set_topology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+	if(gfx_state_set(&g_state_cache, GfxState_Topology, topology)) g_device_context->IASetPrimitiveTopology(topology);
+}
+
+internal void d3d11_set_vertex_buffer(u32 slot, ID3D11Buffer* buffer, UINT stride, UINT offset) {
+	if(!gfx_state_set2(&g_state_cache, gfx_state_vertex_buffer(slot), (u64)buffer, ((u64)offset << 32) | stride)) return;
+	g_device_context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+}
+
+internal void d3d11_set_index_buffer(ID3D11Buffer* buffer, DXGI_FORMAT format) {
+	if(gfx_state_set2(&g_state_cache, GfxState_IndexBuffer, (u64)buffer, format)) g_device_context->IASetIndexBuffer(buffer, format, 0);
+}
+
+internal void d3d11_set_vertex_shader(ID3D11VertexShader* shader) {
+	if(gfx_state_set(&g_state_cache, GfxState_VertexShader, (u64)shader)) g_device_context->VSSetShader(shader, nullptr, 0);
+}
+
+internal void d3d11_set_pixel_shader(ID3D11PixelShader* shader) {
+	if(gfx_state_set(&g_state_cache, GfxState_PixelShader, (u64)shader)) g_device_context->PSSetShader(shader, nullptr, 0);
+}
+
+// Slots [0, count) in one call, as VSSetConstantBuffers takes them.
+internal void d3d11_set_vs_constant_buffers(ID3D11Buffer* const* buffers, u32 count) {
+	u64 values[GFX_STATE_CONSTANT_BUFFERS];
+	for(u32 i = 0; i < count; i++) values[i] = (u64)buffers[i];
+	if(!gfx_state_set_range(&g_state_cache, gfx_state_constant_buffer(GfxStage_Vertex, 0), count, values)) return;
+	g_device_context->VSSetConstantBuffers(0, count, buffers);
+}
+
+internal void d3d11_set_ps_texture(u32 slot, ID3D11ShaderResourceView* view) {
+	if(gfx_state_set(&g_state_cache, gfx_state_texture(GfxStage_Pixel, slot), (u64)view)) g_device_context->PSSetShaderResources(slot, 1, &view);
+}
+
+internal void d3d11_set_ps_sampler(u32 slot, ID3D11SamplerState* sampler) {
+	if(gfx_state_set(&g_state_cache, gfx_state_sampler(GfxStage_Pixel, slot), (u64)sampler)) g_device_context->PSSetSamplers(slot, 1, &sampler);
+}
+
+internal void d3d11_set_rasterizer(ID3D11RasterizerState* rasterizer) {
+	if(gfx_state_set(&g_state_cache, GfxState_Rasterizer, (u64)rasterizer)) g_device_context->RSSetState(rasterizer);
+}
+
+// The depth range is always [0, 1] here, only the rectangle is compared.
+internal void d3d11_set_viewport(const D3D11_VIEWPORT* viewport) {
+	u64 origin = gfx_state_pack_f32(viewport->TopLeftX, viewport->TopLeftY);
+	u64 size = gfx_state_pack_f32(viewport->Width, viewport->Height);
+	if(gfx_state_set2(&g_state_cache, GfxState_Viewport, origin, size)) g_device_context->RSSetViewports(1, viewport);
+}
+
+internal void d3d11_set_render_target(ID3D11RenderTargetView* target, ID3D11DepthStencilView* depth) {
+	if(gfx_state_set2(&g_state_cache, GfxState_RenderTargets, (u64)target, (u64)depth)) g_device_context->OMSetRenderTargets(1, &target, depth);
+}
+
+internal void d3d11_set_depth_stencil(ID3D11DepthStencilState* state, UINT stencil_ref) {
+	if(gfx_state_set2(&g_state_cache, GfxState_DepthStencil, (u64)state, stencil_ref)) g_device_context->OMSetDepthStencilState(state, stencil_ref);
+}
+
+//------------------------------------------------------------------------
+// GfxDrawFuncs (gfx/queue.h) on g_device_context
+//------------------------------------------------------------------------
+
+internal void d3d11_bind_shader(void* user, u32 shader) {
+	// Shader_Textured is the only one so far.
+	d3d11_set_input_layout(g_input_layout);
+	d3d11_set_vertex_shader(g_vertex_shader);
+	d3d11_set_pixel_shader(g_pixel_shader);
+}
+
+internal void d3d11_bind_texture(void* user, const GfxTexture* texture) {
+	if(!texture) texture = gfx_texture_get(&g_gfx, g_placeholder_texture);
+	d3d11_set_ps_texture(0, (ID3D11ShaderResourceView*)texture->view.pointer);
+}
+
+internal void d3d11_bind_mesh(void* user, GfxResources* resources, const GfxMesh* mesh) {
+	d3d11_set_vertex_buffer(0, d3d11_buffer(mesh->vertices), mesh->vertex_stride, 0);
+	d3d11_set_index_buffer(d3d11_buffer(mesh->indices), mesh->index_size == 4 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT);
+}
+
+// The one object's world matrix is already in ConstantBuffer_Object (Update()).
+internal void d3d11_draw(void* user, const GfxDrawPacket* packet, const GfxMesh* mesh) {
+	g_device_context->DrawIndexed(mesh->index_count, mesh->first_index, 0);
+}
+
+internal GfxDrawFuncs d3d11_draw_funcs() {
+	GfxDrawFuncs funcs = {};
+	funcs.bind_shader = d3d11_bind_shader;
+	funcs.bind_texture = d3d11_bind_texture;
+	funcs.bind_mesh = d3d11_bind_mesh;
+	funcs.draw = d3d11_draw;
+	return funcs;
+}
+
 void init_pipeline() {
 	assert(g_device);
 	HRESULT hr;
 
-  // Create and init vertex buffer
-	{
-		D3D11_BUFFER_DESC vertex_buffer_desc = {};
-		vertex_buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		vertex_buffer_desc.ByteWidth = sizeof(Vertex) * _countof(g_vertices);
-		vertex_buffer_desc.CPUAccessFlags = 0;
-		vertex_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-
-		D3D11_SUBRESOURCE_DATA resource_data = {};
-		resource_data.pSysMem = g_vertices;
-		HRESULT hr = g_device->CreateBuffer(&vertex_buffer_desc, &resource_data, &g_vertex_buffer);
-		if(FAILED(hr)) {
-			MessageBox(nullptr, TEXT("Failed to create vertex buffer desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
-			ExitProcess(1);
-		}
+	GfxBackend backend = d3d11_gfx_backend();
+	if(!gfx_resources_init(&g_gfx, &backend) || !gfx_queue_init(&g_render_queue, GFX_QUEUE_DEFAULT_CAPACITY)) {
+		MessageBox(nullptr, TEXT("Failed to allocate the resource pools"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
+		ExitProcess(1);
 	}
+	g_draw_funcs = d3d11_draw_funcs();
 
-	{
-		// Initialize the index buffer
-		D3D11_SUBRESOURCE_DATA resource_data = {};
-		D3D11_BUFFER_DESC index_buffer_desc = {};
-		index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		index_buffer_desc.ByteWidth = sizeof(WORD) * _countof(g_indices);
-		index_buffer_desc.CPUAccessFlags = 0;
-		index_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-		resource_data.pSysMem = g_indices;
-		hr = g_device->CreateBuffer(&index_buffer_desc, &resource_data, &g_index_buffer);
-		if(FAILED(hr)) {
-			MessageBox(nullptr, TEXT("Failed to create index buffer desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
-			ExitProcess(1);
-		}
+	// Vertex and index buffer
+	g_triangle_mesh = gfx_mesh_create(&g_gfx, g_vertices, _countof(g_vertices), sizeof(Vertex), g_indices, _countof(g_indices), sizeof(u16));
+	if(!g_triangle_mesh.value) {
+		MessageBox(nullptr, TEXT("Failed to create the triangle mesh"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
+		ExitProcess(1);
 	}
 
 	// Initialize the texture sampler
@@ -412,77 +596,41 @@ void init_pipeline() {
 		}
 	}
 
-	// Create texture description
-	{
-		D3D11_TEXTURE2D_DESC texture_desc = {};
-		texture_desc.Height = g_texture_height;
-		texture_desc.Width = g_texture_width;
-		texture_desc.MipLevels = 0;
-		texture_desc.ArraySize = 1;
-		texture_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		texture_desc.SampleDesc.Count = 1;
-		texture_desc.SampleDesc.Quality = 0;
-		texture_desc.Usage = D3D11_USAGE_DEFAULT;
-		texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-		texture_desc.CPUAccessFlags = 0;
-		texture_desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
-		
-		hr = g_device->CreateTexture2D(&texture_desc, NULL, &g_texture);
-		if(FAILED(hr)) {
-			MessageBox(nullptr, TEXT("Failed to create texture desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
-			ExitProcess(1);
-		}
-
-		row_pitch = (g_texture_width * 4) * sizeof(u8);
-	}
-
-	// Setup shader resource view description
+	// Placeholder drawn until the streamed texture has its first mip level, a small
+	// grey checker that is obviously not final art.
 	{
-		D3D11_SHADER_RESOURCE_VIEW_DESC shader_resource_view = {};
-		shader_resource_view.Format =  DXGI_FORMAT_R8G8B8A8_UNORM;
-		shader_resource_view.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		shader_resource_view.Texture2D.MostDetailedMip = 0;
-		shader_resource_view.Texture2D.MipLevels = -1;
+		u32 checker[4 * 4];
+		for(u32 i = 0; i < ArrayCount(checker); i++) checker[i] = ((i ^ (i / 4)) & 1) ? 0xff808080 : 0xff404040;
 
-		hr = g_device->CreateShaderResourceView(g_texture, &shader_resource_view, &g_shader_rsv);
-		if(FAILED(hr)) {
-			MessageBox(nullptr, TEXT("Failed to create shader resource view desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
+		GfxTextureDesc placeholder_desc = { CookedFormat_RGBA8, false, 4, 4, 1 };
+		g_placeholder_texture = gfx_texture_create(&g_gfx, &placeholder_desc);
+		if(!g_placeholder_texture.value) {
+			MessageBox(nullptr, TEXT("Failed to create placeholder texture"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 			ExitProcess(1);
 		}
-
+		gfx_texture_upload_rows(&g_gfx, g_placeholder_texture, 0, 0, 4, (const u8*)checker, 4 * sizeof(u32));
 	}
 
   // Initialize the content of the constant buffer defined in the vertex shader.
-  D3D11_BUFFER_DESC constant_buffer_desc = {};
-  constant_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-  constant_buffer_desc.ByteWidth = sizeof(XMMATRIX);
-  constant_buffer_desc.CPUAccessFlags = 0;
-  constant_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-
+	GfxBufferDesc constant_buffer_desc = { GfxBuffer_Constant, sizeof(Mat4), 0, true };
   for (s8 i = 0; i < _countof(g_constant_buffers); i++) {
-    hr = g_device->CreateBuffer(&constant_buffer_desc, nullptr, &g_constant_buffers[i]);
-    if(FAILED(hr)) {
+		g_constant_buffers[i] = gfx_buffer_create(&g_gfx, &constant_buffer_desc, nullptr);
+    if(!g_constant_buffers[i].value) {
 			MessageBox(nullptr, TEXT("Failed to create constant buffer desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 			ExitProcess(1);
 		}
   }
-
-	
 }
 
-// Load the compiled shaders
-void load_shaders(LPCWSTR vertex_shader_obj, LPCWSTR pixel_shader_obj) {
-	ID3DBlob* vertex_shader_blob;
-	ID3DBlob* pixel_shader_blob;
-
-	HRESULT hr = D3DReadFileToBlob(vertex_shader_obj, &vertex_shader_blob);
-	if(FAILED(hr)) {
+// Load the compiled shaders, straight out of the pack
+void load_shaders(const char* vertex_shader_obj, const char* pixel_shader_obj) {
+	PackSpan vertex_shader_blob = pack_find(&g_pack, vertex_shader_obj);
+	if(!vertex_shader_blob.data) {
 		MessageBox(nullptr, TEXT("Failed to read vertex shader blob"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 		ExitProcess(1);
 	}
 
-	hr = g_device->CreateVertexShader(vertex_shader_blob->GetBufferPointer(), vertex_shader_blob->GetBufferSize(), 
-																		nullptr, &g_vertex_shader);
+	HRESULT hr = g_device->CreateVertexShader(vertex_shader_blob.data, vertex_shader_blob.size, nullptr, &g_vertex_shader);
 	if(FAILED(hr)) {
 		MessageBox(nullptr, TEXT("Failed to create vertex shader"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 		ExitProcess(1);
@@ -494,105 +642,60 @@ void load_shaders(LPCWSTR vertex_shader_obj, LPCWSTR pixel_shader_obj) {
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,   0, 	D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
   };
 
-  hr = g_device->CreateInputLayout(vertex_layout_desc, _countof(vertex_layout_desc), vertex_shader_blob->GetBufferPointer(), 
-																	 vertex_shader_blob->GetBufferSize(), &g_input_layout);
+  hr = g_device->CreateInputLayout(vertex_layout_desc, _countof(vertex_layout_desc), vertex_shader_blob.data,
+																	 vertex_shader_blob.size, &g_input_layout);
   if (FAILED(hr)) { 
     MessageBox(nullptr, TEXT("Failed to create input layout"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 		ExitProcess(1);
 	}
-  SafeRelease(vertex_shader_blob);
-
 	// Load up pixel shader blob
-	hr = D3DReadFileToBlob(pixel_shader_obj, &pixel_shader_blob); 
-	if(FAILED(hr)) {
+	PackSpan pixel_shader_blob = pack_find(&g_pack, pixel_shader_obj);
+	if(!pixel_shader_blob.data) {
 		MessageBox(nullptr, TEXT("Failed to read pixel shader blob"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 		ExitProcess(1);
 	}
 
 	// Create pixel shader
-	hr = g_device->CreatePixelShader(pixel_shader_blob->GetBufferPointer(), pixel_shader_blob->GetBufferSize(), nullptr, &g_pixel_shader);
+	hr = g_device->CreatePixelShader(pixel_shader_blob.data, pixel_shader_blob.size, nullptr, &g_pixel_shader);
 	if(FAILED(hr)) {
 		MessageBox(nullptr, TEXT("Failed to create vertex shader blob"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
 		ExitProcess(1);
 	}
-
-	SafeRelease(pixel_shader_blob);
-
-	// Copy the tga imade data into the texture
-	g_device_context->UpdateSubresource(g_texture, 0, nullptr, g_texture_data, row_pitch, 0);
-
-	// Generate mipmap levels for attached texture
-	g_device_context->GenerateMips(g_shader_rsv);
 }
 
-struct TGAHeader {
-	u8 data[12];
-	u16 width;
-	u16 height;
-	u8 bpp;
-	u8 data2;
-};
-
-bool load_tga32bit(char* filename) {
-	s32 error, bpp, image_size, index, i, j, k;
-	FILE* file_ptr;
-	u32 count;
-	TGAHeader file_header;
-	u8* tga_image;
-
-	error = fopen_s(&file_ptr, filename, "rb");
-	if(error != 0) return false;
-
-	count = (u32)fread(&file_header, sizeof(TGAHeader), 1, file_ptr);
-	if(count != 1) return false;
-
-	g_texture_width = file_header.width;
-	g_texture_height = file_header.height;
-	bpp = (s32)file_header.bpp;
-
-	// Check that the bpp is 32 bits and not 24
-	if(bpp != 32) return false;
-
-	image_size = g_texture_width * g_texture_height * 4;
-	tga_image = new u8[image_size];
-
-	// Read in tga image data
-	count = (u32)fread(tga_image, 1, image_size, file_ptr);
-	if(count != image_size) return false;
-
-	// Close file
-	error = fclose(file_ptr);
-	if(error != 0) return false;
-
-	// allocate memory for the tga destination data
-	g_texture_data = new u8[image_size];
-
-	// Initialize the index into the tga destination data array
-	index = 0;
-
-	// initialize the index into the tga image data
-	k = (g_texture_width * g_texture_height * 4) - (g_texture_width * 4);
-
-	// copy TGA image data 
-	for(j = 0; j < g_texture_height; j++) {
-		for(i = 0; i < g_texture_width; i++) {
-			g_texture_data[index + 0] = tga_image[k + 2]; // red
-			g_texture_data[index + 1] = tga_image[k + 1]; // green
-			g_texture_data[index + 2] = tga_image[k + 0]; // blue
-			g_texture_data[index + 3] = tga_image[k + 3]; // alpha
-
-			k += 4;
-			index += 4;
+// Called by stream_pump() with bands of rows, smallest level first. The texture is
+// created on the first call and its handle kept in the StreamTexture.
+void upload_texture_rows(void* user, StreamTexture* texture, u32 level, u32 row, u32 row_count) {
+	GfxResources* resources = (GfxResources*)user;
+	GfxTextureHandle gpu_texture = { (PoolHandle)(u64)texture->user };
+	if(!gfx_texture_get(resources, gpu_texture)) {
+		GfxTextureDesc texture_desc = { texture->format, texture->srgb, texture->width, texture->height, texture->level_count };
+		gpu_texture = gfx_texture_create(resources, &texture_desc);
+		if(!gpu_texture.value) {
+			MessageBox(nullptr, TEXT("Failed to create texture desc"), TEXT("Fatal Error!"), MB_OK | MB_ICONERROR);
+			ExitProcess(1);
 		}
-
-		// set the tga image data index back to the prceeding row at the beginning of the columen since its is readin it upside down.
-		k -= (g_texture_width * 8);
+		texture->user = (void*)(u64)gpu_texture.value;
 	}
 
+	const StreamLevel* source = &texture->levels[level];
+	gfx_texture_upload_rows(resources, gpu_texture, level, row, row_count, source->data + (u64)row * source->row_pitch, source->row_pitch);
+}
 
-	tga_image = 0;
-	return true;
+// The GPU side of a streamed texture, 0 before its first upload.
+internal GfxTextureHandle stream_gpu_texture(StreamHandle handle) {
+	StreamTexture* texture = stream_texture(&g_streamer, handle);
+	GfxTextureHandle result = { texture ? (PoolHandle)(u64)texture->user : 0 };
+	return result;
+}
 
+void update_streaming() {
+	// Prefer the cooked texture (build.bat cook), fall back to decoding the TGA.
+	if(!g_stone_fallback && stream_state(&g_streamer, g_stone_texture) == StreamState_Failed) {
+		g_stone_fallback = true;
+		g_stone_texture = stream_request_texture(&g_streamer, "stone01.tga");
+	}
+	stream_pump(&g_streamer, g_stream_upload_budget, upload_texture_rows, &g_gfx);
 }
 
 void setup_projection() {
@@ -602,8 +705,8 @@ void setup_projection() {
 	f32 height = (f32)(client_rect.bottom - client_rect.top);
 	f32 aspect_ratio = width / height;
 
-	XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.0f), aspect_ratio, 0.1f, 10.0f);
-	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Application], 0, nullptr, &projection, 0, 0);
+	Mat4 projection = mat4_perspective_fov_lh(3.14159265f / 2.0f, aspect_ratio, 0.1f, 10.0f);
+	gfx_buffer_update(&g_gfx, g_constant_buffers[ConstantBuffer_Application], 0, sizeof(projection), &projection);
 }
 
 void clear_buffer(const f32 colour[4], f32 depth, u8 stencil) {
@@ -611,46 +714,23 @@ void clear_buffer(const f32 colour[4], f32 depth, u8 stencil) {
 	g_device_context->ClearDepthStencilView(g_depth_stencil_view, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, depth, stencil);
 }
 
-//void Update(float dt) {
-//	// --- Camera ---
-//	XMVECTOR eye   = XMVectorSet(0, 0, -10, 1);
-//	XMVECTOR focus = XMVectorSet(0, 0, 0, 1);
-//	XMVECTOR up    = XMVectorSet(0, 1, 0, 0);
-//	g_view_matrix = XMMatrixLookAtLH(eye, focus, up);
-//	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Frame], 0, nullptr, &g_view_matrix, 0, 0);
-
-//	// --- Object world matrix ---
-//	static f32 angle = 0.0f;
-//	angle += 25.0f * dt;
-//	XMVECTOR rotation_axis = XMVectorSet(1, 0, 0, 0);
-//	g_world_matrix = XMMatrixRotationAxis(rotation_axis, XMConvertToRadians(angle));
-//	//g_world_matrix = XMMatrixIdentity();
-//	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Object], 0, nullptr, &g_world_matrix, 0, 0);
-//}
-
 void Update(float dt) {
 	// --- Camera ---
-	XMVECTOR eye   = XMVectorSet(0, 0, 2.6, 1); // move the camera back a bit
-	XMVECTOR focus = XMVectorSet(0, 0, 0, 1);
-	XMVECTOR up    = XMVectorSet(0, 1, 1, 0);
-	g_view_matrix = XMMatrixLookAtLH(eye, focus, up);
-	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Frame], 0, nullptr, &g_view_matrix, 0, 0);
+	Vec4 eye   = vec4(0, 0, 2.6f, 1); // move the camera back a bit
+	Vec4 focus = vec4(0, 0, 0, 1);
+	Vec4 up    = vec4(0, 1, 1, 0);
+	g_view_matrix = mat4_look_at_lh(eye, focus, up);
+	gfx_buffer_update(&g_gfx, g_constant_buffers[ConstantBuffer_Frame], 0, sizeof(g_view_matrix), &g_view_matrix);
 
 	// --- Object world matrix ---
 	static float angle = 0.0f;
 	angle += 90.0f * dt; // 90 degrees per second
 	if (angle > 360.0f) angle -= 360.0f; // wrap around for numerical stability
 
-	// Rotate around Z-axis (spins in XY plane facing camera)
-	//g_world_matrix = XMMatrixRotationZ(XMConvertToRadians(angle));
-	g_world_matrix = XMMatrixIdentity();
-	g_world_matrix = XMMatrixRotationAxis(XMVectorSet(0, 1, 0, 0), XMConvertToRadians(angle));
+	// Spin around Y so the texture turns to face the camera and away
+	g_world_matrix = mat4_rotation_axis(0, 1, 0, angle * 3.14159265f / 180.0f);
 
-	// Optional: translate to keep triangle centered if needed
-	//XMMATRIX translation = XMMatrixTranslation(0.0f, 0.0f, 0.0f);
-	//g_world_matrix = g_world_matrix * translation;
-
-	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Object], 0, nullptr, &g_world_matrix, 0, 0);
+	gfx_buffer_update(&g_gfx, g_constant_buffers[ConstantBuffer_Object], 0, sizeof(g_world_matrix), &g_world_matrix);
 }
 
 
@@ -663,37 +743,41 @@ void Render() {
 	f32 black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	clear_buffer(black, 1.0f, 0);
 
-	// setup input assembler
-  const UINT vertex_stride = sizeof(Vertex);
-  const UINT offset = 0;
-
-  g_device_context->IASetVertexBuffers(0, 1, &g_vertex_buffer, &vertex_stride, &offset);
-  g_device_context->IASetInputLayout(g_input_layout);
-  g_device_context->IASetIndexBuffer(g_index_buffer, DXGI_FORMAT_R16_UINT, 0);
-  g_device_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-  // setup the vertex shader stage
-  g_device_context->VSSetShader(g_vertex_shader, nullptr, 0);
-  g_device_context->VSSetConstantBuffers(0, 3, g_constant_buffers);
-
-	// Set the shader texture resource in the pixel shader
-	g_device_context->PSSetShaderResources(0, 1, &g_shader_rsv);
-
-	// Setup the sample state
-	g_device_context->PSSetSamplers(0, 1, &g_sampler_state);
-
-  // setup rasterizer stage
-  g_device_context->RSSetState(g_rasterizer_state);
-  g_device_context->RSSetViewports(1, &g_viewport);
-
-  // setup pixel shader
-  g_device_context->PSSetShader(g_pixel_shader, nullptr, 0);
-
-  // setup output merger stage
-  g_device_context->OMSetRenderTargets(1, &g_framebuffer_rtv, g_depth_stencil_view);
-  g_device_context->OMSetDepthStencilState(g_depth_stencil_state, 1);
-
-  g_device_context->DrawIndexed(_countof(g_indices), 0, 0);
+	// Frame-wide state, the same for every draw. After the first frame the
+	// cache drops all of it.
+	gfx_state_reset_stats(&g_state_cache);
+	d3d11_set_topology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	ID3D11Buffer* constant_buffers[ConstantBuffer_COUNT];
+	for(u32 i = 0; i < ConstantBuffer_COUNT; i++) constant_buffers[i] = d3d11_buffer(g_constant_buffers[i]);
+	d3d11_set_vs_constant_buffers(constant_buffers, ConstantBuffer_COUNT);
+	d3d11_set_ps_sampler(0, g_sampler_state);
+	d3d11_set_rasterizer(g_rasterizer_state);
+	d3d11_set_viewport(&g_viewport);
+	d3d11_set_render_target(g_framebuffer_rtv, g_depth_stencil_view);
+	d3d11_set_depth_stencil(g_depth_stencil_state, 1);
+
+	// Record the draws, then sort and submit them. The streamed texture is drawn
+	// with the placeholder until it has a complete mip level.
+	gfx_queue_begin(&g_render_queue);
+	GfxTextureHandle texture = stream_gpu_texture(g_stone_texture);
+	GfxTexture* streamed = gfx_texture_get(&g_gfx, texture);
+	if(!streamed || !streamed->levels_ready) texture = g_placeholder_texture;
+	u64 key = gfx_sort_key(GfxPass_Opaque, Shader_Textured, gfx_material_id(texture), gfx_mesh_id(g_triangle_mesh), 0.5f);
+	gfx_queue_draw(&g_render_queue, key, g_triangle_mesh, texture, Shader_Textured, 0);
+	gfx_queue_submit(&g_render_queue, &g_gfx, &g_draw_funcs);
+
+	// Draws and state changes of the frame in the title, once a second.
+	f64 now = os_now_seconds();
+	if(now - g_render_stats_shown_at >= 1.0) {
+		const GfxQueueStats* stats = &g_render_queue.stats;
+		char title[256];
+		snprintf(title, sizeof(title), "%s - %u draws, %u state changes (%u unsorted), %llu binds (%llu dropped), sort %.3f ms",
+						 g_window_name, stats->draws, stats->state_changes, stats->unsorted_state_changes,
+						 (unsigned long long)g_state_cache.stats.issued, (unsigned long long)g_state_cache.stats.filtered,
+						 stats->sort_seconds * 1000.0);
+		SetWindowTextA(g_window_handle, title);
+		g_render_stats_shown_at = now;
+	}
 
 	if (g_enable_vsync) {
     g_swapchain->Present(1, 0);
@@ -719,7 +803,8 @@ int Run() {
       prev_time = current_time;
 
       // cap delta time to the max time step
-      dt = std::min<float>(dt, max_time_step);
+      dt = Min(dt, max_time_step);
+      update_streaming();
       Update(dt);
       Render();
 
@@ -730,11 +815,8 @@ int Run() {
 
 void unload_pipeline() {
 	SafeRelease(g_sampler_state);
-  SafeRelease(g_constant_buffers[ConstantBuffer_Application]);
-  SafeRelease(g_constant_buffers[ConstantBuffer_Frame]);
-  SafeRelease(g_constant_buffers[ConstantBuffer_Object]);
-  SafeRelease(g_index_buffer);
-  SafeRelease(g_vertex_buffer);
+	gfx_queue_release(&g_render_queue);
+	gfx_resources_release(&g_gfx);
   SafeRelease(g_input_layout);
   SafeRelease(g_vertex_shader);
   SafeRelease(g_pixel_shader);
@@ -752,8 +834,9 @@ void shutdown_directx() {
 }
 
 void system_cleanup() {
-	// Release teh tga image data once copied to the destination array
-	delete[] g_texture_data;
+	// Workers first, they read out of the pack.
+	stream_stop(&g_streamer);
+	pack_close(&g_pack);
 }
 
 
@@ -761,18 +844,19 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
   UNREFERENCED_PARAMETER(prevInstance);
   UNREFERENCED_PARAMETER(cmdLine);
 
-  // Check for DirectX Math library support.
-  if (!XMVerifyCPUSupport()) {
-    MessageBox(nullptr, TEXT("Failed to verify DirectX Math library support."), TEXT("Error"), MB_OK);
-    return -1;
-  }
-
   if (init_application(hInstance, cmdShow) != 0) {
     MessageBox(nullptr, TEXT("Failed to create applicaiton window."), TEXT("Error"), MB_OK);
     return -1;
   }
 
-	load_tga32bit("data/stone01.tga");
+	if(!pack_open(&g_pack, "data.pak")) {
+		MessageBox(nullptr, TEXT("Failed to open data.pak, run build.bat to pack the data directory."), TEXT("Fatal Error"), MB_OK);
+		return -1;
+	}
+
+	// Start loading right away, it overlaps with device creation and the first frames.
+	stream_start(&g_streamer, &g_pack, 0);
+	g_stone_texture = stream_request_texture(&g_streamer, "stone01.ctex");
 
   if (init_directx(hInstance, g_enable_vsync) != 0) {
     MessageBox(nullptr, TEXT("Error occured while initializing the GPU"), TEXT("Fatal Error"), MB_OK);
@@ -781,7 +865,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
 	
 	init_pipeline();
 
-	load_shaders(L"data/shaders/textured_vs.cso", L"data/shaders/textured_ps.cso");
+	load_shaders("shaders/textured_vs.cso", "shaders/textured_ps.cso");
 
 	setup_projection();
 
@@ -2,11 +2,14 @@
 #include <windows.h>
 #include <d3d11.h>
 #include <d3dcompiler.h>
-#include <directxmath.h>
 
+#include <cassert>
 #include <iostream>
 #include <string>
 
+#include "basic/types.h"
+#include "basic/vecmath.h"
+
 // Static libs
 #pragma comment(lib, "user32")
 #pragma comment(lib, "Winmm")
@@ -14,32 +17,6 @@
 #pragma comment(lib, "dxgi")
 #pragma comment(lib, "d3dcompiler")
 
-// Keywords Macros
-#define global static
-#define internal static
-#define local static
-
-// Base Types
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-
-typedef int8_t s8;
-typedef int16_t s16;
-typedef int32_t s32;
-typedef int64_t s64;
-
-typedef s8 b8;
-typedef s16 b16;
-typedef s32 b32;
-typedef s64 b64;
-
-typedef float f32;
-typedef double f64;
-
-using namespace DirectX;
-
 // For releasing COM objects
 template <typename T> inline void SafeRelease(T &ptr) {
   if (ptr != NULL) {
@@ -83,9 +60,8 @@ ID3D11InputLayout*				g_input_layout  = nullptr;
 ID3D11PixelShader*				g_pixel_shader  = nullptr;
 ID3D11VertexShader*				g_vertex_shader = nullptr;
 
-XMMATRIX g_world_matrix;
-XMMATRIX g_view_matrix; 
-XMMATRIX g_projection_matrix;
+Mat4 g_world_matrix;
+Mat4 g_view_matrix;
 
 enum ConstantBuffer : u64 {
   ConstantBuffer_Application,
@@ -101,14 +77,14 @@ ID3D11Buffer *g_constant_buffers[ConstantBuffer_COUNT];
 //------------------------------------------------------------------------
 
 struct VertexPosColour {
-  XMFLOAT3 position;
-  XMFLOAT4 colour;
+  Vec3 position;
+  Vec4 colour;
 };
 
 VertexPosColour g_vertices[8] = {
-	{ XMFLOAT3(-1.0f, -1.0f, 0.0f), XMFLOAT4(0.0f, 1.0f, 0.0f, 1.0f) },
-	{ XMFLOAT3( 0.0f,  1.0f, 0.0f), XMFLOAT4(0.0f, 1.0f, 0.0f, 1.0f) },
-	{ XMFLOAT3( 1.0f, -1.0f, 0.0f), XMFLOAT4(0.0f, 1.0f, 0.0f, 1.0f) }
+	{ { -1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } },
+	{ {  0.0f,  1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } },
+	{ {  1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } }
 };
 
 u16 g_indices[3] = { 0, 1, 2 };
@@ -368,7 +344,7 @@ void init_pipeline() {
   // Initialize the content of the constant buffer defined in the vertex shader.
   D3D11_BUFFER_DESC constant_buffer_desc = {};
   constant_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-  constant_buffer_desc.ByteWidth = sizeof(XMMATRIX);
+  constant_buffer_desc.ByteWidth = sizeof(Mat4);
   constant_buffer_desc.CPUAccessFlags = 0;
   constant_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
 
@@ -438,7 +414,7 @@ void setup_projection() {
 	f32 height = (f32)(client_rect.bottom - client_rect.top);
 	f32 aspect_ratio = width / height;
 
-	XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.0f), aspect_ratio, 0.1f, 10.0f);
+	Mat4 projection = mat4_perspective_fov_lh(3.14159265f / 2.0f, aspect_ratio, 0.1f, 10.0f);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Application], 0, nullptr, &projection, 0, 0);
 }
 
@@ -449,18 +425,16 @@ void clear_buffer(const f32 colour[4], f32 depth, u8 stencil) {
 
 void Update(float dt) {
 	// --- Camera ---
-	XMVECTOR eye   = XMVectorSet(0, 0, -10, 1);
-	XMVECTOR focus = XMVectorSet(0, 0, 0, 1);
-	XMVECTOR up    = XMVectorSet(0, 1, 0, 0);
-	g_view_matrix = XMMatrixLookAtLH(eye, focus, up);
+	Vec4 eye   = vec4(0, 0, -10, 1);
+	Vec4 focus = vec4(0, 0, 0, 1);
+	Vec4 up    = vec4(0, 1, 0, 0);
+	g_view_matrix = mat4_look_at_lh(eye, focus, up);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Frame], 0, nullptr, &g_view_matrix, 0, 0);
 
 	// --- Object world matrix ---
 	static f32 angle = 0.0f;
 	angle += 90.0f * dt;
-	XMVECTOR rotation_axis = XMVectorSet(1, 0, 0, 0);
-	g_world_matrix = XMMatrixRotationAxis(rotation_axis, XMConvertToRadians(angle));
-	//g_world_matrix = XMMatrixIdentity();
+	g_world_matrix = mat4_rotation_axis(1, 0, 0, angle * 3.14159265f / 180.0f);
 	g_device_context->UpdateSubresource(g_constant_buffers[ConstantBuffer_Object], 0, nullptr, &g_world_matrix, 0, 0);
 }
 
@@ -559,12 +533,6 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
   UNREFERENCED_PARAMETER(prevInstance);
   UNREFERENCED_PARAMETER(cmdLine);
 
-  // Check for DirectX Math library support.
-  if (!XMVerifyCPUSupport()) {
-    MessageBox(nullptr, TEXT("Failed to verify DirectX Math library support."), TEXT("Error"), MB_OK);
-    return -1;
-  }
-
   if (init_application(hInstance, cmdShow) != 0) {
     MessageBox(nullptr, TEXT("Failed to create applicaiton window."), TEXT("Error"), MB_OK);
     return -1;
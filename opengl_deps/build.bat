@@ -35,7 +35,7 @@ if "%preprocess%"=="1" (
 )
 
 :: --- Clang 
-set clang_common=   -I..\src\ -Wall -std=c++11 -march=x86-64-v3 -ferror-limit=15 -gcodeview -fdiagnostics-absolute-paths -fno-exceptions -Wno-initializer-overrides -Wno-unused-function -Wno-missing-braces -Wno-unused-variable -Wno-writable-strings -Wno-address-of-temporary -Wno-switch -Wno-return-type -Wno-unused-command-line-argument -Wno-unused-but-set-variable
+set clang_common=   -I..\src\ -Wall -std=c++11 -march=x86-64-v3 -ffp-contract=off -ferror-limit=15 -gcodeview -fdiagnostics-absolute-paths -fno-exceptions -Wno-initializer-overrides -Wno-unused-function -Wno-missing-braces -Wno-unused-variable -Wno-writable-strings -Wno-address-of-temporary -Wno-switch -Wno-return-type -Wno-unused-command-line-argument -Wno-unused-but-set-variable
 set clang_debug=    call clang -g -O0 -DBUILD_DEBUG=1 %clang_common% %auto_compile_flags% %preprocessor_flags%
 set clang_release=  call clang -g -O2 -DBUILD_DEBUG=0 -DBUILD_RELEASE=1 %clang_common% %auto_compile_flags%
 set clang_link=     -fuse-ld=lld -Xlinker /MANIFEST:EMBED -Xlinker /pdbaltpath:%%%%_PDB%%%% -Wl,/ignore:4099
@@ -93,6 +93,28 @@ REM 	REM --- Delete previous build related files before compiling
 	del /s *.pdb *.exe *.obj
 	
 	if "%hello%"=="1"					set didbuild=1 && %compile% ..\src\edgerunner\hello.cc %compile_link% %link_resource% %out%edgerunner.exe 		|| exit /b 1
+	if "%tga_bench%"=="1"			set didbuild=1 && %compile% ..\src\tools\tga_bench.cc %compile_link% %out%tga_bench.exe 		|| exit /b 1
+	if "%texture_cooker%"=="1"	set didbuild=1 && %compile% ..\src\tools\texture_cooker.cc %compile_link% %out%texture_cooker.exe 		|| exit /b 1
+	if "%bc_bench%"=="1"		set didbuild=1 && %compile% ..\src\tools\bc_bench.cc %compile_link% %out%bc_bench.exe 			|| exit /b 1
+	if "%png_bench%"=="1"		set didbuild=1 && %compile% ..\src\tools\png_bench.cc %compile_link% %out%png_bench.exe 			|| exit /b 1
+	if "%asset_packer%"=="1"	set didbuild=1 && %compile% ..\src\tools\asset_packer.cc %compile_link% %out%asset_packer.exe 		|| exit /b 1
+	if "%stream_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\stream_bench.cc %compile_link% %out%stream_bench.exe 		|| exit /b 1
+	if "%raster_textured%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_textured.cc %compile_link% %out%raster_textured.exe 	|| exit /b 1
+	if "%raster_tiles_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_tiles_bench.cc %compile_link% %out%raster_tiles_bench.exe 	|| exit /b 1
+	if "%raster_kernel_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_kernel_bench.cc %compile_link% %out%raster_kernel_bench.exe 	|| exit /b 1
+	if "%raster_occlusion_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_occlusion_bench.cc %compile_link% %out%raster_occlusion_bench.exe 	|| exit /b 1
+	if "%raster_sampler_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_sampler_bench.cc %compile_link% %out%raster_sampler_bench.exe 	|| exit /b 1
+	if "%raster_clip_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\raster_clip_bench.cc %compile_link% %out%raster_clip_bench.exe 	|| exit /b 1
+	if "%vecmath_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\vecmath_bench.cc %compile_link% %out%vecmath_bench.exe 	|| exit /b 1
+	if "%cull_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\cull_bench.cc %compile_link% %out%cull_bench.exe 	|| exit /b 1
+	if "%transform_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\transform_bench.cc %compile_link% %out%transform_bench.exe 	|| exit /b 1
+	if "%anim_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\anim_bench.cc %compile_link% %out%anim_bench.exe 	|| exit /b 1
+	if "%arena_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\arena_bench.cc %compile_link% %out%arena_bench.exe 	|| exit /b 1
+	if "%jobs_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\jobs_bench.cc %compile_link% %out%jobs_bench.exe 	|| exit /b 1
+	if "%pool_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\pool_bench.cc %compile_link% %out%pool_bench.exe 	|| exit /b 1
+	if "%queue_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\queue_bench.cc %compile_link% %out%queue_bench.exe 	|| exit /b 1
+	if "%program_cache_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\program_cache_bench.cc %compile_link% %out%program_cache_bench.exe 	|| exit /b 1
+	if "%state_bench%"=="1"	set didbuild=1 && %compile% ..\src\tools\state_bench.cc %compile_link% %out%state_bench.exe 	|| exit /b 1
 popd
 
 :: --- Warn On No Builds ------------------------------------------------------
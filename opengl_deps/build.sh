@@ -0,0 +1,66 @@
+#!/bin/bash
+# Linux counterpart of build.bat for the portable tools and benchmarks.
+# Usage mirrors build.bat, e.g. `./build.sh tga_bench release`.
+set -eu
+cd "$(dirname "$0")"
+
+# --- Unpack arguments
+for arg in "$@"; do declare $arg='1'; done
+if [ ! -v gcc ];     then clang=1; fi
+if [ ! -v release ]; then debug=1; fi
+if [ -v debug ];     then echo "[debug mode]"; fi
+if [ -v release ];   then echo "[release mode]"; fi
+if [ -v clang ];     then compiler="${CXX:-clang++}"; echo "[compiling with clang]"; fi
+if [ -v gcc ];       then compiler="${CXX:-g++}"; echo "[compiling with gcc]"; fi
+
+auto_compile_flags=''
+arch_flags='-march=x86-64-v3'
+if [ -v asan ];   then auto_compile_flags="$auto_compile_flags -fsanitize=address"; echo "[asan enabled]"; fi
+if [ -v tsan ];   then auto_compile_flags="$auto_compile_flags -fsanitize=thread"; echo "[tsan enabled]"; fi
+if [ -v avx512 ]; then arch_flags='-march=x86-64-v4'; echo "[AVX-512 enabled]"; fi
+
+# --- Compile/Link Line Definitions
+common="-I../src/ -std=c++11 $arch_flags -ffp-contract=off -fno-exceptions -fno-rtti -Wall -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-missing-braces -Wno-unknown-pragmas"
+compile_debug="$compiler -g -O0 -DBUILD_DEBUG=1 $common $auto_compile_flags"
+compile_release="$compiler -g -O2 -DBUILD_DEBUG=0 -DBUILD_RELEASE=1 $common $auto_compile_flags"
+compile_link="-lpthread -lm"
+out="-o"
+
+if [ -v debug ];   then compile="$compile_debug"; fi
+if [ -v release ]; then compile="$compile_release"; fi
+
+# --- Prep Directories
+mkdir -p run_tree
+
+# --- Build Things
+cd run_tree
+didbuild=''
+if [ -v tga_bench ];      then didbuild=1 && $compile ../src/tools/tga_bench.cc $compile_link $out tga_bench; fi
+if [ -v texture_cooker ]; then didbuild=1 && $compile ../src/tools/texture_cooker.cc $compile_link $out texture_cooker; fi
+if [ -v bc_bench ];       then didbuild=1 && $compile ../src/tools/bc_bench.cc $compile_link $out bc_bench; fi
+if [ -v png_bench ];      then didbuild=1 && $compile ../src/tools/png_bench.cc $compile_link $out png_bench; fi
+if [ -v asset_packer ];   then didbuild=1 && $compile ../src/tools/asset_packer.cc $compile_link $out asset_packer; fi
+if [ -v stream_bench ];   then didbuild=1 && $compile ../src/tools/stream_bench.cc $compile_link $out stream_bench; fi
+if [ -v raster_textured ]; then didbuild=1 && $compile ../src/tools/raster_textured.cc $compile_link $out raster_textured; fi
+if [ -v raster_tiles_bench ]; then didbuild=1 && $compile ../src/tools/raster_tiles_bench.cc $compile_link $out raster_tiles_bench; fi
+if [ -v raster_kernel_bench ]; then didbuild=1 && $compile ../src/tools/raster_kernel_bench.cc $compile_link $out raster_kernel_bench; fi
+if [ -v raster_occlusion_bench ]; then didbuild=1 && $compile ../src/tools/raster_occlusion_bench.cc $compile_link $out raster_occlusion_bench; fi
+if [ -v raster_sampler_bench ]; then didbuild=1 && $compile ../src/tools/raster_sampler_bench.cc $compile_link $out raster_sampler_bench; fi
+if [ -v raster_clip_bench ]; then didbuild=1 && $compile ../src/tools/raster_clip_bench.cc $compile_link $out raster_clip_bench; fi
+if [ -v vecmath_bench ]; then didbuild=1 && $compile ../src/tools/vecmath_bench.cc $compile_link $out vecmath_bench; fi
+if [ -v cull_bench ]; then didbuild=1 && $compile ../src/tools/cull_bench.cc $compile_link $out cull_bench; fi
+if [ -v transform_bench ]; then didbuild=1 && $compile ../src/tools/transform_bench.cc $compile_link $out transform_bench; fi
+if [ -v anim_bench ]; then didbuild=1 && $compile ../src/tools/anim_bench.cc $compile_link -lEGL -ldl $out anim_bench; fi
+if [ -v arena_bench ]; then didbuild=1 && $compile ../src/tools/arena_bench.cc $compile_link $out arena_bench; fi
+if [ -v jobs_bench ]; then didbuild=1 && $compile ../src/tools/jobs_bench.cc $compile_link $out jobs_bench; fi
+if [ -v pool_bench ]; then didbuild=1 && $compile ../src/tools/pool_bench.cc $compile_link $out pool_bench; fi
+if [ -v queue_bench ]; then didbuild=1 && $compile ../src/tools/queue_bench.cc $compile_link $out queue_bench; fi
+if [ -v program_cache_bench ]; then didbuild=1 && $compile ../src/tools/program_cache_bench.cc $compile_link -lEGL -ldl $out program_cache_bench; fi
+if [ -v state_bench ]; then didbuild=1 && $compile ../src/tools/state_bench.cc $compile_link -lEGL -ldl $out state_bench; fi
+cd ..
+
+# --- Warn On No Builds
+if [ -z "$didbuild" ]; then
+  echo "[WARNING] no valid build target specified; must use build target names as arguments to this script, like \`./build.sh tga_bench\`."
+  exit 1
+fi
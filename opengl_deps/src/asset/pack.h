@@ -0,0 +1,202 @@
+#pragma once
+
+// Single-file asset pack (.pak).
+//
+// Everything a sample loads at runtime (compiled shaders, cooked textures, ...)
+// is packed offline by tools/asset_packer.cc and mapped once at startup.
+// Lookups hash the asset name and go through a bucket table in front of the
+// hash-sorted table of contents, so finding an entry touches one bucket of
+// (on average) one entry. Entry payloads start on 4 KiB boundaries, page
+// aligned inside the mapping, and are returned as spans into it: no open, no
+// read, no copy per asset.
+//
+// Layout:
+//   PackHeader
+//   PackEntry[entry_count]               sorted by hash
+//   u32 buckets[(1 << bucket_bits) + 1]  first entry of every bucket (top hash bits)
+//   names                                zero terminated, for verification and tools
+//   payloads                             each at PackEntry::offset, PACK_ALIGN aligned
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include <cstring>
+
+#define PACK_MAGIC   0x4b415045u   // "EPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGN   KB(4)
+
+struct PackHeader {
+	u32 magic;
+	u32 version;
+	u32 entry_count;
+	u32 bucket_bits;
+	u64 toc_offset;
+	u64 buckets_offset;
+	u64 names_offset;
+	u64 names_size;
+	u64 file_size;
+	u64 reserved;
+};
+
+struct PackEntry {
+	u64 hash;
+	u64 offset;        // From the start of the file.
+	u64 size;
+	u32 name_offset;   // Into the names block.
+	u32 reserved;
+};
+
+struct PackSpan {
+	const u8* data;
+	u64 size;
+};
+
+//------------------------------------------------------------------------
+// Names
+//------------------------------------------------------------------------
+
+// Names are relative paths; they are hashed case-insensitively with '/' and '\'
+// treated the same, so "shaders\Textured_VS.cso" finds "shaders/textured_vs.cso".
+internal char pack_normalize_char(char c) {
+	if(c >= 'A' && c <= 'Z') return c + ('a' - 'A');
+	if(c == '\\') return '/';
+	return c;
+}
+
+// FNV-1a, 64-bit.
+internal u64 pack_hash_name(const char* name) {
+	u64 hash = 0xcbf29ce484222325ull;
+	for(const char* at = name; *at; at++) hash = (hash ^ (u8)pack_normalize_char(*at)) * 0x100000001b3ull;
+	return hash;
+}
+
+internal b32 pack_names_match(const char* a, const char* b) {
+	for(; *a && *b; a++, b++) {
+		if(pack_normalize_char(*a) != pack_normalize_char(*b)) return false;
+	}
+	return *a == *b;
+}
+
+internal u32 pack_bucket_bits(u32 entry_count) {
+	u32 bits = 1;
+	while(bits < 24 && (1u << bits) < entry_count) bits++;
+	return bits;
+}
+
+internal u32 pack_bucket(u64 hash, u32 bucket_bits) {
+	return (u32)(hash >> (64 - bucket_bits));
+}
+
+//------------------------------------------------------------------------
+// Runtime
+//------------------------------------------------------------------------
+
+struct Pack {
+	OS_FileMap file;
+	const PackHeader* header;
+	const PackEntry* entries;
+	const u32* buckets;
+	const char* names;
+};
+
+// True if [offset, offset + length) lies inside a file of `size` bytes, without overflowing.
+internal b32 pack_range_fits(u64 offset, u64 length, u64 size) {
+	return length <= size && offset <= size - length;
+}
+
+// Maps the pack and validates the header and table of contents. Payloads are
+// not touched until they are used.
+internal b32 pack_open(Pack* pack, const char* path) {
+	*pack = {};
+	if(!os_file_map_open(&pack->file, path)) return false;
+
+	const u8* base = pack->file.data;
+	u64 size = pack->file.size;
+	const PackHeader* header = (const PackHeader*)base;
+	b32 valid = size >= sizeof(PackHeader) &&
+							header->magic == PACK_MAGIC &&
+							header->version == PACK_VERSION &&
+							header->file_size == size &&
+							header->bucket_bits >= 1 && header->bucket_bits <= 24;
+	u64 bucket_count = valid ? ((u64)1 << header->bucket_bits) + 1 : 0;
+	valid = valid &&
+					header->toc_offset % alignof(PackEntry) == 0 &&
+					header->buckets_offset % alignof(u32) == 0 &&
+					pack_range_fits(header->toc_offset, (u64)header->entry_count * sizeof(PackEntry), size) &&
+					pack_range_fits(header->buckets_offset, bucket_count * sizeof(u32), size) &&
+					pack_range_fits(header->names_offset, header->names_size, size) &&
+					header->names_size > 0 && base[header->names_offset + header->names_size - 1] == 0;
+
+	if(valid) {
+		pack->entries = (const PackEntry*)(base + header->toc_offset);
+		pack->buckets = (const u32*)(base + header->buckets_offset);
+		pack->names = (const char*)(base + header->names_offset);
+
+		// Buckets are where lookups start and stop scanning the entries, so
+		// they have to rise from 0 to entry_count and put every entry in the
+		// bucket its hash picks.
+		valid = pack->buckets[0] == 0 && pack->buckets[bucket_count - 1] == header->entry_count;
+		for(u64 i = 1; valid && i < bucket_count; i++) valid = pack->buckets[i - 1] <= pack->buckets[i];
+		for(u32 i = 0; valid && i < header->entry_count; i++) {
+			const PackEntry* entry = &pack->entries[i];
+			u32 bucket = pack_bucket(entry->hash, header->bucket_bits);
+			valid = entry->offset % PACK_ALIGN == 0 &&
+							pack_range_fits(entry->offset, entry->size, size) &&
+							entry->name_offset < header->names_size &&
+							(i == 0 || pack->entries[i - 1].hash < entry->hash) &&
+							pack->buckets[bucket] <= i && i < pack->buckets[bucket + 1];
+		}
+	}
+
+	if(!valid) {
+		os_file_map_close(&pack->file);
+		*pack = {};
+		return false;
+	}
+
+	pack->header = header;
+	return true;
+}
+
+internal void pack_close(Pack* pack) {
+	os_file_map_close(&pack->file);
+	*pack = {};
+}
+
+internal const PackEntry* pack_find_entry(const Pack* pack, u64 hash) {
+	u32 bucket = pack_bucket(hash, pack->header->bucket_bits);
+	for(u32 i = pack->buckets[bucket]; i < pack->buckets[bucket + 1]; i++) {
+		const PackEntry* entry = &pack->entries[i];
+		if(entry->hash == hash) return entry;
+		if(entry->hash > hash) break;
+	}
+	return 0;
+}
+
+internal PackSpan pack_entry_span(const Pack* pack, const PackEntry* entry) {
+	PackSpan span = {};
+	if(entry) {
+		span.data = pack->file.data + entry->offset;
+		span.size = entry->size;
+	}
+	return span;
+}
+
+// Looks an asset up by a precomputed name hash. The span points into the
+// mapping and stays valid until pack_close(); data is 0 if there is no entry.
+internal PackSpan pack_find_hash(const Pack* pack, u64 hash) {
+	return pack_entry_span(pack, pack_find_entry(pack, hash));
+}
+
+// Looks an asset up by name. The stored name is compared too, so a name that is
+// not in the pack can never alias another entry through a hash collision.
+internal PackSpan pack_find(const Pack* pack, const char* name) {
+	const PackEntry* entry = pack_find_entry(pack, pack_hash_name(name));
+	if(entry && !pack_names_match(pack->names + entry->name_offset, name)) entry = 0;
+	return pack_entry_span(pack, entry);
+}
+
+internal const char* pack_entry_name(const Pack* pack, u32 index) {
+	return pack->names + pack->entries[index].name_offset;
+}
@@ -0,0 +1,366 @@
+#pragma once
+
+// Background texture streaming.
+//
+// stream_request_texture() only queues a name. Worker threads look it up in
+// the pack and do everything that can touch the disk or take a while: a
+// cooked texture (.ctex) is validated and its pages are faulted in, a TGA is
+// decoded and gets its mip chain built. Finished textures are handed back in
+// the order they complete.
+//
+// The render thread calls stream_pump() once per frame. It uploads ready
+// textures through a callback in bands of rows, smallest mip level first, and
+// stops once the frame's byte budget is spent, so a big texture (even a single
+// big level) is spread over several frames and becomes usable, at reduced
+// detail, after its first tiny level. The render thread never waits on a worker: it only takes the
+// queue lock to move indices around, and until a texture has its first level
+// the caller keeps drawing with a placeholder.
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "asset/pack.h"
+#include "texture/tga.h"
+#include "texture/mips.h"
+#include "texture/cooked.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#define STREAM_MAX_TEXTURES 256
+#define STREAM_MAX_WORKERS  8
+#define STREAM_NAME_SIZE    128
+
+enum StreamState : u32 {
+	StreamState_Queued,
+	StreamState_Loading,     // On a worker.
+	StreamState_Ready,       // In memory, waiting for its first upload.
+	StreamState_Uploading,   // Some levels are on the GPU.
+	StreamState_Resident,    // Every level is on the GPU and the CPU copy is gone.
+	StreamState_Failed,      // Not in the pack or not a texture we can read.
+};
+
+struct StreamLevel {
+	const u8* data;
+	u32 width;
+	u32 height;
+	u32 row_pitch;           // Bytes per row of pixels, or per row of 4x4 blocks for BCn.
+	u32 row_count;           // Rows of pixels, or of 4x4 blocks for BCn.
+	u64 size;
+};
+
+struct StreamTexture {
+	char name[STREAM_NAME_SIZE];
+	std::atomic<u32> state;
+
+	// Written by the worker, read by the render thread once the state is Ready.
+	CookedFormat format;
+	b32 srgb;
+	u32 width;
+	u32 height;
+	u32 level_count;
+	StreamLevel levels[MIP_MAX_LEVELS];
+	MipChain mips;           // Decoded TGA, the levels point into it. Empty for cooked textures.
+	f64 requested_at;
+	f64 ready_at;
+
+	// Render thread only.
+	u32 levels_uploaded;     // Counted from the smallest level.
+	u32 rows_uploaded;       // Of the level being uploaded.
+	f64 resident_at;
+	void* user;              // For the upload callback, e.g. the GPU texture.
+};
+
+typedef u32 StreamHandle;    // 0 is never a valid handle.
+
+// Uploads rows [row, row + row_count) of a level (UpdateSubresource with a box,
+// glTexSubImage2D). Levels arrive smallest first, level_count - 1 down to 0, and
+// each in order top to bottom, so the first call for a texture is where its GPU
+// resource gets created and a level is complete once its last row arrives.
+typedef void StreamUploadFunc(void* user, StreamTexture* texture, u32 level, u32 row, u32 row_count);
+
+struct StreamStats {
+	u32 requested;
+	u32 failed;
+	u32 resident;
+	u64 bytes_uploaded;
+	u32 frames;
+	u32 frames_uploading;    // Frames that uploaded anything.
+	u64 peak_frame_bytes;
+	u32 over_budget_rows;    // Single rows larger than the whole budget, uploaded alone.
+	f64 load_seconds;        // Summed over the workers.
+	f64 pump_seconds;        // Render thread.
+	f64 peak_pump_seconds;
+};
+
+struct Streamer {
+	const Pack* pack;
+	u32 worker_count;
+	std::thread workers[STREAM_MAX_WORKERS];
+
+	// Guards the two rings and `quit`. Held only to push or pop an index.
+	std::mutex mutex;
+	std::condition_variable wake;
+	u32 queue[STREAM_MAX_TEXTURES];   // Requested, not yet picked up by a worker.
+	u32 queue_read, queue_write;
+	u32 ready[STREAM_MAX_TEXTURES];   // Loaded, in completion order.
+	u32 ready_read, ready_write;
+	b32 quit;
+	std::atomic<u64> load_nanoseconds;   // Folded into stats by stream_pump().
+
+	// Render thread only.
+	StreamTexture textures[STREAM_MAX_TEXTURES];
+	u32 texture_count;
+	u32 uploading[STREAM_MAX_TEXTURES];   // Ready or Uploading, oldest first.
+	u32 uploading_count;
+	StreamStats stats;
+};
+
+//------------------------------------------------------------------------
+// Workers
+//------------------------------------------------------------------------
+
+internal b32 stream_has_extension(const char* name, const char* extension) {
+	u64 name_length = strlen(name);
+	u64 extension_length = strlen(extension);
+	return name_length >= extension_length && pack_names_match(name + name_length - extension_length, extension);
+}
+
+// Reads one byte per page so the mapping is resident before the render
+// thread copies out of it.
+internal void stream_touch_pages(const u8* data, u64 size) {
+	volatile u8 sink = 0;
+	for(u64 offset = 0; offset < size; offset += KB(4)) sink += data[offset];
+	if(size) sink += data[size - 1];
+}
+
+internal b32 stream_load_cooked(StreamTexture* texture, PackSpan file) {
+	CookedTexture cooked;
+	if(!cooked_texture_from_memory(&cooked, file.data, file.size)) return false;
+
+	const CookedTextureHeader* header = cooked.header;
+	texture->format = (CookedFormat)header->format;
+	texture->srgb = (header->flags & CookedFlag_SRGB) != 0;
+	texture->width = header->width;
+	texture->height = header->height;
+	texture->level_count = header->level_count;
+	for(u32 i = 0; i < header->level_count; i++) {
+		StreamLevel* level = &texture->levels[i];
+		level->data = cooked_texture_level_data(&cooked, i);
+		level->width = header->levels[i].width;
+		level->height = header->levels[i].height;
+		level->row_pitch = header->levels[i].row_pitch;
+		level->row_count = cooked_level_row_count(texture->format, level->height);
+		level->size = header->levels[i].size;
+	}
+	stream_touch_pages(file.data, file.size);
+	return true;
+}
+
+internal b32 stream_load_tga(StreamTexture* texture, PackSpan file) {
+	TGAImage image;
+	if(!file.data || !tga_parse(&image, file.data, file.size)) return false;
+
+	MipChain* mips = &texture->mips;
+	if(!mip_chain_alloc(mips, image.width, image.height)) return false;
+	if(!tga_decode_rgba8(&image, mip_level_data(mips, 0), mips->levels[0].row_pitch)) {
+		mip_chain_release(mips);
+		return false;
+	}
+
+	// One thread per texture, the parallelism comes from the workers and the
+	// render thread keeps its core.
+	MipSettings mip_settings = {};
+	mip_settings.filter = MipFilter_Lanczos;
+	mip_settings.srgb = true;
+	mip_settings.thread_count = 1;
+	mip_generate(mips, &mip_settings);
+
+	texture->format = CookedFormat_RGBA8;
+	texture->srgb = true;
+	texture->width = mips->width;
+	texture->height = mips->height;
+	texture->level_count = mips->level_count;
+	for(u32 i = 0; i < mips->level_count; i++) {
+		StreamLevel* level = &texture->levels[i];
+		level->data = mip_level_data(mips, i);
+		level->width = mips->levels[i].width;
+		level->height = mips->levels[i].height;
+		level->row_pitch = mips->levels[i].row_pitch;
+		level->row_count = level->height;
+		level->size = (u64)level->row_pitch * level->height;
+	}
+	return true;
+}
+
+internal void stream_worker(Streamer* streamer) {
+	for(;;) {
+		u32 index;
+		{
+			std::unique_lock<std::mutex> lock(streamer->mutex);
+			streamer->wake.wait(lock, [streamer] { return streamer->quit || streamer->queue_read != streamer->queue_write; });
+			if(streamer->quit) return;
+			index = streamer->queue[streamer->queue_read++ % STREAM_MAX_TEXTURES];
+		}
+
+		StreamTexture* texture = &streamer->textures[index];
+		texture->state.store(StreamState_Loading);
+		f64 start = os_now_seconds();
+
+		PackSpan file = pack_find(streamer->pack, texture->name);
+		b32 ok = false;
+		if(file.data && stream_has_extension(texture->name, ".ctex")) ok = stream_load_cooked(texture, file);
+		else if(file.data && stream_has_extension(texture->name, ".tga")) ok = stream_load_tga(texture, file);
+
+		f64 end = os_now_seconds();
+		texture->ready_at = end;
+		streamer->load_nanoseconds.fetch_add((u64)((end - start) * 1e9));
+
+		// Published through the lock, the render thread sees the level table once it pops the index.
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		texture->state.store(ok ? StreamState_Ready : StreamState_Failed);
+		streamer->ready[streamer->ready_write++ % STREAM_MAX_TEXTURES] = index;
+	}
+}
+
+//------------------------------------------------------------------------
+// Render thread
+//------------------------------------------------------------------------
+
+// `pack` has to stay open until stream_stop(). 0 workers means one per logical
+// core, minus the render thread's.
+internal void stream_start(Streamer* streamer, const Pack* pack, u32 worker_count) {
+	if(worker_count == 0) worker_count = Max(os_logical_core_count() - 1, 1u);
+	streamer->pack = pack;
+	streamer->worker_count = Min(worker_count, (u32)STREAM_MAX_WORKERS);
+	streamer->queue_read = streamer->queue_write = 0;
+	streamer->ready_read = streamer->ready_write = 0;
+	streamer->quit = false;
+	streamer->load_nanoseconds = 0;
+	streamer->texture_count = 0;
+	streamer->uploading_count = 0;
+	streamer->stats = {};
+	mip_tables_init();    // Before the workers, so the first .tga load does not build them.
+	for(u32 i = 0; i < streamer->worker_count; i++) streamer->workers[i] = std::thread(stream_worker, streamer);
+}
+
+// Stops the workers (a load in flight finishes first) and frees every CPU copy.
+// GPU resources hanging off StreamTexture::user are the caller's.
+internal void stream_stop(Streamer* streamer) {
+	{
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->quit = true;
+	}
+	streamer->wake.notify_all();
+	for(u32 i = 0; i < streamer->worker_count; i++) streamer->workers[i].join();
+	streamer->worker_count = 0;
+	for(u32 i = 0; i < streamer->texture_count; i++) mip_chain_release(&streamer->textures[i].mips);
+}
+
+// Returns 0 when STREAM_MAX_TEXTURES textures have been requested.
+internal StreamHandle stream_request_texture(Streamer* streamer, const char* name) {
+	if(streamer->texture_count == STREAM_MAX_TEXTURES || strlen(name) >= STREAM_NAME_SIZE) return 0;
+
+	u32 index = streamer->texture_count++;
+	StreamTexture* texture = &streamer->textures[index];
+	memcpy(texture->name, name, strlen(name) + 1);
+	texture->state.store(StreamState_Queued);
+	texture->mips = {};
+	texture->levels_uploaded = 0;
+	texture->rows_uploaded = 0;
+	texture->requested_at = os_now_seconds();
+	texture->ready_at = texture->resident_at = 0.0;
+	texture->user = 0;
+	streamer->stats.requested++;
+
+	{
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->queue[streamer->queue_write++ % STREAM_MAX_TEXTURES] = index;
+	}
+	streamer->wake.notify_one();
+	return index + 1;
+}
+
+internal StreamTexture* stream_texture(Streamer* streamer, StreamHandle handle) {
+	return handle ? &streamer->textures[handle - 1] : 0;
+}
+
+internal StreamState stream_state(Streamer* streamer, StreamHandle handle) {
+	return handle ? (StreamState)streamer->textures[handle - 1].state.load() : StreamState_Failed;
+}
+
+// Uploads at most `budget_bytes` of level data this frame, oldest texture
+// first. A single row larger than the whole budget is still uploaded (on its
+// own) so nothing can starve. Returns the bytes uploaded.
+internal u64 stream_pump(Streamer* streamer, u64 budget_bytes, StreamUploadFunc* upload, void* user) {
+	f64 start = os_now_seconds();
+	StreamStats* stats = &streamer->stats;
+	stats->frames++;
+
+	{
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		while(streamer->ready_read != streamer->ready_write) {
+			u32 index = streamer->ready[streamer->ready_read++ % STREAM_MAX_TEXTURES];
+			if(streamer->textures[index].state.load() == StreamState_Failed) stats->failed++;
+			else streamer->uploading[streamer->uploading_count++] = index;
+		}
+	}
+
+	u64 bytes = 0;
+	u32 done = 0;
+	for(u32 i = 0; i < streamer->uploading_count; i++) {
+		StreamTexture* texture = &streamer->textures[streamer->uploading[i]];
+		while(texture->levels_uploaded < texture->level_count) {
+			u32 level = texture->level_count - 1 - texture->levels_uploaded;
+			const StreamLevel* source = &texture->levels[level];
+			u64 room = budget_bytes > bytes ? budget_bytes - bytes : 0;
+			u32 rows = (u32)Min((u64)(source->row_count - texture->rows_uploaded), room / source->row_pitch);
+			if(rows == 0) {
+				if(bytes > 0) break;
+				rows = 1;
+				stats->over_budget_rows++;
+			}
+
+			upload(user, texture, level, texture->rows_uploaded, rows);
+			texture->state.store(StreamState_Uploading);
+			texture->rows_uploaded += rows;
+			bytes += (u64)rows * source->row_pitch;
+			if(texture->rows_uploaded < source->row_count) break;
+
+			texture->levels_uploaded++;
+			texture->rows_uploaded = 0;
+		}
+
+		if(texture->levels_uploaded == texture->level_count) {
+			texture->state.store(StreamState_Resident);
+			texture->resident_at = os_now_seconds();
+			mip_chain_release(&texture->mips);
+			stats->resident++;
+			done++;
+		} else {
+			break;   // Budget spent, keep the order for the next frame.
+		}
+	}
+
+	// Drop finished textures from the front, the rest stay in order.
+	if(done) {
+		memmove(streamer->uploading, streamer->uploading + done, (streamer->uploading_count - done) * sizeof(u32));
+		streamer->uploading_count -= done;
+	}
+
+	stats->bytes_uploaded += bytes;
+	stats->frames_uploading += bytes > 0;
+	stats->peak_frame_bytes = Max(stats->peak_frame_bytes, bytes);
+	stats->load_seconds = (f64)streamer->load_nanoseconds.load() * 1e-9;
+	f64 seconds = os_now_seconds() - start;
+	stats->pump_seconds += seconds;
+	stats->peak_pump_seconds = Max(stats->peak_pump_seconds, seconds);
+	return bytes;
+}
+
+// True once every request is either resident or failed.
+internal b32 stream_idle(Streamer* streamer) {
+	return streamer->stats.resident + streamer->stats.failed == streamer->stats.requested;
+}
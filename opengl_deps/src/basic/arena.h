@@ -0,0 +1,190 @@
+#pragma once
+
+// Linear allocators on reserved address space.
+//
+// An Arena reserves a big range of virtual memory up front and commits it in
+// ARENA_COMMIT_SIZE steps as allocations reach new pages, so it can grow to
+// its reservation without ever moving and without asking the OS again once it
+// has been that big before. Memory is handed out by bumping an offset and
+// given back all at once: arena_reset(), or arena_temp_end() back to a marker
+// taken with arena_temp_begin().
+//
+// On top of that:
+//   scratch  arena_scratch_begin()/arena_scratch_end() lend one of a pool of
+//            arenas for temporaries, on any thread. Nested and concurrent
+//            users get different arenas, and the pool keeps the arenas (and
+//            their committed pages) between uses.
+//   frame    arena_frame() is the render thread's per-frame arena and
+//            arena_frame_end() resets it, once the frame is submitted.
+//
+// Allocations are not zeroed unless they come from arena_push_zero(): pages
+// are zero when first committed, but a reset arena hands out old data.
+// g_os_memory (platform/os.h) counts the OS requests, a loop that allocates
+// from warm arenas only leaves it unchanged.
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include <atomic>
+#include <cstring>
+
+#define ARENA_COMMIT_SIZE      KB(64)
+#define ARENA_DEFAULT_ALIGN    16
+#define ARENA_SCRATCH_COUNT    64
+#define ARENA_SCRATCH_RESERVE  GB(8)
+#define ARENA_FRAME_RESERVE    GB(1)
+
+enum ArenaFlags : u32 {
+	ArenaFlag_LargePages = 1 << 0,    // Commit in OS_LARGE_PAGE_SIZE steps on a huge page backed range (Linux).
+};
+
+struct Arena {
+	u8* base;
+	u64 reserved;
+	u64 committed;
+	u64 used;
+	u64 peak;
+	u64 commit_size;
+	u32 commits;         // Times the arena went to the OS for more pages.
+};
+
+struct ArenaTemp {
+	Arena* arena;
+	u64 used;
+	u32 slot;            // Scratch pool slot, ARENA_SCRATCH_COUNT for other arenas.
+};
+
+internal b32 arena_init(Arena* arena, u64 reserve, u32 flags) {
+	*arena = {};
+	b32 large_pages = (flags & ArenaFlag_LargePages) != 0;
+	arena->commit_size = large_pages ? OS_LARGE_PAGE_SIZE : ARENA_COMMIT_SIZE;
+	arena->reserved = AlignPow2(reserve, arena->commit_size);
+	arena->base = (u8*)os_reserve_pages(arena->reserved, large_pages);
+	if(!arena->base) arena->reserved = 0;
+	return arena->base != nullptr;
+}
+
+internal void arena_release(Arena* arena) {
+	os_release_pages(arena->base, arena->reserved, arena->committed);
+	*arena = {};
+}
+
+// `align` is a power of two. Returns 0 once the reservation is used up, and
+// for the null arena of a failed arena_scratch_begin().
+internal void* arena_push(Arena* arena, u64 size, u64 align) {
+	if(!arena) return nullptr;
+	u64 offset = AlignPow2(arena->used, align);
+	u64 end = offset + size;
+	if(end > arena->reserved) return nullptr;
+	if(end > arena->committed) {
+		u64 committed = Min(AlignPow2(end, arena->commit_size), arena->reserved);
+		if(!os_commit_pages(arena->base + arena->committed, committed - arena->committed)) return nullptr;
+		arena->committed = committed;
+		arena->commits++;
+	}
+	arena->used = end;
+	arena->peak = Max(arena->peak, end);
+	return arena->base + offset;
+}
+
+internal void* arena_push_zero(Arena* arena, u64 size, u64 align) {
+	void* result = arena_push(arena, size, align);
+	if(result) memset(result, 0, size);
+	return result;
+}
+
+#define ArenaPushArray(arena, type, count)     ((type*)arena_push((arena), (u64)(count) * sizeof(type), Max((u64)alignof(type), (u64)ARENA_DEFAULT_ALIGN)))
+#define ArenaPushArrayZero(arena, type, count) ((type*)arena_push_zero((arena), (u64)(count) * sizeof(type), Max((u64)alignof(type), (u64)ARENA_DEFAULT_ALIGN)))
+
+// Keeps the committed pages for the next round.
+internal void arena_reset(Arena* arena) {
+	arena->used = 0;
+}
+
+// Decommits the pages past `keep` bytes (and past what is in use), for after
+// a one-off spike.
+internal void arena_trim(Arena* arena, u64 keep) {
+	u64 committed = Min(AlignPow2(Max(arena->used, keep), arena->commit_size), arena->committed);
+	if(committed < arena->committed) os_decommit_pages(arena->base + committed, arena->committed - committed);
+	arena->committed = committed;
+}
+
+internal ArenaTemp arena_temp_begin(Arena* arena) {
+	ArenaTemp temp = { arena, arena->used, ARENA_SCRATCH_COUNT };
+	return temp;
+}
+
+// Frees everything allocated since the matching arena_temp_begin().
+internal void arena_temp_end(ArenaTemp temp) {
+	temp.arena->used = temp.used;
+}
+
+//------------------------------------------------------------------------
+// Scratch pool
+//------------------------------------------------------------------------
+
+struct ArenaScratchPool {
+	std::atomic<u64> busy;               // Bit per slot.
+	Arena arenas[ARENA_SCRATCH_COUNT];   // Reserved on first use, kept for the life of the program.
+};
+
+global ArenaScratchPool g_arena_scratch;
+
+// Lends a scratch arena; give it back with arena_scratch_end(). Everything
+// pushed in between is gone afterwards. Returns a temp with a null arena if
+// all ARENA_SCRATCH_COUNT are lent out or the reservation fails.
+internal ArenaTemp arena_scratch_begin() {
+	ArenaTemp temp = { nullptr, 0, ARENA_SCRATCH_COUNT };
+	u64 busy = g_arena_scratch.busy.load(std::memory_order_relaxed);
+	for(;;) {
+		if(busy == ~0ull) return temp;
+		u32 slot = 0;
+		while(busy & (1ull << slot)) slot++;
+		if(g_arena_scratch.busy.compare_exchange_weak(busy, busy | (1ull << slot), std::memory_order_acquire)) {
+			temp.slot = slot;
+			break;
+		}
+	}
+
+	Arena* arena = &g_arena_scratch.arenas[temp.slot];
+	if(!arena->base && !arena_init(arena, ARENA_SCRATCH_RESERVE, 0)) {
+		g_arena_scratch.busy.fetch_and(~(1ull << temp.slot), std::memory_order_release);
+		temp.slot = ARENA_SCRATCH_COUNT;
+		return temp;
+	}
+	temp.arena = arena;
+	temp.used = arena->used;
+	return temp;
+}
+
+internal void arena_scratch_end(ArenaTemp temp) {
+	if(!temp.arena) return;
+	arena_temp_end(temp);
+	g_arena_scratch.busy.fetch_and(~(1ull << temp.slot), std::memory_order_release);
+}
+
+//------------------------------------------------------------------------
+// Frame arena
+//------------------------------------------------------------------------
+
+struct ArenaFrameStats {
+	u64 frames;
+	u64 last_used;       // Bytes the last finished frame allocated.
+	u64 peak;
+};
+
+global Arena g_arena_frame;
+global ArenaFrameStats g_arena_frame_stats;
+
+// The render thread's arena for data that lives until the end of the frame.
+internal Arena* arena_frame() {
+	if(!g_arena_frame.base) arena_init(&g_arena_frame, ARENA_FRAME_RESERVE, 0);
+	return &g_arena_frame;
+}
+
+internal void arena_frame_end() {
+	g_arena_frame_stats.frames++;
+	g_arena_frame_stats.last_used = g_arena_frame.used;
+	g_arena_frame_stats.peak = Max(g_arena_frame_stats.peak, g_arena_frame.used);
+	arena_reset(&g_arena_frame);
+}
@@ -3,11 +3,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cmath>
-
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <sstream>
+#include <cstdio>
 
 
 // Third-party libraries
@@ -0,0 +1,364 @@
+#pragma once
+
+// Work-stealing job system.
+//
+// A fixed set of workers, started once, each with a Chase-Lev deque: the
+// owner pushes and pops jobs at the bottom without locking, idle workers
+// steal from the top of a random victim's deque. The thread that calls
+// job_system_start() is worker 0 and only runs jobs while it waits in
+// job_wait(). The other workers spin briefly when they run dry and then
+// sleep until new work is pushed.
+//
+// A job is a function over a range of indices. Ranges wider than their grain
+// are split in half when run: the upper half goes back on the deque for a
+// thief and the worker carries on with the lower half, so a parallel for
+// over a million items starts as one push and spreads itself over the
+// workers. Jobs report to a JobCounter; job_wait() returns once every job
+// submitted against the counter (and every half split off them) has run,
+// and runs other jobs meanwhile. A job may submit and wait on jobs of its
+// own, so dependencies are just counters waited on before moving on.
+//
+// Each worker queues up to JOB_DEQUE_SIZE jobs and runs a job on the spot
+// when its deque is full. Threads outside the system (e.g. streaming
+// workers) can submit too: their jobs go through a locked queue, and their
+// job_wait() only sleeps.
+//
+// Usage:
+//   global JobSystem g_jobs;
+//   job_system_start(&g_jobs, 0);
+//   job_parallel_for(&g_jobs, count, 64, func, user);   // func(user, index, worker)
+//   job_system_stop(&g_jobs);
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <immintrin.h>
+#endif
+
+#define JOB_MAX_WORKERS    64
+#define JOB_DEQUE_SIZE     4096         // Power of two.
+#define JOB_SPIN_ROUNDS    64           // Empty searches before a worker goes to sleep.
+#define JOB_NO_WORKER      0xffffffffu
+
+// `worker` is in [0, worker_count), for per-worker scratch.
+typedef void JobFunc(void* user, u32 index, u32 worker);
+
+struct JobCounter {
+	std::atomic<u32> pending;
+};
+
+struct Job {
+	JobFunc* func;
+	void* user;
+	u32 first;
+	u32 end;
+	u32 grain;           // Indices run without splitting further.
+	JobCounter* counter;
+};
+
+struct JobStats {
+	u64 jobs;            // Ranges run, after splitting.
+	u64 indices;
+	u64 splits;
+	u64 steals;
+	u64 steal_misses;    // Victims that were empty or lost the race.
+	u64 sleeps;
+};
+
+// Chase and Lev, "Dynamic Circular Work-Stealing Deque", with the memory
+// orders of Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+// Models", strengthened to seq_cst where the paper uses fences. Jobs are held
+// by value: a thief copies the entry before it claims it with the CAS on
+// `top`, and throws the copy away if the CAS fails. The owner only writes an
+// entry JOB_DEQUE_SIZE pushes after it was claimed.
+struct JobDeque {
+	alignas(64) std::atomic<s64> top;
+	alignas(64) std::atomic<s64> bottom;
+	alignas(64) Job entries[JOB_DEQUE_SIZE];
+};
+
+struct JobWorker {
+	JobDeque deque;
+	u32 random;
+	JobStats stats;
+	std::thread thread;
+};
+
+struct JobSystem {
+	u32 worker_count;
+	JobWorker* workers;
+	std::atomic<u32> quit;
+	JobStats stats;      // Summed over the workers by job_system_stop().
+
+	// Every submit bumps the epoch. A worker that found nothing sleeps until
+	// it moves on from the value it saw before looking.
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<u32> epoch;
+	std::atomic<u32> sleeping;
+
+	// Jobs submitted from threads that are not workers.
+	std::mutex inject_mutex;
+	Job inject[JOB_DEQUE_SIZE];
+	u32 inject_read, inject_write;
+	std::atomic<u32> inject_count;
+};
+
+// Index of the calling thread in the system it works for.
+global thread_local u32 t_job_worker = JOB_NO_WORKER;
+
+//------------------------------------------------------------------------
+// Deque
+//------------------------------------------------------------------------
+
+// Owner only. False if the deque is full.
+internal b32 job_deque_push(JobDeque* deque, const Job* job) {
+	s64 bottom = deque->bottom.load(std::memory_order_relaxed);
+	s64 top = deque->top.load(std::memory_order_acquire);
+	if(bottom - top >= JOB_DEQUE_SIZE) return false;
+	deque->entries[bottom & (JOB_DEQUE_SIZE - 1)] = *job;
+	deque->bottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+// Owner only, newest first.
+internal b32 job_deque_pop(JobDeque* deque, Job* out) {
+	s64 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+	deque->bottom.store(bottom, std::memory_order_seq_cst);
+	s64 top = deque->top.load(std::memory_order_seq_cst);
+	if(top > bottom) {
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+		return false;
+	}
+	*out = deque->entries[bottom & (JOB_DEQUE_SIZE - 1)];
+	if(top == bottom) {
+		// Last one, race the thieves for it.
+		b32 won = deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+		return won;
+	}
+	return true;
+}
+
+// Any thread, oldest first. False if empty or another thief got there first.
+internal b32 job_deque_steal(JobDeque* deque, Job* out) {
+	s64 top = deque->top.load(std::memory_order_seq_cst);
+	s64 bottom = deque->bottom.load(std::memory_order_seq_cst);
+	if(top >= bottom) return false;
+	*out = deque->entries[top & (JOB_DEQUE_SIZE - 1)];
+	return deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------
+// Submitting and running
+//------------------------------------------------------------------------
+
+internal void job_execute(JobSystem* system, u32 worker, Job job);
+
+internal void job_wake(JobSystem* system) {
+	system->epoch.fetch_add(1, std::memory_order_seq_cst);
+	if(system->sleeping.load(std::memory_order_seq_cst) == 0) return;
+	std::lock_guard<std::mutex> lock(system->sleep_mutex);
+	system->wake.notify_one();
+}
+
+// Queues a range. The counter goes up before anybody can run it.
+internal void job_submit(JobSystem* system, JobFunc* func, void* user, u32 first, u32 end, u32 grain, JobCounter* counter) {
+	if(first >= end) return;
+	counter->pending.fetch_add(1, std::memory_order_relaxed);
+	Job job = { func, user, first, end, Max(grain, 1u), counter };
+
+	u32 worker = t_job_worker;
+	if(worker < system->worker_count) {
+		if(!job_deque_push(&system->workers[worker].deque, &job)) {
+			// Full: run it here rather than fail.
+			job_execute(system, worker, job);
+			return;
+		}
+	} else {
+		for(;;) {
+			{
+				std::lock_guard<std::mutex> lock(system->inject_mutex);
+				if(system->inject_write - system->inject_read < JOB_DEQUE_SIZE) {
+					system->inject[system->inject_write++ & (JOB_DEQUE_SIZE - 1)] = job;
+					system->inject_count.fetch_add(1, std::memory_order_seq_cst);
+					break;
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+	job_wake(system);
+}
+
+internal void job_execute(JobSystem* system, u32 worker, Job job) {
+	JobStats* stats = &system->workers[worker].stats;
+	while(job.end - job.first > job.grain) {
+		u32 middle = job.first + (job.end - job.first) / 2;
+		job_submit(system, job.func, job.user, middle, job.end, job.grain, job.counter);
+		job.end = middle;
+		stats->splits++;
+	}
+	for(u32 i = job.first; i < job.end; i++) job.func(job.user, i, worker);
+	stats->jobs++;
+	stats->indices += job.end - job.first;
+	job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+// Own deque, then the injected queue, then the others' deques starting at a
+// random one.
+internal b32 job_find(JobSystem* system, u32 worker, Job* out) {
+	JobWorker* self = &system->workers[worker];
+	if(job_deque_pop(&self->deque, out)) return true;
+
+	if(system->inject_count.load(std::memory_order_seq_cst) > 0) {
+		std::lock_guard<std::mutex> lock(system->inject_mutex);
+		if(system->inject_read != system->inject_write) {
+			*out = system->inject[system->inject_read++ & (JOB_DEQUE_SIZE - 1)];
+			system->inject_count.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	u32 count = system->worker_count;
+	self->random = self->random * 1664525u + 1013904223u;
+	u32 start = (self->random >> 8) % count;
+	for(u32 k = 0; k < count; k++) {
+		u32 victim = (start + k) % count;
+		if(victim == worker) continue;
+		if(job_deque_steal(&system->workers[victim].deque, out)) {
+			self->stats.steals++;
+			return true;
+		}
+		self->stats.steal_misses++;
+	}
+	return false;
+}
+
+internal void job_pause() {
+#if defined(__SSE2__) || defined(_M_X64)
+	_mm_pause();
+#endif
+}
+
+internal void job_worker_main(JobSystem* system, u32 worker) {
+	t_job_worker = worker;
+	u32 empty = 0;
+	u32 epoch = system->epoch.load(std::memory_order_seq_cst);
+	while(!system->quit.load(std::memory_order_acquire)) {
+		Job job;
+		if(job_find(system, worker, &job)) {
+			job_execute(system, worker, job);
+			empty = 0;
+			epoch = system->epoch.load(std::memory_order_seq_cst);
+			continue;
+		}
+		if(++empty < JOB_SPIN_ROUNDS) {
+			job_pause();
+			continue;
+		}
+
+		// A submit either sees `sleeping` go up and notifies, or bumped the
+		// epoch before it did and the wait returns straight away.
+		system->workers[worker].stats.sleeps++;
+		{
+			std::unique_lock<std::mutex> lock(system->sleep_mutex);
+			system->sleeping.fetch_add(1, std::memory_order_seq_cst);
+			system->wake.wait(lock, [system, epoch] {
+				return system->quit.load(std::memory_order_acquire) || system->epoch.load(std::memory_order_seq_cst) != epoch;
+			});
+			system->sleeping.fetch_sub(1, std::memory_order_seq_cst);
+		}
+		epoch = system->epoch.load(std::memory_order_seq_cst);
+		empty = 0;
+	}
+	t_job_worker = JOB_NO_WORKER;
+}
+
+//------------------------------------------------------------------------
+// Interface
+//------------------------------------------------------------------------
+
+// `worker_count` includes the calling thread, 0 means one per logical core.
+// The JobSystem holds the injection queue, too big for the stack.
+internal b32 job_system_start(JobSystem* system, u32 worker_count) {
+	if(worker_count == 0) worker_count = os_logical_core_count();
+	system->worker_count = Clamp(1u, worker_count, (u32)JOB_MAX_WORKERS);
+	system->workers = (JobWorker*)os_alloc_pages(sizeof(JobWorker) * system->worker_count);
+	if(!system->workers) return false;
+	system->quit = 0;
+	system->stats = {};
+	system->epoch = 0;
+	system->sleeping = 0;
+	system->inject_read = system->inject_write = 0;
+	system->inject_count = 0;
+	for(u32 i = 0; i < system->worker_count; i++) {
+		JobWorker* worker = new(&system->workers[i]) JobWorker();
+		worker->random = 0x9e3779b9u * (i + 1);
+	}
+	t_job_worker = 0;
+	for(u32 i = 1; i < system->worker_count; i++) system->workers[i].thread = std::thread(job_worker_main, system, i);
+	return true;
+}
+
+// Waits for the workers to finish what they are running; queued jobs are
+// dropped. Fills in system->stats.
+internal void job_system_stop(JobSystem* system) {
+	system->quit.store(1, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(system->sleep_mutex);
+		system->wake.notify_all();
+	}
+	for(u32 i = 1; i < system->worker_count; i++) system->workers[i].thread.join();
+	for(u32 i = 0; i < system->worker_count; i++) {
+		const JobStats* stats = &system->workers[i].stats;
+		system->stats.jobs += stats->jobs;
+		system->stats.indices += stats->indices;
+		system->stats.splits += stats->splits;
+		system->stats.steals += stats->steals;
+		system->stats.steal_misses += stats->steal_misses;
+		system->stats.sleeps += stats->sleeps;
+		system->workers[i].~JobWorker();
+	}
+	os_free_pages(system->workers, sizeof(JobWorker) * system->worker_count);
+	system->workers = nullptr;
+	system->worker_count = 0;
+	t_job_worker = JOB_NO_WORKER;
+}
+
+// Runs jobs until every one counted by `counter` is done.
+internal void job_wait(JobSystem* system, JobCounter* counter) {
+	u32 worker = t_job_worker;
+	while(counter->pending.load(std::memory_order_acquire) != 0) {
+		Job job;
+		if(worker < system->worker_count && job_find(system, worker, &job)) job_execute(system, worker, job);
+		else if(worker < system->worker_count) job_pause();
+		else std::this_thread::yield();
+	}
+}
+
+// One job for `index`.
+internal void job_run(JobSystem* system, JobFunc* func, void* user, u32 index, JobCounter* counter) {
+	job_submit(system, func, user, index, index + 1, 1, counter);
+}
+
+// Every index in [0, count), in ranges of at least `grain` indices.
+internal void job_run_range(JobSystem* system, u32 count, u32 grain, JobFunc* func, void* user, JobCounter* counter) {
+	job_submit(system, func, user, 0, count, grain, counter);
+}
+
+// job_run_range() and wait for it.
+internal void job_parallel_for(JobSystem* system, u32 count, u32 grain, JobFunc* func, void* user) {
+	JobCounter counter;
+	counter.pending = 0;
+	job_run_range(system, count, grain, func, user, &counter);
+	job_wait(system, &counter);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+// Fixed-capacity pools addressed by generational handles.
+//
+// A PoolHandle is 32 bits: the slot in the low POOL_INDEX_BITS and the slot's
+// generation above it. Destroying an item bumps its slot's generation, so a
+// handle kept past the destroy no longer resolves (pool_get() returns 0)
+// instead of reaching whatever reuses the slot. Generations start at 1, which
+// keeps 0 free as the handle that never resolves, and wrap after
+// POOL_GENERATION_MASK reuses of the same slot. A slot's generation word also
+// carries POOL_SLOT_LIVE while the slot holds an item, and a handle only
+// matches a live slot, so a very old handle whose generation has come round
+// again never reaches a free slot (one whose slot is in use again does
+// resolve, to the new item). Validating is one compare on the slot.
+//
+// Items are stored densely: the live items are items[0, count), in no
+// particular order, so a walk over all of them is a walk over one array.
+// Slots map to dense positions and back, create, destroy and lookup are O(1)
+// and freed slots go on a free list. Destroy moves the last item into the
+// hole, which means pointers from pool_get() hold only until the next destroy;
+// keep handles, not pointers.
+//
+// All storage is allocated once in pool_init(), nothing is allocated per item.
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include <cstring>
+
+#define POOL_INDEX_BITS       20
+#define POOL_INDEX_MASK       ((1u << POOL_INDEX_BITS) - 1)
+#define POOL_GENERATION_MASK  ((1u << (32 - POOL_INDEX_BITS)) - 1)
+#define POOL_MAX_ITEMS        POOL_INDEX_MASK       // The last index is the end of the free list.
+#define POOL_NONE             POOL_INDEX_MASK
+#define POOL_SLOT_LIVE        (1u << 31)            // In PoolSlot::generation, never in a handle.
+
+typedef u32 PoolHandle;       // 0 is never a valid handle.
+
+// A lookup reads the slot and then the item, two cache lines at most.
+struct PoolSlot {
+	u32 dense;                // Position in items of a live slot, the next free slot of a free one.
+	u32 generation;           // Bumped by every destroy, | POOL_SLOT_LIVE while in use.
+};
+
+struct Pool {
+	u32 item_size;
+	u32 capacity;
+	u32 count;                // Live items, items[0, count).
+	u32 slot_count;           // Slots handed out so far, past these nothing was ever created.
+	u32 free_head;            // POOL_NONE when empty.
+
+	u8* items;                // capacity * item_size
+	u32* dense_slots;         // Slot of each dense item.
+	PoolSlot* slots;
+
+	void* memory;
+	u64 memory_size;
+};
+
+internal PoolHandle pool_make_handle(u32 slot, u32 generation) {
+	return (generation << POOL_INDEX_BITS) | slot;
+}
+
+internal u32 pool_handle_slot(PoolHandle handle) {
+	return handle & POOL_INDEX_MASK;
+}
+
+internal u32 pool_handle_generation(PoolHandle handle) {
+	return handle >> POOL_INDEX_BITS;
+}
+
+// Frees a slot: old handles stop resolving and the slot goes on the free list.
+internal void pool_free_slot(Pool* pool, u32 slot) {
+	PoolSlot* entry = &pool->slots[slot];
+	u32 generation = entry->generation & POOL_GENERATION_MASK;
+	entry->generation = generation == POOL_GENERATION_MASK ? 1 : generation + 1;
+	entry->dense = pool->free_head;
+	pool->free_head = slot;
+}
+
+// `item_size` is rounded up to 8 bytes so items stay aligned for pointers and u64s.
+internal b32 pool_init(Pool* pool, u32 item_size, u32 capacity) {
+	*pool = {};
+	if(capacity == 0 || capacity > POOL_MAX_ITEMS) return false;
+	item_size = AlignPow2(Max(item_size, 1u), 8u);
+
+	u64 items_size = (u64)item_size * capacity;
+	u64 dense_size = AlignPow2((u64)capacity * sizeof(u32), 8ull);
+	u64 size = items_size + dense_size + (u64)capacity * sizeof(PoolSlot);
+	u8* memory = (u8*)os_alloc_pages(size);
+	if(!memory) return false;
+
+	pool->item_size = item_size;
+	pool->capacity = capacity;
+	pool->free_head = POOL_NONE;
+	pool->items = memory;
+	pool->dense_slots = (u32*)(memory + items_size);
+	pool->slots = (PoolSlot*)(memory + items_size + dense_size);
+	pool->memory = memory;
+	pool->memory_size = size;
+	return true;
+}
+
+internal void pool_release(Pool* pool) {
+	if(pool->memory) os_free_pages(pool->memory, pool->memory_size);
+	*pool = {};
+}
+
+// Forgets every item at once. Every outstanding handle goes stale.
+internal void pool_clear(Pool* pool) {
+	for(u32 i = 0; i < pool->count; i++) pool_free_slot(pool, pool->dense_slots[i]);
+	pool->count = 0;
+}
+
+// Returns a zeroed item and its handle, or 0 when the pool is full.
+internal PoolHandle pool_create(Pool* pool, void** item) {
+	if(pool->count == pool->capacity) {
+		if(item) *item = nullptr;
+		return 0;
+	}
+
+	u32 slot;
+	if(pool->free_head != POOL_NONE) {
+		slot = pool->free_head;
+		pool->free_head = pool->slots[slot].dense;
+	} else {
+		slot = pool->slot_count++;
+		pool->slots[slot].generation = 1;
+	}
+	pool->slots[slot].generation |= POOL_SLOT_LIVE;
+
+	u32 dense = pool->count++;
+	pool->dense_slots[dense] = slot;
+	pool->slots[slot].dense = dense;
+	u8* result = pool->items + (u64)dense * pool->item_size;
+	memset(result, 0, pool->item_size);
+	if(item) *item = result;
+	return pool_make_handle(slot, pool->slots[slot].generation & POOL_GENERATION_MASK);
+}
+
+internal b32 pool_valid(const Pool* pool, PoolHandle handle) {
+	u32 slot = pool_handle_slot(handle);
+	return slot < pool->slot_count && pool->slots[slot].generation == (pool_handle_generation(handle) | POOL_SLOT_LIVE);
+}
+
+// 0 for stale and invalid handles.
+internal void* pool_get(const Pool* pool, PoolHandle handle) {
+	if(!pool_valid(pool, handle)) return nullptr;
+	return pool->items + (u64)pool->slots[pool_handle_slot(handle)].dense * pool->item_size;
+}
+
+internal b32 pool_destroy(Pool* pool, PoolHandle handle) {
+	if(!pool_valid(pool, handle)) return false;
+	u32 slot = pool_handle_slot(handle);
+	u32 dense = pool->slots[slot].dense;
+
+	// Fill the hole with the last item.
+	u32 last = --pool->count;
+	if(dense != last) {
+		u32 moved_slot = pool->dense_slots[last];
+		memcpy(pool->items + (u64)dense * pool->item_size, pool->items + (u64)last * pool->item_size, pool->item_size);
+		pool->dense_slots[dense] = moved_slot;
+		pool->slots[moved_slot].dense = dense;
+	}
+
+	pool_free_slot(pool, slot);
+	return true;
+}
+
+// Dense access, for walking every live item: for(u32 i = 0; i < pool->count; i++).
+internal void* pool_item_at(const Pool* pool, u32 dense) {
+	return pool->items + (u64)dense * pool->item_size;
+}
+
+internal PoolHandle pool_handle_at(const Pool* pool, u32 dense) {
+	u32 slot = pool->dense_slots[dense];
+	return pool_make_handle(slot, pool->slots[slot].generation & POOL_GENERATION_MASK);
+}
+
+#define PoolGet(pool, type, handle)  ((type*)pool_get((pool), (handle)))
+#define PoolItemAt(pool, type, i)    ((type*)pool_item_at((pool), (i)))
@@ -0,0 +1,58 @@
+#pragma once
+
+// Radix sort of 64-bit keys carrying a 32-bit value each (an index, usually).
+//
+// Least significant byte first, one counting pass per byte. The histograms of
+// all eight bytes come out of a single read of the keys, and a byte that is
+// the same in every key (the top bytes of small keys, fields nobody set) is
+// skipped, so typical sort keys take three to five passes. Stable, and O(n)
+// where qsort's comparator calls would be O(n log n).
+
+#include "basic/types.h"
+
+#include <cstring>
+
+// Sorts `keys` ascending and `values` with them. `temp_keys` and
+// `temp_values` hold `count` entries each and are clobbered.
+internal void radix_sort_u64(u64* keys, u32* values, u32 count, u64* temp_keys, u32* temp_values) {
+	u32 counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for(u32 i = 0; i < count; i++) {
+		u64 key = keys[i];
+		for(u32 byte = 0; byte < 8; byte++) counts[byte][(key >> (byte * 8)) & 0xff]++;
+	}
+
+	u64* source_keys = keys;
+	u32* source_values = values;
+	u64* target_keys = temp_keys;
+	u32* target_values = temp_values;
+	for(u32 byte = 0; byte < 8; byte++) {
+		u32* histogram = counts[byte];
+		if(count == 0 || histogram[(source_keys[0] >> (byte * 8)) & 0xff] == count) continue;
+
+		u32 offset = 0;
+		for(u32 digit = 0; digit < 256; digit++) {
+			u32 digit_count = histogram[digit];
+			histogram[digit] = offset;
+			offset += digit_count;
+		}
+		u32 shift = byte * 8;
+		for(u32 i = 0; i < count; i++) {
+			u32 slot = histogram[(source_keys[i] >> shift) & 0xff]++;
+			target_keys[slot] = source_keys[i];
+			target_values[slot] = source_values[i];
+		}
+
+		u64* swap_keys = source_keys;
+		source_keys = target_keys;
+		target_keys = swap_keys;
+		u32* swap_values = source_values;
+		source_values = target_values;
+		target_values = swap_values;
+	}
+
+	if(source_keys != keys) {
+		memcpy(keys, source_keys, (u64)count * sizeof(u64));
+		memcpy(values, source_values, (u64)count * sizeof(u32));
+	}
+}
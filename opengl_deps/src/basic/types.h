@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 // Keywords Macros
 #define global   static
 #define internal static
@@ -59,3 +62,10 @@ typedef void glvoid;
 #define Thousand(n) ((n) * 1000)
 #define Million(n)  ((n) * 1000000)
 #define Billion(n)  ((n) * 1000000000)
+
+// Helpers
+#define ArrayCount(a)   (sizeof(a) / sizeof((a)[0]))
+#define Min(a, b)       (((a) < (b)) ? (a) : (b))
+#define Max(a, b)       (((a) > (b)) ? (a) : (b))
+#define Clamp(a, x, b)  (((x) < (a)) ? (a) : ((b) < (x)) ? (b) : (x))
+#define AlignPow2(x, b) (((x) + (b) - 1) & (~((b) - 1)))
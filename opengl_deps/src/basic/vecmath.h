@@ -0,0 +1,584 @@
+#pragma once
+
+// Vectors, quaternions and 4x4 matrices for the CPU side of the renderers,
+// standing in for DirectXMath.
+//
+// Same conventions as DirectXMath and the shaders' `#pragma pack_matrix(row_major)`:
+// row vectors, row-major storage, left-handed, so a vertex goes through
+// v * world * view * projection and mat4_mul(a, b) applies a first. Quaternions
+// are (x, y, z, w) with quat_mul(a, b) applying a first, like XMQuaternionMultiply.
+//
+// The types are plain floats with no alignment requirement so they can sit in
+// vertex and constant buffer structs. The single-matrix functions use SSE when
+// the target has it and the batch functions (mat4_mul_array(), mat4_mul_pairs(),
+// mat4_transform_points()) use AVX, two matrix rows or eight points per
+// register; each has a *_scalar twin that is the fallback and the reference.
+// The SIMD paths add and multiply in the same order as the scalar ones, so with
+// contraction off (-ffp-contract=off) they match bit for bit, except
+// mat4_inverse(), which takes a different route to the same result.
+
+#include "basic/types.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define VECMATH_SSE 1
+	#include <immintrin.h>
+#else
+	#define VECMATH_SSE 0
+#endif
+
+#if defined(__AVX__)
+	#define VECMATH_AVX 1
+#else
+	#define VECMATH_AVX 0
+#endif
+
+//------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------
+
+struct Vec3 {
+	f32 x, y, z;
+};
+
+struct Vec4 {
+	f32 x, y, z, w;
+};
+
+struct Quat {
+	f32 x, y, z, w;
+};
+
+struct Mat4 {
+	f32 m[4][4];
+};
+
+// Structure-of-arrays points for the batch functions, `count` floats per array.
+struct Vec3Array {
+	f32* x;
+	f32* y;
+	f32* z;
+};
+
+//------------------------------------------------------------------------
+// Vectors
+//------------------------------------------------------------------------
+
+internal Vec3 vec3(f32 x, f32 y, f32 z) {
+	Vec3 result = { x, y, z };
+	return result;
+}
+
+internal Vec4 vec4(f32 x, f32 y, f32 z, f32 w) {
+	Vec4 result = { x, y, z, w };
+	return result;
+}
+
+internal Vec3 vec3_add(Vec3 a, Vec3 b)     { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+internal Vec3 vec3_sub(Vec3 a, Vec3 b)     { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+internal Vec3 vec3_scale(Vec3 a, f32 s)    { return vec3(a.x * s, a.y * s, a.z * s); }
+internal f32  vec3_dot(Vec3 a, Vec3 b)     { return a.x * b.x + a.y * b.y + a.z * b.z; }
+internal f32  vec3_length(Vec3 a)          { return sqrtf(vec3_dot(a, a)); }
+
+internal Vec3 vec3_cross(Vec3 a, Vec3 b) {
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+internal Vec3 vec3_normalize(Vec3 a) {
+	f32 length = vec3_length(a);
+	return vec3(a.x / length, a.y / length, a.z / length);
+}
+
+internal Vec3 vec3_lerp(Vec3 a, Vec3 b, f32 t) {
+	return vec3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+//------------------------------------------------------------------------
+// Quaternions
+//------------------------------------------------------------------------
+
+internal Quat quat_identity() {
+	Quat result = { 0.0f, 0.0f, 0.0f, 1.0f };
+	return result;
+}
+
+// XMQuaternionRotationAxis; the axis does not have to be normalized.
+internal Quat quat_from_axis_angle(Vec3 axis, f32 radians) {
+	Vec3 n = vec3_normalize(axis);
+	f32 s = sinf(0.5f * radians);
+	Quat result = { n.x * s, n.y * s, n.z * s, cosf(0.5f * radians) };
+	return result;
+}
+
+// Rotation a followed by rotation b, which is the Hamilton product b * a.
+internal Quat quat_mul(Quat a, Quat b) {
+	Quat result;
+	result.x = b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y;
+	result.y = b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x;
+	result.z = b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w;
+	result.w = b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z;
+	return result;
+}
+
+internal Quat quat_conjugate(Quat q) {
+	Quat result = { -q.x, -q.y, -q.z, q.w };
+	return result;
+}
+
+internal f32 quat_dot(Quat a, Quat b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+internal Quat quat_normalize(Quat q) {
+	f32 length = sqrtf(quat_dot(q, q));
+	Quat result = { q.x / length, q.y / length, q.z / length, q.w / length };
+	return result;
+}
+
+internal Vec3 quat_rotate(Quat q, Vec3 v) {
+	Vec3 u = vec3(q.x, q.y, q.z);
+	Vec3 t = vec3_scale(vec3_cross(u, v), 2.0f);
+	return vec3_add(vec3_add(v, vec3_scale(t, q.w)), vec3_cross(u, t));
+}
+
+// Normalized lerp along the shorter arc; cheap and good enough between close keys.
+internal Quat quat_nlerp(Quat a, Quat b, f32 t) {
+	f32 sign = quat_dot(a, b) < 0.0f ? -1.0f : 1.0f;
+	Quat result;
+	result.x = a.x + (b.x * sign - a.x) * t;
+	result.y = a.y + (b.y * sign - a.y) * t;
+	result.z = a.z + (b.z * sign - a.z) * t;
+	result.w = a.w + (b.w * sign - a.w) * t;
+	return quat_normalize(result);
+}
+
+// Constant angular velocity along the shorter arc, nlerp when the two are nearly parallel.
+internal Quat quat_slerp(Quat a, Quat b, f32 t) {
+	f32 cos_angle = quat_dot(a, b);
+	f32 sign = 1.0f;
+	if(cos_angle < 0.0f) {
+		cos_angle = -cos_angle;
+		sign = -1.0f;
+	}
+	if(cos_angle > 0.9995f) return quat_nlerp(a, b, t);
+
+	f32 angle = acosf(cos_angle);
+	f32 inverse_sin = 1.0f / sinf(angle);
+	f32 wa = sinf((1.0f - t) * angle) * inverse_sin;
+	f32 wb = sinf(t * angle) * inverse_sin * sign;
+	Quat result = { a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb };
+	return result;
+}
+
+//------------------------------------------------------------------------
+// Matrices
+//------------------------------------------------------------------------
+
+internal Mat4 mat4_identity() {
+	Mat4 result = {};
+	for(u32 i = 0; i < 4; i++) result.m[i][i] = 1.0f;
+	return result;
+}
+
+internal Mat4 mat4_transpose(const Mat4* a) {
+	Mat4 result;
+	for(u32 r = 0; r < 4; r++) {
+		for(u32 c = 0; c < 4; c++) result.m[r][c] = a->m[c][r];
+	}
+	return result;
+}
+
+internal Vec4 vec4_transform_scalar(Vec4 v, const Mat4* m) {
+	Vec4 result;
+	result.x = v.x * m->m[0][0] + v.y * m->m[1][0] + v.z * m->m[2][0] + v.w * m->m[3][0];
+	result.y = v.x * m->m[0][1] + v.y * m->m[1][1] + v.z * m->m[2][1] + v.w * m->m[3][1];
+	result.z = v.x * m->m[0][2] + v.y * m->m[1][2] + v.z * m->m[2][2] + v.w * m->m[3][2];
+	result.w = v.x * m->m[0][3] + v.y * m->m[1][3] + v.z * m->m[2][3] + v.w * m->m[3][3];
+	return result;
+}
+
+// Point with w = 1, the fourth column ignored: for affine matrices.
+internal Vec3 vec3_transform_point(Vec3 v, const Mat4* m) {
+	Vec3 result;
+	result.x = v.x * m->m[0][0] + v.y * m->m[1][0] + v.z * m->m[2][0] + m->m[3][0];
+	result.y = v.x * m->m[0][1] + v.y * m->m[1][1] + v.z * m->m[2][1] + m->m[3][1];
+	result.z = v.x * m->m[0][2] + v.y * m->m[1][2] + v.z * m->m[2][2] + m->m[3][2];
+	return result;
+}
+
+// Direction with w = 0: rotation and scale only.
+internal Vec3 vec3_transform_direction(Vec3 v, const Mat4* m) {
+	Vec3 result;
+	result.x = v.x * m->m[0][0] + v.y * m->m[1][0] + v.z * m->m[2][0];
+	result.y = v.x * m->m[0][1] + v.y * m->m[1][1] + v.z * m->m[2][1];
+	result.z = v.x * m->m[0][2] + v.y * m->m[1][2] + v.z * m->m[2][2];
+	return result;
+}
+
+internal Mat4 mat4_mul_scalar(const Mat4* a, const Mat4* b) {
+	Mat4 result;
+	for(u32 r = 0; r < 4; r++) {
+		for(u32 c = 0; c < 4; c++) {
+			result.m[r][c] = a->m[r][0] * b->m[0][c] + a->m[r][1] * b->m[1][c] + a->m[r][2] * b->m[2][c] + a->m[r][3] * b->m[3][c];
+		}
+	}
+	return result;
+}
+
+// Cofactor expansion over 2x2 minors. Returns the identity and a zero
+// determinant for singular matrices.
+internal Mat4 mat4_inverse_scalar(const Mat4* a, f32* determinant_out) {
+	const f32* m = &a->m[0][0];
+	f32 s0 = m[0] * m[5] - m[1] * m[4];
+	f32 s1 = m[0] * m[6] - m[2] * m[4];
+	f32 s2 = m[0] * m[7] - m[3] * m[4];
+	f32 s3 = m[1] * m[6] - m[2] * m[5];
+	f32 s4 = m[1] * m[7] - m[3] * m[5];
+	f32 s5 = m[2] * m[7] - m[3] * m[6];
+	f32 c5 = m[10] * m[15] - m[11] * m[14];
+	f32 c4 = m[9] * m[15] - m[11] * m[13];
+	f32 c3 = m[9] * m[14] - m[10] * m[13];
+	f32 c2 = m[8] * m[15] - m[11] * m[12];
+	f32 c1 = m[8] * m[14] - m[10] * m[12];
+	f32 c0 = m[8] * m[13] - m[9] * m[12];
+
+	f32 determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	if(determinant_out) *determinant_out = determinant;
+	if(determinant == 0.0f) return mat4_identity();
+	f32 d = 1.0f / determinant;
+
+	Mat4 result;
+	f32* r = &result.m[0][0];
+	r[0]  = ( m[5] * c5 - m[6] * c4 + m[7] * c3) * d;
+	r[1]  = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * d;
+	r[2]  = ( m[13] * s5 - m[14] * s4 + m[15] * s3) * d;
+	r[3]  = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * d;
+	r[4]  = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * d;
+	r[5]  = ( m[0] * c5 - m[2] * c2 + m[3] * c1) * d;
+	r[6]  = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * d;
+	r[7]  = ( m[8] * s5 - m[10] * s2 + m[11] * s1) * d;
+	r[8]  = ( m[4] * c4 - m[5] * c2 + m[7] * c0) * d;
+	r[9]  = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * d;
+	r[10] = ( m[12] * s4 - m[13] * s2 + m[15] * s0) * d;
+	r[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * d;
+	r[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * d;
+	r[13] = ( m[0] * c3 - m[1] * c1 + m[2] * c0) * d;
+	r[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * d;
+	r[15] = ( m[8] * s3 - m[9] * s1 + m[10] * s0) * d;
+	return result;
+}
+
+#if VECMATH_SSE
+
+#define VECMATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define VECMATH_SWIZZLE(a, x, y, z, w)    _mm_shuffle_ps(a, a, _MM_SHUFFLE(w, z, y, x))
+
+// The 2x2 helpers below hold a row-major 2x2 matrix as (m00, m01, m10, m11).
+
+// a * b
+inline __m128 vecmath_mat2_mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, VECMATH_SWIZZLE(b, 0, 3, 0, 3)),
+	                  _mm_mul_ps(VECMATH_SWIZZLE(a, 1, 0, 3, 2), VECMATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adjugate(a) * b
+inline __m128 vecmath_mat2_adj_mul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(VECMATH_SWIZZLE(a, 3, 3, 0, 0), b),
+	                  _mm_mul_ps(VECMATH_SWIZZLE(a, 1, 1, 2, 2), VECMATH_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// a * adjugate(b)
+inline __m128 vecmath_mat2_mul_adj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, VECMATH_SWIZZLE(b, 3, 0, 3, 0)),
+	                  _mm_mul_ps(VECMATH_SWIZZLE(a, 1, 0, 3, 2), VECMATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// One row of a * b: the row's four elements broadcast against b's rows.
+inline __m128 vecmath_row_mul(const f32* row, const Mat4* b) {
+	__m128 result = _mm_mul_ps(_mm_set1_ps(row[0]), _mm_loadu_ps(b->m[0]));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[1]), _mm_loadu_ps(b->m[1])));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[2]), _mm_loadu_ps(b->m[2])));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[3]), _mm_loadu_ps(b->m[3])));
+	return result;
+}
+
+#endif
+
+internal Vec4 vec4_transform(Vec4 v, const Mat4* m) {
+#if VECMATH_SSE
+	Vec4 result;
+	_mm_storeu_ps(&result.x, vecmath_row_mul(&v.x, m));
+	return result;
+#else
+	return vec4_transform_scalar(v, m);
+#endif
+}
+
+internal Mat4 mat4_mul(const Mat4* a, const Mat4* b) {
+#if VECMATH_SSE
+	Mat4 result;
+	for(u32 r = 0; r < 4; r++) _mm_storeu_ps(result.m[r], vecmath_row_mul(a->m[r], b));
+	return result;
+#else
+	return mat4_mul_scalar(a, b);
+#endif
+}
+
+// Blockwise inversion over the four 2x2 quadrants:
+//   inverse(M) = 1/|M| * [ adj(X) adj(Y) ; adj(Z) adj(W) ]
+// with X = |D|A - B adj(D)C, W = |A|D - C adj(A)B, Y = |B|C - D adj(adj(A)B),
+// Z = |C|B - A adj(adj(D)C) and |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C).
+// Agrees with mat4_inverse_scalar() to rounding; same singular case.
+internal Mat4 mat4_inverse(const Mat4* m, f32* determinant_out) {
+#if VECMATH_SSE
+	__m128 r0 = _mm_loadu_ps(m->m[0]);
+	__m128 r1 = _mm_loadu_ps(m->m[1]);
+	__m128 r2 = _mm_loadu_ps(m->m[2]);
+	__m128 r3 = _mm_loadu_ps(m->m[3]);
+
+	__m128 a = _mm_movelh_ps(r0, r1);
+	__m128 b = _mm_movehl_ps(r1, r0);
+	__m128 c = _mm_movelh_ps(r2, r3);
+	__m128 d = _mm_movehl_ps(r3, r2);
+
+	// (|A|, |B|, |C|, |D|)
+	__m128 sub_determinants = _mm_sub_ps(_mm_mul_ps(VECMATH_SHUFFLE(r0, r2, 0, 2, 0, 2), VECMATH_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+	                                     _mm_mul_ps(VECMATH_SHUFFLE(r0, r2, 1, 3, 1, 3), VECMATH_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+	__m128 det_a = VECMATH_SWIZZLE(sub_determinants, 0, 0, 0, 0);
+	__m128 det_b = VECMATH_SWIZZLE(sub_determinants, 1, 1, 1, 1);
+	__m128 det_c = VECMATH_SWIZZLE(sub_determinants, 2, 2, 2, 2);
+	__m128 det_d = VECMATH_SWIZZLE(sub_determinants, 3, 3, 3, 3);
+
+	__m128 d_c = vecmath_mat2_adj_mul(d, c);
+	__m128 a_b = vecmath_mat2_adj_mul(a, b);
+	__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), vecmath_mat2_mul(b, d_c));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), vecmath_mat2_mul(c, a_b));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), vecmath_mat2_mul_adj(d, a_b));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), vecmath_mat2_mul_adj(a, d_c));
+
+	__m128 trace = _mm_mul_ps(a_b, VECMATH_SWIZZLE(d_c, 0, 2, 1, 3));
+	trace = _mm_add_ps(trace, _mm_movehl_ps(trace, trace));
+	trace = _mm_add_ps(trace, VECMATH_SWIZZLE(trace, 1, 0, 1, 0));
+	trace = VECMATH_SWIZZLE(trace, 0, 0, 0, 0);
+	__m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), trace);
+
+	f32 determinant_scalar = _mm_cvtss_f32(determinant);
+	if(determinant_out) *determinant_out = determinant_scalar;
+	if(determinant_scalar == 0.0f) return mat4_identity();
+
+	// The adjugates' sign flips folded into the reciprocal.
+	__m128 reciprocal = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), determinant);
+	x = _mm_mul_ps(x, reciprocal);
+	y = _mm_mul_ps(y, reciprocal);
+	z = _mm_mul_ps(z, reciprocal);
+	w = _mm_mul_ps(w, reciprocal);
+
+	Mat4 result;
+	_mm_storeu_ps(result.m[0], VECMATH_SHUFFLE(x, y, 3, 1, 3, 1));
+	_mm_storeu_ps(result.m[1], VECMATH_SHUFFLE(x, y, 2, 0, 2, 0));
+	_mm_storeu_ps(result.m[2], VECMATH_SHUFFLE(z, w, 3, 1, 3, 1));
+	_mm_storeu_ps(result.m[3], VECMATH_SHUFFLE(z, w, 2, 0, 2, 0));
+	return result;
+#else
+	return mat4_inverse_scalar(m, determinant_out);
+#endif
+}
+
+internal Mat4 mat4_scaling(f32 x, f32 y, f32 z) {
+	Mat4 result = mat4_identity();
+	result.m[0][0] = x;
+	result.m[1][1] = y;
+	result.m[2][2] = z;
+	return result;
+}
+
+internal Mat4 mat4_translation(f32 x, f32 y, f32 z) {
+	Mat4 result = mat4_identity();
+	result.m[3][0] = x;
+	result.m[3][1] = y;
+	result.m[3][2] = z;
+	return result;
+}
+
+// XMMatrixRotationAxis.
+internal Mat4 mat4_rotation_axis(f32 x, f32 y, f32 z, f32 radians) {
+	f32 length = sqrtf(x * x + y * y + z * z);
+	x /= length; y /= length; z /= length;
+	f32 s = sinf(radians);
+	f32 c = cosf(radians);
+	f32 t = 1.0f - c;
+
+	Mat4 result = mat4_identity();
+	result.m[0][0] = c + x * x * t;     result.m[0][1] = x * y * t + z * s; result.m[0][2] = x * z * t - y * s;
+	result.m[1][0] = x * y * t - z * s; result.m[1][1] = c + y * y * t;     result.m[1][2] = y * z * t + x * s;
+	result.m[2][0] = x * z * t + y * s; result.m[2][1] = y * z * t - x * s; result.m[2][2] = c + z * z * t;
+	return result;
+}
+
+// XMMatrixRotationQuaternion; q has to be normalized.
+internal Mat4 mat4_from_quat(Quat q) {
+	f32 xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	f32 xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	f32 wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	Mat4 result = mat4_identity();
+	result.m[0][0] = 1.0f - 2.0f * (yy + zz); result.m[0][1] = 2.0f * (xy + wz);        result.m[0][2] = 2.0f * (xz - wy);
+	result.m[1][0] = 2.0f * (xy - wz);        result.m[1][1] = 1.0f - 2.0f * (xx + zz); result.m[1][2] = 2.0f * (yz + wx);
+	result.m[2][0] = 2.0f * (xz + wy);        result.m[2][1] = 2.0f * (yz - wx);        result.m[2][2] = 1.0f - 2.0f * (xx + yy);
+	return result;
+}
+
+// Scale, then rotate, then translate, in one matrix without the multiplies.
+internal Mat4 mat4_affine(Vec3 scale, Quat rotation, Vec3 translation) {
+	Mat4 result = mat4_from_quat(rotation);
+	for(u32 c = 0; c < 3; c++) {
+		result.m[0][c] *= scale.x;
+		result.m[1][c] *= scale.y;
+		result.m[2][c] *= scale.z;
+	}
+	result.m[3][0] = translation.x;
+	result.m[3][1] = translation.y;
+	result.m[3][2] = translation.z;
+	return result;
+}
+
+// XMMatrixLookAtLH.
+internal Mat4 mat4_look_at_lh(Vec4 eye, Vec4 focus, Vec4 up) {
+	f32 f[3] = { focus.x - eye.x, focus.y - eye.y, focus.z - eye.z };
+	f32 f_length = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+	for(u32 i = 0; i < 3; i++) f[i] /= f_length;
+
+	f32 r[3] = { up.y * f[2] - up.z * f[1], up.z * f[0] - up.x * f[2], up.x * f[1] - up.y * f[0] };
+	f32 r_length = sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+	for(u32 i = 0; i < 3; i++) r[i] /= r_length;
+
+	f32 u[3] = { f[1] * r[2] - f[2] * r[1], f[2] * r[0] - f[0] * r[2], f[0] * r[1] - f[1] * r[0] };
+
+	Mat4 result = mat4_identity();
+	for(u32 i = 0; i < 3; i++) {
+		result.m[i][0] = r[i];
+		result.m[i][1] = u[i];
+		result.m[i][2] = f[i];
+	}
+	result.m[3][0] = -(r[0] * eye.x + r[1] * eye.y + r[2] * eye.z);
+	result.m[3][1] = -(u[0] * eye.x + u[1] * eye.y + u[2] * eye.z);
+	result.m[3][2] = -(f[0] * eye.x + f[1] * eye.y + f[2] * eye.z);
+	return result;
+}
+
+// XMMatrixPerspectiveFovLH: depth goes to [0, 1] between the near and far planes.
+internal Mat4 mat4_perspective_fov_lh(f32 fov_y, f32 aspect_ratio, f32 near_z, f32 far_z) {
+	f32 height = cosf(0.5f * fov_y) / sinf(0.5f * fov_y);
+	f32 range = far_z / (far_z - near_z);
+
+	Mat4 result = {};
+	result.m[0][0] = height / aspect_ratio;
+	result.m[1][1] = height;
+	result.m[2][2] = range;
+	result.m[2][3] = 1.0f;
+	result.m[3][2] = -range * near_z;
+	return result;
+}
+
+//------------------------------------------------------------------------
+// Batches
+//------------------------------------------------------------------------
+
+// out[i] = a[i] * b[i]. `out` may alias `a` or `b`.
+internal void mat4_mul_pairs_scalar(Mat4* out, const Mat4* a, const Mat4* b, u32 count) {
+	for(u32 i = 0; i < count; i++) out[i] = mat4_mul_scalar(&a[i], &b[i]);
+}
+
+// out[i] = a[i] * b, e.g. a batch of world matrices times one view-projection.
+internal void mat4_mul_array_scalar(Mat4* out, const Mat4* a, const Mat4* b, u32 count) {
+	Mat4 shared = *b;
+	for(u32 i = 0; i < count; i++) out[i] = mat4_mul_scalar(&a[i], &shared);
+}
+
+internal void mat4_transform_points_scalar(Vec3Array out, Vec3Array in, const Mat4* m, u32 count) {
+	for(u32 i = 0; i < count; i++) {
+		f32 x = in.x[i], y = in.y[i], z = in.z[i];
+		out.x[i] = x * m->m[0][0] + y * m->m[1][0] + z * m->m[2][0] + m->m[3][0];
+		out.y[i] = x * m->m[0][1] + y * m->m[1][1] + z * m->m[2][1] + m->m[3][1];
+		out.z[i] = x * m->m[0][2] + y * m->m[1][2] + z * m->m[2][2] + m->m[3][2];
+	}
+}
+
+#if VECMATH_AVX
+
+// Rows r and r+1 of a * b, one per 128-bit lane: each lane broadcasts its
+// row's elements in turn against b's rows, which are duplicated in both lanes.
+inline __m256 vecmath_row_pair_mul(__m256 rows, __m256 b0, __m256 b1, __m256 b2, __m256 b3) {
+	__m256 result = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0);
+	result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1));
+	result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xaa), b2));
+	result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xff), b3));
+	return result;
+}
+
+#endif
+
+internal void mat4_mul_pairs(Mat4* out, const Mat4* a, const Mat4* b, u32 count) {
+#if VECMATH_AVX
+	for(u32 i = 0; i < count; i++) {
+		__m256 b0 = _mm256_broadcast_ps((const __m128*)b[i].m[0]);
+		__m256 b1 = _mm256_broadcast_ps((const __m128*)b[i].m[1]);
+		__m256 b2 = _mm256_broadcast_ps((const __m128*)b[i].m[2]);
+		__m256 b3 = _mm256_broadcast_ps((const __m128*)b[i].m[3]);
+		__m256 low = vecmath_row_pair_mul(_mm256_loadu_ps(a[i].m[0]), b0, b1, b2, b3);
+		__m256 high = vecmath_row_pair_mul(_mm256_loadu_ps(a[i].m[2]), b0, b1, b2, b3);
+		_mm256_storeu_ps(out[i].m[0], low);
+		_mm256_storeu_ps(out[i].m[2], high);
+	}
+#else
+	for(u32 i = 0; i < count; i++) out[i] = mat4_mul(&a[i], &b[i]);
+#endif
+}
+
+internal void mat4_mul_array(Mat4* out, const Mat4* a, const Mat4* b, u32 count) {
+#if VECMATH_AVX
+	__m256 b0 = _mm256_broadcast_ps((const __m128*)b->m[0]);
+	__m256 b1 = _mm256_broadcast_ps((const __m128*)b->m[1]);
+	__m256 b2 = _mm256_broadcast_ps((const __m128*)b->m[2]);
+	__m256 b3 = _mm256_broadcast_ps((const __m128*)b->m[3]);
+	for(u32 i = 0; i < count; i++) {
+		__m256 low = vecmath_row_pair_mul(_mm256_loadu_ps(a[i].m[0]), b0, b1, b2, b3);
+		__m256 high = vecmath_row_pair_mul(_mm256_loadu_ps(a[i].m[2]), b0, b1, b2, b3);
+		_mm256_storeu_ps(out[i].m[0], low);
+		_mm256_storeu_ps(out[i].m[2], high);
+	}
+#else
+	Mat4 shared = *b;
+	for(u32 i = 0; i < count; i++) out[i] = mat4_mul(&a[i], &shared);
+#endif
+}
+
+internal void mat4_inverse_array(Mat4* out, const Mat4* in, u32 count) {
+	for(u32 i = 0; i < count; i++) out[i] = mat4_inverse(&in[i], 0);
+}
+
+// Points with w = 1 through an affine matrix, 8 at a time; `out` may be `in`.
+internal void mat4_transform_points(Vec3Array out, Vec3Array in, const Mat4* m, u32 count) {
+	u32 i = 0;
+#if VECMATH_AVX
+	__m256 m00 = _mm256_set1_ps(m->m[0][0]), m01 = _mm256_set1_ps(m->m[0][1]), m02 = _mm256_set1_ps(m->m[0][2]);
+	__m256 m10 = _mm256_set1_ps(m->m[1][0]), m11 = _mm256_set1_ps(m->m[1][1]), m12 = _mm256_set1_ps(m->m[1][2]);
+	__m256 m20 = _mm256_set1_ps(m->m[2][0]), m21 = _mm256_set1_ps(m->m[2][1]), m22 = _mm256_set1_ps(m->m[2][2]);
+	__m256 m30 = _mm256_set1_ps(m->m[3][0]), m31 = _mm256_set1_ps(m->m[3][1]), m32 = _mm256_set1_ps(m->m[3][2]);
+	for(; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_loadu_ps(in.x + i);
+		__m256 y = _mm256_loadu_ps(in.y + i);
+		__m256 z = _mm256_loadu_ps(in.z + i);
+		__m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m00), _mm256_mul_ps(y, m10)), _mm256_mul_ps(z, m20)), m30);
+		__m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m01), _mm256_mul_ps(y, m11)), _mm256_mul_ps(z, m21)), m31);
+		__m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m02), _mm256_mul_ps(y, m12)), _mm256_mul_ps(z, m22)), m32);
+		_mm256_storeu_ps(out.x + i, rx);
+		_mm256_storeu_ps(out.y + i, ry);
+		_mm256_storeu_ps(out.z + i, rz);
+	}
+#endif
+	Vec3Array tail_in = { in.x + i, in.y + i, in.z + i };
+	Vec3Array tail_out = { out.x + i, out.y + i, out.z + i };
+	mat4_transform_points_scalar(tail_out, tail_in, m, count - i);
+}
@@ -1,5 +1,7 @@
 #include "basic/basic.h"
 #include "platform/platform.h"
+#include "gl/program_cache.h"
+#include "gl/state.h"
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   glViewport(0, 0, width, height);
@@ -12,8 +14,8 @@ void process_input(GLFWwindow *window) {
 
 glenum gl_check_error_(const char *file, s32 line) {
 	glenum error_code = 0;
-	while((error_code == glGetError	()) != GL_NO_ERROR) {
-		std::string error;
+	while((error_code = glGetError()) != GL_NO_ERROR) {
+		const char* error = "UNKNOWN";
 		switch(error_code) {
 			case GL_INVALID_ENUM: 			error = "INVALID_ENUM"; break;
 			case GL_INVALID_VALUE: 			error = "INVALID_VALUE"; break;
@@ -24,7 +26,7 @@ glenum gl_check_error_(const char *file, s32 line) {
 			case GL_INVALID_FRAMEBUFFER_OPERATION: error = "INVALID_FRAMEBUFFER_OPERATION"; break;
 		}
 
-		std::cout << error << " | " << file << " (" << line << ") \n"; 
+		printf("%s | %s (%d)\n", error, file, line);
 	}
 	return error_code;
 }
@@ -34,7 +36,7 @@ glenum gl_check_error_(const char *file, s32 line) {
 // FPS counter
 static f64 previous;
 static f64 frame_count;
-void update_fps_counter(GLFWwindow* window) {
+void update_fps_counter(GLFWwindow* window, const GfxStateCache* state_cache) {
 	f64 current = glfwGetTime();
 	f64 elapsed = current - previous;
 	
@@ -43,7 +45,8 @@ void update_fps_counter(GLFWwindow* window) {
 		previous = current;
 		char tmp[128];
 		f64 fps = (f64)frame_count / elapsed;
-		sprintf(tmp, "Edgerunner - FPS: %.2f", fps);
+		sprintf(tmp, "Edgerunner - FPS: %.2f - binds: %llu issued, %llu filtered", fps,
+						(unsigned long long)state_cache->stats.issued, (unsigned long long)state_cache->stats.filtered);
 		glfwSetWindowTitle(window, tmp);
 		frame_count = 0;
 	}
@@ -58,7 +61,7 @@ int main() {
 
   GLFWwindow *window = glfwCreateWindow(1280, 720, "Edgerunner", NULL, NULL);
   if (window == NULL) {
-    std::cout << "Failed to create GLFW window\n";
+    printf("Failed to create GLFW window\n");
     glfwTerminate();
     return -1;
   }
@@ -71,7 +74,7 @@ int main() {
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    std::cout << "Failed to initialize GLAD\n";
+    printf("Failed to initialize GLAD\n");
     return -1;
   }
 
@@ -83,10 +86,10 @@ int main() {
 	int max_vertex_attr;
 	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_vertex_attr);
 
-	std::cout << "Vendor: " << vendor << "\n";
-	std::cout << "Renderer: " << renderer << "\n";
-	std::cout << "OpenGL Version: " << version << "\n";
-	std::cout << "GLSL Version: " << shading_lang_version << "\n";
+	printf("Vendor: %s\n", vendor);
+	printf("Renderer: %s\n", renderer);
+	printf("OpenGL Version: %s\n", version);
+	printf("GLSL Version: %s\n", shading_lang_version);
 
 	// Triangle
 	f32 g_vertices[] = {
@@ -96,7 +99,8 @@ int main() {
 	};
 
 	
-	// Vertex shader
+	// Shaders go through the program-binary cache, only the first launch (or a
+	// shader edit, or a driver update) compiles GLSL.
 	const char *vertex_shader_source = "#version 330 core\n"
     "layout (location = 0) in vec3 aPos;\n"
     "void main()\n"
@@ -104,57 +108,30 @@ int main() {
     "   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
     "}\0";
 
-	u32 vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
-	glCompileShader(vertex_shader);
-	
-	{
-		int  success;
-		char infoLog[512];
-		glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-		if(!success) {
-			glGetShaderInfoLog(vertex_shader, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
-	}
-
-	// Fragment shader
 	const char *fragment_shader_source = "#version 330 core\n"
 	" out vec4 FragColor;\n"
 	"void main() {\n"
   "  FragColor = vec4(0.27183728f, 0.284972084f, 0.01998319f, 1.0f);\n"
 	"}\0";
 
-	u32 fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment_shader, 1 , &fragment_shader_source, NULL);
-	glCompileShader(fragment_shader);
-	
-	{
-		int  success;
-		char infoLog[512];
-		glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-		if(!success) {
-			glGetShaderInfoLog(vertex_shader, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
+	GLProgramCache program_cache;
+	if(!gl_program_cache_init(&program_cache, "program_cache")) {
+		printf("Program cache disabled, the driver exposes no program binary formats\n");
 	}
 
-	u32 shader_program = glCreateProgram();
-	glAttachShader(shader_program, vertex_shader);
-	glAttachShader(shader_program, fragment_shader);
-	glLinkProgram(shader_program);
-	{
-		int success;
-		char infoLog[512];
-		glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
-		if(!success) {
-			glGetProgramInfoLog(shader_program, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::LINKING_FAILED\n" << infoLog << std::endl;
-		}
+	GLShaderStage stages[] = {
+		{ GL_VERTEX_SHADER, vertex_shader_source },
+		{ GL_FRAGMENT_SHADER, fragment_shader_source },
+	};
+	GLProgramDesc program_desc = { "hello", stages, ArrayCount(stages), nullptr };
+	u32 shader_program = gl_program_cache_get(&program_cache, &program_desc);
+	if(!shader_program) {
+		printf("ERROR::SHADER::BUILD_FAILED\n%s\n", program_cache.error);
 	}
 
-	//glDeleteShader(vertex_shader);
-	//glDeleteShader(fragment_shader);
+	const GLProgramCacheStats* cache_stats = &program_cache.stats;
+	printf("Program cache: %u hits, %u misses, %u rejected (%g%% hit rate), %g ms saved\n", cache_stats->hits, cache_stats->misses,
+				 cache_stats->rejected, gl_program_cache_hit_rate(cache_stats) * 100.0, cache_stats->saved_seconds * 1000.0);
 
 	u32 vbo;
 	glGenBuffers(1, &vbo);
@@ -168,18 +145,20 @@ int main() {
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(f32), (void*)0);
 
+	// Program and vertex array are bound through the cache: only the first frame makes the calls.
+	GfxStateCache state_cache = {};
 
 	while(!glfwWindowShouldClose(window)) {
     process_input(window);
 
-		update_fps_counter(window);
+		update_fps_counter(window, &state_cache);
 
     // rendering commands here
     glClearColor(0.2f, 0.3f, 1.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glUseProgram(shader_program);
-		glBindVertexArray(vao);
+		gl_state_use_program(&state_cache, shader_program);
+		gl_state_bind_vertex_array(&state_cache, vao);
 
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 
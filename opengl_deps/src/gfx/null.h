@@ -0,0 +1,112 @@
+#pragma once
+
+// A GfxBackend (gfx/resources.h) and GfxDrawFuncs (gfx/queue.h) without a
+// GPU: objects are numbers and the calls are only counted. For tools and
+// benchmarks that exercise the front end on machines without a device, and to
+// check that what was created was also destroyed.
+
+#include "basic/types.h"
+#include "gfx/resources.h"
+#include "gfx/queue.h"
+
+struct GfxNullDevice {
+	u64 next_name;           // Names start at 1, 0 stays the null object.
+	u64 live_buffers;
+	u64 live_textures;
+	u64 buffer_bytes;        // Created and updated.
+	u64 texture_rows;        // Uploaded.
+	u64 shader_binds;
+	u64 texture_binds;
+	u64 mesh_binds;
+	u64 draws;
+	u64 calls;
+};
+
+internal b32 gfx_null_create_buffer(void* user, const GfxBufferDesc* desc, const void* data, GfxNative* native) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	native->value = ++device->next_name;
+	device->live_buffers++;
+	device->buffer_bytes += data ? desc->size : 0;
+	device->calls++;
+	return true;
+}
+
+internal void gfx_null_update_buffer(void* user, const GfxBufferDesc* desc, GfxNative native, u32 offset, u32 size, const void* data) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->buffer_bytes += size;
+	device->calls++;
+}
+
+internal void gfx_null_destroy_buffer(void* user, GfxNative native) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->live_buffers--;
+	device->calls++;
+}
+
+internal b32 gfx_null_create_texture(void* user, const GfxTextureDesc* desc, GfxNative* native, GfxNative* view) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	native->value = ++device->next_name;
+	device->live_textures++;
+	device->calls++;
+	return true;
+}
+
+internal void gfx_null_upload_texture(void* user, const GfxTextureDesc* desc, GfxNative native, u32 level, u32 row, u32 row_count,
+																			const u8* data, u32 row_pitch, b32 level_complete) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->texture_rows += row_count;
+	device->calls++;
+}
+
+internal void gfx_null_destroy_texture(void* user, GfxNative native, GfxNative view) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->live_textures--;
+	device->calls++;
+}
+
+internal GfxBackend gfx_null_backend(GfxNullDevice* device) {
+	GfxBackend backend = {};
+	backend.name = "null";
+	backend.user = device;
+	backend.create_buffer = gfx_null_create_buffer;
+	backend.update_buffer = gfx_null_update_buffer;
+	backend.destroy_buffer = gfx_null_destroy_buffer;
+	backend.create_texture = gfx_null_create_texture;
+	backend.upload_texture = gfx_null_upload_texture;
+	backend.destroy_texture = gfx_null_destroy_texture;
+	return backend;
+}
+
+internal void gfx_null_bind_shader(void* user, u32 shader) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->shader_binds++;
+	device->calls++;
+}
+
+internal void gfx_null_bind_texture(void* user, const GfxTexture* texture) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->texture_binds++;
+	device->calls++;
+}
+
+internal void gfx_null_bind_mesh(void* user, GfxResources* resources, const GfxMesh* mesh) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->mesh_binds++;
+	device->calls++;
+}
+
+internal void gfx_null_draw(void* user, const GfxDrawPacket* packet, const GfxMesh* mesh) {
+	GfxNullDevice* device = (GfxNullDevice*)user;
+	device->draws++;
+	device->calls++;
+}
+
+internal GfxDrawFuncs gfx_null_draw_funcs(GfxNullDevice* device) {
+	GfxDrawFuncs funcs = {};
+	funcs.user = device;
+	funcs.bind_shader = gfx_null_bind_shader;
+	funcs.bind_texture = gfx_null_bind_texture;
+	funcs.bind_mesh = gfx_null_bind_mesh;
+	funcs.draw = gfx_null_draw;
+	return funcs;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+// Render queue: draws are recorded as packets with a 64-bit sort key, sorted
+// once per frame and submitted in key order, binding only what changes.
+//
+// The key decides the order. Its top bits are the pass, so passes draw one
+// after another. Below that, opaque passes sort by shader, then material
+// (texture), then mesh, and only then by depth (front to back), because a
+// shader or texture switch costs more than the overdraw a coarse depth order
+// lets through. The transparent pass has to blend back to front, so there depth
+// (far first) comes right under the pass:
+//
+//   opaque       pass:4 | shader:12 | material:20 | mesh:14 | depth:14
+//   transparent  pass:4 | depth:24 (inverted) | shader:12 | material:20 | 0:4
+//
+// gfx_queue_submit() radix sorts the keys (basic/sort.h) and walks the packets
+// in order through a GfxDrawFuncs table. Shader, texture and mesh are bound
+// only when they differ from the previous packet's. Every submit leaves counts
+// in queue->stats: draws, each kind of state change, and the state changes the
+// same packets would have cost in the order they were recorded.
+//
+// Render thread only.
+
+#include "basic/types.h"
+#include "basic/pool.h"
+#include "basic/sort.h"
+#include "gfx/resources.h"
+#include "platform/os.h"
+
+#define GFX_QUEUE_DEFAULT_CAPACITY  65536
+
+enum GfxPass : u32 {
+	GfxPass_Opaque,
+	GfxPass_Transparent,
+	GfxPass_Overlay,          // Sorted like opaque, drawn last.
+	GfxPass_COUNT
+};
+
+struct GfxDrawPacket {
+	u64 key;
+	GfxMeshHandle mesh;
+	GfxTextureHandle texture;
+	u32 shader;               // Meaning is up to the GfxDrawFuncs.
+	u32 object;               // Per-draw data for GfxDrawFunc, e.g. an index into the frame's transforms.
+};
+
+// `texture` is 0 if the packet's texture handle is 0 or stale.
+typedef void GfxBindShaderFunc(void* user, u32 shader);
+typedef void GfxBindTextureFunc(void* user, const GfxTexture* texture);
+typedef void GfxBindMeshFunc(void* user, GfxResources* resources, const GfxMesh* mesh);
+typedef void GfxDrawFunc(void* user, const GfxDrawPacket* packet, const GfxMesh* mesh);
+
+struct GfxDrawFuncs {
+	void* user;
+	GfxBindShaderFunc* bind_shader;
+	GfxBindTextureFunc* bind_texture;
+	GfxBindMeshFunc* bind_mesh;
+	GfxDrawFunc* draw;
+};
+
+struct GfxQueueStats {
+	u32 packets;
+	u32 draws;
+	u32 skipped;              // Packets whose mesh no longer exists.
+	u32 shader_changes;
+	u32 texture_changes;
+	u32 mesh_changes;
+	u32 state_changes;        // The three above together.
+	u32 unsorted_state_changes;  // What recording order would have cost.
+	f64 sort_seconds;
+	f64 submit_seconds;
+};
+
+struct GfxRenderQueue {
+	u32 capacity;
+	u32 count;
+	u32 dropped;              // Packets past capacity this frame.
+	GfxDrawPacket* packets;
+	u64* keys;
+	u32* order;
+	u64* temp_keys;
+	u32* temp_order;
+	GfxQueueStats stats;      // Of the last submit.
+
+	void* memory;
+	u64 memory_size;
+};
+
+internal b32 gfx_queue_init(GfxRenderQueue* queue, u32 capacity) {
+	*queue = {};
+	u64 size = (u64)capacity * (sizeof(GfxDrawPacket) + 2 * sizeof(u64) + 2 * sizeof(u32));
+	u8* memory = (u8*)os_alloc_pages(size);
+	if(!memory) return false;
+	queue->capacity = capacity;
+	queue->packets = (GfxDrawPacket*)memory;
+	queue->keys = (u64*)(queue->packets + capacity);
+	queue->temp_keys = queue->keys + capacity;
+	queue->order = (u32*)(queue->temp_keys + capacity);
+	queue->temp_order = queue->order + capacity;
+	queue->memory = memory;
+	queue->memory_size = size;
+	return true;
+}
+
+internal void gfx_queue_release(GfxRenderQueue* queue) {
+	if(queue->memory) os_free_pages(queue->memory, queue->memory_size);
+	*queue = {};
+}
+
+//------------------------------------------------------------------------
+// Keys
+//------------------------------------------------------------------------
+
+// `depth` is the view depth mapped to [0, 1], near to far. Fields wider than
+// their bits are masked, materials and meshes are usually pool slots
+// (gfx_material_id(), gfx_mesh_id()).
+internal u64 gfx_sort_key(GfxPass pass, u32 shader, u32 material, u32 mesh, f32 depth) {
+	depth = Clamp(0.0f, depth, 1.0f);
+	u64 key = (u64)pass << 60;
+	if(pass == GfxPass_Transparent) {
+		u64 far_first = (1u << 24) - 1 - (u32)(depth * (f32)((1u << 24) - 1));
+		key |= far_first << 36;
+		key |= (u64)(shader & 0xfff) << 24;
+		key |= (u64)(material & 0xfffff) << 4;
+	} else {
+		key |= (u64)(shader & 0xfff) << 48;
+		key |= (u64)(material & 0xfffff) << 28;
+		key |= (u64)(mesh & 0x3fff) << 14;
+		key |= (u64)(depth * (f32)((1u << 14) - 1));
+	}
+	return key;
+}
+
+internal u32 gfx_material_id(GfxTextureHandle texture) {
+	return pool_handle_slot(texture.value);
+}
+
+internal u32 gfx_mesh_id(GfxMeshHandle mesh) {
+	return pool_handle_slot(mesh.value);
+}
+
+//------------------------------------------------------------------------
+// Recording and submission
+//------------------------------------------------------------------------
+
+internal void gfx_queue_begin(GfxRenderQueue* queue) {
+	queue->count = 0;
+	queue->dropped = 0;
+}
+
+internal void gfx_queue_draw(GfxRenderQueue* queue, u64 key, GfxMeshHandle mesh, GfxTextureHandle texture, u32 shader, u32 object) {
+	if(queue->count == queue->capacity) {
+		queue->dropped++;
+		return;
+	}
+	GfxDrawPacket* packet = &queue->packets[queue->count++];
+	packet->key = key;
+	packet->mesh = mesh;
+	packet->texture = texture;
+	packet->shader = shader;
+	packet->object = object;
+}
+
+// State changes to draw `packets` in the order `order` gives, or as stored if it is 0.
+internal u32 gfx_queue_count_changes(const GfxDrawPacket* packets, const u32* order, u32 count) {
+	u32 changes = 0;
+	const GfxDrawPacket* previous = nullptr;
+	for(u32 i = 0; i < count; i++) {
+		const GfxDrawPacket* packet = &packets[order ? order[i] : i];
+		if(!previous) changes += 3;
+		else {
+			changes += packet->shader != previous->shader;
+			changes += packet->texture.value != previous->texture.value;
+			changes += packet->mesh.value != previous->mesh.value;
+		}
+		previous = packet;
+	}
+	return changes;
+}
+
+// Sorts this frame's packets and draws them.
+internal void gfx_queue_submit(GfxRenderQueue* queue, GfxResources* resources, const GfxDrawFuncs* funcs) {
+	GfxQueueStats stats = {};
+	stats.packets = queue->count;
+	stats.unsorted_state_changes = gfx_queue_count_changes(queue->packets, nullptr, queue->count);
+
+	f64 start = os_now_seconds();
+	for(u32 i = 0; i < queue->count; i++) {
+		queue->keys[i] = queue->packets[i].key;
+		queue->order[i] = i;
+	}
+	radix_sort_u64(queue->keys, queue->order, queue->count, queue->temp_keys, queue->temp_order);
+	f64 sorted = os_now_seconds();
+
+	b32 first = true;
+	u32 shader = 0;
+	PoolHandle texture = 0, mesh_handle = 0;
+	for(u32 i = 0; i < queue->count; i++) {
+		const GfxDrawPacket* packet = &queue->packets[queue->order[i]];
+		GfxMesh* mesh = gfx_mesh_get(resources, packet->mesh);
+		if(!mesh) {
+			stats.skipped++;
+			continue;
+		}
+		if(first || packet->shader != shader) {
+			shader = packet->shader;
+			funcs->bind_shader(funcs->user, shader);
+			stats.shader_changes++;
+		}
+		if(first || packet->texture.value != texture) {
+			texture = packet->texture.value;
+			funcs->bind_texture(funcs->user, gfx_texture_get(resources, packet->texture));
+			stats.texture_changes++;
+		}
+		if(first || packet->mesh.value != mesh_handle) {
+			mesh_handle = packet->mesh.value;
+			funcs->bind_mesh(funcs->user, resources, mesh);
+			stats.mesh_changes++;
+		}
+		first = false;
+		funcs->draw(funcs->user, packet, mesh);
+		stats.draws++;
+	}
+
+	stats.state_changes = stats.shader_changes + stats.texture_changes + stats.mesh_changes;
+	stats.sort_seconds = sorted - start;
+	stats.submit_seconds = os_now_seconds() - sorted;
+	queue->stats = stats;
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+// GPU resources behind handles, independent of the graphics API.
+//
+// Buffers, textures and meshes live in basic/pool.h pools inside GfxResources
+// and are named by typed 32-bit handles (GfxBufferHandle and so on), so a scene
+// holds as many of each as the pools have room for and a stale handle resolves
+// to nothing instead of a released object. Each entry keeps its description
+// and what the backend made for it (GfxNative: a COM pointer for D3D11, an
+// object name for GL), the front end never looks inside the latter.
+//
+// A backend is a GfxBackend, a table of functions that create, fill and
+// destroy the API objects. gl/gfx.h is the GL one, gfx/null.h one that only
+// counts, and the D3D11 sample has its own.
+//
+// A mesh is a vertex buffer, an index buffer and the range to draw, and owns
+// both buffers. Textures fill a band of rows at a time, as asset/stream.h
+// uploads them, smallest level first; levels_ready says how many levels
+// (counted from the smallest) are complete and safe to sample.
+//
+// An srgb texture holds sRGB-encoded texels, as texture/mips.h writes them.
+// Every backend gives it an sRGB format (GL_SRGB8_ALPHA8, DXGI_FORMAT_*_SRGB
+// and so on), so sampling decodes it to linear and filters in linear. What is
+// drawn with it should go to an sRGB render target, which encodes the result
+// again; the D3D11 sample's back buffer is one.
+//
+// Render thread only.
+
+#include "basic/types.h"
+#include "basic/pool.h"
+#include "texture/cooked.h"
+#include "texture/mips.h"
+
+#define GFX_MAX_BUFFERS   16384
+#define GFX_MAX_TEXTURES  8192
+#define GFX_MAX_MESHES    8192
+
+struct GfxBufferHandle  { PoolHandle value; };
+struct GfxTextureHandle { PoolHandle value; };
+struct GfxMeshHandle    { PoolHandle value; };
+
+enum GfxBufferKind : u32 {
+	GfxBuffer_Vertex,
+	GfxBuffer_Index,
+	GfxBuffer_Constant,
+	GfxBuffer_COUNT
+};
+
+struct GfxBufferDesc {
+	GfxBufferKind kind;
+	u32 size;                // A multiple of 16 for constant buffers.
+	u32 stride;              // Vertex size, or 2 or 4 for 16 and 32-bit indices.
+	b32 dynamic;             // Updated often, e.g. per frame constants.
+};
+
+struct GfxTextureDesc {
+	CookedFormat format;
+	b32 srgb;
+	u32 width;
+	u32 height;
+	u32 level_count;
+};
+
+// The backend's object, opaque to the front end.
+union GfxNative {
+	void* pointer;
+	u64 value;
+};
+
+struct GfxBuffer {
+	GfxBufferDesc desc;
+	GfxNative native;
+};
+
+struct GfxTexture {
+	GfxTextureDesc desc;
+	GfxNative native;
+	GfxNative view;          // D3D11 shader resource view, unused by GL.
+	u32 levels_ready;        // Counted from the smallest level.
+};
+
+struct GfxMesh {
+	GfxBufferHandle vertices;
+	GfxBufferHandle indices;
+	u32 vertex_stride;
+	u32 index_size;          // 2 or 4.
+	u32 first_index;
+	u32 index_count;
+};
+
+// Create functions return false if the API object could not be made, nothing
+// is added then. Buffer updates are in bounds, and a constant buffer is only
+// ever updated whole (offset 0, size desc->size), as D3D11 requires. Texture uploads are bands of rows (rows of 4x4 blocks for
+// BCn) of one level, `level_complete` once the band finishes it.
+typedef b32  GfxCreateBufferFunc(void* user, const GfxBufferDesc* desc, const void* data, GfxNative* native);
+typedef void GfxUpdateBufferFunc(void* user, const GfxBufferDesc* desc, GfxNative native, u32 offset, u32 size, const void* data);
+typedef void GfxDestroyBufferFunc(void* user, GfxNative native);
+typedef b32  GfxCreateTextureFunc(void* user, const GfxTextureDesc* desc, GfxNative* native, GfxNative* view);
+typedef void GfxUploadTextureFunc(void* user, const GfxTextureDesc* desc, GfxNative native, u32 level, u32 row, u32 row_count,
+																	const u8* data, u32 row_pitch, b32 level_complete);
+typedef void GfxDestroyTextureFunc(void* user, GfxNative native, GfxNative view);
+
+struct GfxBackend {
+	const char* name;
+	void* user;
+	GfxCreateBufferFunc* create_buffer;
+	GfxUpdateBufferFunc* update_buffer;
+	GfxDestroyBufferFunc* destroy_buffer;
+	GfxCreateTextureFunc* create_texture;
+	GfxUploadTextureFunc* upload_texture;
+	GfxDestroyTextureFunc* destroy_texture;
+};
+
+struct GfxResourceStats {
+	u64 created;
+	u64 destroyed;
+	u64 failed;              // Pool full, bad description or refused by the backend.
+	u64 stale;               // Calls with a handle that no longer resolves.
+};
+
+struct GfxResources {
+	GfxBackend backend;
+	Pool buffers;
+	Pool textures;
+	Pool meshes;
+	GfxResourceStats stats;
+};
+
+internal b32 gfx_resources_init(GfxResources* resources, const GfxBackend* backend) {
+	*resources = {};
+	resources->backend = *backend;
+	if(pool_init(&resources->buffers, sizeof(GfxBuffer), GFX_MAX_BUFFERS) &&
+		 pool_init(&resources->textures, sizeof(GfxTexture), GFX_MAX_TEXTURES) &&
+		 pool_init(&resources->meshes, sizeof(GfxMesh), GFX_MAX_MESHES)) {
+		return true;
+	}
+	pool_release(&resources->buffers);
+	pool_release(&resources->textures);
+	pool_release(&resources->meshes);
+	return false;
+}
+
+//------------------------------------------------------------------------
+// Buffers
+//------------------------------------------------------------------------
+
+internal GfxBuffer* gfx_buffer_get(GfxResources* resources, GfxBufferHandle handle) {
+	return PoolGet(&resources->buffers, GfxBuffer, handle.value);
+}
+
+// `data` may be 0 to leave the contents undefined.
+internal GfxBufferHandle gfx_buffer_create(GfxResources* resources, const GfxBufferDesc* desc, const void* data) {
+	GfxBufferHandle result = {};
+	GfxNative native = {};
+	if(resources->buffers.count == resources->buffers.capacity || (desc->kind == GfxBuffer_Constant && desc->size % 16) ||
+		 !resources->backend.create_buffer(resources->backend.user, desc, data, &native)) {
+		resources->stats.failed++;
+		return result;
+	}
+	GfxBuffer* buffer;
+	result.value = pool_create(&resources->buffers, (void**)&buffer);
+	buffer->desc = *desc;
+	buffer->native = native;
+	resources->stats.created++;
+	return result;
+}
+
+// Updates out of bounds, and constant buffer updates that are not of the whole
+// buffer, are dropped.
+internal void gfx_buffer_update(GfxResources* resources, GfxBufferHandle handle, u32 offset, u32 size, const void* data) {
+	GfxBuffer* buffer = gfx_buffer_get(resources, handle);
+	if(!buffer) {
+		resources->stats.stale++;
+		return;
+	}
+	if(offset > buffer->desc.size || size > buffer->desc.size - offset) return;
+	if(buffer->desc.kind == GfxBuffer_Constant && (offset != 0 || size != buffer->desc.size)) return;
+	resources->backend.update_buffer(resources->backend.user, &buffer->desc, buffer->native, offset, size, data);
+}
+
+internal void gfx_buffer_destroy(GfxResources* resources, GfxBufferHandle handle) {
+	GfxBuffer* buffer = gfx_buffer_get(resources, handle);
+	if(!buffer) {
+		resources->stats.stale += handle.value != 0;
+		return;
+	}
+	resources->backend.destroy_buffer(resources->backend.user, buffer->native);
+	pool_destroy(&resources->buffers, handle.value);
+	resources->stats.destroyed++;
+}
+
+//------------------------------------------------------------------------
+// Textures
+//------------------------------------------------------------------------
+
+internal GfxTexture* gfx_texture_get(GfxResources* resources, GfxTextureHandle handle) {
+	return PoolGet(&resources->textures, GfxTexture, handle.value);
+}
+
+// Rows of pixels, or of 4x4 blocks for BCn, in `level`.
+internal u32 gfx_texture_level_rows(const GfxTextureDesc* desc, u32 level) {
+	u32 height = Max(desc->height >> level, 1u);
+	return cooked_format_is_block_compressed(desc->format) ? (height + 3) / 4 : height;
+}
+
+// Allocates every level; nothing is sampleable until gfx_texture_upload_rows() completes one.
+internal GfxTextureHandle gfx_texture_create(GfxResources* resources, const GfxTextureDesc* desc) {
+	GfxTextureHandle result = {};
+	GfxNative native = {}, view = {};
+	if(desc->level_count == 0 || desc->level_count > MIP_MAX_LEVELS || resources->textures.count == resources->textures.capacity ||
+		 !resources->backend.create_texture(resources->backend.user, desc, &native, &view)) {
+		resources->stats.failed++;
+		return result;
+	}
+	GfxTexture* texture;
+	result.value = pool_create(&resources->textures, (void**)&texture);
+	texture->desc = *desc;
+	texture->native = native;
+	texture->view = view;
+	resources->stats.created++;
+	return result;
+}
+
+internal void gfx_texture_upload_rows(GfxResources* resources, GfxTextureHandle handle, u32 level, u32 row, u32 row_count,
+																			const u8* data, u32 row_pitch) {
+	GfxTexture* texture = gfx_texture_get(resources, handle);
+	if(!texture) {
+		resources->stats.stale++;
+		return;
+	}
+	if(level >= texture->desc.level_count) return;
+	b32 complete = row + row_count >= gfx_texture_level_rows(&texture->desc, level);
+	resources->backend.upload_texture(resources->backend.user, &texture->desc, texture->native, level, row, row_count,
+																		data, row_pitch, complete);
+	if(complete) texture->levels_ready = Max(texture->levels_ready, texture->desc.level_count - level);
+}
+
+internal void gfx_texture_destroy(GfxResources* resources, GfxTextureHandle handle) {
+	GfxTexture* texture = gfx_texture_get(resources, handle);
+	if(!texture) {
+		resources->stats.stale += handle.value != 0;
+		return;
+	}
+	resources->backend.destroy_texture(resources->backend.user, texture->native, texture->view);
+	pool_destroy(&resources->textures, handle.value);
+	resources->stats.destroyed++;
+}
+
+//------------------------------------------------------------------------
+// Meshes
+//------------------------------------------------------------------------
+
+internal GfxMesh* gfx_mesh_get(GfxResources* resources, GfxMeshHandle handle) {
+	return PoolGet(&resources->meshes, GfxMesh, handle.value);
+}
+
+// Static vertex and index buffers filled from the arrays, drawn whole.
+internal GfxMeshHandle gfx_mesh_create(GfxResources* resources, const void* vertices, u32 vertex_count, u32 vertex_stride,
+																			 const void* indices, u32 index_count, u32 index_size) {
+	GfxMeshHandle result = {};
+	if(resources->meshes.count == resources->meshes.capacity) {
+		resources->stats.failed++;
+		return result;
+	}
+
+	GfxBufferDesc vertex_desc = { GfxBuffer_Vertex, vertex_count * vertex_stride, vertex_stride, false };
+	GfxBufferDesc index_desc = { GfxBuffer_Index, index_count * index_size, index_size, false };
+	GfxBufferHandle vertex_buffer = gfx_buffer_create(resources, &vertex_desc, vertices);
+	GfxBufferHandle index_buffer = vertex_buffer.value ? gfx_buffer_create(resources, &index_desc, indices) : GfxBufferHandle{};
+	if(!index_buffer.value) {
+		gfx_buffer_destroy(resources, vertex_buffer);
+		return result;
+	}
+
+	GfxMesh* mesh;
+	result.value = pool_create(&resources->meshes, (void**)&mesh);
+	mesh->vertices = vertex_buffer;
+	mesh->indices = index_buffer;
+	mesh->vertex_stride = vertex_stride;
+	mesh->index_size = index_size;
+	mesh->index_count = index_count;
+	resources->stats.created++;
+	return result;
+}
+
+// Destroys the mesh's buffers with it.
+internal void gfx_mesh_destroy(GfxResources* resources, GfxMeshHandle handle) {
+	GfxMesh* mesh = gfx_mesh_get(resources, handle);
+	if(!mesh) {
+		resources->stats.stale += handle.value != 0;
+		return;
+	}
+	gfx_buffer_destroy(resources, mesh->vertices);
+	gfx_buffer_destroy(resources, mesh->indices);
+	pool_destroy(&resources->meshes, handle.value);
+	resources->stats.destroyed++;
+}
+
+//------------------------------------------------------------------------
+// Shutdown
+//------------------------------------------------------------------------
+
+// Destroys whatever is left, through the backend, and frees the pools.
+internal void gfx_resources_release(GfxResources* resources) {
+	while(resources->meshes.count) {
+		GfxMeshHandle mesh = { pool_handle_at(&resources->meshes, resources->meshes.count - 1) };
+		gfx_mesh_destroy(resources, mesh);
+	}
+	while(resources->textures.count) {
+		GfxTextureHandle texture = { pool_handle_at(&resources->textures, resources->textures.count - 1) };
+		gfx_texture_destroy(resources, texture);
+	}
+	while(resources->buffers.count) {
+		GfxBufferHandle buffer = { pool_handle_at(&resources->buffers, resources->buffers.count - 1) };
+		gfx_buffer_destroy(resources, buffer);
+	}
+	pool_release(&resources->buffers);
+	pool_release(&resources->textures);
+	pool_release(&resources->meshes);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+// Shadow copy of the bound pipeline state, to drop calls that would bind what
+// is already bound.
+//
+// Every piece of bindable state is a GfxState: the shaders, the input layout,
+// the render targets and so on, and one per slot for vertex buffers, constant
+// buffers, textures and samplers. A state holds two u64s: the object (a COM
+// pointer, a GL name) and whatever else the call takes (stride and offset,
+// the depth view, a format). gfx_state_set() compares them with what was last
+// set and records the new ones. It returns false if they are the same, and
+// the caller skips the API call:
+//
+//   if(gfx_state_set(&cache, GfxState_PixelShader, (u64)shader)) context->PSSetShader(shader, nullptr, 0);
+//
+// gl/state.h wraps the GL calls this way, the D3D11 sample its context's.
+// Nothing is known at first, or after gfx_state_invalidate(); the first set
+// of anything is always issued. Code that changes state behind the cache's
+// back has to call gfx_state_forget() for what it touched, or
+// gfx_state_invalidate() when it can't tell, and destroying an object calls
+// gfx_state_forget_value() for the slots it could be bound to.
+//
+// stats counts the calls that went through and the ones that were dropped,
+// per state and in total.
+
+#include "basic/types.h"
+
+#include <cstring>
+
+#define GFX_STATE_VERTEX_BUFFERS    8
+#define GFX_STATE_CONSTANT_BUFFERS  8       // Per stage.
+#define GFX_STATE_TEXTURES          16      // Per stage.
+#define GFX_STATE_SAMPLERS          8       // Per stage.
+
+enum GfxStage : u32 {
+	GfxStage_Vertex,
+	GfxStage_Pixel,
+	GfxStage_COUNT
+};
+
+enum GfxState : u32 {
+	GfxState_VertexShader,                  // GL: the program.
+	GfxState_PixelShader,
+	GfxState_InputLayout,                   // GL: the vertex array.
+	GfxState_Topology,
+	GfxState_IndexBuffer,
+	GfxState_Rasterizer,                    // GL: face culling.
+	GfxState_DepthStencil,                  // GL: the depth test.
+	GfxState_Blend,
+	GfxState_RenderTargets,                 // GL: the draw framebuffer.
+	GfxState_Viewport,
+	GfxState_ActiveTexture,                 // GL only.
+	GfxState_VertexBuffer,
+	GfxState_ConstantBuffer = GfxState_VertexBuffer + GFX_STATE_VERTEX_BUFFERS,
+	GfxState_Texture = GfxState_ConstantBuffer + GfxStage_COUNT * GFX_STATE_CONSTANT_BUFFERS,
+	GfxState_Sampler = GfxState_Texture + GfxStage_COUNT * GFX_STATE_TEXTURES,
+	GfxState_COUNT = GfxState_Sampler + GfxStage_COUNT * GFX_STATE_SAMPLERS
+};
+
+struct GfxStateStats {
+	u64 issued;
+	u64 filtered;
+	u32 issued_by_state[GfxState_COUNT];
+	u32 filtered_by_state[GfxState_COUNT];
+};
+
+struct GfxStateCache {
+	u64 values[GfxState_COUNT][2];
+	u64 known[(GfxState_COUNT + 63) / 64];  // Bit per state.
+	GfxStateStats stats;
+};
+
+internal u32 gfx_state_vertex_buffer(u32 slot) {
+	return GfxState_VertexBuffer + slot;
+}
+
+internal u32 gfx_state_constant_buffer(GfxStage stage, u32 slot) {
+	return GfxState_ConstantBuffer + stage * GFX_STATE_CONSTANT_BUFFERS + slot;
+}
+
+internal u32 gfx_state_texture(GfxStage stage, u32 slot) {
+	return GfxState_Texture + stage * GFX_STATE_TEXTURES + slot;
+}
+
+internal u32 gfx_state_sampler(GfxStage stage, u32 slot) {
+	return GfxState_Sampler + stage * GFX_STATE_SAMPLERS + slot;
+}
+
+// Two f32 in one u64, for viewports and the like. Compared bit for bit.
+internal u64 gfx_state_pack_f32(f32 a, f32 b) {
+	u32 low, high;
+	memcpy(&low, &a, sizeof(u32));
+	memcpy(&high, &b, sizeof(u32));
+	return ((u64)high << 32) | low;
+}
+
+// For reports: what kind of state `state` is.
+internal const char* gfx_state_name(u32 state) {
+	switch(state) {
+		case GfxState_VertexShader:  return "vertex shader";
+		case GfxState_PixelShader:   return "pixel shader";
+		case GfxState_InputLayout:   return "input layout";
+		case GfxState_Topology:      return "topology";
+		case GfxState_IndexBuffer:   return "index buffer";
+		case GfxState_Rasterizer:    return "rasterizer";
+		case GfxState_DepthStencil:  return "depth stencil";
+		case GfxState_Blend:         return "blend";
+		case GfxState_RenderTargets: return "render targets";
+		case GfxState_Viewport:      return "viewport";
+		case GfxState_ActiveTexture: return "active texture";
+	}
+	if(state < GfxState_ConstantBuffer) return "vertex buffer";
+	if(state < GfxState_Texture)        return "constant buffer";
+	if(state < GfxState_Sampler)        return "texture";
+	return "sampler";
+}
+
+internal void gfx_state_invalidate(GfxStateCache* cache) {
+	memset(cache->known, 0, sizeof(cache->known));
+}
+
+internal void gfx_state_forget(GfxStateCache* cache, u32 state) {
+	cache->known[state / 64] &= ~(1ull << (state % 64));
+}
+
+internal b32 gfx_state_is_known(const GfxStateCache* cache, u32 state) {
+	return (cache->known[state / 64] >> (state % 64)) & 1;
+}
+
+// Forgets the states in [first_state, first_state + count) that hold `value`.
+// For when the object is destroyed: its name or address can come back as a
+// new object that the cache would take for the old one.
+internal void gfx_state_forget_value(GfxStateCache* cache, u32 first_state, u32 count, u64 value) {
+	for(u32 state = first_state; state < first_state + count; state++) {
+		if(cache->values[state][0] == value) gfx_state_forget(cache, state);
+	}
+}
+
+// True if the call has to be made: the state was unknown or held something else.
+internal b32 gfx_state_set2(GfxStateCache* cache, u32 state, u64 value, u64 extra) {
+	u64* values = cache->values[state];
+	if(gfx_state_is_known(cache, state) && values[0] == value && values[1] == extra) {
+		cache->stats.filtered++;
+		cache->stats.filtered_by_state[state]++;
+		return false;
+	}
+	values[0] = value;
+	values[1] = extra;
+	cache->known[state / 64] |= 1ull << (state % 64);
+	cache->stats.issued++;
+	cache->stats.issued_by_state[state]++;
+	return true;
+}
+
+internal b32 gfx_state_set(GfxStateCache* cache, u32 state, u64 value) {
+	return gfx_state_set2(cache, state, value, 0);
+}
+
+// One call that binds `count` consecutive slots (VSSetConstantBuffers and the
+// like): true if any of them changes, and then all of them are recorded.
+// Counted as one call either way.
+internal b32 gfx_state_set_range(GfxStateCache* cache, u32 first_state, u32 count, const u64* values) {
+	b32 changed = false;
+	for(u32 i = 0; i < count && !changed; i++) {
+		u32 state = first_state + i;
+		changed = !gfx_state_is_known(cache, state) || cache->values[state][0] != values[i] || cache->values[state][1] != 0;
+	}
+	if(!changed) {
+		cache->stats.filtered++;
+		cache->stats.filtered_by_state[first_state]++;
+		return false;
+	}
+	for(u32 i = 0; i < count; i++) {
+		u32 state = first_state + i;
+		cache->values[state][0] = values[i];
+		cache->values[state][1] = 0;
+		cache->known[state / 64] |= 1ull << (state % 64);
+	}
+	cache->stats.issued++;
+	cache->stats.issued_by_state[first_state]++;
+	return true;
+}
+
+internal void gfx_state_reset_stats(GfxStateCache* cache) {
+	memset(&cache->stats, 0, sizeof(cache->stats));
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// The OpenGL GfxBackend for gfx/resources.h.
+//
+// Buffers are filled through GL_COPY_WRITE_BUFFER so creating or updating one
+// never changes the element buffer of whatever vertex array is bound. Textures
+// get every level allocated up front and GL_TEXTURE_BASE_LEVEL follows the
+// uploads, so sampling only ever reads complete levels. Both leave the
+// texture bound to GL_TEXTURE_2D of the active unit; with a GfxStateCache
+// (gl/state.h) as the backend's user, the cache is told.
+
+#include "basic/types.h"
+#include "gfx/resources.h"
+#include "gl/state.h"
+#include "texture/cooked.h"
+#include "third_party/glad/glad.h"
+
+internal glenum gl_gfx_texture_format(const GfxTextureDesc* desc) {
+	switch(desc->format) {
+		case CookedFormat_BC1: return desc->srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case CookedFormat_BC3: return desc->srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case CookedFormat_BC7: return desc->srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default:               return desc->srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+}
+
+internal b32 gl_gfx_create_buffer(void* user, const GfxBufferDesc* desc, const void* data, GfxNative* native) {
+	gluint buffer = 0;
+	glGenBuffers(1, &buffer);
+	if(!buffer) return false;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, desc->size, data, desc->dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	native->value = buffer;
+	return true;
+}
+
+internal void gl_gfx_update_buffer(void* user, const GfxBufferDesc* desc, GfxNative native, u32 offset, u32 size, const void* data) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, (gluint)native.value);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+internal void gl_gfx_destroy_buffer(void* user, GfxNative native) {
+	gluint buffer = (gluint)native.value;
+	glDeleteBuffers(1, &buffer);
+	if(user) gfx_state_forget_value((GfxStateCache*)user, gfx_state_constant_buffer(GfxStage_Vertex, 0), GFX_STATE_CONSTANT_BUFFERS, buffer);
+}
+
+internal b32 gl_gfx_create_texture(void* user, const GfxTextureDesc* desc, GfxNative* native, GfxNative* view) {
+	gluint texture = 0;
+	glGenTextures(1, &texture);
+	if(!texture) return false;
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glenum format = gl_gfx_texture_format(desc);
+	b32 compressed = cooked_format_is_block_compressed(desc->format);
+	for(u32 level = 0; level < desc->level_count; level++) {
+		u32 width = Max(desc->width >> level, 1u);
+		u32 height = Max(desc->height >> level, 1u);
+		if(compressed) {
+			u32 size = ((width + 3) / 4) * ((height + 3) / 4) * cooked_format_unit_size(desc->format);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, size, 0);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, desc->level_count - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, desc->level_count - 1);
+	if(user) gl_state_forget_texture((GfxStateCache*)user);
+	native->value = texture;
+	return true;
+}
+
+internal void gl_gfx_upload_texture(void* user, const GfxTextureDesc* desc, GfxNative native, u32 level, u32 row, u32 row_count,
+																		const u8* data, u32 row_pitch, b32 level_complete) {
+	glBindTexture(GL_TEXTURE_2D, (gluint)native.value);
+	u32 width = Max(desc->width >> level, 1u);
+	u32 height = Max(desc->height >> level, 1u);
+	if(cooked_format_is_block_compressed(desc->format)) {
+		// Rows of blocks, tightly packed. A band that ends at the bottom edge may be short of 4 pixels.
+		u32 y = row * 4;
+		u32 band_height = Min(row_count * 4, height - y);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, band_height, gl_gfx_texture_format(desc), row_count * row_pitch, data);
+	} else {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, row_pitch / 4);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, row, width, row_count, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+	if(level_complete) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	if(user) gl_state_forget_texture((GfxStateCache*)user);
+}
+
+internal void gl_gfx_destroy_texture(void* user, GfxNative native, GfxNative view) {
+	gluint texture = (gluint)native.value;
+	glDeleteTextures(1, &texture);
+	if(user) gfx_state_forget_value((GfxStateCache*)user, gfx_state_texture(GfxStage_Pixel, 0), GFX_STATE_TEXTURES, texture);
+}
+
+// `state` may be 0.
+internal GfxBackend gl_gfx_backend(GfxStateCache* state) {
+	GfxBackend backend = {};
+	backend.name = "gl";
+	backend.user = state;
+	backend.create_buffer = gl_gfx_create_buffer;
+	backend.update_buffer = gl_gfx_update_buffer;
+	backend.destroy_buffer = gl_gfx_destroy_buffer;
+	backend.create_texture = gl_gfx_create_texture;
+	backend.upload_texture = gl_gfx_upload_texture;
+	backend.destroy_texture = gl_gfx_destroy_texture;
+	return backend;
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+// Persistent OpenGL program-binary cache.
+//
+// Compiling and linking GLSL is by far the slowest part of startup once there
+// are more than a handful of programs. gl_program_cache_get() hashes the
+// shader stages, their sources and the defines into a key and looks for
+// <directory>/<key>.glprog. If it holds a binary from the same driver it is
+// handed to glProgramBinary and no GLSL is compiled at all; otherwise (first
+// launch, edited shader, new driver, or a binary the driver refuses) the
+// program is built from source as usual, and glGetProgramBinary's output is
+// written back for the next launch.
+//
+// Every entry also remembers how long building it from source took, so hits
+// can report the startup time they saved.
+//
+// File layout:
+//   GLProgramCacheHeader
+//   binary   (binary_size bytes, as returned by glGetProgramBinary)
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "platform/os.h"
+#include "third_party/glad/glad.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define GL_PROGRAM_CACHE_MAGIC       0x43504745u   // "EGPC"
+#define GL_PROGRAM_CACHE_VERSION     1
+#define GL_PROGRAM_CACHE_MAX_STAGES  5
+#define GL_PROGRAM_CACHE_MAX_FORMATS 16
+
+struct GLShaderStage {
+	glenum type;          // GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, ...
+	const char* source;
+};
+
+struct GLProgramDesc {
+	const char* name;     // Only used in error messages.
+	const GLShaderStage* stages;
+	u32 stage_count;
+	const char* defines;  // Optional, inserted into every stage right after its #version line.
+};
+
+struct GLProgramCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 key;              // gl_program_key() of the program.
+	u64 driver;           // gl_program_driver_hash() of the driver that produced the binary.
+	u32 binary_format;
+	u32 binary_size;
+	f64 build_seconds;    // Compile + link from source, what a hit saves.
+	u64 checksum;         // Of the binary, catches truncated or damaged files.
+};
+
+struct GLProgramCacheStats {
+	u32 hits;
+	u32 misses;           // No entry for the key.
+	u32 rejected;         // An entry existed but was for another driver, an unsupported format, or failed to load.
+	u32 stores;
+	u32 store_failures;
+	f64 load_seconds;     // Spent on hits.
+	f64 build_seconds;    // Spent compiling on misses and rejections.
+	f64 saved_seconds;    // Build time of the hits minus what loading them took.
+};
+
+struct GLProgramCache {
+	char directory[OS_MAX_PATH - 32];   // Leaves room for the entry names.
+	u64 driver;
+	b32 enabled;          // False if the driver exposes no binary formats, every program is then built from source.
+	u32 format_count;
+	glint formats[GL_PROGRAM_CACHE_MAX_FORMATS];
+	GLProgramCacheStats stats;
+	char error[1024];     // Compile/link log of the last failure.
+};
+
+//------------------------------------------------------------------------
+// Keys
+//------------------------------------------------------------------------
+
+internal u64 gl_program_hash_bytes(u64 hash, const void* data, u64 size) {
+	const u8* bytes = (const u8*)data;
+	for(u64 i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+internal u64 gl_program_hash_string(u64 hash, const char* string) {
+	// The terminator is hashed too, so ("ab", "c") and ("a", "bc") differ.
+	return gl_program_hash_bytes(hash, string ? string : "", string ? strlen(string) + 1 : 1);
+}
+
+// Identifies the program independently of the driver: stage types, sources and defines.
+internal u64 gl_program_key(const GLProgramDesc* desc) {
+	u32 version = GL_PROGRAM_CACHE_VERSION;
+	u64 hash = gl_program_hash_bytes(0xcbf29ce484222325ull, &version, sizeof(version));
+	for(u32 i = 0; i < desc->stage_count; i++) {
+		hash = gl_program_hash_bytes(hash, &desc->stages[i].type, sizeof(desc->stages[i].type));
+		hash = gl_program_hash_string(hash, desc->stages[i].source);
+	}
+	return gl_program_hash_string(hash, desc->defines);
+}
+
+// Binaries are only valid for the driver build that produced them. GL_VERSION
+// carries the driver version on every vendor we care about.
+internal u64 gl_program_driver_hash() {
+	u64 hash = 0xcbf29ce484222325ull;
+	hash = gl_program_hash_string(hash, (const char*)glGetString(GL_VENDOR));
+	hash = gl_program_hash_string(hash, (const char*)glGetString(GL_RENDERER));
+	hash = gl_program_hash_string(hash, (const char*)glGetString(GL_VERSION));
+	return hash;
+}
+
+//------------------------------------------------------------------------
+// Building from source
+//------------------------------------------------------------------------
+
+// Where the info log goes after a prefix snprintf() returned `length` for. That is
+// what it wanted to write rather than what fit, so it is clamped to the buffer.
+// Returns the room left for the log, 0 when there is none worth asking for.
+internal glsizei gl_program_log_room(s32 length, u64 error_size, u64* used) {
+	*used = length < 0 || error_size == 0 ? 0 : Min((u64)length, error_size - 1);
+	u64 room = error_size - *used;
+	return room > 1 ? (glsizei)Min(room, (u64)0x7fffffff) : 0;
+}
+
+// Compiles and links the program. Returns 0 on failure with the log in `error`.
+// `retrievable` asks the driver to keep the binary around for glGetProgramBinary.
+internal gluint gl_program_build(const GLProgramDesc* desc, b32 retrievable, char* error, u64 error_size) {
+	if(desc->stage_count == 0 || desc->stage_count > GL_PROGRAM_CACHE_MAX_STAGES) {
+		snprintf(error, error_size, "%s: %u stages", desc->name, desc->stage_count);
+		return 0;
+	}
+
+	gluint shaders[GL_PROGRAM_CACHE_MAX_STAGES] = {};
+	gluint program = glCreateProgram();
+	b32 ok = true;
+	for(u32 i = 0; i < desc->stage_count && ok; i++) {
+		// Defines go after the #version line, which has to stay first.
+		const char* source = desc->stages[i].source;
+		const char* defines = desc->defines ? desc->defines : "";
+		const char* body = source;
+		if(strncmp(source, "#version", 8) == 0) {
+			const char* newline = strchr(source, '\n');
+			body = newline ? newline + 1 : source + strlen(source);
+		}
+		const char* strings[3] = { source, defines, body };
+		glint lengths[3] = { (glint)(body - source), -1, -1 };
+
+		shaders[i] = glCreateShader(desc->stages[i].type);
+		glShaderSource(shaders[i], 3, strings, lengths);
+		glCompileShader(shaders[i]);
+
+		glint compiled = 0;
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+		if(!compiled) {
+			u64 used;
+			glsizei room = gl_program_log_room(snprintf(error, error_size, "%s: stage %u failed to compile\n", desc->name, i), error_size, &used);
+			if(room) glGetShaderInfoLog(shaders[i], room, nullptr, error + used);
+			ok = false;
+		}
+		glAttachShader(program, shaders[i]);
+	}
+
+	if(ok) {
+		if(retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		glint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if(!linked) {
+			u64 used;
+			glsizei room = gl_program_log_room(snprintf(error, error_size, "%s: failed to link\n", desc->name), error_size, &used);
+			if(room) glGetProgramInfoLog(program, room, nullptr, error + used);
+			ok = false;
+		}
+	}
+
+	for(u32 i = 0; i < desc->stage_count; i++) {
+		if(!shaders[i]) continue;
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	if(!ok) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+//------------------------------------------------------------------------
+// Cache
+//------------------------------------------------------------------------
+
+// Needs a current context. `directory` is created if it does not exist.
+internal b32 gl_program_cache_init(GLProgramCache* cache, const char* directory) {
+	*cache = {};
+	u64 length = strlen(directory);
+	if(length >= sizeof(cache->directory)) return false;
+	memcpy(cache->directory, directory, length + 1);
+	cache->driver = gl_program_driver_hash();
+
+	// glGetIntegerv writes every format, so query into a buffer that is surely big enough.
+	glint format_count = 0;
+	glint formats[256] = {};
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	if(format_count > 0 && format_count <= (glint)ArrayCount(formats)) {
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
+		cache->format_count = Min((u32)format_count, (u32)GL_PROGRAM_CACHE_MAX_FORMATS);
+		memcpy(cache->formats, formats, cache->format_count * sizeof(glint));
+	}
+	cache->enabled = cache->format_count > 0 && os_make_directory(directory);
+	return cache->enabled;
+}
+
+internal void gl_program_cache_path(const GLProgramCache* cache, u64 key, char* path, u64 path_size) {
+	snprintf(path, path_size, "%s/%016llx.glprog", cache->directory, (unsigned long long)key);
+}
+
+internal b32 gl_program_cache_supports(const GLProgramCache* cache, u32 format) {
+	for(u32 i = 0; i < cache->format_count; i++) {
+		if((u32)cache->formats[i] == format) return true;
+	}
+	return false;
+}
+
+// Creates a program from the entry for `key`, or returns 0 if there is none
+// (*found == false) or it cannot be used (*found == true).
+internal gluint gl_program_cache_load(GLProgramCache* cache, u64 key, b32* found, f64* build_seconds) {
+	char path[OS_MAX_PATH];
+	gl_program_cache_path(cache, key, path, sizeof(path));
+	OS_FileMap file;
+	*found = os_file_map_open(&file, path);
+	if(!*found) return 0;
+
+	const GLProgramCacheHeader* header = (const GLProgramCacheHeader*)file.data;
+	const u8* binary = file.data + sizeof(GLProgramCacheHeader);
+	b32 valid = file.size >= sizeof(GLProgramCacheHeader) &&
+							header->magic == GL_PROGRAM_CACHE_MAGIC &&
+							header->version == GL_PROGRAM_CACHE_VERSION &&
+							header->key == key &&
+							header->driver == cache->driver &&
+							file.size - sizeof(GLProgramCacheHeader) == header->binary_size &&
+							gl_program_cache_supports(cache, header->binary_format) &&
+							gl_program_hash_bytes(0xcbf29ce484222325ull, binary, header->binary_size) == header->checksum;
+
+	gluint program = 0;
+	if(valid) {
+		// The driver may still refuse it (e.g. a binary it can no longer use), that surfaces as a failed link.
+		program = glCreateProgram();
+		glProgramBinary(program, header->binary_format, binary, (glsizei)header->binary_size);
+		glint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if(!linked) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+		*build_seconds = header->build_seconds;
+	}
+	os_file_map_close(&file);
+	return program;
+}
+
+// Writes through a temporary file and renames it over the entry, so a crash
+// mid-write never leaves a truncated entry behind.
+internal b32 gl_program_cache_store(GLProgramCache* cache, u64 key, gluint program, f64 build_seconds) {
+	glint binary_size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+	if(binary_size <= 0) return false;
+
+	u64 file_size = sizeof(GLProgramCacheHeader) + (u64)binary_size;
+	ArenaTemp scratch = arena_scratch_begin();
+	u8* memory = ArenaPushArray(scratch.arena, u8, file_size);
+	if(!memory) {
+		arena_scratch_end(scratch);
+		return false;
+	}
+
+	GLProgramCacheHeader* header = (GLProgramCacheHeader*)memory;
+	u8* binary = memory + sizeof(GLProgramCacheHeader);
+	glenum format = 0;
+	glsizei written = 0;
+	glGetProgramBinary(program, binary_size, &written, &format, binary);
+
+	b32 ok = written == binary_size;
+	if(ok) {
+		header->magic = GL_PROGRAM_CACHE_MAGIC;
+		header->version = GL_PROGRAM_CACHE_VERSION;
+		header->key = key;
+		header->driver = cache->driver;
+		header->binary_format = format;
+		header->binary_size = (u32)written;
+		header->build_seconds = build_seconds;
+		header->checksum = gl_program_hash_bytes(0xcbf29ce484222325ull, binary, (u64)written);
+
+		char path[OS_MAX_PATH];
+		char temp_path[OS_MAX_PATH + 4];
+		gl_program_cache_path(cache, key, path, sizeof(path));
+		snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+		FILE* file = fopen(temp_path, "wb");
+		ok = file && fwrite(memory, 1, file_size, file) == file_size;
+		if(file) ok = fclose(file) == 0 && ok;
+		if(ok) {
+			remove(path);
+			ok = rename(temp_path, path) == 0;
+		}
+		if(!ok) remove(temp_path);
+	}
+	arena_scratch_end(scratch);
+	return ok;
+}
+
+// Returns a linked program, from the cache if possible. Returns 0 only if the
+// sources themselves fail to build, with the log in cache->error.
+internal gluint gl_program_cache_get(GLProgramCache* cache, const GLProgramDesc* desc) {
+	f64 start = os_now_seconds();
+	u64 key = gl_program_key(desc);
+	if(cache->enabled) {
+		b32 found = false;
+		f64 build_seconds = 0.0;
+		gluint program = gl_program_cache_load(cache, key, &found, &build_seconds);
+		if(program) {
+			f64 seconds = os_now_seconds() - start;
+			cache->stats.hits++;
+			cache->stats.load_seconds += seconds;
+			cache->stats.saved_seconds += Max(build_seconds - seconds, 0.0);
+			return program;
+		}
+		if(found) cache->stats.rejected++;
+		else      cache->stats.misses++;
+	} else {
+		cache->stats.misses++;
+	}
+
+	f64 build_start = os_now_seconds();
+	gluint program = gl_program_build(desc, cache->enabled, cache->error, sizeof(cache->error));
+	f64 build_seconds = os_now_seconds() - build_start;
+	cache->stats.build_seconds += build_seconds;
+	if(program && cache->enabled) {
+		if(gl_program_cache_store(cache, key, program, build_seconds)) cache->stats.stores++;
+		else                                                        cache->stats.store_failures++;
+	}
+	return program;
+}
+
+// Share of lookups served from the cache, 0..1.
+internal f64 gl_program_cache_hit_rate(const GLProgramCacheStats* stats) {
+	u32 lookups = stats->hits + stats->misses + stats->rejected;
+	return lookups ? (f64)stats->hits / (f64)lookups : 0.0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// GPU skinning with a palette from scene/anim.h.
+//
+// The palette goes up in a uniform buffer as anim_palette_pack() lays it out,
+// three vec4 per bone (std140 packs a vec4 array tightly), and the vertex
+// shader below blends the bones of each vertex the same way skin_vertices()
+// does on the CPU. Vertices are scene/skin.h's SkinVertex straight from the
+// vertex buffer: the bone indices are read as integers (glVertexAttribIPointer).
+//
+// Per frame: gl_skin_palette_upload() once per skinned mesh, before its draw.
+// The block is bound to GL_SKIN_PALETTE_BINDING; gl_skin_bind_program() points
+// a program's block there once after linking.
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "scene/anim.h"
+#include "scene/skin.h"
+#include "third_party/glad/glad.h"
+
+#include <cstddef>
+
+#define GL_SKIN_PALETTE_BINDING  1
+#define GL_SKIN_PALETTE_SIZE     (ANIM_MAX_BONES * 12 * sizeof(f32))    // 12 KB, under the 16 KB every GL 3.3 driver allows.
+
+// Attribute locations 0 position, 1 texcoord, 2 weights, 3 bones. The
+// palette block's size has to match ANIM_MAX_BONES.
+global const char* g_gl_skin_vertex_shader =
+	"#version 330 core\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec2 texcoord;\n"
+	"layout(location = 2) in vec4 weights;\n"
+	"layout(location = 3) in uvec4 bones;\n"
+	"layout(std140) uniform SkinPalette {\n"
+	"	vec4 palette[3 * 256];\n"
+	"};\n"
+	"uniform mat4 view_projection;\n"
+	"out vec2 uv;\n"
+	"vec4 blend_row(int row) {\n"
+	"	return weights.x * palette[int(bones.x) * 3 + row] + weights.y * palette[int(bones.y) * 3 + row] +\n"
+	"	       weights.z * palette[int(bones.z) * 3 + row] + weights.w * palette[int(bones.w) * 3 + row];\n"
+	"}\n"
+	"void main() {\n"
+	"	vec4 p = vec4(position, 1.0);\n"
+	"	vec3 skinned = vec3(dot(p, blend_row(0)), dot(p, blend_row(1)), dot(p, blend_row(2)));\n"
+	"	gl_Position = view_projection * vec4(skinned, 1.0);\n"   // A row-major Mat4 uploaded as is, so v * view_projection.
+	"	uv = texcoord;\n"
+	"}\n";
+
+internal gluint gl_skin_palette_create() {
+	gluint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, GL_SKIN_PALETTE_SIZE, 0, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return buffer;
+}
+
+internal void gl_skin_palette_destroy(gluint buffer) {
+	glDeleteBuffers(1, &buffer);
+}
+
+// Packs and uploads `bone_count` palette matrices and binds the buffer for the next draws.
+internal void gl_skin_palette_upload(gluint buffer, const Mat4* palette, u32 bone_count) {
+	f32 packed[ANIM_MAX_BONES * 12];
+	bone_count = Min(bone_count, (u32)ANIM_MAX_BONES);
+	anim_palette_pack(palette, bone_count, packed);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, bone_count * 12 * sizeof(f32), packed);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, GL_SKIN_PALETTE_BINDING, buffer);
+}
+
+internal void gl_skin_bind_program(gluint program) {
+	gluint block = glGetUniformBlockIndex(program, "SkinPalette");
+	if(block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, GL_SKIN_PALETTE_BINDING);
+}
+
+// Attribute pointers for SkinVertex in the bound GL_ARRAY_BUFFER and vertex array.
+internal void gl_skin_vertex_layout() {
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (const void*)offsetof(SkinVertex, position));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (const void*)offsetof(SkinVertex, texture));
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (const void*)offsetof(SkinVertex, weights));
+	glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(SkinVertex), (const void*)offsetof(SkinVertex, bones));
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// OpenGL binds through a GfxStateCache (gfx/state.h): each call is made only
+// when it changes something.
+//
+// GL has one table of texture units and one of uniform buffer bindings for
+// all stages, they are kept as the pixel stage's textures and the vertex
+// stage's constant buffers. glBindTexture() acts on the active unit, so
+// gl_state_bind_texture() selects the unit first, through the cache as well.
+// Code that binds textures behind the cache's back (gl/gfx.h uploads do)
+// calls gl_state_forget_texture() afterwards.
+
+#include "basic/types.h"
+#include "gfx/state.h"
+#include "third_party/glad/glad.h"
+
+internal void gl_state_use_program(GfxStateCache* cache, gluint program) {
+	if(gfx_state_set(cache, GfxState_VertexShader, program)) glUseProgram(program);
+}
+
+internal void gl_state_bind_vertex_array(GfxStateCache* cache, gluint vertex_array) {
+	if(gfx_state_set(cache, GfxState_InputLayout, vertex_array)) glBindVertexArray(vertex_array);
+}
+
+internal void gl_state_bind_texture(GfxStateCache* cache, u32 unit, gluint texture) {
+	if(!gfx_state_set(cache, gfx_state_texture(GfxStage_Pixel, unit), texture)) return;
+	if(gfx_state_set(cache, GfxState_ActiveTexture, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+// After a glBindTexture() the cache did not see, on whatever unit is active.
+internal void gl_state_forget_texture(GfxStateCache* cache) {
+	if(gfx_state_is_known(cache, GfxState_ActiveTexture)) {
+		gfx_state_forget(cache, gfx_state_texture(GfxStage_Pixel, (u32)cache->values[GfxState_ActiveTexture][0]));
+		return;
+	}
+	for(u32 unit = 0; unit < GFX_STATE_TEXTURES; unit++) gfx_state_forget(cache, gfx_state_texture(GfxStage_Pixel, unit));
+}
+
+internal void gl_state_bind_uniform_buffer(GfxStateCache* cache, u32 index, gluint buffer) {
+	if(gfx_state_set(cache, gfx_state_constant_buffer(GfxStage_Vertex, index), buffer)) glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+}
+
+internal void gl_state_bind_framebuffer(GfxStateCache* cache, gluint framebuffer) {
+	if(gfx_state_set(cache, GfxState_RenderTargets, framebuffer)) glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+}
+
+internal void gl_state_viewport(GfxStateCache* cache, s32 x, s32 y, s32 width, s32 height) {
+	u64 origin = ((u64)(u32)y << 32) | (u32)x;
+	u64 size = ((u64)(u32)height << 32) | (u32)width;
+	if(gfx_state_set2(cache, GfxState_Viewport, origin, size)) glViewport(x, y, width, height);
+}
+
+internal void gl_state_depth_test(GfxStateCache* cache, b32 enabled) {
+	if(!gfx_state_set(cache, GfxState_DepthStencil, enabled != 0)) return;
+	if(enabled) glEnable(GL_DEPTH_TEST);
+	else glDisable(GL_DEPTH_TEST);
+}
+
+internal void gl_state_blend(GfxStateCache* cache, b32 enabled) {
+	if(!gfx_state_set(cache, GfxState_Blend, enabled != 0)) return;
+	if(enabled) glEnable(GL_BLEND);
+	else glDisable(GL_BLEND);
+}
+
+internal void gl_state_cull_face(GfxStateCache* cache, b32 enabled) {
+	if(!gfx_state_set(cache, GfxState_Rasterizer, enabled != 0)) return;
+	if(enabled) glEnable(GL_CULL_FACE);
+	else glDisable(GL_CULL_FACE);
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+// Thin OS layer for the bits of the codebase that have to run both on the
+// Windows samples and on headless Linux tools.
+
+#include "basic/types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#if defined(_WIN32)
+	#define OS_WINDOWS 1
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#elif defined(__linux__)
+	#define OS_LINUX 1
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <time.h>
+	#include <unistd.h>
+#else
+	#error "Platform not supported."
+#endif
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+//------------------------------------------------------------------------
+// Read-only file mapping
+//------------------------------------------------------------------------
+
+struct OS_FileMap {
+	const u8* data;
+	u64 size;
+#if OS_WINDOWS
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+// Maps the whole file read-only. The pages are only faulted in as they are
+// touched, so parsing a header does not pull in the entire file.
+internal b32 os_file_map_open(OS_FileMap* map, const char* path) {
+	*map = {};
+#if OS_WINDOWS
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+													FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(map->file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(map->file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(map->file);
+		return false;
+	}
+
+	map->mapping = CreateFileMappingA(map->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(!map->mapping) {
+		CloseHandle(map->file);
+		return false;
+	}
+
+	map->data = (const u8*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!map->data) {
+		CloseHandle(map->mapping);
+		CloseHandle(map->file);
+		return false;
+	}
+	map->size = (u64)file_size.QuadPart;
+#else
+	map->fd = open(path, O_RDONLY);
+	if(map->fd < 0) return false;
+
+	struct stat st;
+	if(fstat(map->fd, &st) != 0 || st.st_size == 0) {
+		close(map->fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+	if(data == MAP_FAILED) {
+		close(map->fd);
+		return false;
+	}
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	map->data = (const u8*)data;
+	map->size = (u64)st.st_size;
+#endif
+	return true;
+}
+
+internal void os_file_map_close(OS_FileMap* map) {
+	if(!map->data) return;
+#if OS_WINDOWS
+	UnmapViewOfFile(map->data);
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+#else
+	munmap((void*)map->data, map->size);
+	close(map->fd);
+#endif
+	*map = {};
+}
+
+//------------------------------------------------------------------------
+// Directories
+//------------------------------------------------------------------------
+
+#define OS_MAX_PATH 1024
+
+// `path` is relative to the root passed to os_list_files() and '/' separated.
+typedef void OS_FileVisitFunc(void* user, const char* path);
+
+internal b32 os_list_files_recursive(char* path, u64 root_length, u64 length, OS_FileVisitFunc* func, void* user) {
+#if OS_WINDOWS
+	if(length + 3 >= OS_MAX_PATH) return false;
+	memcpy(path + length, "/*", 3);
+
+	WIN32_FIND_DATAA find;
+	HANDLE handle = FindFirstFileA(path, &find);
+	if(handle == INVALID_HANDLE_VALUE) return false;
+
+	b32 ok = true;
+	do {
+		const char* name = find.cFileName;
+		if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+		u64 name_length = strlen(name);
+		if(length + 1 + name_length >= OS_MAX_PATH) { ok = false; break; }
+		path[length] = '/';
+		memcpy(path + length + 1, name, name_length + 1);
+
+		if(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			ok = os_list_files_recursive(path, root_length, length + 1 + name_length, func, user) && ok;
+		} else {
+			func(user, path + root_length + 1);
+		}
+	} while(FindNextFileA(handle, &find));
+	FindClose(handle);
+#else
+	path[length] = 0;
+	DIR* dir = opendir(path);
+	if(!dir) return false;
+
+	b32 ok = true;
+	for(struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+		const char* name = entry->d_name;
+		if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+		u64 name_length = strlen(name);
+		if(length + 1 + name_length >= OS_MAX_PATH) { ok = false; break; }
+		path[length] = '/';
+		memcpy(path + length + 1, name, name_length + 1);
+
+		struct stat st;
+		if(stat(path, &st) != 0) continue;
+		if(S_ISDIR(st.st_mode)) {
+			ok = os_list_files_recursive(path, root_length, length + 1 + name_length, func, user) && ok;
+		} else if(S_ISREG(st.st_mode)) {
+			func(user, path + root_length + 1);
+		}
+	}
+	closedir(dir);
+#endif
+	return ok;
+}
+
+// Calls `func` for every regular file under `root`, recursively, in directory
+// order (callers that need a stable order sort the paths themselves).
+internal b32 os_list_files(const char* root, OS_FileVisitFunc* func, void* user) {
+	char path[OS_MAX_PATH];
+	u64 length = strlen(root);
+	while(length > 1 && (root[length - 1] == '/' || root[length - 1] == '\\')) length--;
+	if(length == 0 || length >= OS_MAX_PATH) return false;
+	memcpy(path, root, length);
+	path[length] = 0;
+	return os_list_files_recursive(path, length, length, func, user);
+}
+
+// Creates `path` if it does not exist yet (the parent has to exist).
+internal b32 os_make_directory(const char* path) {
+#if OS_WINDOWS
+	return CreateDirectoryA(path, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	struct stat st;
+	return mkdir(path, 0755) == 0 || (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+#endif
+}
+
+//------------------------------------------------------------------------
+// Memory
+//------------------------------------------------------------------------
+
+#define OS_LARGE_PAGE_SIZE MB(2)
+
+// Every call that asks the OS for memory, for checking that steady-state
+// code does not allocate: read it before and after a frame.
+struct OS_MemoryCounters {
+	std::atomic<u64> allocations;    // os_alloc_pages() and os_reserve_pages().
+	std::atomic<u64> commits;        // os_commit_pages().
+	std::atomic<u64> committed;      // Bytes, reserved ones only once committed.
+};
+
+global OS_MemoryCounters g_os_memory;
+
+internal u64 os_memory_requests() {
+	return g_os_memory.allocations.load(std::memory_order_relaxed) + g_os_memory.commits.load(std::memory_order_relaxed);
+}
+
+// Page granular allocations straight from the OS, zeroed and at least 4 KiB aligned.
+internal void* os_alloc_pages(u64 size) {
+	g_os_memory.allocations.fetch_add(1, std::memory_order_relaxed);
+	g_os_memory.committed.fetch_add(size, std::memory_order_relaxed);
+#if OS_WINDOWS
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return result == MAP_FAILED ? nullptr : result;
+#endif
+}
+
+internal void os_free_pages(void* ptr, u64 size) {
+	if(!ptr) return;
+	g_os_memory.committed.fetch_sub(size, std::memory_order_relaxed);
+#if OS_WINDOWS
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, size);
+#endif
+}
+
+// Address space only: nothing is usable until os_commit_pages(). With
+// `large_pages` the range is OS_LARGE_PAGE_SIZE aligned and Linux is asked to
+// back it with transparent huge pages. Windows large pages have to be
+// committed up front and need a privilege, so there the hint is ignored.
+internal void* os_reserve_pages(u64 size, b32 large_pages) {
+	g_os_memory.allocations.fetch_add(1, std::memory_order_relaxed);
+#if OS_WINDOWS
+	return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	if(!large_pages) {
+		void* result = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return result == MAP_FAILED ? nullptr : result;
+	}
+	// Over-reserve, then trim to an aligned range.
+	u64 padded = size + OS_LARGE_PAGE_SIZE;
+	void* result = mmap(nullptr, padded, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(result == MAP_FAILED) return nullptr;
+	u8* start = (u8*)result;
+	u8* aligned = (u8*)AlignPow2((u64)start, OS_LARGE_PAGE_SIZE);
+	if(aligned > start) munmap(start, (u64)(aligned - start));
+	u8* end = aligned + size;
+	if(end < start + padded) munmap(end, (u64)(start + padded - end));
+	#if defined(MADV_HUGEPAGE)
+		madvise(aligned, size, MADV_HUGEPAGE);
+	#endif
+	return aligned;
+#endif
+}
+
+// Makes [ptr, ptr + size) of a reservation readable and writable. Fresh pages
+// read as zero.
+internal b32 os_commit_pages(void* ptr, u64 size) {
+	g_os_memory.commits.fetch_add(1, std::memory_order_relaxed);
+	g_os_memory.committed.fetch_add(size, std::memory_order_relaxed);
+#if OS_WINDOWS
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+// Hands the pages back but keeps the address range reserved.
+internal void os_decommit_pages(void* ptr, u64 size) {
+	g_os_memory.committed.fetch_sub(size, std::memory_order_relaxed);
+#if OS_WINDOWS
+	VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+	madvise(ptr, size, MADV_DONTNEED);
+	mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+// Releases a whole reservation, committed or not.
+internal void os_release_pages(void* ptr, u64 reserved, u64 committed) {
+	if(!ptr) return;
+	g_os_memory.committed.fetch_sub(committed, std::memory_order_relaxed);
+#if OS_WINDOWS
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, reserved);
+#endif
+}
+
+//------------------------------------------------------------------------
+// CPU
+//------------------------------------------------------------------------
+
+enum OS_CPUFeature : u32 {
+	OS_CPUFeature_AVX2   = 1 << 0,    // AVX2 + FMA, x86-64-v3.
+	OS_CPUFeature_AVX512 = 1 << 1,    // AVX-512 F/CD/BW/DQ/VL, x86-64-v4.
+};
+
+internal void os_cpuid(u32 leaf, u32 subleaf, u32 out[4]) {
+#if defined(_MSC_VER)
+	__cpuidex((int*)out, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+// Instruction sets the CPU has and the OS saves the registers of, for
+// picking a kernel at runtime. Compile-time flags (__AVX2__) only say what the
+// rest of the binary was built for.
+internal u32 os_cpu_features() {
+	u32 leaf0[4], leaf1[4], leaf7[4] = {};
+	os_cpuid(0, 0, leaf0);
+	if(leaf0[0] < 1) return 0;
+	os_cpuid(1, 0, leaf1);
+	if(leaf0[0] >= 7) os_cpuid(7, 0, leaf7);
+
+	// OSXSAVE, then XCR0 for the YMM (and opmask/ZMM) state.
+	if(!(leaf1[2] & (1u << 27))) return 0;
+#if defined(_MSC_VER)
+	u64 xcr0 = _xgetbv(0);
+#else
+	u32 xcr0_low, xcr0_high;
+	__asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	u64 xcr0 = ((u64)xcr0_high << 32) | xcr0_low;
+#endif
+
+	u32 result = 0;
+	b32 avx = (leaf1[2] & (1u << 28)) && (xcr0 & 0x06) == 0x06;
+	b32 fma = (leaf1[2] & (1u << 12)) != 0;
+	b32 avx2 = (leaf7[1] & (1u << 5)) != 0;
+	if(avx && fma && avx2) result |= OS_CPUFeature_AVX2;
+
+	const u32 avx512_bits = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+	if((result & OS_CPUFeature_AVX2) && (xcr0 & 0xe6) == 0xe6 && (leaf7[1] & avx512_bits) == avx512_bits) {
+		result |= OS_CPUFeature_AVX512;
+	}
+	return result;
+}
+
+//------------------------------------------------------------------------
+// Threads
+//------------------------------------------------------------------------
+
+internal u32 os_logical_core_count() {
+#if OS_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return Max((u32)info.dwNumberOfProcessors, 1u);
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (u32)count : 1u;
+#endif
+}
+
+// Most workers one parallel for runs on, the calling thread included. Size
+// per-worker scratch with it.
+#define OS_PARALLEL_MAX_WORKERS 65
+
+typedef void OS_ParallelFunc(void* user, u32 index);
+typedef void OS_ParallelWorkerFunc(void* user, u32 index, u32 worker);
+
+// Number of workers os_parallel_for_workers() runs `count` items on.
+internal u32 os_parallel_worker_count(u32 count, u32 thread_count) {
+	if(thread_count == 0) thread_count = os_logical_core_count();
+	return Max(Min(Min(thread_count, count), (u32)OS_PARALLEL_MAX_WORKERS), 1u);
+}
+
+// The threads behind os_parallel_for_workers(). They are started the first
+// time a call needs them and then sleep between calls, so a per-frame parallel
+// for does not create threads or allocate. One call runs at a time: the caller
+// publishes it, wakes the pool and claims indices itself as worker 0; the
+// first `helpers` threads to wake claim worker numbers 1 and up, the rest go
+// back to sleep. A call made while another is running waits for it, one made
+// from inside a call runs on its own thread.
+//
+// The pool lives in pages that are never freed and its threads are detached,
+// so nothing waits on them at exit.
+
+struct OS_ParallelPool {
+	std::mutex dispatch;         // Held by the calling thread for a whole call.
+	u32 thread_count;            // Started so far, dispatch holder only.
+
+	std::mutex mutex;            // Everything below.
+	std::condition_variable wake;
+	std::condition_variable done;
+	u64 call;                    // Bumped by every call.
+	OS_ParallelWorkerFunc* func;
+	void* user;
+	u32 count;
+	u32 helpers;                 // Threads wanted by the current call.
+	u32 claimed;                 // Worker numbers handed out, up to helpers.
+	u32 running;                 // Helpers not finished yet.
+	std::atomic<u32> next;
+};
+
+global OS_ParallelPool* g_os_parallel;
+global std::once_flag g_os_parallel_once;
+global thread_local b32 t_os_parallel_busy;    // Inside a call, as its caller or a helper.
+
+// Takes indices until there are none left.
+internal void os_parallel_run(OS_ParallelPool* pool, OS_ParallelWorkerFunc* func, void* user, u32 count, u32 worker) {
+	for(u32 i = pool->next.fetch_add(1); i < count; i = pool->next.fetch_add(1)) func(user, i, worker);
+}
+
+internal void os_parallel_thread(OS_ParallelPool* pool, u64 call) {
+	t_os_parallel_busy = true;
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	for(;;) {
+		pool->wake.wait(lock, [pool, call] { return pool->call != call; });
+		call = pool->call;
+		if(pool->claimed == pool->helpers) continue;
+		u32 worker = ++pool->claimed;
+		OS_ParallelWorkerFunc* func = pool->func;
+		void* user = pool->user;
+		u32 count = pool->count;
+		lock.unlock();
+		os_parallel_run(pool, func, user, count, worker);
+		lock.lock();
+		if(--pool->running == 0) pool->done.notify_one();
+	}
+}
+
+internal void os_parallel_pool_init() {
+	void* memory = os_alloc_pages(sizeof(OS_ParallelPool));
+	if(memory) g_os_parallel = new(memory) OS_ParallelPool();
+}
+
+// Calls `func` for every index in [0, count) spread over `thread_count` threads
+// (0 means one per logical core), also passing the worker running it so callers
+// can keep per-worker scratch. Worker 0 is the calling thread, the others are
+// pool threads. Indices are handed out in increasing order and the call
+// returns once every index has run.
+internal void os_parallel_for_workers(u32 count, u32 thread_count, OS_ParallelWorkerFunc* func, void* user) {
+	thread_count = os_parallel_worker_count(count, thread_count);
+	if(thread_count > 1 && !t_os_parallel_busy) std::call_once(g_os_parallel_once, os_parallel_pool_init);
+	OS_ParallelPool* pool = g_os_parallel;
+	if(thread_count <= 1 || t_os_parallel_busy || !pool) {
+		for(u32 i = 0; i < count; i++) func(user, i, 0);
+		return;
+	}
+
+	std::lock_guard<std::mutex> dispatch(pool->dispatch);
+	t_os_parallel_busy = true;
+	u32 helpers = thread_count - 1;
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		for(; pool->thread_count < helpers; pool->thread_count++) std::thread(os_parallel_thread, pool, pool->call).detach();
+		pool->call++;
+		pool->func = func;
+		pool->user = user;
+		pool->count = count;
+		pool->helpers = helpers;
+		pool->claimed = 0;
+		pool->running = helpers;
+		pool->next.store(0, std::memory_order_relaxed);
+	}
+	pool->wake.notify_all();
+
+	os_parallel_run(pool, func, user, count, 0);
+
+	// Every index is taken. Helpers that have not woken yet are not needed.
+	{
+		std::unique_lock<std::mutex> lock(pool->mutex);
+		pool->running -= pool->helpers - pool->claimed;
+		pool->helpers = pool->claimed;
+		pool->done.wait(lock, [pool] { return pool->running == 0; });
+	}
+	t_os_parallel_busy = false;
+}
+
+// Calls `func` for every index in [0, count) spread over `thread_count` threads
+// (0 means one per logical core). The calling thread takes part and the call
+// returns once every index has run.
+internal void os_parallel_for(u32 count, u32 thread_count, OS_ParallelFunc* func, void* user) {
+	struct Forward {
+		OS_ParallelFunc* func;
+		void* user;
+		static void run(void* forward_user, u32 index, u32 worker) {
+			Forward* forward = (Forward*)forward_user;
+			forward->func(forward->user, index);
+		}
+	};
+	Forward forward = { func, user };
+	os_parallel_for_workers(count, thread_count, Forward::run, &forward);
+}
+
+//------------------------------------------------------------------------
+// Time
+//------------------------------------------------------------------------
+
+internal f64 os_now_seconds() {
+#if OS_WINDOWS
+	local LARGE_INTEGER frequency = {};
+	if(frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (f64)counter.QuadPart / (f64)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+#endif
+}
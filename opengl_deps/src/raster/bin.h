@@ -0,0 +1,380 @@
+#pragma once
+
+// Tile-binned, multithreaded drawing for the software rasterizer.
+//
+// Draws are recorded (a copy of the context's state per draw) and run in two
+// parallel passes when the binner is flushed:
+//   front end   the recorded triangles are cut into chunks of
+//               RASTER_BIN_CHUNK. Each chunk runs the vertex shader,
+//               clipping and setup of its triangles on one worker, in
+//               batches of RASTER_CLIP_BATCH, and bins them into the
+//               RASTER_TILE_SIZE screen tiles they overlap, into lists
+//               owned by that chunk, so there is no sharing
+//   back end    every tile is rasterized and shaded by one worker, walking
+//               the chunks' lists in order. Primitive order is kept and no
+//               two workers touch the same pixel, so the framebuffer needs
+//               no locks and the result is identical to raster_draw_indexed()
+//               one draw after the other.
+// A recorded clear runs inside the tile jobs. Tiles are started heaviest
+// first (by binned triangle count) to keep the tail short, and each one's
+// time is kept for reporting.
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "raster/raster.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#define RASTER_TILE_SIZE   64
+#define RASTER_BIN_CHUNK   2048      // Input triangles per front end job.
+#define RASTER_MAX_WORKERS OS_PARALLEL_MAX_WORKERS
+
+struct RasterBinChunk {
+	u32 first_triangle;      // Input triangles [first_triangle, first_triangle + triangle_count) over all draws.
+	u32 triangle_count;
+
+	RasterTriangle* triangles;   // After setup, several per input triangle when clipped.
+	u64 triangles_size;
+	u32 setup_count;
+
+	u32* tile_offsets;       // tile_count + 1 entries into `bin`, then tile_count write cursors.
+	u64 tile_offsets_size;
+	u32* bin;                // Indices into `triangles`, grouped by tile, in submission order.
+	u64 bin_size;
+};
+
+struct RasterTileTiming {
+	f64 seconds;
+	u32 triangles;           // Binned triangles, including those that turned out not to cover a pixel.
+};
+
+struct RasterBinDraw {
+	RasterContext context;   // State at record time.
+	RasterPipeline* pipeline;
+	u32 start_index;
+	s32 base_vertex;
+	u32 first_triangle;      // Of all triangles recorded since the last flush.
+};
+
+struct RasterBinner {
+	RasterTarget* target;
+	u32 thread_count;        // 0 = one per logical core.
+	u32 tiles_x;
+	u32 tiles_y;
+	u32 tile_count;
+
+	// Recorded since the last flush.
+	RasterBinDraw* draws;
+	u64 draws_size;
+	u32 draw_count;
+	u32 triangle_count;
+	b32 clear;
+	u32 clear_colour;
+	u32 clear_depth;
+
+	RasterBinChunk* chunks;
+	u64 chunks_size;
+	u32 chunk_count;
+
+	u32* tile_order;
+	RasterTileTiming* tile_timings;
+
+	RasterStats worker_stats[RASTER_MAX_WORKERS];
+
+	// Of the last flush.
+	RasterStats stats;
+	u64 binned;              // Tile/triangle pairs.
+	f64 front_end_seconds;
+	f64 back_end_seconds;
+};
+
+// Grows a page allocation to at least `size` bytes, keeping its contents.
+internal b32 raster_reserve(void** memory, u64* memory_size, u64 size) {
+	if(size <= *memory_size) return true;
+	u64 new_size = Max(AlignPow2(size, (u64)KB(64)), *memory_size * 2);
+	void* grown = os_alloc_pages(new_size);
+	if(!grown) return false;
+	if(*memory) {
+		memcpy(grown, *memory, *memory_size);
+		os_free_pages(*memory, *memory_size);
+	}
+	*memory = grown;
+	*memory_size = new_size;
+	return true;
+}
+
+#define RasterReserve(pointer, pointer_size, count) raster_reserve((void**)&(pointer), &(pointer_size), (u64)(count) * sizeof(*(pointer)))
+
+internal b32 raster_binner_init(RasterBinner* binner, RasterTarget* target, u32 thread_count) {
+	*binner = {};
+	binner->target = target;
+	binner->thread_count = thread_count;
+	binner->tiles_x = (target->width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	binner->tiles_y = (target->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	binner->tile_count = binner->tiles_x * binner->tiles_y;
+
+	u64 tile_bytes = (u64)binner->tile_count * (sizeof(u32) + sizeof(RasterTileTiming));
+	u8* tiles = (u8*)os_alloc_pages(tile_bytes);
+	binner->tile_order = (u32*)tiles;
+	binner->tile_timings = (RasterTileTiming*)(tiles + (u64)binner->tile_count * sizeof(u32));
+	return tiles != nullptr;
+}
+
+internal void raster_binner_release(RasterBinner* binner) {
+	for(u64 i = 0; i < binner->chunks_size / sizeof(RasterBinChunk); i++) {
+		RasterBinChunk* chunk = &binner->chunks[i];
+		os_free_pages(chunk->triangles, chunk->triangles_size);
+		os_free_pages(chunk->tile_offsets, chunk->tile_offsets_size);
+		os_free_pages(chunk->bin, chunk->bin_size);
+	}
+	os_free_pages(binner->chunks, binner->chunks_size);
+	os_free_pages(binner->draws, binner->draws_size);
+	os_free_pages(binner->tile_order, (u64)binner->tile_count * (sizeof(u32) + sizeof(RasterTileTiming)));
+	*binner = {};
+}
+
+// Recorded, runs at the start of every tile job.
+internal void raster_bin_clear(RasterBinner* binner, const f32 colour[4], f32 depth, u8 stencil) {
+	binner->clear = true;
+	binner->clear_colour = raster_pack_unorm8(colour);
+	binner->clear_depth = raster_depth_to_d24(depth) | ((u32)stencil << 24);
+}
+
+// Records a draw with the state `context` has now. Vertex, index and texture
+// data are referenced, not copied, and have to stay alive until the flush.
+internal b32 raster_bin_draw_indexed(RasterBinner* binner, const RasterContext* context, u32 index_count, u32 start_index, s32 base_vertex) {
+	if(!RasterReserve(binner->draws, binner->draws_size, binner->draw_count + 1)) return false;
+
+	RasterBinDraw* draw = &binner->draws[binner->draw_count++];
+	draw->context = *context;
+	draw->context.target = binner->target;
+	draw->context.stats = {};
+	draw->pipeline = raster_pipeline(&draw->context);
+	draw->start_index = start_index;
+	draw->base_vertex = base_vertex;
+	draw->first_triangle = binner->triangle_count;
+	binner->triangle_count += index_count / 3;
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Front end
+//------------------------------------------------------------------------
+
+internal void raster_tile_range(const RasterTriangle* triangle, u32* tx0, u32* ty0, u32* tx1, u32* ty1) {
+	*tx0 = (u32)triangle->x0 / RASTER_TILE_SIZE;
+	*ty0 = (u32)triangle->y0 / RASTER_TILE_SIZE;
+	*tx1 = (u32)triangle->x1 / RASTER_TILE_SIZE;
+	*ty1 = (u32)triangle->y1 / RASTER_TILE_SIZE;
+}
+
+// Conservative: false only if some edge is negative over the whole tile,
+// found by evaluating each edge at the tile corner where it is largest.
+internal b32 raster_triangle_overlaps_tile(const RasterTriangle* triangle, u32 tx, u32 ty) {
+	s32 x0 = Max((s32)(tx * RASTER_TILE_SIZE), triangle->x0);
+	s32 y0 = Max((s32)(ty * RASTER_TILE_SIZE), triangle->y0);
+	s32 x1 = Min((s32)(tx * RASTER_TILE_SIZE + RASTER_TILE_SIZE - 1), triangle->x1);
+	s32 y1 = Min((s32)(ty * RASTER_TILE_SIZE + RASTER_TILE_SIZE - 1), triangle->y1);
+	for(u32 i = 0; i < 3; i++) {
+		s32 x = triangle->step_x[i] > 0 ? x1 : x0;
+		s32 y = triangle->step_y[i] > 0 ? y1 : y0;
+		s64 edge = triangle->edge[i] + (s64)(x - triangle->x0) * triangle->step_x[i] + (s64)(y - triangle->y0) * triangle->step_y[i];
+		if(edge < 0) return false;
+	}
+	return true;
+}
+
+struct RasterBinJob {
+	RasterBinner* binner;
+	b32 out_of_memory;
+};
+
+internal void raster_bin_chunk_job(void* user, u32 index, u32 worker) {
+	RasterBinJob* job = (RasterBinJob*)user;
+	RasterBinner* binner = job->binner;
+	RasterBinChunk* chunk = &binner->chunks[index];
+	RasterStats* stats = &binner->worker_stats[worker];
+	u32 tile_count = binner->tile_count;
+
+	if(!RasterReserve(chunk->tile_offsets, chunk->tile_offsets_size, 2 * tile_count + 1)) {
+		job->out_of_memory = true;
+		chunk->setup_count = 0;
+		return;
+	}
+	u32* offsets = chunk->tile_offsets;
+	u32* cursors = chunk->tile_offsets + tile_count + 1;
+	memset(offsets, 0, (tile_count + 1) * sizeof(u32));
+
+	// Setup, and count the tiles of every triangle. Draws are found by walking
+	// forward from the one holding the chunk's first triangle.
+	u32 draw = 0;
+	for(u32 count = binner->draw_count; count > 1;) {
+		u32 half = count / 2;
+		if(binner->draws[draw + half].first_triangle <= chunk->first_triangle) draw += half;
+		count -= half;
+	}
+	// Batches never straddle two draws.
+	chunk->setup_count = 0;
+	u32 chunk_end = chunk->first_triangle + chunk->triangle_count;
+	for(u32 t = chunk->first_triangle; t < chunk_end;) {
+		while(draw + 1 < binner->draw_count && binner->draws[draw + 1].first_triangle <= t) draw++;
+		const RasterBinDraw* recorded = &binner->draws[draw];
+		u32 draw_end = draw + 1 < binner->draw_count ? binner->draws[draw + 1].first_triangle : binner->triangle_count;
+		u32 batch = Min(Min(chunk_end, draw_end) - t, (u32)RASTER_CLIP_BATCH);
+		if(!RasterReserve(chunk->triangles, chunk->triangles_size, chunk->setup_count + RASTER_CLIP_BATCH * (RASTER_MAX_CLIP_VERTS - 2))) {
+			job->out_of_memory = true;
+			break;
+		}
+
+		u32 first_index = recorded->start_index + (t - recorded->first_triangle) * 3;
+		RasterTriangle* out = &chunk->triangles[chunk->setup_count];
+		u32 count = raster_assemble_triangles(&recorded->context, first_index, batch, recorded->base_vertex, out, stats);
+		t += batch;
+		for(u32 k = 0; k < count; k++) {
+			out[k].draw = draw;
+			u32 tx0, ty0, tx1, ty1;
+			raster_tile_range(&out[k], &tx0, &ty0, &tx1, &ty1);
+			b32 single = tx0 == tx1 || ty0 == ty1;
+			for(u32 ty = ty0; ty <= ty1; ty++) {
+				for(u32 tx = tx0; tx <= tx1; tx++) {
+					if(single || raster_triangle_overlaps_tile(&out[k], tx, ty)) offsets[ty * binner->tiles_x + tx + 1]++;
+				}
+			}
+		}
+		chunk->setup_count += count;
+	}
+
+	for(u32 i = 0; i < tile_count; i++) {
+		offsets[i + 1] += offsets[i];
+		cursors[i] = offsets[i];
+	}
+	if(!RasterReserve(chunk->bin, chunk->bin_size, offsets[tile_count])) {
+		job->out_of_memory = true;
+		memset(offsets, 0, (tile_count + 1) * sizeof(u32));
+		return;
+	}
+
+	// Same walk again, filling the lists.
+	for(u32 i = 0; i < chunk->setup_count; i++) {
+		const RasterTriangle* triangle = &chunk->triangles[i];
+		u32 tx0, ty0, tx1, ty1;
+		raster_tile_range(triangle, &tx0, &ty0, &tx1, &ty1);
+		b32 single = tx0 == tx1 || ty0 == ty1;
+		for(u32 ty = ty0; ty <= ty1; ty++) {
+			for(u32 tx = tx0; tx <= tx1; tx++) {
+				if(single || raster_triangle_overlaps_tile(triangle, tx, ty)) chunk->bin[cursors[ty * binner->tiles_x + tx]++] = i;
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Back end
+//------------------------------------------------------------------------
+
+internal void raster_tile_job(void* user, u32 index, u32 worker) {
+	RasterBinner* binner = (RasterBinner*)user;
+	RasterTarget* target = binner->target;
+	RasterStats* stats = &binner->worker_stats[worker];
+	u32 tile = binner->tile_order[index];
+	f64 start = os_now_seconds();
+
+	s32 x0 = (s32)((tile % binner->tiles_x) * RASTER_TILE_SIZE);
+	s32 y0 = (s32)((tile / binner->tiles_x) * RASTER_TILE_SIZE);
+	s32 x1 = Min(x0 + RASTER_TILE_SIZE, (s32)target->width) - 1;
+	s32 y1 = Min(y0 + RASTER_TILE_SIZE, (s32)target->height) - 1;
+
+	if(binner->clear) {
+		for(s32 y = y0; y <= y1; y++) {
+			u32* colour = target->colour + (u64)y * target->width;
+			u32* depth = target->depth + (u64)y * target->width;
+			for(s32 x = x0; x <= x1; x++) colour[x] = binner->clear_colour;
+			for(s32 x = x0; x <= x1; x++) depth[x] = binner->clear_depth;
+		}
+	}
+
+	u32 triangles = 0;
+	for(u32 c = 0; c < binner->chunk_count; c++) {
+		const RasterBinChunk* chunk = &binner->chunks[c];
+		for(u32 i = chunk->tile_offsets[tile]; i < chunk->tile_offsets[tile + 1]; i++) {
+			const RasterTriangle* triangle = &chunk->triangles[chunk->bin[i]];
+			const RasterBinDraw* draw = &binner->draws[triangle->draw];
+			draw->pipeline(&draw->context, triangle, x0, y0, x1, y1, stats);
+		}
+		triangles += chunk->tile_offsets[tile + 1] - chunk->tile_offsets[tile];
+	}
+
+	binner->tile_timings[tile].seconds = os_now_seconds() - start;
+	binner->tile_timings[tile].triangles = triangles;
+}
+
+global const RasterTileTiming* g_raster_sort_timings;
+
+internal int raster_compare_tiles(const void* a, const void* b) {
+	u32 ta = g_raster_sort_timings[*(const u32*)a].triangles;
+	u32 tb = g_raster_sort_timings[*(const u32*)b].triangles;
+	if(ta != tb) return ta > tb ? -1 : 1;
+	return *(const u32*)a < *(const u32*)b ? -1 : 1;
+}
+
+// Runs everything recorded since the last flush and resets the recording.
+// Returns false if a bin could not grow, in which case the frame is incomplete.
+internal b32 raster_bin_flush(RasterBinner* binner) {
+	f64 start = os_now_seconds();
+
+	// Front end.
+	RasterBinJob job = { binner, false };
+	binner->chunk_count = (binner->triangle_count + RASTER_BIN_CHUNK - 1) / RASTER_BIN_CHUNK;
+	u64 old_chunks = binner->chunks_size / sizeof(RasterBinChunk);
+	if(!RasterReserve(binner->chunks, binner->chunks_size, binner->chunk_count)) {
+		binner->chunk_count = 0;
+		job.out_of_memory = true;
+	}
+	for(u64 i = old_chunks; i < binner->chunks_size / sizeof(RasterBinChunk); i++) binner->chunks[i] = {};
+	for(u32 i = 0; i < binner->chunk_count; i++) {
+		binner->chunks[i].first_triangle = i * RASTER_BIN_CHUNK;
+		binner->chunks[i].triangle_count = Min(binner->triangle_count - i * RASTER_BIN_CHUNK, (u32)RASTER_BIN_CHUNK);
+	}
+	os_parallel_for_workers(binner->chunk_count, binner->thread_count, raster_bin_chunk_job, &job);
+	f64 front_end_end = os_now_seconds();
+
+	// Back end, heaviest tiles first.
+	binner->binned = 0;
+	for(u32 tile = 0; tile < binner->tile_count; tile++) {
+		u32 triangles = 0;
+		for(u32 c = 0; c < binner->chunk_count; c++) {
+			const RasterBinChunk* chunk = &binner->chunks[c];
+			triangles += chunk->tile_offsets[tile + 1] - chunk->tile_offsets[tile];
+		}
+		binner->tile_timings[tile].triangles = triangles;
+		binner->tile_order[tile] = tile;
+		binner->binned += triangles;
+	}
+	g_raster_sort_timings = binner->tile_timings;
+	qsort(binner->tile_order, binner->tile_count, sizeof(u32), raster_compare_tiles);
+	os_parallel_for_workers(binner->tile_count, binner->thread_count, raster_tile_job, binner);
+	f64 end = os_now_seconds();
+
+	RasterStats* total = &binner->stats;
+	*total = {};
+	total->draws = binner->draw_count;
+	for(u32 i = 0; i < RASTER_MAX_WORKERS; i++) {
+		const RasterStats* s = &binner->worker_stats[i];
+		total->triangles += s->triangles;
+		total->triangles_clipped += s->triangles_clipped;
+		total->triangles_guard_band += s->triangles_guard_band;
+		total->triangles_culled += s->triangles_culled;
+		total->pixels_covered += s->pixels_covered;
+		total->pixels_depth_failed += s->pixels_depth_failed;
+		total->pixels_written += s->pixels_written;
+		binner->worker_stats[i] = {};
+	}
+	binner->front_end_seconds = front_end_end - start;
+	binner->back_end_seconds = end - front_end_end;
+
+	binner->draw_count = 0;
+	binner->triangle_count = 0;
+	binner->clear = false;
+	return !job.out_of_memory;
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+// Software occlusion culling of draws with a masked hierarchical depth buffer.
+//
+// Each frame the large occluders are rasterized into a small depth buffer
+// (a few hundred pixels across, any size that is a multiple of 8) that covers
+// the same viewport as the real target, then the bounding boxes of the
+// objects are tested against it before their DrawIndexed is issued.
+//
+// The buffer follows masked occlusion culling: every 8x8 tile keeps a 64-bit
+// coverage mask and two depths. z_max0 is the farthest depth of the whole
+// tile, and z_max1 is the farthest depth of the pixels in the mask, the
+// working layer. Once the mask is full the working layer becomes the tile's
+// depth, and when a new occluder is much nearer than the working layer that
+// layer is thrown away. Coverage of an 8x8 tile is one call of the
+// rasterizer's SIMD block kernel (raster/raster.h) with the depth test off.
+//
+// After the occluders a hierarchical-Z pyramid is built from the tiles' z_max0,
+// each level the max of 2x2 of the one below. A box is tested at the level
+// where its screen rectangle spans at most 2x2 texels.
+//
+// Like masked occlusion culling the result is conservative except at the
+// buffer's resolution. Occluders cover the buffer pixels whose centres they
+// cover, so an object seen through a crack narrower than a buffer pixel, or
+// past an occluder's edge by less than one, can be culled. Everything else errs
+// towards visible for a LESS depth test:
+//   tile depths are the occluder's plane at the tile's corners
+//   boxes use their nearest corner and all of the tiles they touch
+//   boxes that reach behind the camera are always visible
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "platform/os.h"
+#include "raster/raster.h"
+
+#include <cmath>
+
+#define RASTER_OCCLUSION_MAX_LEVELS 16
+
+struct RasterOcclusionTile {
+	u64 mask;           // Pixels of the working layer, bit row * 8 + column.
+	f32 z_max0;         // Farthest depth in the tile.
+	f32 z_max1;         // Farthest depth of the pixels in `mask`.
+};
+
+struct RasterOcclusionStats {
+	u64 occluder_triangles;     // After clipping and back face culling.
+	u64 tested;
+	u64 visible;
+	u64 occluded;
+	u64 outside;                // Off screen or past the far plane, culled as well.
+	f64 occluder_seconds;       // Rasterizing the occluders and building the pyramid.
+	f64 test_seconds;           // raster_occlusion_test_boxes().
+};
+
+struct RasterOcclusion {
+	u32 width;          // Pixels, multiples of RASTER_BLOCK_SIZE.
+	u32 height;
+	u32 tiles_x;
+	u32 tiles_y;
+	RasterOcclusionTile* tiles;
+
+	u32 level_count;
+	u32 level_width[RASTER_OCCLUSION_MAX_LEVELS];
+	u32 level_height[RASTER_OCCLUSION_MAX_LEVELS];
+	f32* levels[RASTER_OCCLUSION_MAX_LEVELS];   // Level 0 is one texel per tile.
+
+	void* memory;
+	u64 memory_size;
+
+	RasterTarget target;        // Size only, for triangle setup.
+	RasterContext context;      // Matrices and culling of the occluders.
+	Mat4 view_projection;
+	RasterOcclusionStats stats;
+};
+
+// An object's bounds for raster_occlusion_test_boxes(): an axis aligned box
+// in its own space and the world matrix of the draw.
+struct RasterOcclusionBox {
+	Mat4 world;
+	f32 min[3];
+	f32 max[3];
+};
+
+internal b32 raster_occlusion_init(RasterOcclusion* occlusion, u32 width, u32 height) {
+	*occlusion = {};
+	if(width == 0 || height == 0 || width % RASTER_BLOCK_SIZE || height % RASTER_BLOCK_SIZE || width > RASTER_MAX_SIZE ||
+		 height > RASTER_MAX_SIZE) {
+		return false;
+	}
+
+	occlusion->width = width;
+	occlusion->height = height;
+	occlusion->tiles_x = width / RASTER_BLOCK_SIZE;
+	occlusion->tiles_y = height / RASTER_BLOCK_SIZE;
+
+	u64 tile_count = (u64)occlusion->tiles_x * occlusion->tiles_y;
+	u64 size = tile_count * sizeof(RasterOcclusionTile);
+	u32 level_width = occlusion->tiles_x, level_height = occlusion->tiles_y;
+	u64 level_offsets[RASTER_OCCLUSION_MAX_LEVELS];
+	for(;;) {
+		u32 level = occlusion->level_count++;
+		occlusion->level_width[level] = level_width;
+		occlusion->level_height[level] = level_height;
+		level_offsets[level] = size;
+		size += AlignPow2((u64)level_width * level_height * sizeof(f32), (u64)64);
+		if((level_width == 1 && level_height == 1) || occlusion->level_count == RASTER_OCCLUSION_MAX_LEVELS) break;
+		level_width = (level_width + 1) / 2;
+		level_height = (level_height + 1) / 2;
+	}
+
+	occlusion->memory_size = size;
+	occlusion->memory = os_alloc_pages(size);
+	if(!occlusion->memory) return false;
+	occlusion->tiles = (RasterOcclusionTile*)occlusion->memory;
+	for(u32 i = 0; i < occlusion->level_count; i++) occlusion->levels[i] = (f32*)((u8*)occlusion->memory + level_offsets[i]);
+
+	occlusion->target.width = width;
+	occlusion->target.height = height;
+	raster_context_init(&occlusion->context, &occlusion->target);
+	occlusion->context.cull = RasterCull_Back;
+	return true;
+}
+
+internal void raster_occlusion_release(RasterOcclusion* occlusion) {
+	os_free_pages(occlusion->memory, occlusion->memory_size);
+	*occlusion = {};
+}
+
+// Starts a frame seen through `view` and `projection` (the PerFrame and
+// PerApplication matrices of the real draws): clears the buffer and the stats.
+internal void raster_occlusion_begin(RasterOcclusion* occlusion, const Mat4* view, const Mat4* projection) {
+	occlusion->context.constants[RasterConstantBuffer_Frame] = *view;
+	occlusion->context.constants[RasterConstantBuffer_Application] = *projection;
+	occlusion->view_projection = mat4_mul(view, projection);
+	occlusion->stats = {};
+	u64 tile_count = (u64)occlusion->tiles_x * occlusion->tiles_y;
+	for(u64 i = 0; i < tile_count; i++) {
+		occlusion->tiles[i].mask = 0;
+		occlusion->tiles[i].z_max0 = 1.0f;
+		occlusion->tiles[i].z_max1 = 0.0f;
+	}
+}
+
+internal void raster_occlusion_update_tile(RasterOcclusionTile* tile, u64 covered, f32 z) {
+	if(z >= tile->z_max0) return;
+
+	// A much nearer occluder starts a new working layer rather than pulling
+	// the old one forward.
+	if(tile->z_max1 - z > tile->z_max0 - tile->z_max1) {
+		tile->z_max1 = 0.0f;
+		tile->mask = 0;
+	}
+	tile->z_max1 = Max(tile->z_max1, z);
+	tile->mask |= covered;
+	if(tile->mask == ~0ull) {
+		tile->z_max0 = tile->z_max1;
+		tile->z_max1 = 0.0f;
+		tile->mask = 0;
+	}
+}
+
+internal void raster_occlusion_rasterize(RasterOcclusion* occlusion, const RasterTriangle* triangle) {
+	RasterBlockKernel* kernel = raster_block_kernel(RASTER_DEPTH_OFF);
+	RasterBlockDepth no_depth = {};
+
+	s64 edge[3], step_x[3], step_y[3];
+	for(u32 i = 0; i < 3; i++) {
+		edge[i] = triangle->edge[i] >> RASTER_SUBPIXEL_BITS;
+		step_x[i] = triangle->step_x[i] >> RASTER_SUBPIXEL_BITS;
+		step_y[i] = triangle->step_y[i] >> RASTER_SUBPIXEL_BITS;
+	}
+
+	const RasterPlane z = triangle->z;
+	s32 tile_x0 = triangle->x0 / RASTER_BLOCK_SIZE, tile_x1 = triangle->x1 / RASTER_BLOCK_SIZE;
+	s32 tile_y0 = triangle->y0 / RASTER_BLOCK_SIZE, tile_y1 = triangle->y1 / RASTER_BLOCK_SIZE;
+	for(s32 ty = tile_y0; ty <= tile_y1; ty++) {
+		for(s32 tx = tile_x0; tx <= tile_x1; tx++) {
+			RasterBlock block;
+			block.x = tx * RASTER_BLOCK_SIZE;
+			block.y = ty * RASTER_BLOCK_SIZE;
+			block.mask = ~0ull;
+			s64 block_edge[3];
+			for(u32 i = 0; i < 3; i++) {
+				block_edge[i] = edge[i] + (s64)(block.x - triangle->x0) * step_x[i] + (s64)(block.y - triangle->y0) * step_y[i];
+			}
+			if(!raster_block_edges(&block, block_edge, step_x, step_y)) continue;
+
+			u64 covered;
+			kernel(&block, &no_depth, &covered);
+			if(!covered) continue;
+
+			// The plane is linear, its farthest point on the tile is a corner.
+			f32 left = (f32)block.x, right = (f32)(block.x + RASTER_BLOCK_SIZE);
+			f32 top = (f32)block.y, bottom = (f32)(block.y + RASTER_BLOCK_SIZE);
+			f32 z_max = Max(Max(z.c + z.dx * left + z.dy * top, z.c + z.dx * right + z.dy * top),
+											Max(z.c + z.dx * left + z.dy * bottom, z.c + z.dx * right + z.dy * bottom));
+			raster_occlusion_update_tile(&occlusion->tiles[(u64)ty * occlusion->tiles_x + tx], covered, Clamp(0.0f, z_max, 1.0f));
+		}
+	}
+}
+
+// Rasterizes an indexed triangle list as an occluder, drawn with `world` as
+// its PerObject matrix. Back faces are skipped.
+internal void raster_occlusion_add_occluder(RasterOcclusion* occlusion, const Mat4* world, const RasterVertex* vertices,
+																						u32 vertex_count, const u16* indices, u32 index_count) {
+	f64 start = os_now_seconds();
+	RasterContext* context = &occlusion->context;
+	context->constants[RasterConstantBuffer_Object] = *world;
+	context->vertices = vertices;
+	context->vertex_count = vertex_count;
+	context->indices = indices;
+	u32 triangle_count = index_count / 3;
+	for(u32 i = 0; i < triangle_count; i += RASTER_CLIP_BATCH) {
+		RasterTriangle triangles[RASTER_CLIP_BATCH * (RASTER_MAX_CLIP_VERTS - 2)];
+		u32 batch = Min(triangle_count - i, (u32)RASTER_CLIP_BATCH);
+		u32 count = raster_assemble_triangles(context, i * 3, batch, 0, triangles, &context->stats);
+		for(u32 k = 0; k < count; k++) raster_occlusion_rasterize(occlusion, &triangles[k]);
+		occlusion->stats.occluder_triangles += count;
+	}
+	occlusion->stats.occluder_seconds += os_now_seconds() - start;
+}
+
+// Builds the pyramid, after the last occluder and before the first test.
+internal void raster_occlusion_build(RasterOcclusion* occlusion) {
+	f64 start = os_now_seconds();
+	u64 tile_count = (u64)occlusion->tiles_x * occlusion->tiles_y;
+	for(u64 i = 0; i < tile_count; i++) occlusion->levels[0][i] = occlusion->tiles[i].z_max0;
+
+	for(u32 level = 1; level < occlusion->level_count; level++) {
+		const f32* below = occlusion->levels[level - 1];
+		u32 below_width = occlusion->level_width[level - 1];
+		u32 below_height = occlusion->level_height[level - 1];
+		f32* texels = occlusion->levels[level];
+		for(u32 y = 0; y < occlusion->level_height[level]; y++) {
+			u32 y0 = y * 2, y1 = Min(y * 2 + 1, below_height - 1);
+			for(u32 x = 0; x < occlusion->level_width[level]; x++) {
+				u32 x0 = x * 2, x1 = Min(x * 2 + 1, below_width - 1);
+				f32 top = Max(below[y0 * below_width + x0], below[y0 * below_width + x1]);
+				f32 bottom = Max(below[y1 * below_width + x0], below[y1 * below_width + x1]);
+				texels[y * occlusion->level_width[level] + x] = Max(top, bottom);
+			}
+		}
+	}
+	occlusion->stats.occluder_seconds += os_now_seconds() - start;
+}
+
+// Whether the box `box_min`..`box_max`, drawn with `world`, can write a pixel.
+// Counts the result in the stats.
+internal b32 raster_occlusion_test_box(RasterOcclusion* occlusion, const Mat4* world, const f32 box_min[3], const f32 box_max[3]) {
+	RasterOcclusionStats* stats = &occlusion->stats;
+	stats->tested++;
+	Mat4 m = mat4_mul(world, &occlusion->view_projection);
+
+	f32 x0 = 3.402823466e+38f, y0 = 3.402823466e+38f, z_min = 3.402823466e+38f;
+	f32 x1 = -3.402823466e+38f, y1 = -3.402823466e+38f;
+	for(u32 corner = 0; corner < 8; corner++) {
+		Vec4 p = vec4(corner & 1 ? box_max[0] : box_min[0], corner & 2 ? box_max[1] : box_min[1],
+															 corner & 4 ? box_max[2] : box_min[2], 1.0f);
+		p = vec4_transform(p, &m);
+		if(p.w <= 1e-6f) {
+			stats->visible++;
+			return true;
+		}
+		f32 rcp_w = 1.0f / p.w;
+		f32 x = (p.x * rcp_w + 1.0f) * 0.5f * (f32)occlusion->width;
+		f32 y = (1.0f - p.y * rcp_w) * 0.5f * (f32)occlusion->height;
+		x0 = Min(x0, x); x1 = Max(x1, x);
+		y0 = Min(y0, y); y1 = Max(y1, y);
+		z_min = Min(z_min, p.z * rcp_w);
+	}
+
+	if(x1 < 0.0f || y1 < 0.0f || x0 > (f32)occlusion->width || y0 > (f32)occlusion->height || z_min > 1.0f) {
+		stats->outside++;
+		return false;
+	}
+
+	s32 last_x = (s32)occlusion->tiles_x - 1, last_y = (s32)occlusion->tiles_y - 1;
+	s32 tx0 = Clamp(0, (s32)floorf(x0) / RASTER_BLOCK_SIZE, last_x);
+	s32 ty0 = Clamp(0, (s32)floorf(y0) / RASTER_BLOCK_SIZE, last_y);
+	s32 tx1 = Clamp(0, (s32)floorf(x1) / RASTER_BLOCK_SIZE, last_x);
+	s32 ty1 = Clamp(0, (s32)floorf(y1) / RASTER_BLOCK_SIZE, last_y);
+	u32 level = 0;
+	while(level + 1 < occlusion->level_count && ((tx1 >> level) - (tx0 >> level) > 1 || (ty1 >> level) - (ty0 >> level) > 1)) level++;
+
+	const f32* texels = occlusion->levels[level];
+	u32 level_width = occlusion->level_width[level];
+	f32 z_max = 0.0f;
+	for(s32 y = ty0 >> level; y <= (ty1 >> level); y++) {
+		for(s32 x = tx0 >> level; x <= (tx1 >> level); x++) z_max = Max(z_max, texels[(u64)y * level_width + x]);
+	}
+	if(z_min > z_max) {
+		stats->occluded++;
+		return false;
+	}
+	stats->visible++;
+	return true;
+}
+
+// Tests `count` boxes, `visible[i]` is set for the ones to draw. Times the
+// whole batch into stats.test_seconds.
+internal void raster_occlusion_test_boxes(RasterOcclusion* occlusion, const RasterOcclusionBox* boxes, u32 count, b8* visible) {
+	f64 start = os_now_seconds();
+	for(u32 i = 0; i < count; i++) visible[i] = (b8)raster_occlusion_test_box(occlusion, &boxes[i].world, boxes[i].min, boxes[i].max);
+	occlusion->stats.test_seconds += os_now_seconds() - start;
+}
+
+// The tiles' z_max0 as a greyscale TGA, one pixel per tile, near is black.
+internal b32 raster_occlusion_write_tga(const RasterOcclusion* occlusion, const char* path) {
+	u64 count = (u64)occlusion->tiles_x * occlusion->tiles_y;
+	ArenaTemp scratch = arena_scratch_begin();
+	u32* pixels = ArenaPushArray(scratch.arena, u32, count);
+	for(u64 i = 0; i < count; i++) pixels[i] = raster_depth_to_d24(occlusion->tiles[i].z_max0);
+	b32 result = raster_write_tga_pixels(path, pixels, occlusion->tiles_x, occlusion->tiles_y, true);
+	arena_scratch_end(scratch);
+	return result;
+}
@@ -0,0 +1,1348 @@
+#pragma once
+
+// Software rasterizer for the textured pipeline (d3d11/src/textured.cc).
+//
+// Runs the same frame on the CPU so it can be rendered, timed and compared
+// against golden images on machines without a GPU. It follows the D3D11
+// rules that pipeline relies on:
+//   vertex stage   textured_vs: row vectors times the PerObject (world),
+//                  PerFrame (view) and PerApplication (projection) matrices,
+//                  texcoords passed through
+//   clipping       against the near and far planes, 0 <= z <= w; the sides
+//                  only for triangles reaching out of a guard band, the
+//                  rest is left to the viewport scissor
+//   rasterizer     8 bits of sub-pixel precision, pixel centres at +0.5,
+//                  top-left fill rule, cull none/front/back with clockwise
+//                  front faces (FrontCounterClockwise = false)
+//   pixel stage    textured_ps: one sample of a MIN_MAG_MIP_LINEAR, WRAP
+//                  sampler, perspective correct texcoords, LOD from the
+//                  analytic screen-space derivatives
+//   output merger  D24_UNORM_S8_UINT depth with a comparison function and
+//                  write mask, R8G8B8A8_UNORM colour
+//
+// The vertex positions and clip tests run 8 triangles at a time. Coverage and
+// the early depth test run on 8x8 pixel blocks through a scalar, AVX2 or
+// AVX-512 kernel picked at runtime; the pixel stage runs per pixel.
+//
+// The target is plain memory: colour and depth/stencil are one u32 per pixel
+// and can be written out as TGA files.
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "texture/tga.h"
+#include "texture/mips.h"
+#include "texture/cooked.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <immintrin.h>
+
+#define RASTER_SUBPIXEL_BITS   8
+#define RASTER_SUBPIXEL_ONE    (1 << RASTER_SUBPIXEL_BITS)
+#define RASTER_MAX_CLIP_VERTS  9       // A triangle clipped by six planes.
+#define RASTER_DEPTH_MAX       0x00ffffffu
+#define RASTER_MAX_SIZE        8192    // Keeps edge functions well inside s64.
+#define RASTER_BLOCK_SIZE      8       // Pixels per side of the blocks the kernels cover and depth test.
+#define RASTER_GUARD_BAND      32768   // Pixels either side of the origin rasterized without clipping, f32 still snaps exactly there.
+#define RASTER_CLIP_BATCH      8       // Triangles the front end shades and classifies at once.
+
+//------------------------------------------------------------------------
+// Resources
+//------------------------------------------------------------------------
+
+struct RasterTarget {
+	u32 width;
+	u32 height;
+	u32* colour;        // R8G8B8A8_UNORM, R in the low byte.
+	u32* depth;         // D24_UNORM_S8_UINT, depth in the low 24 bits, stencil in the high 8.
+	u64 size;           // Both planes, one allocation.
+};
+
+internal b32 raster_target_alloc(RasterTarget* target, u32 width, u32 height) {
+	*target = {};
+	if(width == 0 || height == 0 || width > RASTER_MAX_SIZE || height > RASTER_MAX_SIZE) return false;
+
+	u64 plane_size = AlignPow2((u64)width * height * 4, (u64)64);
+	target->width = width;
+	target->height = height;
+	target->size = plane_size * 2;
+	target->colour = (u32*)os_alloc_pages(target->size);
+	target->depth = (u32*)((u8*)target->colour + plane_size);
+	return target->colour != nullptr;
+}
+
+internal void raster_target_release(RasterTarget* target) {
+	os_free_pages(target->colour, target->size);
+	*target = {};
+}
+
+internal u32 raster_pack_unorm8(const f32 colour[4]) {
+	u32 result = 0;
+	for(u32 i = 0; i < 4; i++) {
+		f32 c = Clamp(0.0f, colour[i], 1.0f);
+		result |= (u32)(c * 255.0f + 0.5f) << (i * 8);
+	}
+	return result;
+}
+
+// Rounded to nearest. 0xffffff + 0.5 is not representable as f32 and rounds up, hence the Min.
+internal u32 raster_depth_to_d24(f32 depth) {
+	return Min((u32)(Clamp(0.0f, depth, 1.0f) * (f32)RASTER_DEPTH_MAX + 0.5f), RASTER_DEPTH_MAX);
+}
+
+// ClearRenderTargetView + ClearDepthStencilView(D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL).
+internal void raster_clear(RasterTarget* target, const f32 colour[4], f32 depth, u8 stencil) {
+	u32 colour_value = raster_pack_unorm8(colour);
+	u32 depth_value = raster_depth_to_d24(depth) | ((u32)stencil << 24);
+	u64 count = (u64)target->width * target->height;
+	for(u64 i = 0; i < count; i++) target->colour[i] = colour_value;
+	for(u64 i = 0; i < count; i++) target->depth[i] = depth_value;
+}
+
+struct RasterTextureLevel {
+	const u8* data;     // RGBA8 rows, top-down.
+	u32 width;
+	u32 height;
+	u32 row_pitch;
+};
+
+// A shader resource view over RGBA8 levels the caller owns.
+struct RasterTexture {
+	u32 level_count;
+	f32 min_lod;        // SetResourceMinLOD.
+	RasterTextureLevel levels[MIP_MAX_LEVELS];
+};
+
+internal void raster_texture_from_mips(RasterTexture* texture, const MipChain* chain) {
+	*texture = {};
+	texture->level_count = chain->level_count;
+	for(u32 i = 0; i < chain->level_count; i++) {
+		RasterTextureLevel* level = &texture->levels[i];
+		level->data = mip_level_data(chain, i);
+		level->width = chain->levels[i].width;
+		level->height = chain->levels[i].height;
+		level->row_pitch = chain->levels[i].row_pitch;
+	}
+}
+
+// Only RGBA8 payloads, the sampler does not decode BCn blocks.
+internal b32 raster_texture_from_cooked(RasterTexture* texture, const CookedTexture* cooked) {
+	*texture = {};
+	if(cooked->header->format != CookedFormat_RGBA8) return false;
+
+	texture->level_count = cooked->header->level_count;
+	for(u32 i = 0; i < texture->level_count; i++) {
+		const CookedTextureLevel* source = &cooked->header->levels[i];
+		RasterTextureLevel* level = &texture->levels[i];
+		level->data = cooked_texture_level_data(cooked, i);
+		level->width = source->width;
+		level->height = source->height;
+		level->row_pitch = source->row_pitch;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Block kernels
+//------------------------------------------------------------------------
+
+// Coverage, early depth test and depth write of one 8x8 block of a triangle,
+// the inner loop of the rasterizer. There is a scalar, an AVX2 (one row of 8
+// per instruction) and an AVX-512 (two rows, 16 lanes) version of it; all of
+// them are compiled into every x86-64 build and the widest one the CPU runs is
+// picked at startup, so the rest of the binary does not need -mavx512f.
+// Every version gives the same bits: the depth plane is evaluated with the
+// same unfused multiplies and adds as the scalar code.
+//
+// The depth state is a template argument, so every comparison function with
+// and without writes (and the test off) is its own kernel with no state
+// checks in its loops.
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define RASTER_TARGET_AVX2
+	#define RASTER_TARGET_AVX512
+#else
+	#define RASTER_TARGET_AVX2   __attribute__((target("avx2,fma")))
+	#define RASTER_TARGET_AVX512 __attribute__((target("avx2,fma,avx512f,avx512cd,avx512bw,avx512dq,avx512vl")))
+#endif
+
+enum RasterKernel : u32 {
+	RasterKernel_Scalar,
+	RasterKernel_AVX2,
+	RasterKernel_AVX512,
+	RasterKernel_COUNT
+};
+
+// Edge functions are reduced to whole pixel steps (the sub-pixel part is
+// floored away, which keeps their sign), so a block fits in s32. Edges that
+// cover the whole block are zeroed.
+struct RasterBlock {
+	s32 x;              // Top-left pixel, a multiple of RASTER_BLOCK_SIZE.
+	s32 y;
+	u64 mask;           // Pixels inside the rectangle being shaded, bit row * 8 + column.
+	s32 edge[3];        // At the top-left pixel, inside when >= 0.
+	s32 step_x[3];
+	s32 step_y[3];
+};
+
+struct RasterBlockDepth {
+	f32 c, dx, dy;      // Depth plane of the triangle.
+	f32 min, max;       // Viewport depth range.
+	u32* depth;         // Depth plane of the target.
+	u32 pitch;          // In pixels.
+};
+
+// Depth states of the kernels: RasterCompare * 2 + the write flag while the
+// test is on (the compare bits are 1 less, 2 equal, 4 greater), or
+// RASTER_DEPTH_OFF.
+#define RASTER_DEPTH_OFF    16
+#define RASTER_DEPTH_STATES 17
+
+// Returns the pixels that passed the depth test (and had their depth
+// written), `covered` gets the pixels inside the triangle.
+typedef u64 RasterBlockKernel(const RasterBlock* block, const RasterBlockDepth* depth, u64* covered);
+
+internal u32 raster_popcount(u64 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	return (u32)__popcnt64(mask);
+#else
+	return (u32)__builtin_popcountll(mask);
+#endif
+}
+
+internal u32 raster_lowest_bit(u64 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (u32)index;
+#else
+	return (u32)__builtin_ctzll(mask);
+#endif
+}
+
+// Fills in the edges of `block` from the edge functions at its top-left pixel,
+// in whole pixel steps. Edges that cover the whole block are zeroed. Returns
+// false if the block is entirely outside one of them.
+internal b32 raster_block_edges(RasterBlock* block, const s64 edge[3], const s64 step_x[3], const s64 step_y[3]) {
+	const s64 last = RASTER_BLOCK_SIZE - 1;
+	for(u32 i = 0; i < 3; i++) {
+		s64 low = edge[i] + Min(step_x[i] * last, 0) + Min(step_y[i] * last, 0);
+		s64 high = edge[i] + Max(step_x[i] * last, 0) + Max(step_y[i] * last, 0);
+		if(high < 0) return false;
+		if(low >= 0) {
+			block->edge[i] = block->step_x[i] = block->step_y[i] = 0;
+		} else {
+			block->edge[i] = (s32)edge[i];
+			block->step_x[i] = (s32)step_x[i];
+			block->step_y[i] = (s32)step_y[i];
+		}
+	}
+	return true;
+}
+
+template<u32 depth_state> internal u64 raster_block_scalar(const RasterBlock* block, const RasterBlockDepth* depth, u64* covered) {
+	const b32 enable = depth_state != RASTER_DEPTH_OFF;
+	const u32 func = depth_state >> 1;
+	const b32 write = (depth_state & 1) != 0;
+	u64 cover = 0;
+	u64 pass = 0;
+	for(u32 row = 0; row < RASTER_BLOCK_SIZE; row++) {
+		if(!((block->mask >> (row * 8)) & 0xff)) continue;
+		s32 e0 = block->edge[0] + (s32)row * block->step_y[0];
+		s32 e1 = block->edge[1] + (s32)row * block->step_y[1];
+		s32 e2 = block->edge[2] + (s32)row * block->step_y[2];
+		u32* depth_row = depth->depth + (u64)(block->y + row) * depth->pitch + block->x;
+		f32 cy = (f32)(block->y + (s32)row) + 0.5f;
+		for(u32 column = 0; column < RASTER_BLOCK_SIZE; column++, e0 += block->step_x[0], e1 += block->step_x[1], e2 += block->step_x[2]) {
+			u64 bit = 1ull << (row * 8 + column);
+			if(!(block->mask & bit) || (e0 | e1 | e2) < 0) continue;
+			cover |= bit;
+			if(enable) {
+				f32 cx = (f32)(block->x + (s32)column) + 0.5f;
+				u32 value = raster_depth_to_d24(Clamp(depth->min, depth->c + depth->dx * cx + depth->dy * cy, depth->max));
+				u32 stored = depth_row[column];
+				u32 test = value < (stored & RASTER_DEPTH_MAX) ? 1 : value == (stored & RASTER_DEPTH_MAX) ? 2 : 4;
+				if(!(func & test)) continue;
+				if(write) depth_row[column] = (stored & ~RASTER_DEPTH_MAX) | value;
+			}
+			pass |= bit;
+		}
+	}
+	*covered = cover;
+	return pass;
+}
+
+template<u32 depth_state> RASTER_TARGET_AVX2 internal u64 raster_block_avx2(const RasterBlock* block, const RasterBlockDepth* depth, u64* covered) {
+	const b32 enable = depth_state != RASTER_DEPTH_OFF;
+	const u32 func = depth_state >> 1;
+	const b32 write = (depth_state & 1) != 0;
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	__m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(block->edge[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(block->step_x[0])));
+	__m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(block->edge[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(block->step_x[1])));
+	__m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(block->edge[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(block->step_x[2])));
+	const __m256i step0 = _mm256_set1_epi32(block->step_y[0]);
+	const __m256i step1 = _mm256_set1_epi32(block->step_y[1]);
+	const __m256i step2 = _mm256_set1_epi32(block->step_y[2]);
+
+	// c + dx * cx is the same for every row.
+	__m256 cx = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(block->x), lane)), _mm256_set1_ps(0.5f));
+	const __m256 z_x = _mm256_add_ps(_mm256_set1_ps(depth->c), _mm256_mul_ps(_mm256_set1_ps(depth->dx), cx));
+	const __m256 z_dy = _mm256_set1_ps(depth->dy);
+	const __m256 z_min = _mm256_set1_ps(depth->min);
+	const __m256 z_max = _mm256_set1_ps(depth->max);
+	const __m256i depth_mask = _mm256_set1_epi32((s32)RASTER_DEPTH_MAX);
+
+	u64 cover = 0;
+	u64 pass = 0;
+	for(u32 row = 0; row < RASTER_BLOCK_SIZE; row++) {
+		u32 row_mask = (u32)(block->mask >> (row * 8)) & 0xff;
+		if(row_mask) {
+			u32 outside = (u32)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_or_si256(e0, e1), e2)));
+			u32 row_cover = row_mask & ~outside;
+			u32 row_pass = row_cover;
+			if(row_cover && enable) {
+				__m256i lanes = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((s32)row_cover), lane_bit), lane_bit);
+				__m256 cy = _mm256_set1_ps((f32)(block->y + (s32)row) + 0.5f);
+				__m256 z = _mm256_add_ps(z_x, _mm256_mul_ps(z_dy, cy));
+				z = _mm256_min_ps(_mm256_max_ps(z, z_min), z_max);
+				z = _mm256_min_ps(_mm256_max_ps(z, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+				__m256i value = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps((f32)RASTER_DEPTH_MAX)), _mm256_set1_ps(0.5f)));
+				value = _mm256_min_epu32(value, depth_mask);
+
+				u32* depth_row = depth->depth + (u64)(block->y + row) * depth->pitch + block->x;
+				__m256i stored = _mm256_maskload_epi32((const int*)depth_row, lanes);
+				__m256i stored_depth = _mm256_and_si256(stored, depth_mask);
+				__m256i result = _mm256_setzero_si256();
+				if(func & 1) result = _mm256_or_si256(result, _mm256_cmpgt_epi32(stored_depth, value));
+				if(func & 2) result = _mm256_or_si256(result, _mm256_cmpeq_epi32(stored_depth, value));
+				if(func & 4) result = _mm256_or_si256(result, _mm256_cmpgt_epi32(value, stored_depth));
+				result = _mm256_and_si256(result, lanes);
+				row_pass = (u32)_mm256_movemask_ps(_mm256_castsi256_ps(result));
+				if(row_pass && write) {
+					_mm256_maskstore_epi32((int*)depth_row, result, _mm256_or_si256(_mm256_andnot_si256(depth_mask, stored), value));
+				}
+			}
+			cover |= (u64)row_cover << (row * 8);
+			pass |= (u64)row_pass << (row * 8);
+		}
+		e0 = _mm256_add_epi32(e0, step0);
+		e1 = _mm256_add_epi32(e1, step1);
+		e2 = _mm256_add_epi32(e2, step2);
+	}
+	*covered = cover;
+	return pass;
+}
+
+// GCC 12 warns about the _mm512_undefined_*() inside its own AVX-512 headers
+// when they are inlined into a target("avx512f") function (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+template<u32 depth_state> RASTER_TARGET_AVX512 internal u64 raster_block_avx512(const RasterBlock* block, const RasterBlockDepth* depth, u64* covered) {
+	const b32 enable = depth_state != RASTER_DEPTH_OFF;
+	const u32 func = depth_state >> 1;
+	const b32 write = (depth_state & 1) != 0;
+	// Two rows per vector: lane i is column i & 7 of row i >> 3.
+	const __m512i column = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7);
+	const __m512i row_offset = _mm512_setr_epi32(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+	__m512i e0 = _mm512_add_epi32(_mm512_set1_epi32(block->edge[0]),
+																_mm512_add_epi32(_mm512_mullo_epi32(column, _mm512_set1_epi32(block->step_x[0])),
+																								 _mm512_mullo_epi32(row_offset, _mm512_set1_epi32(block->step_y[0]))));
+	__m512i e1 = _mm512_add_epi32(_mm512_set1_epi32(block->edge[1]),
+																_mm512_add_epi32(_mm512_mullo_epi32(column, _mm512_set1_epi32(block->step_x[1])),
+																								 _mm512_mullo_epi32(row_offset, _mm512_set1_epi32(block->step_y[1]))));
+	__m512i e2 = _mm512_add_epi32(_mm512_set1_epi32(block->edge[2]),
+																_mm512_add_epi32(_mm512_mullo_epi32(column, _mm512_set1_epi32(block->step_x[2])),
+																								 _mm512_mullo_epi32(row_offset, _mm512_set1_epi32(block->step_y[2]))));
+	const __m512i step0 = _mm512_set1_epi32(block->step_y[0] * 2);
+	const __m512i step1 = _mm512_set1_epi32(block->step_y[1] * 2);
+	const __m512i step2 = _mm512_set1_epi32(block->step_y[2] * 2);
+
+	__m512 cx = _mm512_add_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(block->x), column)), _mm512_set1_ps(0.5f));
+	const __m512 z_x = _mm512_add_ps(_mm512_set1_ps(depth->c), _mm512_mul_ps(_mm512_set1_ps(depth->dx), cx));
+	const __m512 z_dy = _mm512_set1_ps(depth->dy);
+	const __m512 z_min = _mm512_set1_ps(depth->min);
+	const __m512 z_max = _mm512_set1_ps(depth->max);
+	const __m512i depth_mask = _mm512_set1_epi32((s32)RASTER_DEPTH_MAX);
+
+	u64 cover = 0;
+	u64 pass = 0;
+	for(u32 row = 0; row < RASTER_BLOCK_SIZE; row += 2) {
+		__mmask16 rows_mask = (__mmask16)(block->mask >> (row * 8));
+		if(rows_mask) {
+			__m512i edges = _mm512_or_si512(_mm512_or_si512(e0, e1), e2);
+			__mmask16 rows_cover = _mm512_mask_cmpge_epi32_mask(rows_mask, edges, _mm512_setzero_si512());
+			__mmask16 rows_pass = rows_cover;
+			if(rows_cover && enable) {
+				__m512 cy = _mm512_add_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(block->y + (s32)row), row_offset)), _mm512_set1_ps(0.5f));
+				__m512 z = _mm512_add_ps(z_x, _mm512_mul_ps(z_dy, cy));
+				z = _mm512_min_ps(_mm512_max_ps(z, z_min), z_max);
+				z = _mm512_min_ps(_mm512_max_ps(z, _mm512_setzero_ps()), _mm512_set1_ps(1.0f));
+				__m512i value = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(z, _mm512_set1_ps((f32)RASTER_DEPTH_MAX)), _mm512_set1_ps(0.5f)));
+				value = _mm512_min_epu32(value, depth_mask);
+
+				// The two rows are a pitch apart in the target. The second one is
+				// addressed 8 lanes back so its pixels land in the upper half.
+				u32* depth_row0 = depth->depth + (u64)(block->y + row) * depth->pitch + block->x;
+				u32* depth_row1 = depth_row0 + depth->pitch - 8;
+				__mmask16 low = rows_cover & 0x00ff;
+				__mmask16 high = rows_cover & 0xff00;
+				__m512i stored = _mm512_mask_loadu_epi32(_mm512_maskz_loadu_epi32(low, depth_row0), high, depth_row1);
+				__m512i stored_depth = _mm512_and_si512(stored, depth_mask);
+				__mmask16 result = 0;
+				if(func & 1) result |= _mm512_mask_cmplt_epu32_mask(rows_cover, value, stored_depth);
+				if(func & 2) result |= _mm512_mask_cmpeq_epu32_mask(rows_cover, value, stored_depth);
+				if(func & 4) result |= _mm512_mask_cmpgt_epu32_mask(rows_cover, value, stored_depth);
+				rows_pass = result;
+				if(rows_pass && write) {
+					__m512i written = _mm512_or_si512(_mm512_andnot_si512(depth_mask, stored), value);
+					_mm512_mask_storeu_epi32(depth_row0, rows_pass & 0x00ff, written);
+					_mm512_mask_storeu_epi32(depth_row1, rows_pass & 0xff00, written);
+				}
+			}
+			cover |= (u64)rows_cover << (row * 8);
+			pass |= (u64)rows_pass << (row * 8);
+		}
+		e0 = _mm512_add_epi32(e0, step0);
+		e1 = _mm512_add_epi32(e1, step1);
+		e2 = _mm512_add_epi32(e2, step2);
+	}
+	*covered = cover;
+	return pass;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic pop
+#endif
+
+global RasterKernel g_raster_kernel;
+global b32 g_raster_kernel_selected;
+global RasterBlockKernel* g_raster_block_kernels[RasterKernel_COUNT][RASTER_DEPTH_STATES];
+
+// Instantiates the kernels of every depth state from `depth_state` up.
+template<u32 depth_state> struct RasterBlockKernelTable {
+	static void fill() {
+		g_raster_block_kernels[RasterKernel_Scalar][depth_state] = raster_block_scalar<depth_state>;
+		g_raster_block_kernels[RasterKernel_AVX2][depth_state] = raster_block_avx2<depth_state>;
+		g_raster_block_kernels[RasterKernel_AVX512][depth_state] = raster_block_avx512<depth_state>;
+		RasterBlockKernelTable<depth_state + 1>::fill();
+	}
+};
+
+template<> struct RasterBlockKernelTable<RASTER_DEPTH_STATES> {
+	static void fill() {}
+};
+
+internal const char* raster_kernel_name(RasterKernel kernel) {
+	switch(kernel) {
+		case RasterKernel_Scalar: return "scalar";
+		case RasterKernel_AVX2:   return "avx2";
+		case RasterKernel_AVX512: return "avx512";
+		default:                  return "unknown";
+	}
+}
+
+internal b32 raster_kernel_supported(RasterKernel kernel) {
+	u32 features = os_cpu_features();
+	switch(kernel) {
+		case RasterKernel_Scalar: return true;
+		case RasterKernel_AVX2:   return (features & OS_CPUFeature_AVX2) != 0;
+		case RasterKernel_AVX512: return (features & OS_CPUFeature_AVX512) != 0;
+		default:                  return false;
+	}
+}
+
+internal RasterKernel raster_kernel_best() {
+	if(raster_kernel_supported(RasterKernel_AVX512)) return RasterKernel_AVX512;
+	if(raster_kernel_supported(RasterKernel_AVX2)) return RasterKernel_AVX2;
+	return RasterKernel_Scalar;
+}
+
+internal void raster_pipelines_fill();
+
+// Picks the block kernels every draw uses from then on. raster_context_init()
+// selects raster_kernel_best() the first time, call this between frames (not
+// while a draw or the binner is running) to override it.
+internal b32 raster_kernel_select(RasterKernel kernel) {
+	if(!raster_kernel_supported(kernel)) return false;
+	if(!g_raster_kernel_selected) {
+		RasterBlockKernelTable<0>::fill();
+		raster_pipelines_fill();
+	}
+	g_raster_kernel = kernel;
+	g_raster_kernel_selected = true;
+	return true;
+}
+
+// The selected kernel for a depth state.
+internal RasterBlockKernel* raster_block_kernel(u32 depth_state) {
+	return g_raster_block_kernels[g_raster_kernel][depth_state];
+}
+
+//------------------------------------------------------------------------
+// State
+//------------------------------------------------------------------------
+
+enum RasterConstantBuffer : u32 {
+	RasterConstantBuffer_Application,   // b0, projection
+	RasterConstantBuffer_Frame,         // b1, view
+	RasterConstantBuffer_Object,        // b2, world
+	RasterConstantBuffer_COUNT
+};
+
+enum RasterCull : u32 {
+	RasterCull_None,
+	RasterCull_Front,
+	RasterCull_Back,
+};
+
+// D3D11_COMPARISON_FUNC - 1, which makes the values the less (1), equal (2)
+// and greater (4) results that pass.
+enum RasterCompare : u32 {
+	RasterCompare_Never,
+	RasterCompare_Less,
+	RasterCompare_Equal,
+	RasterCompare_LessEqual,
+	RasterCompare_Greater,
+	RasterCompare_NotEqual,
+	RasterCompare_GreaterEqual,
+	RasterCompare_Always,
+};
+
+enum RasterFilter : u32 {
+	RasterFilter_Linear,    // D3D11_FILTER_MIN_MAG_MIP_LINEAR
+	RasterFilter_Point,     // D3D11_FILTER_MIN_MAG_MIP_POINT
+};
+
+struct RasterSampler {
+	RasterFilter filter;
+	f32 mip_lod_bias;
+	f32 min_lod;
+	f32 max_lod;
+};
+
+struct RasterViewport {
+	f32 x;
+	f32 y;
+	f32 width;
+	f32 height;
+	f32 min_depth;
+	f32 max_depth;
+};
+
+// Matches the layout of textured.cc's Vertex.
+struct RasterVertex {
+	f32 position[3];
+	f32 texture[2];
+};
+
+struct RasterStats {
+	u64 draws;
+	u64 triangles;
+	u64 triangles_clipped;
+	u64 triangles_guard_band;   // Crossing a side of the clip volume, rasterized unclipped.
+	u64 triangles_culled;       // Back/front facing, zero area or outside the clip volume.
+	u64 pixels_covered;
+	u64 pixels_depth_failed;
+	u64 pixels_written;
+};
+
+// Everything a draw reads, set directly the way textured.cc binds its state.
+struct RasterContext {
+	const RasterVertex* vertices;
+	u32 vertex_count;
+	const u16* indices;
+
+	Mat4 constants[RasterConstantBuffer_COUNT];
+
+	const RasterTexture* texture;       // Unbound samples return zero.
+	RasterSampler sampler;
+
+	RasterCull cull;
+	RasterViewport viewport;
+
+	b32 depth_enable;
+	b32 depth_write;
+	RasterCompare depth_func;
+
+	b32 colour_write;                   // RenderTargetWriteMask, off for depth-only passes (no pixel shading).
+
+	RasterTarget* target;
+	RasterStats stats;
+};
+
+// The state textured.cc creates: D3D11_FILTER_MIN_MAG_MIP_LINEAR with WRAP
+// addressing, CULL_NONE, depth test LESS with writes, full-target viewport.
+internal void raster_context_init(RasterContext* context, RasterTarget* target) {
+	*context = {};
+	for(u32 i = 0; i < RasterConstantBuffer_COUNT; i++) context->constants[i] = mat4_identity();
+	context->sampler.max_lod = 3.402823466e+38f;
+	context->cull = RasterCull_None;
+	context->viewport.width = (f32)target->width;
+	context->viewport.height = (f32)target->height;
+	context->viewport.max_depth = 1.0f;
+	context->depth_enable = true;
+	context->depth_write = true;
+	context->depth_func = RasterCompare_Less;
+	context->colour_write = true;
+	context->target = target;
+	if(!g_raster_kernel_selected) raster_kernel_select(raster_kernel_best());
+}
+
+//------------------------------------------------------------------------
+// Shaders
+//------------------------------------------------------------------------
+
+struct RasterVSOutput {
+	Vec4 position;          // SV_POSITION, clip space.
+	f32 tex[2];             // TEXCOORD0
+};
+
+// textured_vs.hlsl
+internal RasterVSOutput raster_textured_vs(const Mat4 constants[RasterConstantBuffer_COUNT], const RasterVertex* input) {
+	RasterVSOutput output;
+	Vec4 position = vec4(input->position[0], input->position[1], input->position[2], 1.0f);
+	position = vec4_transform(position, &constants[RasterConstantBuffer_Object]);
+	position = vec4_transform(position, &constants[RasterConstantBuffer_Frame]);
+	output.position = vec4_transform(position, &constants[RasterConstantBuffer_Application]);
+	output.tex[0] = input->texture[0];
+	output.tex[1] = input->texture[1];
+	return output;
+}
+
+#if defined(__AVX2__)
+
+inline void raster_transform8(__m256 v[4], const Mat4* m) {
+	__m256 result[4];
+	for(u32 c = 0; c < 4; c++) {
+		__m256 sum = _mm256_add_ps(_mm256_mul_ps(v[0], _mm256_set1_ps(m->m[0][c])), _mm256_mul_ps(v[1], _mm256_set1_ps(m->m[1][c])));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(v[2], _mm256_set1_ps(m->m[2][c])));
+		result[c] = _mm256_add_ps(sum, _mm256_mul_ps(v[3], _mm256_set1_ps(m->m[3][c])));
+	}
+	for(u32 c = 0; c < 4; c++) v[c] = result[c];
+}
+
+// SV_POSITION of raster_textured_vs() for 8 vertices, SoA x, y, z, w. Same
+// operations in the same order, so the same bits.
+inline void raster_textured_vs8(const Mat4 constants[RasterConstantBuffer_COUNT], const RasterVertex* const input[8],
+																__m256 position[4]) {
+	f32 soa[3][8];
+	for(u32 lane = 0; lane < 8; lane++) {
+		for(u32 c = 0; c < 3; c++) soa[c][lane] = input[lane]->position[c];
+	}
+	for(u32 c = 0; c < 3; c++) position[c] = _mm256_loadu_ps(soa[c]);
+	position[3] = _mm256_set1_ps(1.0f);
+	raster_transform8(position, &constants[RasterConstantBuffer_Object]);
+	raster_transform8(position, &constants[RasterConstantBuffer_Frame]);
+	raster_transform8(position, &constants[RasterConstantBuffer_Application]);
+}
+
+#endif
+
+internal s32 raster_wrap(s32 i, u32 size) {
+	s32 r = i % (s32)size;
+	return r < 0 ? r + (s32)size : r;
+}
+
+internal void raster_sample_bilinear(const RasterTextureLevel* level, f32 u, f32 v, f32 out[4]) {
+	f32 x = u * (f32)level->width - 0.5f;
+	f32 y = v * (f32)level->height - 0.5f;
+	f32 x_floor = floorf(x);
+	f32 y_floor = floorf(y);
+	f32 fx = x - x_floor;
+	f32 fy = y - y_floor;
+
+	s32 x0 = raster_wrap((s32)x_floor, level->width);
+	s32 y0 = raster_wrap((s32)y_floor, level->height);
+	s32 x1 = raster_wrap(x0 + 1, level->width);
+	s32 y1 = raster_wrap(y0 + 1, level->height);
+
+	const u8* row0 = level->data + (u64)y0 * level->row_pitch;
+	const u8* row1 = level->data + (u64)y1 * level->row_pitch;
+	const u8* t00 = row0 + x0 * 4;
+	const u8* t10 = row0 + x1 * 4;
+	const u8* t01 = row1 + x0 * 4;
+	const u8* t11 = row1 + x1 * 4;
+	for(u32 c = 0; c < 4; c++) {
+		f32 top = (f32)t00[c] + ((f32)t10[c] - (f32)t00[c]) * fx;
+		f32 bottom = (f32)t01[c] + ((f32)t11[c] - (f32)t01[c]) * fx;
+		out[c] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+	}
+}
+
+internal void raster_sample_nearest(const RasterTextureLevel* level, f32 u, f32 v, f32 out[4]) {
+	s32 x = raster_wrap((s32)floorf(u * (f32)level->width), level->width);
+	s32 y = raster_wrap((s32)floorf(v * (f32)level->height), level->height);
+	const u8* texel = level->data + (u64)y * level->row_pitch + x * 4;
+	for(u32 c = 0; c < 4; c++) out[c] = (f32)texel[c] * (1.0f / 255.0f);
+}
+
+// `lod_squared` is the squared length of the larger screen-space texcoord
+// gradient in level 0 texels, the isotropic LOD of the D3D spec before its
+// log2. Clamped to the sampler's and the texture's range.
+internal f32 raster_sample_lod(const RasterTexture* texture, const RasterSampler* sampler, f32 lod_squared) {
+	f32 lod = 0.5f * log2f(Max(lod_squared, 1e-20f)) + sampler->mip_lod_bias;
+	f32 min_lod = Max(Max(sampler->min_lod, texture->min_lod), 0.0f);
+	f32 max_lod = Min(sampler->max_lod, (f32)(texture->level_count - 1));
+	return Clamp(min_lod, lod, max_lod);
+}
+
+// Texture2D::Sample with a MIN_MAG_MIP_LINEAR / WRAP sampler on a bound texture.
+internal void raster_sample_linear(const RasterTexture* texture, const RasterSampler* sampler, f32 u, f32 v, f32 lod_squared,
+																	 f32 out[4]) {
+	f32 lod = raster_sample_lod(texture, sampler, lod_squared);
+	u32 level = (u32)lod;
+	f32 blend = lod - (f32)level;
+	raster_sample_bilinear(&texture->levels[level], u, v, out);
+	if(blend > 0.0f && level + 1 < texture->level_count) {
+		f32 next[4];
+		raster_sample_bilinear(&texture->levels[level + 1], u, v, next);
+		for(u32 c = 0; c < 4; c++) out[c] += (next[c] - out[c]) * blend;
+	}
+}
+
+// MIN_MAG_MIP_POINT: the nearest texel of the nearest level.
+internal void raster_sample_point(const RasterTexture* texture, const RasterSampler* sampler, f32 u, f32 v, f32 lod_squared,
+																	f32 out[4]) {
+	f32 lod = raster_sample_lod(texture, sampler, lod_squared);
+	u32 level = Min((u32)(lod + 0.5f), texture->level_count - 1);
+	raster_sample_nearest(&texture->levels[level], u, v, out);
+}
+
+// Texture2D::Sample with WRAP addressing and the sampler's filter. Unbound
+// textures sample zero.
+internal void raster_sample(const RasterTexture* texture, const RasterSampler* sampler, f32 u, f32 v, f32 lod_squared,
+														f32 out[4]) {
+	if(!texture || texture->level_count == 0) {
+		out[0] = out[1] = out[2] = out[3] = 0.0f;
+		return;
+	}
+	if(sampler->filter == RasterFilter_Point) raster_sample_point(texture, sampler, u, v, lod_squared, out);
+	else                                      raster_sample_linear(texture, sampler, u, v, lod_squared, out);
+}
+
+//------------------------------------------------------------------------
+// Clipping
+//------------------------------------------------------------------------
+
+// Signed distance to each plane of the D3D clip volume, inside when >= 0.
+internal f32 raster_clip_distance(const RasterVSOutput* v, u32 plane) {
+	switch(plane) {
+		case 0:  return v->position.w + v->position.x;
+		case 1:  return v->position.w - v->position.x;
+		case 2:  return v->position.w + v->position.y;
+		case 3:  return v->position.w - v->position.y;
+		case 4:  return v->position.z;
+		default: return v->position.w - v->position.z;
+	}
+}
+
+// Outcode bits 0-5 are the planes of raster_clip_distance(), 6-9 the sides of
+// the guard band in the same order.
+#define RASTER_OUTCODE_SIDES   0x00fu
+#define RASTER_OUTCODE_DEPTH   0x030u
+#define RASTER_OUTCODE_VOLUME  0x03fu
+#define RASTER_OUTCODE_GUARD   0x3c0u
+
+// The guard band as clip-space x / w and y / w: RASTER_GUARD_BAND pixels
+// either side of the target's origin, never less than the clip volume.
+struct RasterGuardBand {
+	f32 x_min, x_max;
+	f32 y_min, y_max;
+};
+
+internal RasterGuardBand raster_guard_band(const RasterViewport* viewport) {
+	f32 scale_x = 2.0f / Max(viewport->width, 1.0f);
+	f32 scale_y = 2.0f / Max(viewport->height, 1.0f);
+	RasterGuardBand guard;
+	guard.x_min = Min((-RASTER_GUARD_BAND - viewport->x) * scale_x - 1.0f, -1.0f);
+	guard.x_max = Max((RASTER_GUARD_BAND - viewport->x) * scale_x - 1.0f, 1.0f);
+	guard.y_min = Min(1.0f - (RASTER_GUARD_BAND - viewport->y) * scale_y, -1.0f);
+	guard.y_max = Max(1.0f + (RASTER_GUARD_BAND + viewport->y) * scale_y, 1.0f);
+	return guard;
+}
+
+internal u32 raster_outcode(const RasterVSOutput* v, const RasterGuardBand* guard) {
+	u32 code = 0;
+	for(u32 plane = 0; plane < 6; plane++) {
+		if(raster_clip_distance(v, plane) < 0.0f) code |= 1u << plane;
+	}
+	const Vec4* p = &v->position;
+	if(p->x < guard->x_min * p->w) code |= 1u << 6;
+	if(p->x > guard->x_max * p->w) code |= 1u << 7;
+	if(p->y < guard->y_min * p->w) code |= 1u << 8;
+	if(p->y > guard->y_max * p->w) code |= 1u << 9;
+	return code;
+}
+
+#if defined(__AVX2__)
+
+// raster_outcode() of 8 vertices, SoA x, y, z, w.
+inline __m256i raster_outcode8(const __m256 position[4], const RasterGuardBand* guard) {
+	__m256 x = position[0], y = position[1], z = position[2], w = position[3];
+	__m256 zero = _mm256_setzero_ps();
+	__m256 outside[10] = {
+		_mm256_cmp_ps(_mm256_add_ps(w, x), zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(_mm256_sub_ps(w, x), zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(_mm256_add_ps(w, y), zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(_mm256_sub_ps(w, y), zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(z, zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(_mm256_sub_ps(w, z), zero, _CMP_LT_OQ),
+		_mm256_cmp_ps(x, _mm256_mul_ps(_mm256_set1_ps(guard->x_min), w), _CMP_LT_OQ),
+		_mm256_cmp_ps(x, _mm256_mul_ps(_mm256_set1_ps(guard->x_max), w), _CMP_GT_OQ),
+		_mm256_cmp_ps(y, _mm256_mul_ps(_mm256_set1_ps(guard->y_min), w), _CMP_LT_OQ),
+		_mm256_cmp_ps(y, _mm256_mul_ps(_mm256_set1_ps(guard->y_max), w), _CMP_GT_OQ),
+	};
+	__m256i code = _mm256_setzero_si256();
+	for(u32 plane = 0; plane < ArrayCount(outside); plane++) {
+		code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(outside[plane]), _mm256_set1_epi32(1 << plane)));
+	}
+	return code;
+}
+
+#endif
+
+internal RasterVSOutput raster_lerp_vertex(const RasterVSOutput* a, const RasterVSOutput* b, f32 t) {
+	RasterVSOutput result;
+	result.position.x = a->position.x + (b->position.x - a->position.x) * t;
+	result.position.y = a->position.y + (b->position.y - a->position.y) * t;
+	result.position.z = a->position.z + (b->position.z - a->position.z) * t;
+	result.position.w = a->position.w + (b->position.w - a->position.w) * t;
+	result.tex[0] = a->tex[0] + (b->tex[0] - a->tex[0]) * t;
+	result.tex[1] = a->tex[1] + (b->tex[1] - a->tex[1]) * t;
+	return result;
+}
+
+// Sutherland-Hodgman against every plane in `planes`. Returns the vertex count
+// of the clipped convex polygon in `out`, which is 0 when nothing is left.
+internal u32 raster_clip_polygon(RasterVSOutput out[RASTER_MAX_CLIP_VERTS], const RasterVSOutput in[3], u32 planes) {
+	RasterVSOutput buffer[RASTER_MAX_CLIP_VERTS];
+	RasterVSOutput* src = buffer;
+	RasterVSOutput* dst = out;
+	u32 count = 3;
+	for(u32 i = 0; i < 3; i++) src[i] = in[i];
+
+	for(u32 plane = 0; plane < 6 && count >= 3; plane++) {
+		if(!(planes & (1u << plane))) continue;
+
+		u32 dst_count = 0;
+		for(u32 i = 0; i < count; i++) {
+			const RasterVSOutput* a = &src[i];
+			const RasterVSOutput* b = &src[(i + 1) % count];
+			f32 da = raster_clip_distance(a, plane);
+			f32 db = raster_clip_distance(b, plane);
+			if(da >= 0.0f) dst[dst_count++] = *a;
+			if((da >= 0.0f) != (db >= 0.0f)) dst[dst_count++] = raster_lerp_vertex(a, b, da / (da - db));
+		}
+
+		RasterVSOutput* swap = src;
+		src = dst;
+		dst = swap;
+		count = dst_count;
+	}
+
+	if(src != out) {
+		for(u32 i = 0; i < count; i++) out[i] = src[i];
+	}
+	return count >= 3 ? count : 0;
+}
+
+//------------------------------------------------------------------------
+// Rasterization
+//------------------------------------------------------------------------
+
+// An attribute as a linear function of the screen position, f = c + dx * x + dy * y.
+struct RasterPlane {
+	f32 c;
+	f32 dx;
+	f32 dy;
+};
+
+internal RasterPlane raster_plane(const f32 x[3], const f32 y[3], const f32 f[3], f32 inv_area) {
+	f32 x1 = x[1] - x[0], y1 = y[1] - y[0], f1 = f[1] - f[0];
+	f32 x2 = x[2] - x[0], y2 = y[2] - y[0], f2 = f[2] - f[0];
+	RasterPlane plane;
+	plane.dx = (f1 * y2 - f2 * y1) * inv_area;
+	plane.dy = (x1 * f2 - x2 * f1) * inv_area;
+	plane.c = f[0] - plane.dx * x[0] - plane.dy * y[0];
+	return plane;
+}
+
+// Edge function of a -> b at p, all in sub-pixel units. Positive on the
+// inside of a clockwise (on screen, y down) triangle.
+internal s64 raster_edge(s64 ax, s64 ay, s64 bx, s64 by, s64 px, s64 py) {
+	return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+// Top edges (horizontal, interior below) and left edges (interior to the
+// right) own the pixels whose centres lie exactly on them.
+internal b32 raster_is_top_left(s64 ax, s64 ay, s64 bx, s64 by) {
+	return (ay == by && bx > ax) || by < ay;
+}
+
+// A triangle after setup, everything the rasterizer and pixel stage need to
+// cover any rectangle of it.
+struct RasterTriangle {
+	s32 x0, y0, x1, y1;     // Pixels whose centres can be covered, inclusive, inside the viewport.
+	s64 edge[3];            // Edge functions at the centre of pixel (x0, y0), fill rule bias included.
+	s64 step_x[3];          // Per pixel to the right.
+	s64 step_y[3];          // Per row down.
+	RasterPlane z;          // Depth, linear in screen space.
+	RasterPlane w;          // 1/w, u/w and v/w for perspective correct texcoords.
+	RasterPlane u;
+	RasterPlane v;
+	u32 draw;               // Free for the caller (the binner keeps the draw it came from).
+};
+
+// Perspective divide, viewport transform, snapping, culling and edge/plane
+// setup of a triangle that lies inside the clip volume. Returns false if it is
+// culled or covers no pixel centre.
+internal b32 raster_setup_triangle(const RasterContext* context, const RasterVSOutput* v0, const RasterVSOutput* v1,
+																	 const RasterVSOutput* v2, RasterTriangle* triangle, RasterStats* stats) {
+	const RasterViewport* viewport = &context->viewport;
+	const RasterTarget* target = context->target;
+	const RasterVSOutput* v[3] = { v0, v1, v2 };
+
+	s64 fx[3], fy[3];
+	f32 sx[3], sy[3], sz[3], inv_w[3], u_w[3], v_w[3];
+	for(u32 i = 0; i < 3; i++) {
+		f32 w = 1.0f / v[i]->position.w;
+		f32 x = viewport->x + (v[i]->position.x * w + 1.0f) * 0.5f * viewport->width;
+		f32 y = viewport->y + (1.0f - v[i]->position.y * w) * 0.5f * viewport->height;
+		fx[i] = (s64)floorf(x * RASTER_SUBPIXEL_ONE + 0.5f);
+		fy[i] = (s64)floorf(y * RASTER_SUBPIXEL_ONE + 0.5f);
+		sx[i] = (f32)fx[i] * (1.0f / RASTER_SUBPIXEL_ONE);
+		sy[i] = (f32)fy[i] * (1.0f / RASTER_SUBPIXEL_ONE);
+		sz[i] = viewport->min_depth + v[i]->position.z * w * (viewport->max_depth - viewport->min_depth);
+		inv_w[i] = w;
+		u_w[i] = v[i]->tex[0] * w;
+		v_w[i] = v[i]->tex[1] * w;
+	}
+
+	s64 area = raster_edge(fx[0], fy[0], fx[1], fy[1], fx[2], fy[2]);
+	b32 clockwise = area > 0;
+	if(area == 0 ||
+		 (context->cull == RasterCull_Back && !clockwise) ||
+		 (context->cull == RasterCull_Front && clockwise)) {
+		stats->triangles_culled++;
+		return false;
+	}
+	if(!clockwise) {
+		s64 t;
+		t = fx[1]; fx[1] = fx[2]; fx[2] = t;
+		t = fy[1]; fy[1] = fy[2]; fy[2] = t;
+		f32 f;
+		f = sx[1]; sx[1] = sx[2]; sx[2] = f;
+		f = sy[1]; sy[1] = sy[2]; sy[2] = f;
+		f = sz[1]; sz[1] = sz[2]; sz[2] = f;
+		f = inv_w[1]; inv_w[1] = inv_w[2]; inv_w[2] = f;
+		f = u_w[1]; u_w[1] = u_w[2]; u_w[2] = f;
+		f = v_w[1]; v_w[1] = v_w[2]; v_w[2] = f;
+		area = -area;
+	}
+
+	// Pixels whose centres fall inside the bounding box, clipped to the viewport and target.
+	s32 clip_x0 = Max((s32)viewport->x, 0);
+	s32 clip_y0 = Max((s32)viewport->y, 0);
+	s32 clip_x1 = Min((s32)ceilf(viewport->x + viewport->width), (s32)target->width) - 1;
+	s32 clip_y1 = Min((s32)ceilf(viewport->y + viewport->height), (s32)target->height) - 1;
+	const s64 half = RASTER_SUBPIXEL_ONE / 2;
+	s32 x0 = (s32)((Min(Min(fx[0], fx[1]), fx[2]) - half + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS);
+	s32 y0 = (s32)((Min(Min(fy[0], fy[1]), fy[2]) - half + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS);
+	s32 x1 = (s32)((Max(Max(fx[0], fx[1]), fx[2]) - half) >> RASTER_SUBPIXEL_BITS);
+	s32 y1 = (s32)((Max(Max(fy[0], fy[1]), fy[2]) - half) >> RASTER_SUBPIXEL_BITS);
+	triangle->x0 = Max(x0, clip_x0);
+	triangle->y0 = Max(y0, clip_y0);
+	triangle->x1 = Min(x1, clip_x1);
+	triangle->y1 = Min(y1, clip_y1);
+	if(triangle->x0 > triangle->x1 || triangle->y0 > triangle->y1) return false;
+
+	// The fill rule is folded in as a bias, so the test is `edge >= 0` for all three.
+	s64 px = ((s64)triangle->x0 << RASTER_SUBPIXEL_BITS) + half;
+	s64 py = ((s64)triangle->y0 << RASTER_SUBPIXEL_BITS) + half;
+	for(u32 i = 0; i < 3; i++) {
+		u32 a = (i + 1) % 3;
+		u32 b = (i + 2) % 3;
+		triangle->edge[i] = raster_edge(fx[a], fy[a], fx[b], fy[b], px, py) - (raster_is_top_left(fx[a], fy[a], fx[b], fy[b]) ? 0 : 1);
+		triangle->step_x[i] = -(fy[b] - fy[a]) * RASTER_SUBPIXEL_ONE;
+		triangle->step_y[i] = (fx[b] - fx[a]) * RASTER_SUBPIXEL_ONE;
+	}
+
+	f32 inv_area = (f32)((f64)(RASTER_SUBPIXEL_ONE * RASTER_SUBPIXEL_ONE) / (f64)area);
+	triangle->z = raster_plane(sx, sy, sz, inv_area);
+	triangle->w = raster_plane(sx, sy, inv_w, inv_area);
+	triangle->u = raster_plane(sx, sy, u_w, inv_area);
+	triangle->v = raster_plane(sx, sy, v_w, inv_area);
+	return true;
+}
+
+// What the pixel stage does with the pixels that pass the depth test, a
+// template argument of the shading loops.
+enum RasterShade : u32 {
+	RasterShade_None,       // colour_write off, a depth-only pass.
+	RasterShade_Unbound,    // No texture, textured_ps writes zero.
+	RasterShade_Linear,     // textured_ps with the sampler's filter.
+	RasterShade_Point,
+	RasterShade_COUNT
+};
+
+// textured_ps.hlsl for the pixel at (x, y), which passed the depth test.
+template<u32 shade> internal void raster_shade_pixel(const RasterContext* context, const RasterTriangle* triangle, s32 x, s32 y) {
+	u32* out = &context->target->colour[(u64)y * context->target->width + x];
+	if(shade == RasterShade_Unbound) {
+		*out = 0;
+		return;
+	}
+
+	const RasterTexture* texture = context->texture;
+	const RasterPlane w_plane = triangle->w;
+	const RasterPlane u_plane = triangle->u;
+	const RasterPlane v_plane = triangle->v;
+	f32 texture_width = (f32)texture->levels[0].width;
+	f32 texture_height = (f32)texture->levels[0].height;
+	f32 cx = (f32)x + 0.5f;
+	f32 cy = (f32)y + 0.5f;
+
+	// u = U / W, so du/dx = (dU/dx * W - U * dW/dx) / W^2, exact rather than per quad.
+	f32 w = w_plane.c + w_plane.dx * cx + w_plane.dy * cy;
+	f32 uw = u_plane.c + u_plane.dx * cx + u_plane.dy * cy;
+	f32 vw = v_plane.c + v_plane.dx * cx + v_plane.dy * cy;
+	f32 rcp_w = 1.0f / w;
+	f32 u = uw * rcp_w;
+	f32 v = vw * rcp_w;
+	f32 dudx = (u_plane.dx - u * w_plane.dx) * rcp_w * texture_width;
+	f32 dvdx = (v_plane.dx - v * w_plane.dx) * rcp_w * texture_height;
+	f32 dudy = (u_plane.dy - u * w_plane.dy) * rcp_w * texture_width;
+	f32 dvdy = (v_plane.dy - v * w_plane.dy) * rcp_w * texture_height;
+	f32 lod_squared = Max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+
+	f32 colour[4];
+	if(shade == RasterShade_Point) raster_sample_point(texture, &context->sampler, u, v, lod_squared, colour);
+	else                           raster_sample_linear(texture, &context->sampler, u, v, lod_squared, colour);
+	*out = raster_pack_unorm8(colour);
+}
+
+// Rasterizes and shades the part of `triangle` inside the pixel rectangle
+// [x0, x1] x [y0, y1] (inclusive). Only touches pixels of that rectangle, so
+// disjoint rectangles can be shaded concurrently.
+//
+// Walks the 8x8 blocks of the rectangle with the edge functions stepped from
+// block to block. Blocks entirely outside an edge are skipped, edges that
+// cover a whole block are dropped from it, and the rest goes to the block
+// kernel for coverage and the depth test. The pixel shader then runs on the
+// pixels that passed. One of these is compiled for every depth state and
+// pixel stage; raster_pipeline() picks the one a draw's state needs.
+template<u32 depth_state, u32 shade>
+internal void raster_shade_variant(const RasterContext* context, const RasterTriangle* triangle,
+																	 s32 x0, s32 y0, s32 x1, s32 y1, RasterStats* stats) {
+	x0 = Max(x0, triangle->x0);
+	y0 = Max(y0, triangle->y0);
+	x1 = Min(x1, triangle->x1);
+	y1 = Min(y1, triangle->y1);
+	if(x0 > x1 || y0 > y1) return;
+
+	const RasterViewport* viewport = &context->viewport;
+	RasterTarget* target = context->target;
+	RasterBlockKernel* kernel = raster_block_kernel(depth_state);
+
+	RasterBlockDepth depth;
+	depth.c = triangle->z.c;
+	depth.dx = triangle->z.dx;
+	depth.dy = triangle->z.dy;
+	depth.min = Min(viewport->min_depth, viewport->max_depth);
+	depth.max = Max(viewport->min_depth, viewport->max_depth);
+	depth.depth = target->depth;
+	depth.pitch = target->width;
+
+	// Edges in whole pixel steps at the first block.
+	s32 block_x0 = x0 & ~(RASTER_BLOCK_SIZE - 1);
+	s32 block_y0 = y0 & ~(RASTER_BLOCK_SIZE - 1);
+	s64 row_edge[3], step_x[3], step_y[3];
+	for(u32 i = 0; i < 3; i++) {
+		step_x[i] = triangle->step_x[i] >> RASTER_SUBPIXEL_BITS;
+		step_y[i] = triangle->step_y[i] >> RASTER_SUBPIXEL_BITS;
+		row_edge[i] = (triangle->edge[i] >> RASTER_SUBPIXEL_BITS) + (s64)(block_x0 - triangle->x0) * step_x[i] + (s64)(block_y0 - triangle->y0) * step_y[i];
+	}
+
+	for(s32 block_y = block_y0; block_y <= y1; block_y += RASTER_BLOCK_SIZE) {
+		u64 rows = 0;
+		for(s32 row = 0; row < RASTER_BLOCK_SIZE; row++) {
+			if(block_y + row >= y0 && block_y + row <= y1) rows |= 0xffull << (row * 8);
+		}
+
+		s64 edge[3] = { row_edge[0], row_edge[1], row_edge[2] };
+		for(s32 block_x = block_x0; block_x <= x1; block_x += RASTER_BLOCK_SIZE) {
+			RasterBlock block;
+			block.x = block_x;
+			block.y = block_y;
+			b32 inside = raster_block_edges(&block, edge, step_x, step_y);
+			for(u32 i = 0; i < 3; i++) edge[i] += step_x[i] * RASTER_BLOCK_SIZE;
+			if(!inside) continue;
+
+			u32 columns = 0;
+			for(s32 column = 0; column < RASTER_BLOCK_SIZE; column++) {
+				if(block_x + column >= x0 && block_x + column <= x1) columns |= 1u << column;
+			}
+			block.mask = rows & (columns * 0x0101010101010101ull);
+
+			u64 covered;
+			u64 passed = kernel(&block, &depth, &covered);
+			stats->pixels_covered += raster_popcount(covered);
+			stats->pixels_depth_failed += raster_popcount(covered & ~passed);
+			stats->pixels_written += raster_popcount(passed);
+			if(shade != RasterShade_None) {
+				for(u64 pixels = passed; pixels; pixels &= pixels - 1) {
+					u32 bit = raster_lowest_bit(pixels);
+					raster_shade_pixel<shade>(context, triangle, block_x + (s32)(bit & 7), block_y + (s32)(bit >> 3));
+				}
+			}
+		}
+		for(u32 i = 0; i < 3; i++) row_edge[i] += step_y[i] * RASTER_BLOCK_SIZE;
+	}
+}
+
+typedef void RasterPipeline(const RasterContext* context, const RasterTriangle* triangle, s32 x0, s32 y0, s32 x1, s32 y1,
+														RasterStats* stats);
+
+#define RASTER_PIPELINE_COUNT (RASTER_DEPTH_STATES * RasterShade_COUNT)
+
+global RasterPipeline* g_raster_pipelines[RASTER_PIPELINE_COUNT];
+
+// Instantiates the variants of every key from `key` up.
+template<u32 key> struct RasterPipelineTable {
+	static void fill() {
+		g_raster_pipelines[key] = raster_shade_variant<key / RasterShade_COUNT, key % RasterShade_COUNT>;
+		RasterPipelineTable<key + 1>::fill();
+	}
+};
+
+template<> struct RasterPipelineTable<RASTER_PIPELINE_COUNT> {
+	static void fill() {}
+};
+
+internal void raster_pipelines_fill() {
+	RasterPipelineTable<0>::fill();
+}
+
+// The state a draw's pixel loops depend on, packed into an index of the
+// variant table: the depth state and the pixel stage. Cull mode, viewport
+// and the rest are per triangle and stay runtime; the block kernel of the
+// selected instruction set is a call per 8x8 block.
+internal u32 raster_pipeline_key(const RasterContext* context) {
+	u32 depth_state = RASTER_DEPTH_OFF;
+	if(context->depth_enable) depth_state = ((u32)context->depth_func & 7) * 2 + (context->depth_write ? 1 : 0);
+
+	u32 shade = RasterShade_None;
+	if(context->colour_write) {
+		if(!context->texture || context->texture->level_count == 0) shade = RasterShade_Unbound;
+		else if(context->sampler.filter == RasterFilter_Point)      shade = RasterShade_Point;
+		else                                                        shade = RasterShade_Linear;
+	}
+	return depth_state * RasterShade_COUNT + shade;
+}
+
+// The shading loop for the state `context` has now. Look it up once per
+// draw, the state does not change inside one.
+internal RasterPipeline* raster_pipeline(const RasterContext* context) {
+	return g_raster_pipelines[raster_pipeline_key(context)];
+}
+
+// raster_shade_variant() for the state of `context`.
+internal void raster_shade_triangle(const RasterContext* context, const RasterTriangle* triangle,
+																		s32 x0, s32 y0, s32 x1, s32 y1, RasterStats* stats) {
+	raster_pipeline(context)(context, triangle, x0, y0, x1, y1, stats);
+}
+
+// Clipping and setup of a shaded triangle from the AND and the OR of its
+// vertices' outcodes. Only the near and far planes always clip; the sides only
+// clip triangles that reach out of the guard band, the others are rasterized
+// whole and the viewport bounds of raster_setup_triangle() keep them on screen.
+// Writes up to RASTER_MAX_CLIP_VERTS - 2 triangles (clipping can turn one into
+// a fan) and returns how many.
+internal u32 raster_clip_triangle(const RasterContext* context, const RasterVSOutput v[3], u32 code_and, u32 code_or,
+																	RasterTriangle out[RASTER_MAX_CLIP_VERTS - 2], RasterStats* stats) {
+	stats->triangles++;
+	if(code_and & RASTER_OUTCODE_VOLUME) {
+		stats->triangles_culled++;
+		return 0;
+	}
+
+	u32 planes = code_or & RASTER_OUTCODE_DEPTH;
+	if(code_or & RASTER_OUTCODE_GUARD) planes |= code_or & RASTER_OUTCODE_SIDES;
+	else if(code_or & RASTER_OUTCODE_SIDES) stats->triangles_guard_band++;
+	if(!planes) return raster_setup_triangle(context, &v[0], &v[1], &v[2], &out[0], stats) ? 1 : 0;
+
+	RasterVSOutput polygon[RASTER_MAX_CLIP_VERTS];
+	u32 count = raster_clip_polygon(polygon, v, planes);
+	stats->triangles_clipped++;
+	u32 result = 0;
+	for(u32 k = 1; k + 1 < count; k++) {
+		if(raster_setup_triangle(context, &polygon[0], &polygon[k], &polygon[k + 1], &out[result], stats)) result++;
+	}
+	return result;
+}
+
+// Front end for one triangle of an indexed list: vertex shader, clipping and
+// setup. Returns how many triangles it wrote to `out`.
+internal u32 raster_assemble_triangle(const RasterContext* context, u32 first_index, s32 base_vertex,
+																			RasterTriangle out[RASTER_MAX_CLIP_VERTS - 2], RasterStats* stats) {
+	RasterGuardBand guard = raster_guard_band(&context->viewport);
+	RasterVSOutput v[3];
+	u32 code_and = ~0u, code_or = 0;
+	for(u32 k = 0; k < 3; k++) {
+		s64 index = (s64)context->indices[first_index + k] + base_vertex;
+		if(index < 0 || index >= (s64)context->vertex_count) return 0;
+		v[k] = raster_textured_vs(context->constants, &context->vertices[index]);
+		u32 code = raster_outcode(&v[k], &guard);
+		code_and &= code;
+		code_or |= code;
+	}
+	return raster_clip_triangle(context, v, code_and, code_or, out, stats);
+}
+
+// raster_assemble_triangle() for `count` (at most RASTER_CLIP_BATCH)
+// consecutive triangles. The vertex shader's positions and the outcodes run 8
+// lanes wide, one triangle per lane, so the common cases (inside, inside the
+// guard band, outside a plane) never leave SIMD registers; the triangles that
+// are left are clipped and set up in order and packed into `out`. Returns how
+// many were written, the same triangles raster_assemble_triangle() gives.
+internal u32 raster_assemble_triangles(const RasterContext* context, u32 first_index, u32 count, s32 base_vertex,
+																			 RasterTriangle out[RASTER_CLIP_BATCH * (RASTER_MAX_CLIP_VERTS - 2)], RasterStats* stats) {
+	RasterGuardBand guard = raster_guard_band(&context->viewport);
+	const RasterVertex unused = {};
+	const RasterVertex* input[3][RASTER_CLIP_BATCH];
+	u32 valid = 0;
+	for(u32 lane = 0; lane < RASTER_CLIP_BATCH; lane++) {
+		b32 lane_valid = lane < count;
+		for(u32 k = 0; k < 3; k++) {
+			input[k][lane] = &unused;
+			if(!lane_valid) continue;
+			s64 index = (s64)context->indices[first_index + lane * 3 + k] + base_vertex;
+			if(index < 0 || index >= (s64)context->vertex_count) lane_valid = false;
+			else input[k][lane] = &context->vertices[index];
+		}
+		if(lane_valid) valid |= 1u << lane;
+	}
+
+	// Positions SoA, position[vertex][component][lane].
+	f32 position[3][4][RASTER_CLIP_BATCH];
+	u32 code_and[RASTER_CLIP_BATCH], code_or[RASTER_CLIP_BATCH];
+#if defined(__AVX2__)
+	__m256i lanes_and = _mm256_set1_epi32(-1);
+	__m256i lanes_or = _mm256_setzero_si256();
+	for(u32 k = 0; k < 3; k++) {
+		__m256 p[4];
+		raster_textured_vs8(context->constants, input[k], p);
+		__m256i code = raster_outcode8(p, &guard);
+		lanes_and = _mm256_and_si256(lanes_and, code);
+		lanes_or = _mm256_or_si256(lanes_or, code);
+		for(u32 c = 0; c < 4; c++) _mm256_storeu_ps(position[k][c], p[c]);
+	}
+	_mm256_storeu_si256((__m256i*)code_and, lanes_and);
+	_mm256_storeu_si256((__m256i*)code_or, lanes_or);
+#else
+	for(u32 lane = 0; lane < RASTER_CLIP_BATCH; lane++) {
+		code_and[lane] = ~0u;
+		code_or[lane] = 0;
+		for(u32 k = 0; k < 3; k++) {
+			RasterVSOutput v = raster_textured_vs(context->constants, input[k][lane]);
+			u32 code = raster_outcode(&v, &guard);
+			code_and[lane] &= code;
+			code_or[lane] |= code;
+			position[k][0][lane] = v.position.x;
+			position[k][1][lane] = v.position.y;
+			position[k][2][lane] = v.position.z;
+			position[k][3][lane] = v.position.w;
+		}
+	}
+#endif
+
+	u32 result = 0;
+	for(u32 lane = 0; lane < count; lane++) {
+		if(!(valid & (1u << lane))) continue;
+		if(code_and[lane] & RASTER_OUTCODE_VOLUME) {
+			stats->triangles++;
+			stats->triangles_culled++;
+			continue;
+		}
+		RasterVSOutput v[3];
+		for(u32 k = 0; k < 3; k++) {
+			v[k].position = vec4(position[k][0][lane], position[k][1][lane], position[k][2][lane], position[k][3][lane]);
+			v[k].tex[0] = input[k][lane]->texture[0];
+			v[k].tex[1] = input[k][lane]->texture[1];
+		}
+		result += raster_clip_triangle(context, v, code_and[lane], code_or[lane], &out[result], stats);
+	}
+	return result;
+}
+
+// DrawIndexed with a triangle list: `index_count` indices from `start_index`,
+// each offset by `base_vertex`. Runs on the calling thread, a batch of
+// triangles at a time; raster/bin.h is the parallel path.
+internal void raster_draw_indexed(RasterContext* context, u32 index_count, u32 start_index, s32 base_vertex) {
+	context->stats.draws++;
+	RasterPipeline* pipeline = raster_pipeline(context);
+	u32 triangle_count = index_count / 3;
+	for(u32 i = 0; i < triangle_count; i += RASTER_CLIP_BATCH) {
+		RasterTriangle triangles[RASTER_CLIP_BATCH * (RASTER_MAX_CLIP_VERTS - 2)];
+		u32 batch = Min(triangle_count - i, (u32)RASTER_CLIP_BATCH);
+		u32 count = raster_assemble_triangles(context, start_index + i * 3, batch, base_vertex, triangles, &context->stats);
+		for(u32 k = 0; k < count; k++) {
+			pipeline(context, &triangles[k], triangles[k].x0, triangles[k].y0, triangles[k].x1, triangles[k].y1, &context->stats);
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Output
+//------------------------------------------------------------------------
+
+internal b32 raster_write_tga_pixels(const char* path, const u32* pixels, u32 width, u32 height, b32 depth) {
+	FILE* file = fopen(path, "wb");
+	if(!file) return false;
+
+	TGAHeader header = {};
+	header.image_type = TGAImageType_TrueColour;
+	header.width = (u16)width;
+	header.height = (u16)height;
+	header.bpp = 32;
+	header.descriptor = 8 | TGA_DESCRIPTOR_TOP_TO_BOTTOM;
+	b32 ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	ArenaTemp scratch = arena_scratch_begin();
+	u8* row = ArenaPushArray(scratch.arena, u8, (u64)width * 4);
+	for(u32 y = 0; ok && y < height; y++) {
+		const u32* source = pixels + (u64)y * width;
+		if(depth) {
+			// Top 8 bits of the 24-bit depth as grey.
+			for(u32 x = 0; x < width; x++) {
+				u8 grey = (u8)((source[x] & RASTER_DEPTH_MAX) >> 16);
+				row[x * 4 + 0] = row[x * 4 + 1] = row[x * 4 + 2] = grey;
+				row[x * 4 + 3] = 0xff;
+			}
+		} else {
+			tga_swizzle_bgra_to_rgba(row, (const u8*)source, width);
+		}
+		ok = fwrite(row, 1, (u64)width * 4, file) == (u64)width * 4;
+	}
+	arena_scratch_end(scratch);
+	return fclose(file) == 0 && ok;
+}
+
+// Colour as a top-down 32-bit TGA.
+internal b32 raster_write_colour_tga(const RasterTarget* target, const char* path) {
+	return raster_write_tga_pixels(path, target->colour, target->width, target->height, false);
+}
+
+// Depth as a greyscale TGA, near is black.
+internal b32 raster_write_depth_tga(const RasterTarget* target, const char* path) {
+	return raster_write_tga_pixels(path, target->depth, target->width, target->height, true);
+}
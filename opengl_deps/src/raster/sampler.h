@@ -0,0 +1,351 @@
+#pragma once
+
+// Batched trilinear sampler over Morton-swizzled textures.
+//
+// The same filtering as raster_sample_linear() (textured.cc's
+// MIN_MAG_MIP_LINEAR sampler with WRAP addressing, whatever the sampler's
+// filter says) for 8 samples at a time, for software rendering and texture
+// baking. Texels are stored in Morton (Z) order per level, so the 2x2
+// footprint of a bilinear tap and the footprints of neighbouring samples
+// share cache lines whatever the direction of the walk.
+// With AVX2 every tap is a 32-bit gather of 8 texels and all of the
+// addressing, unpacking and filtering is done 8 lanes wide, one lane per
+// sample, each with its own LOD and levels; without it the same math runs
+// lane by lane.
+//
+// Swizzling needs power of two sizes, which makes wrapping a mask. The filter
+// matches raster_sample_linear() operation for operation, only log2 of the LOD is a
+// polynomial (within 1e-7 of log2f) so the SIMD and scalar paths agree bit
+// for bit.
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+#include "raster/raster.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+#define RASTER_SAMPLE_LANES 8
+
+struct RasterSwizzledLevel {
+	u32 offset;         // First texel of the level.
+	u32 width_log2;
+	u32 height_log2;
+};
+
+// RGBA8 texels, every level in Morton order: the square of the smaller side
+// is interleaved, the longer side steps whole squares.
+struct RasterSwizzledTexture {
+	u32 level_count;
+	f32 min_lod;
+	u32 width;          // Level 0.
+	u32 height;
+	RasterSwizzledLevel levels[MIP_MAX_LEVELS];
+	u32* texels;
+	u64 size;
+};
+
+//------------------------------------------------------------------------
+// Swizzling
+//------------------------------------------------------------------------
+
+// Spreads the low 16 bits of `x` to the even bits.
+internal u32 raster_morton_spread(u32 x) {
+	x &= 0xffff;
+	x = (x | (x << 8)) & 0x00ff00ffu;
+	x = (x | (x << 4)) & 0x0f0f0f0fu;
+	x = (x | (x << 2)) & 0x33333333u;
+	x = (x | (x << 1)) & 0x55555555u;
+	return x;
+}
+
+internal u32 raster_morton_index(u32 x, u32 y, u32 square_log2) {
+	u32 square_mask = (1u << square_log2) - 1;
+	return raster_morton_spread(x & square_mask) | (raster_morton_spread(y & square_mask) << 1) |
+				 (((x | y) >> square_log2) << (square_log2 * 2));
+}
+
+internal b32 raster_is_pow2(u32 x) {
+	return x && !(x & (x - 1));
+}
+
+internal u32 raster_log2(u32 x) {
+	u32 result = 0;
+	while(x > 1) {
+		x >>= 1;
+		result++;
+	}
+	return result;
+}
+
+// Copies `source` into Morton order. Fails unless every level is a power of
+// two on both sides (and at most 32768).
+internal b32 raster_swizzle_texture(RasterSwizzledTexture* texture, const RasterTexture* source) {
+	*texture = {};
+	if(source->level_count == 0) return false;
+
+	u64 count = 0;
+	for(u32 i = 0; i < source->level_count; i++) {
+		const RasterTextureLevel* level = &source->levels[i];
+		if(!raster_is_pow2(level->width) || !raster_is_pow2(level->height) || level->width > 32768 || level->height > 32768) return false;
+		texture->levels[i].offset = (u32)count;
+		texture->levels[i].width_log2 = raster_log2(level->width);
+		texture->levels[i].height_log2 = raster_log2(level->height);
+		count += (u64)level->width * level->height;
+		if(count > 0xffffffffull / 4) return false;
+	}
+
+	texture->size = count * 4;
+	texture->texels = (u32*)os_alloc_pages(texture->size);
+	if(!texture->texels) return false;
+	texture->level_count = source->level_count;
+	texture->min_lod = source->min_lod;
+	texture->width = source->levels[0].width;
+	texture->height = source->levels[0].height;
+
+	for(u32 i = 0; i < source->level_count; i++) {
+		const RasterTextureLevel* level = &source->levels[i];
+		u32* texels = texture->texels + texture->levels[i].offset;
+		u32 square_log2 = Min(texture->levels[i].width_log2, texture->levels[i].height_log2);
+		for(u32 y = 0; y < level->height; y++) {
+			const u32* row = (const u32*)(level->data + (u64)y * level->row_pitch);
+			for(u32 x = 0; x < level->width; x++) texels[raster_morton_index(x, y, square_log2)] = row[x];
+		}
+	}
+	return true;
+}
+
+internal void raster_swizzled_release(RasterSwizzledTexture* texture) {
+	os_free_pages(texture->texels, texture->size);
+	*texture = {};
+}
+
+//------------------------------------------------------------------------
+// Scalar
+//------------------------------------------------------------------------
+
+// log2 of a positive normal float: exponent plus 2/ln2 * atanh((m - 1) / (m + 1))
+// with the mantissa m in [sqrt(1/2), sqrt(2)), four terms.
+internal f32 raster_log2_fast(f32 x) {
+	u32 bits;
+	memcpy(&bits, &x, 4);
+	s32 exponent = (s32)(bits >> 23) - 127;
+	bits = (bits & 0x007fffffu) | 0x3f800000u;
+	f32 m;
+	memcpy(&m, &bits, 4);
+	if(m > 1.41421356f) {
+		m = m * 0.5f;
+		exponent += 1;
+	}
+	f32 t = (m - 1.0f) / (m + 1.0f);
+	f32 t2 = t * t;
+	f32 p = t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+	return (f32)exponent + p;
+}
+
+internal void raster_swizzled_bilinear(const RasterSwizzledTexture* texture, u32 level, f32 u, f32 v, f32 out[4]) {
+	const RasterSwizzledLevel* info = &texture->levels[level];
+	u32 width = 1u << info->width_log2;
+	u32 height = 1u << info->height_log2;
+	u32 square_log2 = Min(info->width_log2, info->height_log2);
+	f32 x = u * (f32)width - 0.5f;
+	f32 y = v * (f32)height - 0.5f;
+	f32 x_floor = floorf(x);
+	f32 y_floor = floorf(y);
+	f32 fx = x - x_floor;
+	f32 fy = y - y_floor;
+
+	u32 x0 = (u32)(s32)x_floor & (width - 1);
+	u32 y0 = (u32)(s32)y_floor & (height - 1);
+	u32 x1 = (x0 + 1) & (width - 1);
+	u32 y1 = (y0 + 1) & (height - 1);
+
+	const u32* texels = texture->texels + info->offset;
+	u32 t00 = texels[raster_morton_index(x0, y0, square_log2)];
+	u32 t10 = texels[raster_morton_index(x1, y0, square_log2)];
+	u32 t01 = texels[raster_morton_index(x0, y1, square_log2)];
+	u32 t11 = texels[raster_morton_index(x1, y1, square_log2)];
+	for(u32 c = 0; c < 4; c++) {
+		f32 c00 = (f32)((t00 >> (c * 8)) & 0xff), c10 = (f32)((t10 >> (c * 8)) & 0xff);
+		f32 c01 = (f32)((t01 >> (c * 8)) & 0xff), c11 = (f32)((t11 >> (c * 8)) & 0xff);
+		f32 top = c00 + (c10 - c00) * fx;
+		f32 bottom = c01 + (c11 - c01) * fx;
+		out[c] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+	}
+}
+
+// raster_sample_linear() on a swizzled texture, `lod_squared` as there.
+internal void raster_swizzled_sample(const RasterSwizzledTexture* texture, const RasterSampler* sampler, f32 u, f32 v, f32 lod_squared,
+																		 f32 out[4]) {
+	f32 lod = 0.5f * raster_log2_fast(Max(lod_squared, 1e-20f)) + sampler->mip_lod_bias;
+	f32 min_lod = Max(Max(sampler->min_lod, texture->min_lod), 0.0f);
+	f32 max_lod = Min(sampler->max_lod, (f32)(texture->level_count - 1));
+	lod = Clamp(min_lod, lod, max_lod);
+
+	u32 level = (u32)lod;
+	f32 blend = lod - (f32)level;
+	raster_swizzled_bilinear(texture, level, u, v, out);
+	if(blend > 0.0f && level + 1 < texture->level_count) {
+		f32 next[4];
+		raster_swizzled_bilinear(texture, level + 1, u, v, next);
+		for(u32 c = 0; c < 4; c++) out[c] += (next[c] - out[c]) * blend;
+	}
+}
+
+//------------------------------------------------------------------------
+// Batches of 8
+//------------------------------------------------------------------------
+
+// Squared LOD of two 2x2 quads side by side, lanes 0-3 the top row and 4-7 the
+// row below, from coarse derivatives (the top-left pixel's neighbours) the way
+// a GPU computes them for Sample().
+internal void raster_quad_lod_squared(const RasterSwizzledTexture* texture, const f32 u[8], const f32 v[8], f32 lod_squared[8]) {
+	for(u32 quad = 0; quad < 2; quad++) {
+		u32 i = quad * 2;
+		f32 dudx = (u[i + 1] - u[i]) * (f32)texture->width;
+		f32 dvdx = (v[i + 1] - v[i]) * (f32)texture->height;
+		f32 dudy = (u[i + 4] - u[i]) * (f32)texture->width;
+		f32 dvdy = (v[i + 4] - v[i]) * (f32)texture->height;
+		f32 result = Max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+		lod_squared[i] = lod_squared[i + 1] = lod_squared[i + 4] = lod_squared[i + 5] = result;
+	}
+}
+
+#if defined(__AVX2__)
+
+inline __m256 raster_log2_fast8(__m256 x) {
+	__m256i bits = _mm256_castps_si256(x);
+	__m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+	__m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+	__m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+	m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+	exponent = _mm256_sub_epi32(exponent, _mm256_castps_si256(big));
+	__m256 t = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+	__m256 t2 = _mm256_mul_ps(t, t);
+	__m256 p = _mm256_add_ps(_mm256_set1_ps(0.577078016f), _mm256_mul_ps(t2, _mm256_set1_ps(0.412198583f)));
+	p = _mm256_add_ps(_mm256_set1_ps(0.961796694f), _mm256_mul_ps(t2, p));
+	p = _mm256_add_ps(_mm256_set1_ps(2.88539008f), _mm256_mul_ps(t2, p));
+	return _mm256_add_ps(_mm256_cvtepi32_ps(exponent), _mm256_mul_ps(t, p));
+}
+
+inline __m256i raster_morton_spread8(__m256i x) {
+	x = _mm256_and_si256(x, _mm256_set1_epi32(0xffff));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 8)), _mm256_set1_epi32(0x00ff00ff));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 4)), _mm256_set1_epi32(0x0f0f0f0f));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 2)), _mm256_set1_epi32(0x33333333));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 1)), _mm256_set1_epi32(0x55555555));
+	return x;
+}
+
+// Bilinear taps of 8 samples, each from its own level.
+inline void raster_swizzled_bilinear8(const RasterSwizzledTexture* texture, __m256i level, __m256 u, __m256 v, __m256 out[4]) {
+	// Per-lane level parameters, gathered from the level table.
+	const int* table = (const int*)texture->levels;
+	__m256i entry = _mm256_mullo_epi32(level, _mm256_set1_epi32(sizeof(RasterSwizzledLevel) / 4));
+	__m256i offset = _mm256_i32gather_epi32(table, entry, 4);
+	__m256i width_log2 = _mm256_i32gather_epi32(table + 1, entry, 4);
+	__m256i height_log2 = _mm256_i32gather_epi32(table + 2, entry, 4);
+	__m256i square_log2 = _mm256_min_epu32(width_log2, height_log2);
+	const __m256i one = _mm256_set1_epi32(1);
+	__m256i width_mask = _mm256_sub_epi32(_mm256_sllv_epi32(one, width_log2), one);
+	__m256i height_mask = _mm256_sub_epi32(_mm256_sllv_epi32(one, height_log2), one);
+	__m256i square_mask = _mm256_sub_epi32(_mm256_sllv_epi32(one, square_log2), one);
+
+	__m256 x = _mm256_sub_ps(_mm256_mul_ps(u, _mm256_cvtepi32_ps(_mm256_add_epi32(width_mask, one))), _mm256_set1_ps(0.5f));
+	__m256 y = _mm256_sub_ps(_mm256_mul_ps(v, _mm256_cvtepi32_ps(_mm256_add_epi32(height_mask, one))), _mm256_set1_ps(0.5f));
+	__m256 x_floor = _mm256_floor_ps(x);
+	__m256 y_floor = _mm256_floor_ps(y);
+	__m256 fx = _mm256_sub_ps(x, x_floor);
+	__m256 fy = _mm256_sub_ps(y, y_floor);
+	__m256i x0 = _mm256_and_si256(_mm256_cvttps_epi32(x_floor), width_mask);
+	__m256i y0 = _mm256_and_si256(_mm256_cvttps_epi32(y_floor), height_mask);
+	__m256i x1 = _mm256_and_si256(_mm256_add_epi32(x0, one), width_mask);
+	__m256i y1 = _mm256_and_si256(_mm256_add_epi32(y0, one), height_mask);
+
+	// Morton parts of each coordinate, the square's bits interleaved and the
+	// rest above them.
+	__m256i x0_part = raster_morton_spread8(_mm256_and_si256(x0, square_mask));
+	__m256i x1_part = raster_morton_spread8(_mm256_and_si256(x1, square_mask));
+	__m256i y0_part = _mm256_slli_epi32(raster_morton_spread8(_mm256_and_si256(y0, square_mask)), 1);
+	__m256i y1_part = _mm256_slli_epi32(raster_morton_spread8(_mm256_and_si256(y1, square_mask)), 1);
+	__m256i square_shift = _mm256_add_epi32(square_log2, square_log2);
+	__m256i x0_high = _mm256_sllv_epi32(_mm256_srlv_epi32(x0, square_log2), square_shift);
+	__m256i x1_high = _mm256_sllv_epi32(_mm256_srlv_epi32(x1, square_log2), square_shift);
+	__m256i y0_high = _mm256_sllv_epi32(_mm256_srlv_epi32(y0, square_log2), square_shift);
+	__m256i y1_high = _mm256_sllv_epi32(_mm256_srlv_epi32(y1, square_log2), square_shift);
+	x0_part = _mm256_add_epi32(_mm256_or_si256(x0_part, x0_high), offset);
+	x1_part = _mm256_add_epi32(_mm256_or_si256(x1_part, x1_high), offset);
+	y0_part = _mm256_or_si256(y0_part, y0_high);
+	y1_part = _mm256_or_si256(y1_part, y1_high);
+
+	const int* texels = (const int*)texture->texels;
+	__m256i t00 = _mm256_i32gather_epi32(texels, _mm256_or_si256(x0_part, y0_part), 4);
+	__m256i t10 = _mm256_i32gather_epi32(texels, _mm256_or_si256(x1_part, y0_part), 4);
+	__m256i t01 = _mm256_i32gather_epi32(texels, _mm256_or_si256(x0_part, y1_part), 4);
+	__m256i t11 = _mm256_i32gather_epi32(texels, _mm256_or_si256(x1_part, y1_part), 4);
+
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	for(u32 c = 0; c < 4; c++) {
+		__m256 c00 = _mm256_cvtepi32_ps(_mm256_and_si256(t00, byte));
+		__m256 c10 = _mm256_cvtepi32_ps(_mm256_and_si256(t10, byte));
+		__m256 c01 = _mm256_cvtepi32_ps(_mm256_and_si256(t01, byte));
+		__m256 c11 = _mm256_cvtepi32_ps(_mm256_and_si256(t11, byte));
+		__m256 top = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c10, c00), fx));
+		__m256 bottom = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_sub_ps(c11, c01), fx));
+		out[c] = _mm256_mul_ps(_mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy)), _mm256_set1_ps(1.0f / 255.0f));
+		t00 = _mm256_srli_epi32(t00, 8);
+		t10 = _mm256_srli_epi32(t10, 8);
+		t01 = _mm256_srli_epi32(t01, 8);
+		t11 = _mm256_srli_epi32(t11, 8);
+	}
+}
+
+#endif
+
+// raster_swizzled_sample() for 8 samples. `out` is planar, out[channel][lane].
+internal void raster_swizzled_sample8(const RasterSwizzledTexture* texture, const RasterSampler* sampler, const f32 u[8], const f32 v[8],
+																			const f32 lod_squared[8], f32 out[4][8]) {
+#if defined(__AVX2__)
+	__m256 lod = _mm256_max_ps(_mm256_loadu_ps(lod_squared), _mm256_set1_ps(1e-20f));
+	lod = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), raster_log2_fast8(lod)), _mm256_set1_ps(sampler->mip_lod_bias));
+	f32 min_lod = Max(Max(sampler->min_lod, texture->min_lod), 0.0f);
+	f32 max_lod = Min(sampler->max_lod, (f32)(texture->level_count - 1));
+	lod = _mm256_min_ps(_mm256_max_ps(lod, _mm256_set1_ps(min_lod)), _mm256_set1_ps(max_lod));
+
+	__m256i level = _mm256_cvttps_epi32(lod);
+	__m256 blend = _mm256_sub_ps(lod, _mm256_cvtepi32_ps(level));
+	__m256 su = _mm256_loadu_ps(u);
+	__m256 sv = _mm256_loadu_ps(v);
+	__m256 result[4];
+	raster_swizzled_bilinear8(texture, level, su, sv, result);
+
+	// Lanes without a second level blend by 0, which leaves them as they are.
+	__m256i last = _mm256_set1_epi32((s32)texture->level_count - 1);
+	__m256 has_next = _mm256_and_ps(_mm256_cmp_ps(blend, _mm256_setzero_ps(), _CMP_GT_OQ),
+																	_mm256_castsi256_ps(_mm256_cmpgt_epi32(last, level)));
+	if(_mm256_movemask_ps(has_next)) {
+		blend = _mm256_and_ps(blend, has_next);
+		__m256 next[4];
+		raster_swizzled_bilinear8(texture, _mm256_min_epi32(_mm256_add_epi32(level, _mm256_set1_epi32(1)), last), su, sv, next);
+		for(u32 c = 0; c < 4; c++) result[c] = _mm256_add_ps(result[c], _mm256_mul_ps(_mm256_sub_ps(next[c], result[c]), blend));
+	}
+	for(u32 c = 0; c < 4; c++) _mm256_storeu_ps(out[c], result[c]);
+#else
+	for(u32 i = 0; i < RASTER_SAMPLE_LANES; i++) {
+		f32 sample[4];
+		raster_swizzled_sample(texture, sampler, u[i], v[i], lod_squared[i], sample);
+		for(u32 c = 0; c < 4; c++) out[c][i] = sample[c];
+	}
+#endif
+}
+
+// Sample() of two 2x2 quads (see raster_quad_lod_squared()).
+internal void raster_swizzled_sample_quads(const RasterSwizzledTexture* texture, const RasterSampler* sampler, const f32 u[8],
+																					 const f32 v[8], f32 out[4][8]) {
+	f32 lod_squared[8];
+	raster_quad_lod_squared(texture, u, v, lod_squared);
+	raster_swizzled_sample8(texture, sampler, u, v, lod_squared, out);
+}
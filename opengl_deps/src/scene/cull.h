@@ -0,0 +1,446 @@
+#pragma once
+
+// View frustum culling of large sets of bounding volumes.
+//
+// The volumes are kept structure-of-arrays (all centre x, then all centre y,
+// ...) so a kernel loads one register per component and tests 8 (AVX2) or 16
+// (AVX-512) volumes against each of the six planes at once:
+//   spheres   visible unless the centre is farther than the radius behind a plane
+//   boxes     axis aligned, as centre and half extents; visible unless the
+//             corner nearest to a plane's inside is behind it
+// Both tests are conservative: a volume near a frustum corner can be kept
+// even though it is outside, never the other way round.
+//
+// cull_volumes() writes the indices of the visible volumes, in increasing
+// order, to a compact list. Big sets are split into chunks that run on worker
+// threads (os_parallel_for()), each writing its indices in place at its own
+// offset, and the chunks' lists are moved together afterwards.
+//
+// Like the rasterizer's block kernels, the scalar, AVX2 and AVX-512 kernels
+// are all compiled into every x86-64 build and the widest the CPU runs is
+// picked the first time one is needed. They compute each plane distance with
+// the same unfused multiplies and adds, so they keep the same volumes.
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+#define CULL_PLANES      6
+#define CULL_MAX_LANES   16          // Volume capacities are padded to this, for the widest kernel.
+#define CULL_CHUNK       16384       // Volumes per job, a multiple of CULL_MAX_LANES.
+#define CULL_MAX_CHUNKS  256         // Bigger sets get bigger chunks.
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define CULL_TARGET_AVX2
+	#define CULL_TARGET_AVX512
+#else
+	#define CULL_TARGET_AVX2   __attribute__((target("avx2,fma")))
+	#define CULL_TARGET_AVX512 __attribute__((target("avx2,fma,avx512f,avx512cd,avx512bw,avx512dq,avx512vl")))
+#endif
+
+//------------------------------------------------------------------------
+// Volumes
+//------------------------------------------------------------------------
+
+enum CullShape : u32 {
+	CullShape_Sphere,
+	CullShape_Box,
+	CullShape_COUNT,
+};
+
+struct CullVolumes {
+	CullShape shape;
+	u32 count;
+	u32 capacity;       // A multiple of CULL_MAX_LANES; the padding is zero.
+	f32* x;             // Centres.
+	f32* y;
+	f32* z;
+	f32* radius;        // Spheres only.
+	f32* extent_x;      // Boxes only, half the size along each axis.
+	f32* extent_y;
+	f32* extent_z;
+	void* memory;
+	u64 memory_size;
+};
+
+internal b32 cull_volumes_alloc(CullVolumes* volumes, CullShape shape, u32 capacity) {
+	*volumes = {};
+	volumes->shape = shape;
+	volumes->capacity = AlignPow2(Max(capacity, 1u), (u32)CULL_MAX_LANES);
+	u32 arrays = shape == CullShape_Sphere ? 4 : 6;
+	volumes->memory_size = (u64)volumes->capacity * sizeof(f32) * arrays;
+	volumes->memory = os_alloc_pages(volumes->memory_size);
+	if(!volumes->memory) return false;
+
+	f32* array = (f32*)volumes->memory;
+	volumes->x = array;
+	volumes->y = array + volumes->capacity;
+	volumes->z = array + volumes->capacity * 2;
+	if(shape == CullShape_Sphere) {
+		volumes->radius = array + volumes->capacity * 3;
+	} else {
+		volumes->extent_x = array + volumes->capacity * 3;
+		volumes->extent_y = array + volumes->capacity * 4;
+		volumes->extent_z = array + volumes->capacity * 5;
+	}
+	return true;
+}
+
+internal void cull_volumes_release(CullVolumes* volumes) {
+	if(volumes->memory) os_free_pages(volumes->memory, volumes->memory_size);
+	*volumes = {};
+}
+
+// Returns the sphere's index, or -1 once the set is full.
+internal s32 cull_add_sphere(CullVolumes* volumes, const f32 centre[3], f32 radius) {
+	if(volumes->shape != CullShape_Sphere || volumes->count == volumes->capacity) return -1;
+	u32 i = volumes->count++;
+	volumes->x[i] = centre[0];
+	volumes->y[i] = centre[1];
+	volumes->z[i] = centre[2];
+	volumes->radius[i] = radius;
+	return (s32)i;
+}
+
+// Returns the box's index, or -1 once the set is full.
+internal s32 cull_add_box(CullVolumes* volumes, const f32 min[3], const f32 max[3]) {
+	if(volumes->shape != CullShape_Box || volumes->count == volumes->capacity) return -1;
+	u32 i = volumes->count++;
+	volumes->x[i] = 0.5f * (min[0] + max[0]);
+	volumes->y[i] = 0.5f * (min[1] + max[1]);
+	volumes->z[i] = 0.5f * (min[2] + max[2]);
+	volumes->extent_x[i] = 0.5f * (max[0] - min[0]);
+	volumes->extent_y[i] = 0.5f * (max[1] - min[1]);
+	volumes->extent_z[i] = 0.5f * (max[2] - min[2]);
+	return (s32)i;
+}
+
+//------------------------------------------------------------------------
+// Frustum
+//------------------------------------------------------------------------
+
+// Planes a*x + b*y + c*z + d >= 0 inside, with unit normals so distances are
+// in world units.
+struct CullFrustum {
+	f32 a[CULL_PLANES];
+	f32 b[CULL_PLANES];
+	f32 c[CULL_PLANES];
+	f32 d[CULL_PLANES];
+	f32 abs_a[CULL_PLANES];     // For the boxes' nearest corners.
+	f32 abs_b[CULL_PLANES];
+	f32 abs_c[CULL_PLANES];
+};
+
+// The planes of a row-vector view * projection (Gribb and Hartmann): with
+// clip = v * m and D3D's 0 <= z <= w, left and right are w +- x, bottom and
+// top w +- y, near z and far w - z, each a combination of m's columns.
+internal CullFrustum cull_frustum(const Mat4* view_projection) {
+	const f32 (*m)[4] = view_projection->m;
+	const f32 signs[CULL_PLANES][2] = { { 1, 1 }, { 1, -1 }, { 1, 1 }, { 1, -1 }, { 0, 1 }, { 1, -1 } };
+	const u32 columns[CULL_PLANES] = { 0, 0, 1, 1, 2, 2 };
+
+	CullFrustum result;
+	for(u32 p = 0; p < CULL_PLANES; p++) {
+		f32 plane[4];
+		for(u32 r = 0; r < 4; r++) plane[r] = signs[p][0] * m[r][3] + signs[p][1] * m[r][columns[p]];
+		f32 length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		result.a[p] = plane[0] / length;
+		result.b[p] = plane[1] / length;
+		result.c[p] = plane[2] / length;
+		result.d[p] = plane[3] / length;
+		result.abs_a[p] = fabsf(result.a[p]);
+		result.abs_b[p] = fabsf(result.b[p]);
+		result.abs_c[p] = fabsf(result.c[p]);
+	}
+	return result;
+}
+
+//------------------------------------------------------------------------
+// Kernels
+//------------------------------------------------------------------------
+
+// Tests volumes [first, first + count) and writes the indices of the visible
+// ones to `visible`, returning how many. The SIMD kernels may write garbage
+// past that, up to `count` rounded up to CULL_MAX_LANES.
+typedef u32 CullKernelFunc(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible);
+
+enum CullKernel : u32 {
+	CullKernel_Scalar,
+	CullKernel_AVX2,
+	CullKernel_AVX512,
+	CullKernel_COUNT,
+};
+
+internal u32 cull_popcount(u32 mask) {
+#if defined(_MSC_VER)
+	return (u32)__popcnt(mask);
+#else
+	return (u32)__builtin_popcount(mask);
+#endif
+}
+
+internal u32 cull_spheres_scalar(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	u32 written = 0;
+	for(u32 i = first; i < first + count; i++) {
+		f32 x = volumes->x[i], y = volumes->y[i], z = volumes->z[i], radius = volumes->radius[i];
+		b32 inside = true;
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			f32 distance = x * frustum->a[p] + y * frustum->b[p] + z * frustum->c[p] + frustum->d[p];
+			inside = inside && distance >= -radius;
+		}
+		if(inside) visible[written++] = i;
+	}
+	return written;
+}
+
+internal u32 cull_boxes_scalar(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	u32 written = 0;
+	for(u32 i = first; i < first + count; i++) {
+		f32 x = volumes->x[i], y = volumes->y[i], z = volumes->z[i];
+		f32 ex = volumes->extent_x[i], ey = volumes->extent_y[i], ez = volumes->extent_z[i];
+		b32 inside = true;
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			f32 distance = x * frustum->a[p] + y * frustum->b[p] + z * frustum->c[p] + frustum->d[p];
+			f32 reach = ex * frustum->abs_a[p] + ey * frustum->abs_b[p] + ez * frustum->abs_c[p];
+			inside = inside && distance >= -reach;
+		}
+		if(inside) visible[written++] = i;
+	}
+	return written;
+}
+
+// For every 8-bit lane mask, the lanes that are set packed to the front, one
+// byte each: added to the batch's first index they are its visible indices.
+global u64 g_cull_compact[256];
+
+internal void cull_compact_fill() {
+	for(u32 mask = 0; mask < 256; mask++) {
+		u64 lanes = 0;
+		u32 shift = 0;
+		for(u32 lane = 0; lane < 8; lane++) {
+			if(mask & (1u << lane)) {
+				lanes |= (u64)lane << shift;
+				shift += 8;
+			}
+		}
+		g_cull_compact[mask] = lanes;
+	}
+}
+
+CULL_TARGET_AVX2 inline u32 cull_compact8(u32 mask, u32 index, u32* visible) {
+	__m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&g_cull_compact[mask]));
+	_mm256_storeu_si256((__m256i*)visible, _mm256_add_epi32(lanes, _mm256_set1_epi32((s32)index)));
+	return cull_popcount(mask);
+}
+
+// Lanes of the batch at `offset` that hold volumes, for the last partial one.
+inline u32 cull_tail_mask8(u32 offset, u32 count) {
+	return count - offset >= 8 ? 0xffu : (1u << (count - offset)) - 1;
+}
+
+CULL_TARGET_AVX2 internal u32 cull_spheres_avx2(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	u32 written = 0;
+	for(u32 offset = 0; offset < count; offset += 8) {
+		u32 i = first + offset;
+		__m256 x = _mm256_loadu_ps(volumes->x + i);
+		__m256 y = _mm256_loadu_ps(volumes->y + i);
+		__m256 z = _mm256_loadu_ps(volumes->z + i);
+		__m256 radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(volumes->radius + i));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			__m256 distance = _mm256_mul_ps(x, _mm256_set1_ps(frustum->a[p]));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(frustum->b[p])));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(frustum->c[p])));
+			distance = _mm256_add_ps(distance, _mm256_set1_ps(frustum->d[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, radius, _CMP_GE_OQ));
+		}
+		u32 mask = (u32)_mm256_movemask_ps(inside) & cull_tail_mask8(offset, count);
+		written += cull_compact8(mask, i, visible + written);
+	}
+	return written;
+}
+
+CULL_TARGET_AVX2 internal u32 cull_boxes_avx2(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	u32 written = 0;
+	for(u32 offset = 0; offset < count; offset += 8) {
+		u32 i = first + offset;
+		__m256 x = _mm256_loadu_ps(volumes->x + i);
+		__m256 y = _mm256_loadu_ps(volumes->y + i);
+		__m256 z = _mm256_loadu_ps(volumes->z + i);
+		__m256 ex = _mm256_loadu_ps(volumes->extent_x + i);
+		__m256 ey = _mm256_loadu_ps(volumes->extent_y + i);
+		__m256 ez = _mm256_loadu_ps(volumes->extent_z + i);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			__m256 distance = _mm256_mul_ps(x, _mm256_set1_ps(frustum->a[p]));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(frustum->b[p])));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(frustum->c[p])));
+			distance = _mm256_add_ps(distance, _mm256_set1_ps(frustum->d[p]));
+			__m256 reach = _mm256_mul_ps(ex, _mm256_set1_ps(frustum->abs_a[p]));
+			reach = _mm256_add_ps(reach, _mm256_mul_ps(ey, _mm256_set1_ps(frustum->abs_b[p])));
+			reach = _mm256_add_ps(reach, _mm256_mul_ps(ez, _mm256_set1_ps(frustum->abs_c[p])));
+			reach = _mm256_sub_ps(_mm256_setzero_ps(), reach);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, reach, _CMP_GE_OQ));
+		}
+		u32 mask = (u32)_mm256_movemask_ps(inside) & cull_tail_mask8(offset, count);
+		written += cull_compact8(mask, i, visible + written);
+	}
+	return written;
+}
+
+CULL_TARGET_AVX512 inline __mmask16 cull_tail_mask16(u32 offset, u32 count) {
+	return (__mmask16)(count - offset >= 16 ? 0xffffu : (1u << (count - offset)) - 1);
+}
+
+CULL_TARGET_AVX512 internal u32 cull_spheres_avx512(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	u32 written = 0;
+	for(u32 offset = 0; offset < count; offset += 16) {
+		u32 i = first + offset;
+		__m512 x = _mm512_loadu_ps(volumes->x + i);
+		__m512 y = _mm512_loadu_ps(volumes->y + i);
+		__m512 z = _mm512_loadu_ps(volumes->z + i);
+		__m512 radius = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(volumes->radius + i));
+		__mmask16 inside = cull_tail_mask16(offset, count);
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			__m512 distance = _mm512_mul_ps(x, _mm512_set1_ps(frustum->a[p]));
+			distance = _mm512_add_ps(distance, _mm512_mul_ps(y, _mm512_set1_ps(frustum->b[p])));
+			distance = _mm512_add_ps(distance, _mm512_mul_ps(z, _mm512_set1_ps(frustum->c[p])));
+			distance = _mm512_add_ps(distance, _mm512_set1_ps(frustum->d[p]));
+			inside = _mm512_mask_cmp_ps_mask(inside, distance, radius, _CMP_GE_OQ);
+		}
+		_mm512_mask_compressstoreu_epi32(visible + written, inside, _mm512_add_epi32(lane, _mm512_set1_epi32((s32)i)));
+		written += cull_popcount(inside);
+	}
+	return written;
+}
+
+CULL_TARGET_AVX512 internal u32 cull_boxes_avx512(const CullFrustum* frustum, const CullVolumes* volumes, u32 first, u32 count, u32* visible) {
+	const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	u32 written = 0;
+	for(u32 offset = 0; offset < count; offset += 16) {
+		u32 i = first + offset;
+		__m512 x = _mm512_loadu_ps(volumes->x + i);
+		__m512 y = _mm512_loadu_ps(volumes->y + i);
+		__m512 z = _mm512_loadu_ps(volumes->z + i);
+		__m512 ex = _mm512_loadu_ps(volumes->extent_x + i);
+		__m512 ey = _mm512_loadu_ps(volumes->extent_y + i);
+		__m512 ez = _mm512_loadu_ps(volumes->extent_z + i);
+		__mmask16 inside = cull_tail_mask16(offset, count);
+		for(u32 p = 0; p < CULL_PLANES; p++) {
+			__m512 distance = _mm512_mul_ps(x, _mm512_set1_ps(frustum->a[p]));
+			distance = _mm512_add_ps(distance, _mm512_mul_ps(y, _mm512_set1_ps(frustum->b[p])));
+			distance = _mm512_add_ps(distance, _mm512_mul_ps(z, _mm512_set1_ps(frustum->c[p])));
+			distance = _mm512_add_ps(distance, _mm512_set1_ps(frustum->d[p]));
+			__m512 reach = _mm512_mul_ps(ex, _mm512_set1_ps(frustum->abs_a[p]));
+			reach = _mm512_add_ps(reach, _mm512_mul_ps(ey, _mm512_set1_ps(frustum->abs_b[p])));
+			reach = _mm512_add_ps(reach, _mm512_mul_ps(ez, _mm512_set1_ps(frustum->abs_c[p])));
+			reach = _mm512_sub_ps(_mm512_setzero_ps(), reach);
+			inside = _mm512_mask_cmp_ps_mask(inside, distance, reach, _CMP_GE_OQ);
+		}
+		_mm512_mask_compressstoreu_epi32(visible + written, inside, _mm512_add_epi32(lane, _mm512_set1_epi32((s32)i)));
+		written += cull_popcount(inside);
+	}
+	return written;
+}
+
+global CullKernel g_cull_kernel;
+global b32 g_cull_kernel_selected;
+global CullKernelFunc* g_cull_kernels[CullKernel_COUNT][CullShape_COUNT] = {
+	{ cull_spheres_scalar, cull_boxes_scalar },
+	{ cull_spheres_avx2,   cull_boxes_avx2 },
+	{ cull_spheres_avx512, cull_boxes_avx512 },
+};
+
+internal const char* cull_kernel_name(CullKernel kernel) {
+	switch(kernel) {
+		case CullKernel_Scalar: return "scalar";
+		case CullKernel_AVX2:   return "avx2";
+		case CullKernel_AVX512: return "avx512";
+		default:                return "unknown";
+	}
+}
+
+internal b32 cull_kernel_supported(CullKernel kernel) {
+	u32 features = os_cpu_features();
+	switch(kernel) {
+		case CullKernel_Scalar: return true;
+		case CullKernel_AVX2:   return (features & OS_CPUFeature_AVX2) != 0;
+		case CullKernel_AVX512: return (features & OS_CPUFeature_AVX512) != 0;
+		default:                return false;
+	}
+}
+
+internal CullKernel cull_kernel_best() {
+	if(cull_kernel_supported(CullKernel_AVX512)) return CullKernel_AVX512;
+	if(cull_kernel_supported(CullKernel_AVX2)) return CullKernel_AVX2;
+	return CullKernel_Scalar;
+}
+
+// Picks the kernels every cull uses from then on. The first cull_volumes()
+// selects cull_kernel_best(); call this while no cull is running to override it.
+internal b32 cull_kernel_select(CullKernel kernel) {
+	if(!cull_kernel_supported(kernel)) return false;
+	if(!g_cull_kernel_selected) cull_compact_fill();
+	g_cull_kernel = kernel;
+	g_cull_kernel_selected = true;
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Culling
+//------------------------------------------------------------------------
+
+// Volumes per job for a set of `count`, CULL_CHUNK unless that makes more than CULL_MAX_CHUNKS.
+internal u32 cull_chunk_size(u32 count) {
+	return Max((u32)CULL_CHUNK, AlignPow2((count + CULL_MAX_CHUNKS - 1) / CULL_MAX_CHUNKS, (u32)CULL_MAX_LANES));
+}
+
+struct CullJob {
+	const CullFrustum* frustum;
+	const CullVolumes* volumes;
+	CullKernelFunc* kernel;
+	u32* visible;
+	u32 chunk_size;
+	u32 written[CULL_MAX_CHUNKS];
+};
+
+internal void cull_chunk_job(void* user, u32 index) {
+	CullJob* job = (CullJob*)user;
+	u32 first = index * job->chunk_size;
+	u32 count = Min(job->chunk_size, job->volumes->count - first);
+	job->written[index] = job->kernel(job->frustum, job->volumes, first, count, job->visible + first);
+}
+
+// Writes the indices of the volumes inside or crossing the frustum to
+// `visible` and returns how many there are. `visible` needs room for
+// volumes->capacity indices, since chunks write in place before they are
+// moved together. `thread_count` is as for os_parallel_for(); sets of one
+// chunk or less run on the calling thread.
+internal u32 cull_volumes(const CullFrustum* frustum, const CullVolumes* volumes, u32* visible, u32 thread_count) {
+	if(!g_cull_kernel_selected) cull_kernel_select(cull_kernel_best());
+	if(volumes->count == 0) return 0;
+
+	CullJob job;
+	job.frustum = frustum;
+	job.volumes = volumes;
+	job.kernel = g_cull_kernels[g_cull_kernel][volumes->shape];
+	job.visible = visible;
+	job.chunk_size = cull_chunk_size(volumes->count);
+	u32 chunk_count = (volumes->count + job.chunk_size - 1) / job.chunk_size;
+	if(chunk_count == 1) return job.kernel(frustum, volumes, 0, volumes->count, visible);
+
+	os_parallel_for(chunk_count, thread_count, cull_chunk_job, &job);
+
+	u32 written = job.written[0];
+	for(u32 chunk = 1; chunk < chunk_count; chunk++) {
+		memmove(visible + written, visible + chunk * job.chunk_size, job.written[chunk] * sizeof(u32));
+		written += job.written[chunk];
+	}
+	return written;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Linear blend skinning on the CPU, for the software rasterizer and anything
+// else that wants posed vertices without a GPU.
+//
+// Every vertex is bound to up to four bones of a palette from anim_palette()
+// with weights that sum to one. Its position goes through the weighted sum of
+// their matrices; only the three affine columns are blended. With AVX the
+// blend handles two matrix rows per register, and the position is x and y
+// against rows 0 and 1 in one register plus z and 1 against rows 2 and 3 in
+// another. skin_vertices_scalar() is the same arithmetic in the same order,
+// so both give the same bits.
+//
+// The output is RasterVertex (position and texture coordinates), ready for
+// raster_draw_indexed(). skin_vertices() splits big meshes into chunks that
+// run on worker threads.
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "raster/raster.h"
+
+#include <immintrin.h>
+
+#define SKIN_INFLUENCES 4
+#define SKIN_CHUNK      4096         // Vertices per job.
+
+struct SkinVertex {
+	f32 position[3];                 // Bind pose, model space.
+	f32 texture[2];
+	f32 weights[SKIN_INFLUENCES];    // Sum to one; unused influences weigh zero.
+	u8 bones[SKIN_INFLUENCES];       // Into the palette.
+};
+
+internal void skin_vertices_range_scalar(const Mat4* palette, const SkinVertex* in, RasterVertex* out, u32 count) {
+	for(u32 i = 0; i < count; i++) {
+		const SkinVertex* v = &in[i];
+		f32 m[4][3];
+		for(u32 r = 0; r < 4; r++) {
+			for(u32 c = 0; c < 3; c++) {
+				f32 sum = v->weights[0] * palette[v->bones[0]].m[r][c];
+				for(u32 k = 1; k < SKIN_INFLUENCES; k++) sum = sum + v->weights[k] * palette[v->bones[k]].m[r][c];
+				m[r][c] = sum;
+			}
+		}
+		f32 x = v->position[0], y = v->position[1], z = v->position[2];
+		for(u32 c = 0; c < 3; c++) out[i].position[c] = (x * m[0][c] + z * m[2][c]) + (y * m[1][c] + m[3][c]);
+		out[i].texture[0] = v->texture[0];
+		out[i].texture[1] = v->texture[1];
+	}
+}
+
+internal void skin_vertices_range(const Mat4* palette, const SkinVertex* in, RasterVertex* out, u32 count) {
+#if defined(__AVX__)
+	for(u32 i = 0; i < count; i++) {
+		const SkinVertex* v = &in[i];
+		const Mat4* p = &palette[v->bones[0]];
+		__m256 weight = _mm256_set1_ps(v->weights[0]);
+		__m256 rows01 = _mm256_mul_ps(weight, _mm256_loadu_ps(p->m[0]));
+		__m256 rows23 = _mm256_mul_ps(weight, _mm256_loadu_ps(p->m[2]));
+		for(u32 k = 1; k < SKIN_INFLUENCES; k++) {
+			p = &palette[v->bones[k]];
+			weight = _mm256_set1_ps(v->weights[k]);
+			rows01 = _mm256_add_ps(rows01, _mm256_mul_ps(weight, _mm256_loadu_ps(p->m[0])));
+			rows23 = _mm256_add_ps(rows23, _mm256_mul_ps(weight, _mm256_loadu_ps(p->m[2])));
+		}
+		__m256 xy = _mm256_setr_ps(v->position[0], v->position[0], v->position[0], v->position[0],
+		                           v->position[1], v->position[1], v->position[1], v->position[1]);
+		__m256 z1 = _mm256_setr_ps(v->position[2], v->position[2], v->position[2], v->position[2], 1.0f, 1.0f, 1.0f, 1.0f);
+		// Low half x * row 0 + z * row 2, high half y * row 1 + row 3.
+		__m256 halves = _mm256_add_ps(_mm256_mul_ps(xy, rows01), _mm256_mul_ps(z1, rows23));
+		__m128 low = _mm256_castps256_ps128(halves);
+		__m128 high = _mm256_extractf128_ps(halves, 1);
+		alignas(16) f32 position[4];
+		_mm_store_ps(position, _mm_add_ps(low, high));
+		out[i].position[0] = position[0];
+		out[i].position[1] = position[1];
+		out[i].position[2] = position[2];
+		out[i].texture[0] = v->texture[0];
+		out[i].texture[1] = v->texture[1];
+	}
+#else
+	skin_vertices_range_scalar(palette, in, out, count);
+#endif
+}
+
+struct SkinJob {
+	const Mat4* palette;
+	const SkinVertex* in;
+	RasterVertex* out;
+	u32 count;
+};
+
+internal void skin_job(void* user, u32 index) {
+	SkinJob* job = (SkinJob*)user;
+	u32 first = index * SKIN_CHUNK;
+	skin_vertices_range(job->palette, job->in + first, job->out + first, Min((u32)SKIN_CHUNK, job->count - first));
+}
+
+// Skins `count` vertices with `palette`. `thread_count` is as for
+// os_parallel_for(); meshes of one chunk or less run on the calling thread.
+internal void skin_vertices(const Mat4* palette, const SkinVertex* in, RasterVertex* out, u32 count, u32 thread_count) {
+	u32 chunk_count = (count + SKIN_CHUNK - 1) / SKIN_CHUNK;
+	if(chunk_count <= 1) {
+		skin_vertices_range(palette, in, out, count);
+		return;
+	}
+	SkinJob job = { palette, in, out, count };
+	os_parallel_for(chunk_count, thread_count, skin_job, &job);
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+// Transform hierarchy in flat arrays with incremental world matrix updates.
+//
+// Nodes live in parallel arrays (parent, locals, worlds, dirty) in the order
+// they were added, and a node can only be added under one that already
+// exists, so every parent comes before its children. One pass front to back
+// then sees each parent's world matrix finished before its children need it,
+// with no recursion and no pointer chasing:
+//   worlds[i] = locals[i] * worlds[parent[i]]      (row vectors, local first)
+//
+// transform_set_local() marks a node dirty; transform_update() recomputes the
+// dirty nodes and everything below them, and nothing else. A child is dirty
+// when its parent is, which the pass finds by looking at the parent's flag,
+// so the flags ripple down subtrees on their own.
+//
+// The node array is cut into islands: contiguous ranges no node outside of
+// points into. Each root added together with its subtree (a loaded model, a
+// character) becomes one island, roots whose nodes were interleaved share
+// one. Every island remembers the first dirty node in it, so an update skips
+// clean islands in O(1), starts dirty ones at their first dirty node, and
+// runs independent dirty islands on worker threads. A frame where nothing
+// moved costs one check per island.
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+
+#include <cstring>
+
+#define TRANSFORM_NONE       0xffffffffu
+#define TRANSFORM_JOB_NODES  4096        // Dirty islands are grouped into jobs of about this many nodes.
+#define TRANSFORM_MAX_JOBS   256
+
+struct TransformIsland {
+	u32 first;
+	u32 end;
+	u32 first_dirty;        // `end` when the island is clean.
+};
+
+struct TransformStats {
+	u32 nodes;
+	u32 islands;
+	u32 nodes_updated;      // World matrices recomputed.
+	u32 nodes_visited;      // From each dirty island's first dirty node to its end.
+	u32 islands_updated;
+	u32 jobs;
+};
+
+struct TransformHierarchy {
+	u32 count;
+	u32 capacity;
+	u32* parent;            // TRANSFORM_NONE for roots, otherwise a lower index.
+	Mat4* locals;
+	Mat4* worlds;
+	u8* dirty;
+	u32* island;            // Of each node, valid while `islands_valid`.
+	TransformIsland* islands;
+	u32 island_count;
+	u32* dirty_islands;     // Scratch for transform_update(), also used when cutting the islands.
+	b32 islands_valid;      // Adding nodes invalidates the islands until the next update.
+	void* memory;
+	u64 memory_size;
+	TransformStats stats;   // Of the last update.
+};
+
+internal b32 transform_hierarchy_alloc(TransformHierarchy* hierarchy, u32 capacity) {
+	*hierarchy = {};
+	capacity = Max(capacity, 1u);
+	u64 matrices = (u64)capacity * sizeof(Mat4) * 2;
+	u64 per_node = (u64)capacity * (sizeof(u32) * 3 + sizeof(TransformIsland) + sizeof(u8));
+	hierarchy->memory_size = matrices + per_node;
+	hierarchy->memory = os_alloc_pages(hierarchy->memory_size);
+	if(!hierarchy->memory) return false;
+
+	u8* memory = (u8*)hierarchy->memory;
+	hierarchy->capacity = capacity;
+	hierarchy->locals = (Mat4*)memory;
+	hierarchy->worlds = hierarchy->locals + capacity;
+	hierarchy->parent = (u32*)(hierarchy->worlds + capacity);
+	hierarchy->island = hierarchy->parent + capacity;
+	hierarchy->dirty_islands = hierarchy->island + capacity;
+	hierarchy->islands = (TransformIsland*)(hierarchy->dirty_islands + capacity);
+	hierarchy->dirty = (u8*)(hierarchy->islands + capacity);
+	return true;
+}
+
+internal void transform_hierarchy_release(TransformHierarchy* hierarchy) {
+	if(hierarchy->memory) os_free_pages(hierarchy->memory, hierarchy->memory_size);
+	*hierarchy = {};
+}
+
+// Adds a node under `parent` (TRANSFORM_NONE for a root) and returns its
+// index, or TRANSFORM_NONE when the hierarchy is full or the parent does not
+// exist. The node is dirty until the next update.
+internal u32 transform_add(TransformHierarchy* hierarchy, u32 parent, const Mat4* matrix) {
+	if(hierarchy->count == hierarchy->capacity) return TRANSFORM_NONE;
+	if(parent != TRANSFORM_NONE && parent >= hierarchy->count) return TRANSFORM_NONE;
+	u32 node = hierarchy->count++;
+	hierarchy->parent[node] = parent;
+	hierarchy->locals[node] = *matrix;
+	hierarchy->worlds[node] = *matrix;
+	hierarchy->dirty[node] = 1;
+	hierarchy->islands_valid = false;
+	return node;
+}
+
+internal void transform_set_local(TransformHierarchy* hierarchy, u32 node, const Mat4* matrix) {
+	hierarchy->locals[node] = *matrix;
+	hierarchy->dirty[node] = 1;
+	if(hierarchy->islands_valid) {
+		TransformIsland* island = &hierarchy->islands[hierarchy->island[node]];
+		island->first_dirty = Min(island->first_dirty, node);
+	}
+}
+
+// Cuts the nodes into islands: a new one starts at node i when no node from
+// i on has a parent before i. Each island's first dirty node comes from the
+// flags, so nodes set before the cut are not lost.
+internal void transform_build_islands(TransformHierarchy* hierarchy) {
+	u32 count = hierarchy->count;
+	// Walking back, `reach` is the lowest parent of any node from i on.
+	u32 reach = TRANSFORM_NONE;
+	u32* starts = hierarchy->dirty_islands;
+	for(u32 i = count; i-- > 0;) {
+		if(hierarchy->parent[i] != TRANSFORM_NONE) reach = Min(reach, hierarchy->parent[i]);
+		starts[i] = reach >= i;
+	}
+
+	hierarchy->island_count = 0;
+	for(u32 i = 0; i < count; i++) {
+		if(starts[i]) {
+			TransformIsland* island = &hierarchy->islands[hierarchy->island_count++];
+			island->first = i;
+			island->end = i;
+			island->first_dirty = TRANSFORM_NONE;
+		}
+		TransformIsland* island = &hierarchy->islands[hierarchy->island_count - 1];
+		island->end = i + 1;
+		if(hierarchy->dirty[i] && island->first_dirty == TRANSFORM_NONE) island->first_dirty = i;
+		hierarchy->island[i] = hierarchy->island_count - 1;
+	}
+	for(u32 i = 0; i < hierarchy->island_count; i++) {
+		TransformIsland* island = &hierarchy->islands[i];
+		if(island->first_dirty == TRANSFORM_NONE) island->first_dirty = island->end;
+	}
+	hierarchy->islands_valid = true;
+}
+
+// Recomputes one island from its first dirty node and leaves it clean.
+// Returns how many world matrices were recomputed.
+internal u32 transform_update_island(TransformHierarchy* hierarchy, TransformIsland* island) {
+	const u32* parent = hierarchy->parent;
+	const Mat4* locals = hierarchy->locals;
+	Mat4* worlds = hierarchy->worlds;
+	u8* dirty = hierarchy->dirty;
+
+	u32 updated = 0;
+	for(u32 i = island->first_dirty; i < island->end; i++) {
+		u32 p = parent[i];
+		if(p != TRANSFORM_NONE) dirty[i] |= dirty[p];
+		if(!dirty[i]) continue;
+		if(p == TRANSFORM_NONE) worlds[i] = locals[i];
+		else mat4_mul_pairs(&worlds[i], &locals[i], &worlds[p], 1);
+		updated++;
+	}
+	// Parents are flagged until the whole island is done, children read them.
+	memset(dirty + island->first_dirty, 0, island->end - island->first_dirty);
+	island->first_dirty = island->end;
+	return updated;
+}
+
+struct TransformJob {
+	TransformHierarchy* hierarchy;
+	u32 first[TRANSFORM_MAX_JOBS + 1];      // Into hierarchy->dirty_islands, with the end after the last job.
+	u32 updated[TRANSFORM_MAX_JOBS];
+};
+
+internal void transform_update_job(void* user, u32 index) {
+	TransformJob* job = (TransformJob*)user;
+	TransformHierarchy* hierarchy = job->hierarchy;
+	u32 updated = 0;
+	for(u32 i = job->first[index]; i < job->first[index + 1]; i++) {
+		updated += transform_update_island(hierarchy, &hierarchy->islands[hierarchy->dirty_islands[i]]);
+	}
+	job->updated[index] = updated;
+}
+
+// Brings every world matrix up to date. `thread_count` is as for
+// os_parallel_for(); updates with fewer than two jobs' worth of dirty nodes
+// run on the calling thread.
+internal void transform_update(TransformHierarchy* hierarchy, u32 thread_count) {
+	if(!hierarchy->islands_valid) transform_build_islands(hierarchy);
+
+	TransformStats* stats = &hierarchy->stats;
+	*stats = {};
+	stats->nodes = hierarchy->count;
+	stats->islands = hierarchy->island_count;
+
+	u32 dirty_count = 0;
+	for(u32 i = 0; i < hierarchy->island_count; i++) {
+		const TransformIsland* island = &hierarchy->islands[i];
+		if(island->first_dirty == island->end) continue;
+		hierarchy->dirty_islands[dirty_count++] = i;
+		stats->nodes_visited += island->end - island->first_dirty;
+	}
+	stats->islands_updated = dirty_count;
+	if(dirty_count == 0) return;
+
+	u32 job_count = Min((stats->nodes_visited + TRANSFORM_JOB_NODES - 1) / TRANSFORM_JOB_NODES, (u32)TRANSFORM_MAX_JOBS);
+	if(job_count < 2 || dirty_count < 2 || os_parallel_worker_count(job_count, thread_count) == 1) {
+		for(u32 i = 0; i < dirty_count; i++) {
+			stats->nodes_updated += transform_update_island(hierarchy, &hierarchy->islands[hierarchy->dirty_islands[i]]);
+		}
+		stats->jobs = 1;
+		return;
+	}
+
+	// Consecutive dirty islands grouped into jobs of about the same number of
+	// nodes to visit; one big island is one job however big it is.
+	TransformJob job;
+	job.hierarchy = hierarchy;
+	u32 target = (stats->nodes_visited + job_count - 1) / job_count;
+	u32 jobs = 0, nodes = 0;
+	job.first[0] = 0;
+	for(u32 i = 0; i < dirty_count; i++) {
+		const TransformIsland* island = &hierarchy->islands[hierarchy->dirty_islands[i]];
+		nodes += island->end - island->first_dirty;
+		if(nodes >= target || i + 1 == dirty_count) {
+			job.first[++jobs] = i + 1;
+			nodes = 0;
+		}
+	}
+
+	os_parallel_for(jobs, thread_count, transform_update_job, &job);
+	for(u32 i = 0; i < jobs; i++) stats->nodes_updated += job.updated[i];
+	stats->jobs = jobs;
+}
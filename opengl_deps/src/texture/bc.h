@@ -0,0 +1,903 @@
+#pragma once
+
+// Block compression encoder for BC1, BC3 and BC7.
+//
+// Blocks are loaded as 4x4 SoA floats (0..255 per channel) so the endpoint
+// search can work on 8 pixels per instruction: the principal axis, the
+// projection extents and the per-palette-entry error evaluation are all AVX2
+// (SSE without it). Endpoints are refined by least squares against the chosen
+// indices and re-quantised.
+//
+// BC7 uses mode 6 (one subset, RGBA 7.7.7.7 + p-bits, 4-bit indices) for every
+// block. The high preset also tries mode 1 (two subsets, RGB 6.6.6 + shared
+// p-bit, 3-bit indices) on opaque blocks and keeps whichever is closer.
+//
+// Images are compressed one row of blocks per work item on all cores.
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+enum BCFormat : u32 {
+	BCFormat_BC1,
+	BCFormat_BC3,
+	BCFormat_BC7,
+	BCFormat_COUNT
+};
+
+enum BCQuality : u32 {
+	BCQuality_Fast,     // Bounding box endpoints, one pass.
+	BCQuality_Normal,   // Principal axis endpoints with a least squares refinement.
+	BCQuality_High,     // More refinement, endpoint/p-bit search and BC7 mode 1.
+	BCQuality_COUNT
+};
+
+struct BCSettings {
+	BCFormat format;
+	BCQuality quality;
+	u32 thread_count;   // 0 = one per logical core.
+};
+
+internal u32 bc_block_size(BCFormat format) {
+	return format == BCFormat_BC1 ? 8 : 16;
+}
+
+internal u64 bc_compressed_size(BCFormat format, u32 width, u32 height) {
+	return (u64)((width + 3) / 4) * ((height + 3) / 4) * bc_block_size(format);
+}
+
+//------------------------------------------------------------------------
+// SIMD helpers
+//------------------------------------------------------------------------
+
+#if defined(__AVX2__)
+	#define BC_LANES 8
+	typedef __m256 BCVec;
+	inline BCVec bc_set1(f32 v)                  { return _mm256_set1_ps(v); }
+	inline BCVec bc_load(const f32* p)           { return _mm256_load_ps(p); }
+	inline void  bc_store(f32* p, BCVec v)       { _mm256_store_ps(p, v); }
+	inline BCVec bc_add(BCVec a, BCVec b)        { return _mm256_add_ps(a, b); }
+	inline BCVec bc_sub(BCVec a, BCVec b)        { return _mm256_sub_ps(a, b); }
+	inline BCVec bc_mul(BCVec a, BCVec b)        { return _mm256_mul_ps(a, b); }
+	inline BCVec bc_min(BCVec a, BCVec b)        { return _mm256_min_ps(a, b); }
+	inline BCVec bc_max(BCVec a, BCVec b)        { return _mm256_max_ps(a, b); }
+	inline BCVec bc_less(BCVec a, BCVec b)       { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline BCVec bc_div(BCVec a, BCVec b)        { return _mm256_div_ps(a, b); }
+	inline BCVec bc_sqrt(BCVec a)                { return _mm256_sqrt_ps(a); }
+	inline BCVec bc_select(BCVec mask, BCVec a, BCVec b) { return _mm256_blendv_ps(b, a, mask); }
+	inline f32 bc_hsum(BCVec v) {
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+#else
+	#define BC_LANES 4
+	typedef __m128 BCVec;
+	inline BCVec bc_set1(f32 v)                  { return _mm_set1_ps(v); }
+	inline BCVec bc_load(const f32* p)           { return _mm_load_ps(p); }
+	inline void  bc_store(f32* p, BCVec v)       { _mm_store_ps(p, v); }
+	inline BCVec bc_add(BCVec a, BCVec b)        { return _mm_add_ps(a, b); }
+	inline BCVec bc_sub(BCVec a, BCVec b)        { return _mm_sub_ps(a, b); }
+	inline BCVec bc_mul(BCVec a, BCVec b)        { return _mm_mul_ps(a, b); }
+	inline BCVec bc_min(BCVec a, BCVec b)        { return _mm_min_ps(a, b); }
+	inline BCVec bc_max(BCVec a, BCVec b)        { return _mm_max_ps(a, b); }
+	inline BCVec bc_less(BCVec a, BCVec b)       { return _mm_cmplt_ps(a, b); }
+	inline BCVec bc_div(BCVec a, BCVec b)        { return _mm_div_ps(a, b); }
+	inline BCVec bc_sqrt(BCVec a)                { return _mm_sqrt_ps(a); }
+	inline BCVec bc_select(BCVec mask, BCVec a, BCVec b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	inline f32 bc_hsum(BCVec v) {
+		__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+#endif
+
+//------------------------------------------------------------------------
+// Blocks
+//------------------------------------------------------------------------
+
+#define BC_ALL_PIXELS 0xffffu
+
+struct BCBlock {
+	alignas(32) f32 c[4][16];   // r, g, b, a planes
+	b32 opaque;
+};
+
+// Gathers the 4x4 block at block coordinates (bx, by), clamping at the image edge.
+internal void bc_load_block(BCBlock* block, const u8* rgba, u32 row_pitch, u32 width, u32 height, u32 bx, u32 by) {
+	block->opaque = true;
+	for(u32 y = 0; y < 4; y++) {
+		const u8* row = rgba + (u64)Min(by * 4 + y, height - 1) * row_pitch;
+		for(u32 x = 0; x < 4; x++) {
+			const u8* p = row + Min(bx * 4 + x, width - 1) * 4;
+			u32 i = y * 4 + x;
+			block->c[0][i] = p[0];
+			block->c[1][i] = p[1];
+			block->c[2][i] = p[2];
+			block->c[3][i] = p[3];
+			if(p[3] != 255) block->opaque = false;
+		}
+	}
+}
+
+// Lane masks (all bits set or clear) for the pixels selected by a 16-bit mask.
+internal void bc_lane_weights(f32 weights[16], u32 pixel_mask) {
+	for(u32 i = 0; i < 16; i++) weights[i] = (pixel_mask >> i) & 1 ? 1.0f : 0.0f;
+}
+
+// Principal axis of the selected pixels over `channels` channels (3 or 4),
+// found by power iteration on the covariance matrix.
+internal void bc_principal_axis(const BCBlock* block, u32 pixel_mask, u32 channels, f32 mean[4], f32 axis[4]) {
+	alignas(32) f32 weights[16];
+	bc_lane_weights(weights, pixel_mask);
+
+	BCVec count = bc_set1(0.0f);
+	BCVec sums[4] = { bc_set1(0.0f), bc_set1(0.0f), bc_set1(0.0f), bc_set1(0.0f) };
+	for(u32 i = 0; i < 16; i += BC_LANES) {
+		BCVec w = bc_load(weights + i);
+		count = bc_add(count, w);
+		for(u32 c = 0; c < channels; c++) sums[c] = bc_add(sums[c], bc_mul(w, bc_load(block->c[c] + i)));
+	}
+	f32 n = Max(bc_hsum(count), 1.0f);
+	for(u32 c = 0; c < 4; c++) mean[c] = c < channels ? bc_hsum(sums[c]) / n : 0.0f;
+
+	// Upper triangle of the covariance matrix.
+	BCVec cov[10];
+	for(u32 k = 0; k < 10; k++) cov[k] = bc_set1(0.0f);
+	for(u32 i = 0; i < 16; i += BC_LANES) {
+		BCVec w = bc_load(weights + i);
+		BCVec d[4];
+		for(u32 c = 0; c < 4; c++) d[c] = c < channels ? bc_mul(w, bc_sub(bc_load(block->c[c] + i), bc_set1(mean[c]))) : bc_set1(0.0f);
+		u32 k = 0;
+		for(u32 a = 0; a < 4; a++) {
+			for(u32 b = a; b < 4; b++, k++) cov[k] = bc_add(cov[k], bc_mul(d[a], d[b]));
+		}
+	}
+
+	f32 m[4][4];
+	u32 k = 0;
+	for(u32 a = 0; a < 4; a++) {
+		for(u32 b = a; b < 4; b++) {
+			m[a][b] = m[b][a] = bc_hsum(cov[k++]);
+		}
+	}
+
+	// Start from the channel with the largest spread, converges in a handful of steps.
+	f32 v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	u32 largest = 0;
+	for(u32 c = 1; c < channels; c++) if(m[c][c] > m[largest][largest]) largest = c;
+	v[largest] = 1.0f;
+	for(u32 iteration = 0; iteration < 8; iteration++) {
+		f32 next[4];
+		for(u32 a = 0; a < 4; a++) next[a] = m[a][0] * v[0] + m[a][1] * v[1] + m[a][2] * v[2] + m[a][3] * v[3];
+		f32 length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if(length < 1e-6f) break;
+		for(u32 a = 0; a < 4; a++) v[a] = next[a] / length;
+	}
+	for(u32 c = 0; c < 4; c++) axis[c] = v[c];
+}
+
+// Endpoints at the extremes of the selected pixels projected onto the axis.
+internal void bc_project_extents(const BCBlock* block, u32 pixel_mask, const f32 mean[4], const f32 axis[4], f32 e0[4], f32 e1[4]) {
+	alignas(32) f32 weights[16];
+	bc_lane_weights(weights, pixel_mask);
+
+	BCVec lo = bc_set1(FLT_MAX);
+	BCVec hi = bc_set1(-FLT_MAX);
+	for(u32 i = 0; i < 16; i += BC_LANES) {
+		BCVec t = bc_set1(0.0f);
+		for(u32 c = 0; c < 4; c++) t = bc_add(t, bc_mul(bc_sub(bc_load(block->c[c] + i), bc_set1(mean[c])), bc_set1(axis[c])));
+		BCVec selected = bc_less(bc_set1(0.5f), bc_load(weights + i));
+		lo = bc_min(lo, bc_select(selected, t, bc_set1(FLT_MAX)));
+		hi = bc_max(hi, bc_select(selected, t, bc_set1(-FLT_MAX)));
+	}
+
+	alignas(32) f32 lo_lanes[BC_LANES], hi_lanes[BC_LANES];
+	bc_store(lo_lanes, lo);
+	bc_store(hi_lanes, hi);
+	f32 t0 = FLT_MAX, t1 = -FLT_MAX;
+	for(u32 i = 0; i < BC_LANES; i++) {
+		t0 = Min(t0, lo_lanes[i]);
+		t1 = Max(t1, hi_lanes[i]);
+	}
+	if(t0 > t1) t0 = t1 = 0.0f;
+
+	for(u32 c = 0; c < 4; c++) {
+		e0[c] = Clamp(0.0f, mean[c] + axis[c] * t0, 255.0f);
+		e1[c] = Clamp(0.0f, mean[c] + axis[c] * t1, 255.0f);
+	}
+}
+
+internal void bc_bounding_box(const BCBlock* block, u32 pixel_mask, f32 e0[4], f32 e1[4]) {
+	for(u32 c = 0; c < 4; c++) {
+		e0[c] = 255.0f;
+		e1[c] = 0.0f;
+		for(u32 i = 0; i < 16; i++) {
+			if(!((pixel_mask >> i) & 1)) continue;
+			e0[c] = Min(e0[c], block->c[c][i]);
+			e1[c] = Max(e1[c], block->c[c][i]);
+		}
+		// Inset by 1/16 of the range, the extremes are rarely hit exactly.
+		f32 inset = (e1[c] - e0[c]) / 16.0f;
+		e0[c] += inset;
+		e1[c] -= inset;
+	}
+}
+
+// Picks the closest palette entry for every pixel and returns the summed squared
+// error of the pixels in `pixel_mask`. Channels are weighted by `channel_weights`.
+internal f32 bc_fit_palette(const BCBlock* block, const f32 (*palette)[4], u32 palette_count,
+														const f32 channel_weights[4], u32 pixel_mask, u8 indices[16]) {
+	f32 total = 0.0f;
+	for(u32 i = 0; i < 16; i += BC_LANES) {
+		BCVec best_error = bc_set1(FLT_MAX);
+		BCVec best_index = bc_set1(0.0f);
+		BCVec px[4];
+		for(u32 c = 0; c < 4; c++) px[c] = bc_load(block->c[c] + i);
+
+		for(u32 k = 0; k < palette_count; k++) {
+			BCVec error = bc_set1(0.0f);
+			for(u32 c = 0; c < 4; c++) {
+				BCVec d = bc_sub(px[c], bc_set1(palette[k][c]));
+				error = bc_add(error, bc_mul(bc_mul(d, d), bc_set1(channel_weights[c])));
+			}
+			BCVec better = bc_less(error, best_error);
+			best_error = bc_select(better, error, best_error);
+			best_index = bc_select(better, bc_set1((f32)k), best_index);
+		}
+
+		alignas(32) f32 errors[BC_LANES], chosen[BC_LANES];
+		bc_store(errors, best_error);
+		bc_store(chosen, best_index);
+		for(u32 j = 0; j < BC_LANES; j++) {
+			if(!((pixel_mask >> (i + j)) & 1)) continue;
+			indices[i + j] = (u8)chosen[j];
+			total += errors[j];
+		}
+	}
+	return total;
+}
+
+// Least squares endpoints for fixed indices: every selected pixel is modelled as
+// lerp(e0, e1, weight[index]). Returns false when the system is degenerate.
+internal b32 bc_refine_endpoints(const BCBlock* block, u32 pixel_mask, const u8 indices[16], const f32* index_weights,
+																 u32 channels, f32 e0[4], f32 e1[4]) {
+	f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	f32 ax[4] = {}, bx[4] = {};
+	for(u32 i = 0; i < 16; i++) {
+		if(!((pixel_mask >> i) & 1)) continue;
+		f32 w = index_weights[indices[i]];
+		f32 a = 1.0f - w;
+		aa += a * a;
+		ab += a * w;
+		bb += w * w;
+		for(u32 c = 0; c < channels; c++) {
+			ax[c] += a * block->c[c][i];
+			bx[c] += w * block->c[c][i];
+		}
+	}
+
+	f32 det = aa * bb - ab * ab;
+	if(fabsf(det) < 1e-6f) return false;
+	f32 inv = 1.0f / det;
+	for(u32 c = 0; c < channels; c++) {
+		e0[c] = Clamp(0.0f, (bb * ax[c] - ab * bx[c]) * inv, 255.0f);
+		e1[c] = Clamp(0.0f, (aa * bx[c] - ab * ax[c]) * inv, 255.0f);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Bit packing
+//------------------------------------------------------------------------
+
+struct BCBits {
+	u64 words[2];
+	u32 position;
+};
+
+internal void bc_put_bits(BCBits* bits, u32 value, u32 count) {
+	for(u32 i = 0; i < count; i++) {
+		u32 at = bits->position++;
+		bits->words[at >> 6] |= (u64)((value >> i) & 1) << (at & 63);
+	}
+}
+
+//------------------------------------------------------------------------
+// BC1 (and the colour half of BC3)
+//------------------------------------------------------------------------
+
+global const f32 g_bc1_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+global const f32 g_bc_rgb_channel_weights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+
+internal u16 bc1_quantize_565(const f32 c[4]) {
+	u32 r = (u32)(Clamp(0.0f, c[0], 255.0f) * 31.0f / 255.0f + 0.5f);
+	u32 g = (u32)(Clamp(0.0f, c[1], 255.0f) * 63.0f / 255.0f + 0.5f);
+	u32 b = (u32)(Clamp(0.0f, c[2], 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (u16)((r << 11) | (g << 5) | b);
+}
+
+internal void bc1_dequantize_565(u16 v, f32 c[4]) {
+	u32 r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (f32)((r << 3) | (r >> 2));
+	c[1] = (f32)((g << 2) | (g >> 4));
+	c[2] = (f32)((b << 3) | (b >> 2));
+	c[3] = 255.0f;
+}
+
+internal void bc1_palette(u16 c0, u16 c1, f32 palette[4][4]) {
+	bc1_dequantize_565(c0, palette[0]);
+	bc1_dequantize_565(c1, palette[1]);
+	for(u32 c = 0; c < 4; c++) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+}
+
+struct BC1Candidate {
+	u16 c0;
+	u16 c1;
+	u8 indices[16];
+	f32 error;
+};
+
+internal void bc1_evaluate(const BCBlock* block, u16 c0, u16 c1, BC1Candidate* best) {
+	f32 palette[4][4];
+	bc1_palette(c0, c1, palette);
+	BC1Candidate candidate;
+	candidate.c0 = c0;
+	candidate.c1 = c1;
+	candidate.error = bc_fit_palette(block, palette, 4, g_bc_rgb_channel_weights, BC_ALL_PIXELS, candidate.indices);
+	if(candidate.error < best->error) *best = candidate;
+}
+
+internal void bc1_encode_colour(const BCBlock* block, BCQuality quality, u8 out[8]) {
+	f32 e0[4], e1[4];
+	if(quality == BCQuality_Fast) {
+		bc_bounding_box(block, BC_ALL_PIXELS, e0, e1);
+	} else {
+		f32 mean[4], axis[4];
+		bc_principal_axis(block, BC_ALL_PIXELS, 3, mean, axis);
+		bc_project_extents(block, BC_ALL_PIXELS, mean, axis, e0, e1);
+	}
+
+	BC1Candidate best;
+	best.error = FLT_MAX;
+	bc1_evaluate(block, bc1_quantize_565(e1), bc1_quantize_565(e0), &best);
+
+	u32 refinements = quality == BCQuality_Fast ? 0 : quality == BCQuality_Normal ? 1 : 3;
+	for(u32 i = 0; i < refinements; i++) {
+		f32 r0[4], r1[4];
+		if(!bc_refine_endpoints(block, BC_ALL_PIXELS, best.indices, g_bc1_weights, 3, r0, r1)) break;
+		f32 previous = best.error;
+		bc1_evaluate(block, bc1_quantize_565(r0), bc1_quantize_565(r1), &best);
+		if(best.error >= previous) break;
+	}
+
+	// Greedy +-1 nudges of every 565 channel of both endpoints.
+	if(quality == BCQuality_High) {
+		const u16 steps[3] = { 1 << 11, 1 << 5, 1 };
+		const u16 masks[3] = { 31 << 11, 63 << 5, 31 };
+		for(u32 e = 0; e < 2; e++) {
+			for(u32 ch = 0; ch < 3; ch++) {
+				u16 base = e == 0 ? best.c0 : best.c1;
+				if((base & masks[ch]) != masks[ch]) {
+					u16 up = (u16)(base + steps[ch]);
+					bc1_evaluate(block, e == 0 ? up : best.c0, e == 0 ? best.c1 : up, &best);
+				}
+				if((base & masks[ch]) != 0) {
+					u16 down = (u16)(base - steps[ch]);
+					bc1_evaluate(block, e == 0 ? down : best.c0, e == 0 ? best.c1 : down, &best);
+				}
+			}
+		}
+	}
+
+	// Four colour mode needs c0 > c1. Swapping the endpoints swaps index 0<->1 and 2<->3.
+	u16 c0 = best.c0, c1 = best.c1;
+	u8 flip = 0;
+	if(c0 < c1) {
+		u16 t = c0; c0 = c1; c1 = t;
+		flip = 1;
+	}
+
+	u32 packed = 0;
+	if(c0 != c1) {
+		for(u32 i = 0; i < 16; i++) packed |= (u32)(best.indices[i] ^ flip) << (i * 2);
+	}
+
+	memcpy(out + 0, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &packed, 4);
+}
+
+//------------------------------------------------------------------------
+// BC3 alpha (BC4 layout)
+//------------------------------------------------------------------------
+
+internal void bc4_palette(u8 a0, u8 a1, f32 palette[8][4]) {
+	f32 values[8];
+	values[0] = a0;
+	values[1] = a1;
+	if(a0 > a1) {
+		for(u32 i = 1; i < 7; i++) values[i + 1] = ((7 - i) * a0 + i * a1) / 7.0f;
+	} else {
+		for(u32 i = 1; i < 5; i++) values[i + 1] = ((5 - i) * a0 + i * a1) / 5.0f;
+		values[6] = 0.0f;
+		values[7] = 255.0f;
+	}
+	for(u32 i = 0; i < 8; i++) {
+		palette[i][0] = palette[i][1] = palette[i][2] = 0.0f;
+		palette[i][3] = values[i];
+	}
+}
+
+internal void bc3_encode_alpha(const BCBlock* block, BCQuality quality, u8 out[8]) {
+	const f32 alpha_only[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	f32 lo = 255.0f, hi = 0.0f;
+	f32 inner_lo = 255.0f, inner_hi = 0.0f;
+	for(u32 i = 0; i < 16; i++) {
+		f32 a = block->c[3][i];
+		lo = Min(lo, a);
+		hi = Max(hi, a);
+		if(a > 0.0f && a < 255.0f) {
+			inner_lo = Min(inner_lo, a);
+			inner_hi = Max(inner_hi, a);
+		}
+	}
+
+	// Eight value mode over the full range.
+	u8 a0 = (u8)hi, a1 = (u8)lo;
+	f32 palette[8][4];
+	u8 indices[16];
+	bc4_palette(a0, a1, palette);
+	f32 error = bc_fit_palette(block, palette, 8, alpha_only, BC_ALL_PIXELS, indices);
+
+	// Six value mode keeps exact 0 and 255 and spends the ramp on what is left.
+	if(quality == BCQuality_High && inner_lo <= inner_hi && (lo == 0.0f || hi == 255.0f)) {
+		u8 b0 = (u8)inner_lo, b1 = (u8)inner_hi;
+		u8 six_indices[16];
+		f32 six_palette[8][4];
+		bc4_palette(b0, b1, six_palette);
+		f32 six_error = bc_fit_palette(block, six_palette, 8, alpha_only, BC_ALL_PIXELS, six_indices);
+		if(six_error < error) {
+			a0 = b0;
+			a1 = b1;
+			memcpy(indices, six_indices, 16);
+		}
+	}
+
+	u64 packed = 0;
+	for(u32 i = 0; i < 16; i++) packed |= (u64)indices[i] << (i * 3);
+	out[0] = a0;
+	out[1] = a1;
+	for(u32 i = 0; i < 6; i++) out[2 + i] = (u8)(packed >> (i * 8));
+}
+
+//------------------------------------------------------------------------
+// BC7
+//------------------------------------------------------------------------
+
+global const f32 g_bc7_weights4[16] = {
+	0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+	34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+};
+global const u32 g_bc7_weights4_int[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+global const f32 g_bc7_weights3[8] = { 0 / 64.0f, 9 / 64.0f, 18 / 64.0f, 27 / 64.0f, 37 / 64.0f, 46 / 64.0f, 55 / 64.0f, 64 / 64.0f };
+global const u32 g_bc7_weights3_int[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+global const f32 g_bc_rgba_channel_weights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+// Two subset partitions, bit i set = pixel i belongs to subset 1.
+global const u16 g_bc7_partitions2[64] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+	0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// Anchor pixel of subset 1 for every two subset partition (subset 0 is always pixel 0).
+global const u8 g_bc7_anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+// Quantises an endpoint channel to `bits` plus a p-bit and returns the 8-bit value it decodes to.
+internal u32 bc7_quantize_channel(f32 v, u32 bits, u32 pbit, u32* stored) {
+	u32 levels = (1u << bits) - 1;
+	// Decoded value is ((q << 1) | p) expanded from bits+1 to 8 bits.
+	u32 total_bits = bits + 1;
+	f32 scale = (f32)((1u << total_bits) - 1) / 255.0f;
+	s32 q = (s32)floorf((v * scale - (f32)pbit) / 2.0f + 0.5f);
+	q = Clamp(0, q, (s32)levels);
+	*stored = (u32)q;
+	u32 value = ((u32)q << 1) | pbit;
+	return (value << (8 - total_bits)) | (value >> (2 * total_bits - 8));
+}
+
+// P-bit with the smallest quantisation error for one endpoint on its own.
+internal u32 bc7_best_pbit(const f32 e[4], u32 bits, u32 channels) {
+	f32 errors[2] = { 0.0f, 0.0f };
+	for(u32 pbit = 0; pbit < 2; pbit++) {
+		for(u32 c = 0; c < channels; c++) {
+			u32 stored;
+			f32 d = (f32)bc7_quantize_channel(e[c], bits, pbit, &stored) - e[c];
+			errors[pbit] += d * d;
+		}
+	}
+	return errors[1] < errors[0] ? 1 : 0;
+}
+
+internal u32 bc7_interpolate(u32 e0, u32 e1, u32 weight) {
+	return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+struct BC7Endpoints {
+	u32 stored[2][4];   // Quantised values as written to the block.
+	u32 pbits[2];
+	f32 decoded[2][4];  // What the decoder reconstructs.
+};
+
+internal void bc7_quantize_endpoints(BC7Endpoints* q, const f32 e0[4], const f32 e1[4], u32 bits, u32 channels,
+																		 u32 pbit0, u32 pbit1) {
+	const f32* e[2] = { e0, e1 };
+	u32 pbits[2] = { pbit0, pbit1 };
+	for(u32 k = 0; k < 2; k++) {
+		q->pbits[k] = pbits[k];
+		for(u32 c = 0; c < 4; c++) {
+			if(c < channels) {
+				q->decoded[k][c] = (f32)bc7_quantize_channel(e[k][c], bits, pbits[k], &q->stored[k][c]);
+			} else {
+				q->stored[k][c] = 0;
+				q->decoded[k][c] = 255.0f;
+			}
+		}
+	}
+}
+
+internal void bc7_palette(const BC7Endpoints* q, const u32* weights, u32 count, f32 palette[][4]) {
+	for(u32 i = 0; i < count; i++) {
+		for(u32 c = 0; c < 4; c++) {
+			palette[i][c] = (f32)bc7_interpolate((u32)q->decoded[0][c], (u32)q->decoded[1][c], weights[i]);
+		}
+	}
+}
+
+//- Mode 6
+
+struct BC7Mode6 {
+	BC7Endpoints endpoints;
+	u8 indices[16];
+	f32 error;
+};
+
+internal void bc7_mode6_evaluate(const BCBlock* block, const f32 e0[4], const f32 e1[4], b32 search_pbits, BC7Mode6* best) {
+	u32 combos = search_pbits ? 4 : 1;
+	for(u32 combo = 0; combo < combos; combo++) {
+		u32 p0 = combo & 1, p1 = combo >> 1;
+		if(!search_pbits) {
+			p0 = bc7_best_pbit(e0, 7, 4);
+			p1 = bc7_best_pbit(e1, 7, 4);
+		}
+
+		BC7Mode6 candidate;
+		bc7_quantize_endpoints(&candidate.endpoints, e0, e1, 7, 4, p0, p1);
+		f32 palette[16][4];
+		bc7_palette(&candidate.endpoints, g_bc7_weights4_int, 16, palette);
+		candidate.error = bc_fit_palette(block, palette, 16, g_bc_rgba_channel_weights, BC_ALL_PIXELS, candidate.indices);
+		if(candidate.error < best->error) *best = candidate;
+	}
+}
+
+internal void bc7_mode6_encode(const BCBlock* block, BCQuality quality, BC7Mode6* best) {
+	f32 e0[4], e1[4];
+	if(quality == BCQuality_Fast) {
+		bc_bounding_box(block, BC_ALL_PIXELS, e0, e1);
+	} else {
+		f32 mean[4], axis[4];
+		bc_principal_axis(block, BC_ALL_PIXELS, 4, mean, axis);
+		bc_project_extents(block, BC_ALL_PIXELS, mean, axis, e0, e1);
+	}
+
+	b32 search_pbits = quality == BCQuality_High;
+	best->error = FLT_MAX;
+	bc7_mode6_evaluate(block, e0, e1, search_pbits, best);
+
+	u32 refinements = quality == BCQuality_Fast ? 0 : quality == BCQuality_Normal ? 1 : 3;
+	for(u32 i = 0; i < refinements && best->error > 0.0f; i++) {
+		f32 r0[4], r1[4];
+		if(!bc_refine_endpoints(block, BC_ALL_PIXELS, best->indices, g_bc7_weights4, 4, r0, r1)) break;
+		f32 previous = best->error;
+		bc7_mode6_evaluate(block, r0, r1, search_pbits, best);
+		if(best->error >= previous) break;
+	}
+}
+
+internal void bc7_mode6_pack(const BC7Mode6* mode, u8 out[16]) {
+	BC7Endpoints q = mode->endpoints;
+	u8 indices[16];
+	memcpy(indices, mode->indices, 16);
+
+	// The anchor index is stored without its top bit, so it has to be < 8.
+	if(indices[0] & 8) {
+		for(u32 c = 0; c < 4; c++) {
+			u32 t = q.stored[0][c]; q.stored[0][c] = q.stored[1][c]; q.stored[1][c] = t;
+		}
+		u32 t = q.pbits[0]; q.pbits[0] = q.pbits[1]; q.pbits[1] = t;
+		for(u32 i = 0; i < 16; i++) indices[i] = (u8)(15 - indices[i]);
+	}
+
+	BCBits bits = {};
+	bc_put_bits(&bits, 1 << 6, 7);
+	for(u32 c = 0; c < 4; c++) {
+		bc_put_bits(&bits, q.stored[0][c], 7);
+		bc_put_bits(&bits, q.stored[1][c], 7);
+	}
+	bc_put_bits(&bits, q.pbits[0], 1);
+	bc_put_bits(&bits, q.pbits[1], 1);
+	bc_put_bits(&bits, indices[0], 3);
+	for(u32 i = 1; i < 16; i++) bc_put_bits(&bits, indices[i], 4);
+	memcpy(out, bits.words, 16);
+}
+
+//- Mode 1
+
+struct BC7Mode1 {
+	u32 partition;
+	BC7Endpoints endpoints[2];
+	u8 indices[16];
+	f32 error;
+};
+
+internal f32 bc7_mode1_subset(const BCBlock* block, u32 pixel_mask, const f32 e0[4], const f32 e1[4],
+															BC7Endpoints* out_endpoints, u8 indices[16]) {
+	f32 best = FLT_MAX;
+	for(u32 pbit = 0; pbit < 2; pbit++) {
+		BC7Endpoints q;
+		bc7_quantize_endpoints(&q, e0, e1, 6, 3, pbit, pbit);
+		f32 palette[8][4];
+		bc7_palette(&q, g_bc7_weights3_int, 8, palette);
+		u8 candidate[16];
+		f32 error = bc_fit_palette(block, palette, 8, g_bc_rgb_channel_weights, pixel_mask, candidate);
+		if(error < best) {
+			best = error;
+			*out_endpoints = q;
+			for(u32 i = 0; i < 16; i++) if((pixel_mask >> i) & 1) indices[i] = candidate[i];
+		}
+	}
+	return best;
+}
+
+internal f32 bc7_mode1_encode_partition(const BCBlock* block, u32 partition, BC7Mode1* out) {
+	out->partition = partition;
+	out->error = 0.0f;
+	u32 masks[2] = { (u32)(~g_bc7_partitions2[partition]) & BC_ALL_PIXELS, g_bc7_partitions2[partition] };
+	for(u32 s = 0; s < 2; s++) {
+		f32 mean[4], axis[4], e0[4], e1[4];
+		bc_principal_axis(block, masks[s], 3, mean, axis);
+		bc_project_extents(block, masks[s], mean, axis, e0, e1);
+		f32 error = bc7_mode1_subset(block, masks[s], e0, e1, &out->endpoints[s], out->indices);
+
+		f32 r0[4], r1[4];
+		if(bc_refine_endpoints(block, masks[s], out->indices, g_bc7_weights3, 3, r0, r1)) {
+			BC7Endpoints refined;
+			u8 refined_indices[16];
+			memcpy(refined_indices, out->indices, 16);
+			f32 refined_error = bc7_mode1_subset(block, masks[s], r0, r1, &refined, refined_indices);
+			if(refined_error < error) {
+				error = refined_error;
+				out->endpoints[s] = refined;
+				memcpy(out->indices, refined_indices, 16);
+			}
+		}
+		out->error += error;
+	}
+	return out->error;
+}
+
+struct BCTables {
+	alignas(32) f32 subset1_weights[16][64];   // [pixel][partition], 1 when the pixel is in subset 1.
+	alignas(32) f32 subset1_counts[64];
+	b32 ready;
+};
+
+global BCTables g_bc_tables;
+
+internal void bc_tables_init() {
+	if(g_bc_tables.ready) return;
+	for(u32 p = 0; p < 64; p++) {
+		g_bc_tables.subset1_counts[p] = 0.0f;
+		for(u32 i = 0; i < 16; i++) {
+			f32 in_subset1 = (g_bc7_partitions2[p] >> i) & 1 ? 1.0f : 0.0f;
+			g_bc_tables.subset1_weights[i][p] = in_subset1;
+			g_bc_tables.subset1_counts[p] += in_subset1;
+		}
+	}
+	g_bc_tables.ready = true;
+}
+
+// Variance an RGB subset has left over after fitting its principal axis, from the
+// raw moments (count, per channel sums, sums of the six channel products). One
+// subset per lane.
+internal BCVec bc_line_residual(BCVec n, const BCVec sums[3], const BCVec products[6]) {
+	BCVec inv_n = bc_div(bc_set1(1.0f), bc_max(n, bc_set1(1.0f)));
+	BCVec m[3][3];
+	u32 k = 0;
+	for(u32 a = 0; a < 3; a++) {
+		for(u32 b = a; b < 3; b++, k++) m[a][b] = m[b][a] = bc_sub(products[k], bc_mul(bc_mul(sums[a], sums[b]), inv_n));
+	}
+
+	// Power iteration from a fixed start, the small bias keeps empty subsets finite.
+	BCVec v[3] = { bc_set1(0.577f), bc_set1(0.577f), bc_set1(0.577f) };
+	for(u32 iteration = 0; iteration < 4; iteration++) {
+		BCVec next[3];
+		for(u32 a = 0; a < 3; a++) next[a] = bc_add(bc_add(bc_mul(m[a][0], v[0]), bc_mul(m[a][1], v[1])), bc_mul(m[a][2], v[2]));
+		BCVec length_sq = bc_add(bc_add(bc_mul(next[0], next[0]), bc_mul(next[1], next[1])), bc_mul(next[2], next[2]));
+		BCVec inv_length = bc_div(bc_set1(1.0f), bc_sqrt(bc_add(length_sq, bc_set1(1e-12f))));
+		for(u32 a = 0; a < 3; a++) v[a] = bc_mul(next[a], inv_length);
+	}
+
+	BCVec lambda = bc_set1(0.0f);
+	for(u32 a = 0; a < 3; a++) {
+		BCVec mv = bc_add(bc_add(bc_mul(m[a][0], v[0]), bc_mul(m[a][1], v[1])), bc_mul(m[a][2], v[2]));
+		lambda = bc_add(lambda, bc_mul(v[a], mv));
+	}
+	return bc_sub(bc_add(bc_add(m[0][0], m[1][1]), m[2][2]), lambda);
+}
+
+// Ranks every partition by how well a line fits each subset and fully encodes only
+// the most promising ones. The ranking runs across partitions, one per lane: the
+// moments of subset 1 are accumulated pixel by pixel, subset 0 is the remainder.
+internal void bc7_mode1_encode(const BCBlock* block, u32 candidates, BC7Mode1* best) {
+	f32 moments[9][16];
+	f32 totals[9] = {};
+	for(u32 i = 0; i < 16; i++) {
+		f32 r = block->c[0][i], g = block->c[1][i], b = block->c[2][i];
+		moments[0][i] = r;
+		moments[1][i] = g;
+		moments[2][i] = b;
+		moments[3][i] = r * r;
+		moments[4][i] = r * g;
+		moments[5][i] = r * b;
+		moments[6][i] = g * g;
+		moments[7][i] = g * b;
+		moments[8][i] = b * b;
+		for(u32 k = 0; k < 9; k++) totals[k] += moments[k][i];
+	}
+
+	alignas(32) f32 scores[64];
+	for(u32 p = 0; p < 64; p += BC_LANES) {
+		BCVec subset1[9];
+		for(u32 k = 0; k < 9; k++) subset1[k] = bc_set1(0.0f);
+		for(u32 i = 0; i < 16; i++) {
+			BCVec w = bc_load(g_bc_tables.subset1_weights[i] + p);
+			for(u32 k = 0; k < 9; k++) subset1[k] = bc_add(subset1[k], bc_mul(w, bc_set1(moments[k][i])));
+		}
+
+		BCVec subset0[9];
+		for(u32 k = 0; k < 9; k++) subset0[k] = bc_sub(bc_set1(totals[k]), subset1[k]);
+
+		BCVec n1 = bc_load(g_bc_tables.subset1_counts + p);
+		BCVec n0 = bc_sub(bc_set1(16.0f), n1);
+		bc_store(scores + p, bc_add(bc_line_residual(n0, subset0, subset0 + 3), bc_line_residual(n1, subset1, subset1 + 3)));
+	}
+
+	best->error = FLT_MAX;
+	for(u32 n = 0; n < candidates; n++) {
+		u32 pick = 0;
+		for(u32 p = 1; p < 64; p++) if(scores[p] < scores[pick]) pick = p;
+		scores[pick] = FLT_MAX;
+
+		BC7Mode1 candidate = {};
+		bc7_mode1_encode_partition(block, pick, &candidate);
+		if(candidate.error < best->error) *best = candidate;
+	}
+}
+
+internal void bc7_mode1_pack(const BC7Mode1* mode, u8 out[16]) {
+	BC7Endpoints q[2] = { mode->endpoints[0], mode->endpoints[1] };
+	u8 indices[16];
+	memcpy(indices, mode->indices, 16);
+
+	u16 partition = g_bc7_partitions2[mode->partition];
+	u32 anchors[2] = { 0, g_bc7_anchors2[mode->partition] };
+	for(u32 s = 0; s < 2; s++) {
+		if(!(indices[anchors[s]] & 4)) continue;
+		for(u32 c = 0; c < 3; c++) {
+			u32 t = q[s].stored[0][c]; q[s].stored[0][c] = q[s].stored[1][c]; q[s].stored[1][c] = t;
+		}
+		for(u32 i = 0; i < 16; i++) {
+			if((u32)((partition >> i) & 1) == s) indices[i] = (u8)(7 - indices[i]);
+		}
+	}
+
+	BCBits bits = {};
+	bc_put_bits(&bits, 1 << 1, 2);
+	bc_put_bits(&bits, mode->partition, 6);
+	for(u32 c = 0; c < 3; c++) {
+		bc_put_bits(&bits, q[0].stored[0][c], 6);
+		bc_put_bits(&bits, q[0].stored[1][c], 6);
+		bc_put_bits(&bits, q[1].stored[0][c], 6);
+		bc_put_bits(&bits, q[1].stored[1][c], 6);
+	}
+	bc_put_bits(&bits, q[0].pbits[0], 1);
+	bc_put_bits(&bits, q[1].pbits[0], 1);
+	for(u32 i = 0; i < 16; i++) {
+		b32 anchor = i == anchors[0] || i == anchors[1];
+		bc_put_bits(&bits, indices[i], anchor ? 2 : 3);
+	}
+	memcpy(out, bits.words, 16);
+}
+
+internal void bc7_encode_block(const BCBlock* block, BCQuality quality, u8 out[16]) {
+	BC7Mode6 mode6;
+	bc7_mode6_encode(block, quality, &mode6);
+
+	if(quality == BCQuality_High && block->opaque && mode6.error > 0.0f) {
+		BC7Mode1 mode1 = {};
+		bc7_mode1_encode(block, 4, &mode1);
+		if(mode1.error < mode6.error) {
+			bc7_mode1_pack(&mode1, out);
+			return;
+		}
+	}
+	bc7_mode6_pack(&mode6, out);
+}
+
+//------------------------------------------------------------------------
+// Images
+//------------------------------------------------------------------------
+
+internal void bc_encode_block(const BCBlock* block, BCFormat format, BCQuality quality, u8* out) {
+	switch(format) {
+		case BCFormat_BC1: {
+			bc1_encode_colour(block, quality, out);
+		} break;
+		case BCFormat_BC3: {
+			bc3_encode_alpha(block, quality, out);
+			bc1_encode_colour(block, quality, out + 8);
+		} break;
+		case BCFormat_BC7: {
+			bc7_encode_block(block, quality, out);
+		} break;
+		default: break;
+	}
+}
+
+struct BCImageJob {
+	const u8* rgba;
+	u32 width;
+	u32 height;
+	u32 row_pitch;
+	u8* out;
+	const BCSettings* settings;
+};
+
+internal void bc_block_row_job(void* user, u32 by) {
+	BCImageJob* job = (BCImageJob*)user;
+	u32 blocks_wide = (job->width + 3) / 4;
+	u32 block_size = bc_block_size(job->settings->format);
+	u8* out = job->out + (u64)by * blocks_wide * block_size;
+	for(u32 bx = 0; bx < blocks_wide; bx++) {
+		BCBlock block;
+		bc_load_block(&block, job->rgba, job->row_pitch, job->width, job->height, bx, by);
+		bc_encode_block(&block, job->settings->format, job->settings->quality, out + (u64)bx * block_size);
+	}
+}
+
+// Compresses an RGBA8 image into `out` (bc_compressed_size bytes, rows of blocks
+// tightly packed). Rows of blocks are spread over the worker threads.
+internal void bc_compress_image(const u8* rgba, u32 width, u32 height, u32 row_pitch, u8* out, const BCSettings* settings) {
+	bc_tables_init();
+	BCImageJob job = { rgba, width, height, row_pitch, out, settings };
+	u32 blocks_high = (height + 3) / 4;
+	os_parallel_for(blocks_high, settings->thread_count, bc_block_row_job, &job);
+}
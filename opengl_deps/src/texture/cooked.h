@@ -0,0 +1,218 @@
+#pragma once
+
+// Cooked texture container (.ctex).
+//
+// An offline-built file that is loaded with one mapping and zero copies: a
+// fixed header with a per-level table, followed by the payload of every mip
+// level already in its GPU format (RGBA8 or BCn blocks). Every level starts on
+// a 64-byte boundary of the file, and since mappings are page aligned the
+// level pointers handed to D3D11_SUBRESOURCE_DATA / glTexImage2D point
+// straight into the mapped pages.
+//
+// Layout:
+//   CookedTextureHeader   (COOKED_TEXTURE_HEADER_SIZE bytes, zero padded)
+//   level 0 .. level N-1  (each at CookedTextureLevel::offset, 64-byte aligned)
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define COOKED_TEXTURE_MAGIC       0x58544345u   // "ECTX"
+#define COOKED_TEXTURE_VERSION     1
+#define COOKED_TEXTURE_ALIGN       64
+#define COOKED_TEXTURE_HEADER_SIZE 640
+#define COOKED_TEXTURE_MAX_SIZE    65536         // Widest and tallest accepted, keeps row pitches far from overflow.
+
+enum CookedFormat : u32 {
+	CookedFormat_RGBA8,
+	CookedFormat_BC1,
+	CookedFormat_BC3,
+	CookedFormat_BC7,
+	CookedFormat_COUNT
+};
+
+enum CookedFlags : u32 {
+	CookedFlag_SRGB = (1 << 0),   // Colour is sRGB encoded (and mips were filtered in linear space).
+};
+
+struct CookedTextureLevel {
+	u32 width;
+	u32 height;
+	u32 row_pitch;    // Bytes per row of pixels, or per row of 4x4 blocks for BCn.
+	u32 reserved;
+	u64 offset;       // From the start of the file.
+	u64 size;
+};
+
+struct CookedTextureHeader {
+	u32 magic;
+	u32 version;
+	u32 format;
+	u32 flags;
+	u32 width;
+	u32 height;
+	u32 level_count;
+	u32 reserved;
+	u64 file_size;
+	u64 reserved2;
+	CookedTextureLevel levels[MIP_MAX_LEVELS];
+};
+
+static_assert(sizeof(CookedTextureHeader) <= COOKED_TEXTURE_HEADER_SIZE, "Cooked texture header does not fit");
+static_assert(COOKED_TEXTURE_HEADER_SIZE % COOKED_TEXTURE_ALIGN == 0, "Cooked texture payload must start aligned");
+
+internal b32 cooked_format_is_block_compressed(CookedFormat format) {
+	return format != CookedFormat_RGBA8;
+}
+
+// Bytes per pixel for RGBA8, bytes per 4x4 block for BCn.
+internal u32 cooked_format_unit_size(CookedFormat format) {
+	switch(format) {
+		case CookedFormat_RGBA8: return 4;
+		case CookedFormat_BC1:   return 8;
+		case CookedFormat_BC3:   return 16;
+		case CookedFormat_BC7:   return 16;
+		default:                 return 0;
+	}
+}
+
+internal u32 cooked_level_row_pitch(CookedFormat format, u32 width) {
+	if(cooked_format_is_block_compressed(format)) return ((width + 3) / 4) * cooked_format_unit_size(format);
+	return width * cooked_format_unit_size(format);
+}
+
+internal u32 cooked_level_row_count(CookedFormat format, u32 height) {
+	return cooked_format_is_block_compressed(format) ? (height + 3) / 4 : height;
+}
+
+//------------------------------------------------------------------------
+// Loading
+//------------------------------------------------------------------------
+
+struct CookedTexture {
+	OS_FileMap file;    // Empty when the texture lives in memory owned by someone else (e.g. a pack).
+	const CookedTextureHeader* header;
+};
+
+// Validates a cooked texture that is already in memory, such as a span of a
+// mapped asset pack. Nothing is copied, `data` has to outlive the texture.
+internal b32 cooked_texture_from_memory(CookedTexture* texture, const u8* data, u64 size) {
+	*texture = {};
+	const CookedTextureHeader* header = (const CookedTextureHeader*)data;
+	b32 valid = data && size >= COOKED_TEXTURE_HEADER_SIZE &&
+							header->magic == COOKED_TEXTURE_MAGIC &&
+							header->version == COOKED_TEXTURE_VERSION &&
+							header->format < CookedFormat_COUNT &&
+							header->file_size == size &&
+							header->width >= 1 && header->height >= 1 && header->width <= COOKED_TEXTURE_MAX_SIZE && header->height <= COOKED_TEXTURE_MAX_SIZE &&
+							header->level_count >= 1 && header->level_count <= MIP_MAX_LEVELS;
+
+	// Every level is a halving of the one before, tightly packed, and inside the
+	// file. Readers size their copies and uploads from width, height and
+	// row_pitch, so those must agree with the bytes that are really there.
+	for(u32 i = 0; valid && i < header->level_count; i++) {
+		const CookedTextureLevel* level = &header->levels[i];
+		CookedFormat format = (CookedFormat)header->format;
+		u64 expected = (u64)level->row_pitch * cooked_level_row_count(format, level->height);
+		valid = level->width == Max(header->width >> i, 1u) &&
+						level->height == Max(header->height >> i, 1u) &&
+						level->row_pitch == cooked_level_row_pitch(format, level->width) &&
+						level->offset % COOKED_TEXTURE_ALIGN == 0 &&
+						level->offset >= COOKED_TEXTURE_HEADER_SIZE &&
+						level->size == expected &&
+						level->size <= size && level->offset <= size - level->size;
+	}
+
+	if(valid) texture->header = header;
+	return valid;
+}
+
+// Maps the file and validates the header and level table. Nothing is copied,
+// level data stays in the mapping until cooked_texture_close().
+internal b32 cooked_texture_open(CookedTexture* texture, const char* path) {
+	OS_FileMap file;
+	if(!os_file_map_open(&file, path)) return false;
+	if(!cooked_texture_from_memory(texture, file.data, file.size)) {
+		os_file_map_close(&file);
+		return false;
+	}
+	texture->file = file;
+	return true;
+}
+
+internal void cooked_texture_close(CookedTexture* texture) {
+	os_file_map_close(&texture->file);
+	*texture = {};
+}
+
+internal const u8* cooked_texture_level_data(const CookedTexture* texture, u32 level) {
+	return (const u8*)texture->header + texture->header->levels[level].offset;
+}
+
+//------------------------------------------------------------------------
+// Writing
+//------------------------------------------------------------------------
+
+struct CookedLevelSource {
+	const u8* data;
+	u32 width;
+	u32 height;
+};
+
+// Writes a cooked texture. `levels` holds `level_count` payloads already in
+// `format`, tightly packed (row pitch as given by cooked_level_row_pitch).
+internal b32 cooked_texture_write(const char* path, CookedFormat format, u32 flags,
+																	const CookedLevelSource* levels, u32 level_count) {
+	if(level_count == 0 || level_count > MIP_MAX_LEVELS) return false;
+
+	CookedTextureHeader header = {};
+	header.magic = COOKED_TEXTURE_MAGIC;
+	header.version = COOKED_TEXTURE_VERSION;
+	header.format = format;
+	header.flags = flags;
+	header.width = levels[0].width;
+	header.height = levels[0].height;
+	header.level_count = level_count;
+
+	u64 offset = COOKED_TEXTURE_HEADER_SIZE;
+	for(u32 i = 0; i < level_count; i++) {
+		CookedTextureLevel* level = &header.levels[i];
+		level->width = levels[i].width;
+		level->height = levels[i].height;
+		level->row_pitch = cooked_level_row_pitch(format, level->width);
+		level->offset = offset;
+		level->size = (u64)level->row_pitch * cooked_level_row_count(format, level->height);
+		offset = AlignPow2(offset + level->size, (u64)COOKED_TEXTURE_ALIGN);
+	}
+	header.file_size = offset;
+
+	FILE* file = fopen(path, "wb");
+	if(!file) return false;
+
+	u8 zeroes[COOKED_TEXTURE_HEADER_SIZE] = {};
+	b32 ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+					 fwrite(zeroes, 1, COOKED_TEXTURE_HEADER_SIZE - sizeof(header), file) == COOKED_TEXTURE_HEADER_SIZE - sizeof(header);
+	for(u32 i = 0; ok && i < level_count; i++) {
+		const CookedTextureLevel* level = &header.levels[i];
+		u64 padding = AlignPow2(level->offset + level->size, (u64)COOKED_TEXTURE_ALIGN) - (level->offset + level->size);
+		ok = fwrite(levels[i].data, 1, level->size, file) == level->size &&
+				 fwrite(zeroes, 1, padding, file) == padding;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+// Convenience for uncompressed RGBA8 chains straight out of texture/mips.h.
+internal b32 cooked_texture_write_mips(const char* path, const MipChain* chain, u32 flags) {
+	CookedLevelSource levels[MIP_MAX_LEVELS];
+	for(u32 i = 0; i < chain->level_count; i++) {
+		levels[i].data = mip_level_data(chain, i);
+		levels[i].width = chain->levels[i].width;
+		levels[i].height = chain->levels[i].height;
+	}
+	return cooked_texture_write(path, CookedFormat_RGBA8, flags, levels, chain->level_count);
+}
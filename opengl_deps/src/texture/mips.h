@@ -0,0 +1,445 @@
+#pragma once
+
+// CPU mip chain generation for RGBA8 textures.
+//
+// Replaces D3D11_RESOURCE_MISC_GENERATE_MIPS: the whole chain is built up front
+// in one allocation with 64-byte aligned levels, so it can be handed to the GPU
+// as initial data for an immutable texture (one D3D11_SUBRESOURCE_DATA per
+// level) and the texture no longer needs to be bindable as a render target.
+//
+// Each level is filtered from the previous one. Colour channels can be treated
+// as sRGB, in which case they are linearised through a table before filtering
+// and re-encoded afterwards; alpha is always filtered linearly. Rows of a level
+// are split into bands that run in parallel, and batches of textures are spread
+// one texture per thread.
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "platform/os.h"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <immintrin.h>
+#endif
+
+#define MIP_MAX_LEVELS     16
+#define MIP_LEVEL_ALIGN    64
+#define MIP_BAND_ROWS      32
+#define MIP_MAX_TAPS       16
+
+enum MipFilter : u32 {
+	MipFilter_Box,      // 2x2 average, what GenerateMips does.
+	MipFilter_Lanczos,  // Separable Lanczos2, sharper and without the box filter's aliasing.
+	MipFilter_COUNT
+};
+
+struct MipSettings {
+	MipFilter filter;
+	b32 srgb;           // Filter colour in linear space.
+	u32 thread_count;   // 0 = one per logical core.
+};
+
+struct MipLevel {
+	u32 width;
+	u32 height;
+	u32 row_pitch;
+	u64 offset;
+};
+
+struct MipChain {
+	u32 width;
+	u32 height;
+	u32 level_count;
+	MipLevel levels[MIP_MAX_LEVELS];
+	u8* data;           // All levels, level 0 first.
+	u64 size;
+};
+
+internal u32 mip_level_count(u32 width, u32 height) {
+	u32 count = 1;
+	while((width > 1 || height > 1) && count < MIP_MAX_LEVELS) {
+		width = Max(width / 2, 1u);
+		height = Max(height / 2, 1u);
+		count++;
+	}
+	return count;
+}
+
+// Lays out a full chain for a `width` x `height` RGBA8 texture and allocates it.
+// The caller fills level 0 and then calls mip_generate().
+internal b32 mip_chain_alloc(MipChain* chain, u32 width, u32 height) {
+	*chain = {};
+	if(width == 0 || height == 0) return false;
+
+	chain->width = width;
+	chain->height = height;
+	chain->level_count = mip_level_count(width, height);
+
+	u64 offset = 0;
+	for(u32 i = 0; i < chain->level_count; i++) {
+		MipLevel* level = &chain->levels[i];
+		level->width = width;
+		level->height = height;
+		level->row_pitch = width * 4;
+		level->offset = offset;
+		offset = AlignPow2(offset + (u64)level->row_pitch * height, (u64)MIP_LEVEL_ALIGN);
+		width = Max(width / 2, 1u);
+		height = Max(height / 2, 1u);
+	}
+
+	chain->size = offset;
+	chain->data = (u8*)os_alloc_pages(chain->size);
+	return chain->data != nullptr;
+}
+
+internal void mip_chain_release(MipChain* chain) {
+	os_free_pages(chain->data, chain->size);
+	*chain = {};
+}
+
+internal u8* mip_level_data(const MipChain* chain, u32 level) {
+	return chain->data + chain->levels[level].offset;
+}
+
+//------------------------------------------------------------------------
+// sRGB tables
+//------------------------------------------------------------------------
+
+#define MIP_SRGB_ENCODE_STEPS 4096
+
+struct MipTables {
+	f32 srgb_to_linear[256];
+	f32 unorm_to_float[256];
+	u8  linear_to_srgb[MIP_SRGB_ENCODE_STEPS + 1];
+};
+
+global MipTables g_mip_tables;
+global std::once_flag g_mip_tables_once;
+
+internal f32 mip_srgb_to_linear(f32 c) {
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+internal f32 mip_linear_to_srgb(f32 c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+internal void mip_tables_build() {
+	for(u32 i = 0; i < 256; i++) {
+		g_mip_tables.srgb_to_linear[i] = mip_srgb_to_linear(i / 255.0f);
+		g_mip_tables.unorm_to_float[i] = i / 255.0f;
+	}
+	for(u32 i = 0; i <= MIP_SRGB_ENCODE_STEPS; i++) {
+		f32 c = mip_linear_to_srgb((f32)i / MIP_SRGB_ENCODE_STEPS);
+		g_mip_tables.linear_to_srgb[i] = (u8)(c * 255.0f + 0.5f);
+	}
+}
+
+// Builds the tables once. Safe from any thread: mip_generate() runs on stream
+// workers, several at a time, and every caller returns with the tables ready.
+internal void mip_tables_init() {
+	std::call_once(g_mip_tables_once, mip_tables_build);
+}
+
+// Filtering happens on f32x4 pixels (r, g, b, a) in [0, 1].
+inline __m128 mip_decode_pixel(const u8* p, b32 srgb) {
+	const f32* colour = srgb ? g_mip_tables.srgb_to_linear : g_mip_tables.unorm_to_float;
+	return _mm_setr_ps(colour[p[0]], colour[p[1]], colour[p[2]], g_mip_tables.unorm_to_float[p[3]]);
+}
+
+inline void mip_encode_pixel(u8* p, __m128 v, b32 srgb) {
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	if(srgb) {
+		__m128i index = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps((f32)MIP_SRGB_ENCODE_STEPS)));
+		__m128i unorm = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+		p[0] = g_mip_tables.linear_to_srgb[_mm_cvtsi128_si32(index)];
+		p[1] = g_mip_tables.linear_to_srgb[_mm_extract_epi16(index, 2)];
+		p[2] = g_mip_tables.linear_to_srgb[_mm_extract_epi16(index, 4)];
+		p[3] = (u8)_mm_extract_epi16(unorm, 6);
+	} else {
+		__m128i unorm = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+		unorm = _mm_packs_epi32(unorm, unorm);
+		unorm = _mm_packus_epi16(unorm, unorm);
+		u32 packed = (u32)_mm_cvtsi128_si32(unorm);
+		memcpy(p, &packed, 4);
+	}
+}
+
+//------------------------------------------------------------------------
+// Box filter
+//------------------------------------------------------------------------
+
+// Averages 2x2 blocks of RGBA8 with round-to-nearest. `src_row1` is the second
+// source row (the same as `src_row0` when the source is one pixel tall).
+internal void mip_box_row_unorm(u8* dst, const u8* src_row0, const u8* src_row1, u32 dst_width, u32 src_width) {
+	u32 x = 0;
+
+	// The vector path needs both pixels of every pair, odd source widths finish in the scalar loop.
+	u32 paired = (src_width >= 2) ? dst_width : 0;
+#if defined(__AVX2__)
+	const __m256i round = _mm256_set1_epi16(2);
+	for(; x + 4 <= paired && (x * 2 + 8) <= src_width; x += 4) {
+		// 8 source pixels per row -> 4 output pixels.
+		__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src_row0 + x * 8)));
+		__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src_row1 + x * 8)));
+		__m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src_row0 + x * 8 + 16)));
+		__m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src_row1 + x * 8 + 16)));
+		__m256i lo = _mm256_add_epi16(a, b);   // pixels 0..3, rows summed
+		__m256i hi = _mm256_add_epi16(c, d);   // pixels 4..7
+		// Each 128-bit lane holds two pixels, add them together.
+		lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+		hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 2);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 2);
+		// Keep the low 64 bits of each lane: out0 | out1 | out2 | out3.
+		__m256i packed = _mm256_unpacklo_epi64(lo, hi);                   // lane0: out0 out2, lane1: out1 out3
+		packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)); // out0 out1 out2 out3
+		packed = _mm256_packus_epi16(packed, packed);
+		packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i*)(dst + x * 4), _mm256_castsi256_si128(packed));
+	}
+#endif
+
+	for(; x < dst_width; x++) {
+		u32 x0 = Min(x * 2, src_width - 1);
+		u32 x1 = Min(x * 2 + 1, src_width - 1);
+		for(u32 c = 0; c < 4; c++) {
+			u32 sum = src_row0[x0 * 4 + c] + src_row0[x1 * 4 + c] + src_row1[x0 * 4 + c] + src_row1[x1 * 4 + c];
+			dst[x * 4 + c] = (u8)((sum + 2) >> 2);
+		}
+	}
+}
+
+internal void mip_box_row_srgb(u8* dst, const u8* src_row0, const u8* src_row1, u32 dst_width, u32 src_width) {
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	for(u32 x = 0; x < dst_width; x++) {
+		u32 x0 = Min(x * 2, src_width - 1);
+		u32 x1 = Min(x * 2 + 1, src_width - 1);
+		__m128 sum = _mm_add_ps(_mm_add_ps(mip_decode_pixel(src_row0 + x0 * 4, true), mip_decode_pixel(src_row0 + x1 * 4, true)),
+														_mm_add_ps(mip_decode_pixel(src_row1 + x0 * 4, true), mip_decode_pixel(src_row1 + x1 * 4, true)));
+		mip_encode_pixel(dst + x * 4, _mm_mul_ps(sum, quarter), true);
+	}
+}
+
+//------------------------------------------------------------------------
+// Lanczos filter
+//------------------------------------------------------------------------
+
+struct MipTaps {
+	s32 first;          // Source index of the first tap, may be negative (wraps).
+	u32 count;
+	f32 weights[MIP_MAX_TAPS];
+};
+
+internal f32 mip_lanczos2(f32 x) {
+	x = fabsf(x);
+	if(x < 1e-5f) return 1.0f;
+	if(x >= 2.0f) return 0.0f;
+	const f32 pi = 3.14159265358979f;
+	return 2.0f * sinf(pi * x) * sinf(pi * x * 0.5f) / (pi * pi * x * x);
+}
+
+// Tap positions and weights for every output index along one axis. The kernel is
+// stretched by the downsample ratio so it always covers the full source footprint.
+internal void mip_build_taps(MipTaps* taps, u32 dst_size, u32 src_size) {
+	f32 scale = (f32)src_size / (f32)dst_size;
+	f32 radius = 2.0f * scale;
+	for(u32 i = 0; i < dst_size; i++) {
+		MipTaps* t = &taps[i];
+		f32 centre = (i + 0.5f) * scale;
+		s32 first = (s32)floorf(centre - radius + 0.5f);
+		s32 last = (s32)floorf(centre + radius - 0.5f);
+		if(last - first + 1 > MIP_MAX_TAPS) {
+			s32 excess = (last - first + 1) - MIP_MAX_TAPS;
+			first += excess / 2;
+			last = first + MIP_MAX_TAPS - 1;
+		}
+
+		f32 total = 0.0f;
+		t->first = first;
+		t->count = (u32)(last - first + 1);
+		for(u32 k = 0; k < t->count; k++) {
+			f32 w = mip_lanczos2(((f32)(first + (s32)k) + 0.5f - centre) / scale);
+			t->weights[k] = w;
+			total += w;
+		}
+		for(u32 k = 0; k < t->count; k++) t->weights[k] /= total;
+	}
+}
+
+inline u32 mip_wrap(s32 i, u32 size) {
+	s32 m = i % (s32)size;
+	return (u32)(m < 0 ? m + (s32)size : m);
+}
+
+//------------------------------------------------------------------------
+// Level generation
+//------------------------------------------------------------------------
+
+struct MipBandJob {
+	const MipSettings* settings;
+	const u8* src;
+	u8* dst;
+	const MipLevel* src_level;
+	const MipLevel* dst_level;
+	const MipTaps* x_taps;
+	const MipTaps* y_taps;
+	u8* scratch;             // Lanczos: scratch_size bytes per worker.
+	u64 scratch_size;
+};
+
+internal void mip_band_box(MipBandJob* job, u32 y0, u32 y1) {
+	const MipLevel* s = job->src_level;
+	const MipLevel* d = job->dst_level;
+	for(u32 y = y0; y < y1; y++) {
+		const u8* row0 = job->src + (u64)Min(y * 2, s->height - 1) * s->row_pitch;
+		const u8* row1 = job->src + (u64)Min(y * 2 + 1, s->height - 1) * s->row_pitch;
+		u8* out = job->dst + (u64)y * d->row_pitch;
+		if(job->settings->srgb) mip_box_row_srgb(out, row0, row1, d->width, s->width);
+		else                    mip_box_row_unorm(out, row0, row1, d->width, s->width);
+	}
+}
+
+// Source rows the taps of destination rows [y0, y1) reach.
+internal u32 mip_band_source_rows(const MipTaps* y_taps, u32 y0, u32 y1) {
+	s32 first_row = y_taps[y0].first;
+	s32 last_row = y_taps[y1 - 1].first + (s32)y_taps[y1 - 1].count - 1;
+	return (u32)(last_row - first_row + 1);
+}
+
+// Horizontal pass over the source rows the band touches into the worker's
+// float scratch, then a vertical pass straight into the destination level.
+internal void mip_band_lanczos(MipBandJob* job, u32 y0, u32 y1, u32 worker) {
+	const MipLevel* s = job->src_level;
+	const MipLevel* d = job->dst_level;
+	b32 srgb = job->settings->srgb;
+
+	s32 first_row = job->y_taps[y0].first;
+	u32 row_count = mip_band_source_rows(job->y_taps, y0, y1);
+
+	__m128* decoded = (__m128*)(job->scratch + job->scratch_size * worker);
+	__m128* horizontal = decoded + s->width;
+
+	for(u32 r = 0; r < row_count; r++) {
+		const u8* src_row = job->src + (u64)mip_wrap(first_row + (s32)r, s->height) * s->row_pitch;
+		for(u32 x = 0; x < s->width; x++) decoded[x] = mip_decode_pixel(src_row + x * 4, srgb);
+
+		__m128* out = horizontal + (u64)r * d->width;
+		for(u32 x = 0; x < d->width; x++) {
+			const MipTaps* t = &job->x_taps[x];
+			__m128 sum = _mm_setzero_ps();
+			if(t->first >= 0 && t->first + t->count <= s->width) {
+				const __m128* in = decoded + t->first;
+				for(u32 k = 0; k < t->count; k++) sum = _mm_add_ps(sum, _mm_mul_ps(in[k], _mm_set1_ps(t->weights[k])));
+			} else {
+				for(u32 k = 0; k < t->count; k++) {
+					sum = _mm_add_ps(sum, _mm_mul_ps(decoded[mip_wrap(t->first + (s32)k, s->width)], _mm_set1_ps(t->weights[k])));
+				}
+			}
+			out[x] = sum;
+		}
+	}
+
+	// Vertical pass a whole row at a time, reusing the decode row as the accumulator.
+	__m128* sum = decoded;
+	for(u32 y = y0; y < y1; y++) {
+		const MipTaps* t = &job->y_taps[y];
+		const __m128* rows = horizontal + (u64)(t->first - first_row) * d->width;
+		for(u32 x = 0; x < d->width; x++) sum[x] = _mm_setzero_ps();
+		for(u32 k = 0; k < t->count; k++) {
+			const __m128* in = rows + (u64)k * d->width;
+			__m128 w = _mm_set1_ps(t->weights[k]);
+			for(u32 x = 0; x < d->width; x++) sum[x] = _mm_add_ps(sum[x], _mm_mul_ps(in[x], w));
+		}
+
+		u8* out = job->dst + (u64)y * d->row_pitch;
+		for(u32 x = 0; x < d->width; x++) mip_encode_pixel(out + x * 4, sum[x], srgb);
+	}
+}
+
+internal void mip_band_job(void* user, u32 band, u32 worker) {
+	MipBandJob* job = (MipBandJob*)user;
+	u32 y0 = band * MIP_BAND_ROWS;
+	u32 y1 = Min(y0 + MIP_BAND_ROWS, job->dst_level->height);
+	if(job->settings->filter == MipFilter_Lanczos) mip_band_lanczos(job, y0, y1, worker);
+	else                                           mip_band_box(job, y0, y1);
+}
+
+internal void mip_generate_levels(MipChain* chain, const MipSettings* settings, u32 thread_count) {
+	ArenaTemp scratch = arena_scratch_begin();
+	MipTaps* taps = nullptr;
+	if(settings->filter == MipFilter_Lanczos) taps = ArenaPushArray(scratch.arena, MipTaps, chain->width + chain->height);
+
+	for(u32 i = 1; i < chain->level_count; i++) {
+		MipBandJob job = {};
+		job.settings = settings;
+		job.src_level = &chain->levels[i - 1];
+		job.dst_level = &chain->levels[i];
+		job.src = mip_level_data(chain, i - 1);
+		job.dst = mip_level_data(chain, i);
+		if(taps) {
+			MipTaps* x_taps = taps;
+			MipTaps* y_taps = taps + job.dst_level->width;
+			mip_build_taps(x_taps, job.dst_level->width, job.src_level->width);
+			mip_build_taps(y_taps, job.dst_level->height, job.src_level->height);
+			job.x_taps = x_taps;
+			job.y_taps = y_taps;
+		}
+
+		u32 band_count = (job.dst_level->height + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+		u32 worker_count = os_parallel_worker_count(band_count, thread_count);
+
+		// Every worker's band scratch comes out of this one arena, sized for
+		// the tallest band, so the same chain asks for the same memory each
+		// time however the bands land on the workers.
+		ArenaTemp level_scratch = {};
+		if(taps) {
+			level_scratch = arena_temp_begin(scratch.arena);
+			u32 max_rows = 0;
+			for(u32 band = 0; band < band_count; band++) {
+				u32 y0 = band * MIP_BAND_ROWS;
+				u32 rows = mip_band_source_rows(job.y_taps, y0, Min(y0 + MIP_BAND_ROWS, job.dst_level->height));
+				max_rows = Max(max_rows, rows);
+			}
+			job.scratch_size = AlignPow2((job.src_level->width + (u64)max_rows * job.dst_level->width) * sizeof(__m128), 64ull);
+			job.scratch = ArenaPushArray(scratch.arena, u8, job.scratch_size * worker_count);
+		}
+		os_parallel_for_workers(band_count, worker_count, mip_band_job, &job);
+		if(taps) arena_temp_end(level_scratch);
+	}
+
+	arena_scratch_end(scratch);
+}
+
+// Fills levels 1..N from level 0. Bands of rows within a level run in parallel.
+internal void mip_generate(MipChain* chain, const MipSettings* settings) {
+	mip_tables_init();
+	mip_generate_levels(chain, settings, settings->thread_count);
+}
+
+struct MipBatchJob {
+	MipChain** chains;
+	const MipSettings* settings;
+};
+
+internal void mip_batch_job(void* user, u32 index) {
+	MipBatchJob* job = (MipBatchJob*)user;
+	mip_generate_levels(job->chains[index], job->settings, 1);
+}
+
+// Generates many chains at once. With more textures than threads every thread
+// takes whole textures, which avoids the per-level sync of the banded path.
+internal void mip_generate_batch(MipChain** chains, u32 count, const MipSettings* settings) {
+	mip_tables_init();
+	u32 thread_count = settings->thread_count ? settings->thread_count : os_logical_core_count();
+	if(count < thread_count) {
+		for(u32 i = 0; i < count; i++) mip_generate_levels(chains[i], settings, thread_count);
+		return;
+	}
+
+	MipBatchJob job = { chains, settings };
+	os_parallel_for(count, thread_count, mip_batch_job, &job);
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+// Batch PNG decoding on top of stb_image.
+//
+// png_decode_batch() decodes many PNGs at once on all cores. Every worker owns
+// a scratch block sized for the largest image of the batch and stb_image's
+// allocations are routed into it (STBI_MALLOC & co. below), so decoding does
+// not touch the heap: the scratch is simply reset between images. RGBA8 rows
+// land either in caller buffers or in one output block allocated for the whole
+// batch; with tightly packed rows stb_image writes its final image straight
+// there. Items are started largest first, to keep the tail short, and are
+// reported in the order they complete.
+//
+// stb_image is configured and compiled here (PNG only, static, so every
+// translation unit that includes this header gets its own copy, like the rest
+// of the code). Don't include stb_image.h yourself alongside it, and not
+// together with third_party/third_party.h, whose stb_image has no hooks.
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "platform/os.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(STBI_INCLUDE_STB_IMAGE_H)
+	#error "texture/png.h has to be included before stb_image.h so the allocator hooks are used"
+#endif
+
+//------------------------------------------------------------------------
+// Scratch allocator for stb_image
+//------------------------------------------------------------------------
+
+#define PNG_SCRATCH_ALIGN 16
+
+struct PNGScratch {
+	u8* base;
+	u64 size;
+	u64 used;
+	u64 last;             // Offset of the most recent allocation, the only one that can grow in place.
+	u64 peak;
+	u32 heap_fallbacks;   // Allocations that did not fit and went to the heap.
+
+	// Final destination of the image. stb_image's one allocation of exactly this
+	// size is placed there, which for RGBA8 output is the decoded image itself and
+	// saves the copy out of the scratch.
+	u8* destination;
+	u64 destination_size;
+	u8* destination_given;
+};
+
+// Scratch of the image being decoded on this thread, 0 outside of a batch
+// (stb_image then falls back to the heap as usual).
+global thread_local PNGScratch* t_png_scratch;
+
+internal b32 png_scratch_owns(const PNGScratch* scratch, const void* ptr) {
+	return scratch && (const u8*)ptr >= scratch->base && (const u8*)ptr < scratch->base + scratch->size;
+}
+
+internal void* png_scratch_alloc(u64 size) {
+	PNGScratch* scratch = t_png_scratch;
+	if(scratch) {
+		if(scratch->destination && size == scratch->destination_size) {
+			scratch->destination_given = scratch->destination;
+			scratch->destination = 0;
+			return scratch->destination_given;
+		}
+
+		u64 offset = AlignPow2(scratch->used, (u64)PNG_SCRATCH_ALIGN);
+		if(offset + size <= scratch->size) {
+			scratch->last = offset;
+			scratch->used = offset + size;
+			scratch->peak = Max(scratch->peak, scratch->used);
+			return scratch->base + offset;
+		}
+		scratch->heap_fallbacks++;
+	}
+	return malloc(size);
+}
+
+internal void* png_scratch_realloc(void* ptr, u64 old_size, u64 new_size) {
+	if(!ptr) return png_scratch_alloc(new_size);
+
+	PNGScratch* scratch = t_png_scratch;
+	b32 from_destination = scratch && ptr == scratch->destination_given;
+	if(!png_scratch_owns(scratch, ptr) && !from_destination) return realloc(ptr, new_size);
+
+	u64 offset = (u64)((u8*)ptr - scratch->base);
+	if(!from_destination && offset == scratch->last && offset + new_size <= scratch->size) {
+		scratch->used = offset + new_size;
+		scratch->peak = Max(scratch->peak, scratch->used);
+		return ptr;
+	}
+
+	void* result = png_scratch_alloc(new_size);
+	if(result) memcpy(result, ptr, Min(old_size, new_size));
+	return result;
+}
+
+internal void png_scratch_free(void* ptr) {
+	PNGScratch* scratch = t_png_scratch;
+	if(!ptr || png_scratch_owns(scratch, ptr) || (scratch && ptr == scratch->destination_given)) return;
+	free(ptr);
+}
+
+#define STB_IMAGE_STATIC
+#define STBI_ONLY_PNG
+#define STBI_MALLOC(size)                         png_scratch_alloc(size)
+#define STBI_REALLOC_SIZED(ptr, old_size, new_size) png_scratch_realloc(ptr, old_size, new_size)
+#define STBI_FREE(ptr)                            png_scratch_free(ptr)
+#define STB_IMAGE_IMPLEMENTATION
+#include "third_party/stb/stb_image.h"
+
+//------------------------------------------------------------------------
+// Batch decoding
+//------------------------------------------------------------------------
+
+#define PNG_OUTPUT_ALIGN 64
+
+struct PNGBatchItem {
+	// In
+	const u8* data;       // Encoded PNG, e.g. a mapped file.
+	u64 size;
+	u8* pixels;           // RGBA8 destination (row_pitch * height bytes), or 0 to use the batch output block.
+	u64 row_pitch;        // Destination bytes per row, 0 means width * 4.
+
+	// Out
+	u32 width;
+	u32 height;
+	b32 ok;
+};
+
+// Called on the worker thread as soon as an item is decoded (or failed).
+typedef void PNGDoneFunc(void* user, PNGBatchItem* item, u32 index);
+
+struct PNGBatchSettings {
+	u32 thread_count;     // 0 = one per logical core.
+	PNGDoneFunc* on_done; // Optional.
+	void* user;
+};
+
+struct PNGBatch {
+	u8* memory;           // One allocation for the completion list and every output image.
+	u64 memory_size;
+	const u32* completed; // Item indices in the order they finished.
+	u32 completed_count;
+	u32 failed_count;
+	u32 worker_count;
+	u64 scratch_size;     // Per worker.
+	u64 scratch_peak;     // Largest scratch use of any single image.
+	u32 heap_fallbacks;   // stb_image allocations that did not fit the scratch, ideally 0.
+	f64 seconds;
+};
+
+// Reads the size from the header without decoding anything.
+internal b32 png_info(const u8* data, u64 size, u32* width, u32* height) {
+	int w, h, channels;
+	if(!stbi_info_from_memory(data, (int)size, &w, &h, &channels)) return false;
+	*width = (u32)w;
+	*height = (u32)h;
+	return true;
+}
+
+// Upper bound of what stb_image allocates for one image: the concatenated IDAT
+// stream (grown by doubling), the inflated scanlines, the unfiltered image and
+// the RGBA8 conversion.
+internal u64 png_scratch_estimate(const u8* data, u64 size) {
+	int w, h, channels;
+	if(!stbi_info_from_memory(data, (int)size, &w, &h, &channels)) return 0;
+	u64 bytes = stbi_is_16_bit_from_memory(data, (int)size) ? 2 : 1;
+	u64 pixels = (u64)w * (u64)h;
+	u64 raw = (u64)h * ((u64)w * channels * bytes + 1);
+	u64 unfiltered = pixels * channels * bytes;
+	u64 converted = pixels * 4 * bytes;
+	return 2 * size + raw + unfiltered + converted + KB(64);
+}
+
+struct PNGBatchJob {
+	PNGBatchItem* items;
+	const u32* order;
+	u32* completed;
+	std::atomic<u32> completed_count;
+	std::atomic<u32> failed_count;
+	PNGScratch* scratch;
+	const PNGBatchSettings* settings;
+};
+
+internal void png_decode_job(void* user, u32 slot, u32 worker) {
+	PNGBatchJob* job = (PNGBatchJob*)user;
+	u32 index = job->order[slot];
+	PNGBatchItem* item = &job->items[index];
+	PNGScratch* scratch = &job->scratch[worker];
+
+	u64 row_size = (u64)item->width * 4;
+	u64 row_pitch = item->row_pitch ? item->row_pitch : row_size;
+	scratch->used = 0;
+	scratch->last = 0;
+	scratch->destination = row_pitch == row_size ? item->pixels : 0;
+	scratch->destination_size = row_size * item->height;
+	scratch->destination_given = 0;
+	t_png_scratch = scratch;
+
+	// The destination may also have served as a same-sized temporary, the copy
+	// below is what makes it hold the image in that case.
+	int w = 0, h = 0, channels;
+	stbi_uc* decoded = item->width ? stbi_load_from_memory(item->data, (int)item->size, &w, &h, &channels, 4) : 0;
+	item->ok = decoded && (u32)w == item->width && (u32)h == item->height;
+	if(item->ok && decoded != item->pixels) {
+		if(row_pitch == row_size) {
+			memcpy(item->pixels, decoded, row_size * item->height);
+		} else {
+			for(u32 y = 0; y < item->height; y++) memcpy(item->pixels + y * row_pitch, decoded + y * row_size, row_size);
+		}
+	}
+	stbi_image_free(decoded);
+	t_png_scratch = 0;
+
+	if(!item->ok) job->failed_count.fetch_add(1);
+	job->completed[job->completed_count.fetch_add(1)] = index;
+	if(job->settings->on_done) job->settings->on_done(job->settings->user, item, index);
+}
+
+// Decodes every item. Items without a destination get one in the batch output
+// block, which stays valid until png_batch_release(). Returns false if any item
+// failed; the failures have ok == false and a null `pixels` if they had no
+// destination.
+internal b32 png_decode_batch(PNGBatch* batch, PNGBatchItem* items, u32 count, const PNGBatchSettings* settings) {
+	*batch = {};
+	if(count == 0) return true;
+	f64 start = os_now_seconds();
+
+	// Header pass on the calling thread: sizes, scratch requirement and output layout.
+	u64 scratch_size = 0;
+	u64 completed_size = AlignPow2((u64)count * sizeof(u32) * 2, (u64)PNG_OUTPUT_ALIGN);
+	u64 output_size = 0;
+	for(u32 i = 0; i < count; i++) {
+		PNGBatchItem* item = &items[i];
+		item->ok = png_info(item->data, item->size, &item->width, &item->height);
+		if(!item->ok) {
+			item->width = item->height = 0;
+			continue;
+		}
+		scratch_size = Max(scratch_size, png_scratch_estimate(item->data, item->size));
+		if(!item->pixels) output_size += AlignPow2((u64)item->width * item->height * 4, (u64)PNG_OUTPUT_ALIGN);
+	}
+	scratch_size = AlignPow2(scratch_size, (u64)KB(4));
+
+	batch->worker_count = os_parallel_worker_count(count, settings->thread_count);
+	batch->scratch_size = scratch_size;
+	batch->memory_size = completed_size + output_size;
+	batch->memory = (u8*)os_alloc_pages(batch->memory_size);
+	// The workers' scratch blocks come from a pooled arena, which keeps its
+	// pages for the next batch.
+	ArenaTemp scratch_arena = arena_scratch_begin();
+	u8* scratch_memory = ArenaPushArray(scratch_arena.arena, u8, scratch_size * batch->worker_count);
+	if(!batch->memory || !scratch_memory) {
+		os_free_pages(batch->memory, batch->memory_size);
+		arena_scratch_end(scratch_arena);
+		*batch = {};
+		return false;
+	}
+
+	u32* completed = (u32*)batch->memory;
+	u32* order = completed + count;
+	u8* output = batch->memory + completed_size;
+	for(u32 i = 0; i < count; i++) {
+		PNGBatchItem* item = &items[i];
+		order[i] = i;
+		if(item->ok && !item->pixels) {
+			item->pixels = output;
+			item->row_pitch = 0;
+			output += AlignPow2((u64)item->width * item->height * 4, (u64)PNG_OUTPUT_ALIGN);
+		}
+	}
+
+	// Largest first (insertion sort, batches are at most a few thousand items).
+	for(u32 i = 1; i < count; i++) {
+		u32 value = order[i];
+		u64 pixels = (u64)items[value].width * items[value].height;
+		u32 j = i;
+		for(; j > 0 && (u64)items[order[j - 1]].width * items[order[j - 1]].height < pixels; j--) order[j] = order[j - 1];
+		order[j] = value;
+	}
+
+	PNGScratch scratch[OS_PARALLEL_MAX_WORKERS] = {};
+	for(u32 w = 0; w < batch->worker_count; w++) {
+		scratch[w].base = scratch_memory + scratch_size * w;
+		scratch[w].size = scratch_size;
+	}
+
+	PNGBatchJob job;
+	job.items = items;
+	job.order = order;
+	job.completed = completed;
+	job.completed_count = 0;
+	job.failed_count = 0;
+	job.scratch = scratch;
+	job.settings = settings;
+	os_parallel_for_workers(count, batch->worker_count, png_decode_job, &job);
+
+	for(u32 w = 0; w < batch->worker_count; w++) {
+		batch->scratch_peak = Max(batch->scratch_peak, scratch[w].peak);
+		batch->heap_fallbacks += scratch[w].heap_fallbacks;
+	}
+	arena_scratch_end(scratch_arena);
+
+	batch->completed = completed;
+	batch->completed_count = job.completed_count.load();
+	batch->failed_count = job.failed_count.load();
+	batch->seconds = os_now_seconds() - start;
+	return batch->failed_count == 0;
+}
+
+internal void png_batch_release(PNGBatch* batch) {
+	os_free_pages(batch->memory, batch->memory_size);
+	*batch = {};
+}
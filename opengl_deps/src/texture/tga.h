@@ -0,0 +1,261 @@
+#pragma once
+
+// TGA loading straight out of a mapped file.
+//
+// The file is parsed in place (no fread into a staging buffer) and the pixel
+// data is converted to top-down RGBA8 in a single pass: every destination row
+// is produced by one SIMD BGRA -> RGBA shuffle (or BGR -> RGBA expand for 24-bit
+// images) over the matching source row, so the vertical flip is free and there
+// is no intermediate copy. RLE images are decoded span by span through the
+// same kernels.
+
+#include "basic/types.h"
+
+#include <cstring>
+
+#if defined(__SSSE3__) || defined(__AVX2__) || defined(_M_X64)
+	#include <immintrin.h>
+#endif
+
+#pragma pack(push, 1)
+struct TGAHeader {
+	u8  id_length;
+	u8  colour_map_type;
+	u8  image_type;
+	u16 colour_map_first;
+	u16 colour_map_length;
+	u8  colour_map_depth;
+	u16 x_origin;
+	u16 y_origin;
+	u16 width;
+	u16 height;
+	u8  bpp;
+	u8  descriptor;
+};
+#pragma pack(pop)
+
+enum TGAImageType : u8 {
+	TGAImageType_TrueColour    = 2,
+	TGAImageType_TrueColourRLE = 10,
+};
+
+#define TGA_DESCRIPTOR_RIGHT_TO_LEFT 0x10
+#define TGA_DESCRIPTOR_TOP_TO_BOTTOM 0x20
+
+struct TGAImage {
+	u32 width;
+	u32 height;
+	u32 bpp;            // 24 or 32
+	b32 top_down;
+	b32 rle;
+	const u8* pixels;   // Points into the mapped file.
+	u64 pixels_size;    // Exact for raw images, bytes left in the file for RLE ones.
+};
+
+// Validates the header and points `image` at the pixel data inside `file`.
+// Raw and run-length encoded true colour images at 24 or 32 bits are accepted.
+internal b32 tga_parse(TGAImage* image, const u8* file, u64 file_size) {
+	*image = {};
+	if(file_size < sizeof(TGAHeader)) return false;
+
+	TGAHeader header;
+	memcpy(&header, file, sizeof(header));
+
+	if(header.image_type != TGAImageType_TrueColour && header.image_type != TGAImageType_TrueColourRLE) return false;
+	if(header.colour_map_type != 0) return false;
+	if(header.bpp != 24 && header.bpp != 32) return false;
+	if(header.descriptor & TGA_DESCRIPTOR_RIGHT_TO_LEFT) return false;
+	if(header.width == 0 || header.height == 0) return false;
+
+	u64 offset = sizeof(TGAHeader) + header.id_length;
+	if(offset > file_size) return false;
+
+	b32 rle = header.image_type == TGAImageType_TrueColourRLE;
+	u64 pixels_size = rle ? file_size - offset : (u64)header.width * header.height * (header.bpp / 8);
+	if(offset + pixels_size > file_size) return false;
+
+	image->width = header.width;
+	image->height = header.height;
+	image->bpp = header.bpp;
+	image->top_down = (header.descriptor & TGA_DESCRIPTOR_TOP_TO_BOTTOM) != 0;
+	image->rle = rle;
+	image->pixels = file + offset;
+	image->pixels_size = pixels_size;
+	return true;
+}
+
+// Swaps the red and blue channels of `count` pixels. `dst` and `src` must not overlap.
+internal void tga_swizzle_bgra_to_rgba(u8* dst, const u8* src, u64 count) {
+	u64 i = 0;
+	u64 bytes = count * 4;
+
+#if defined(__AVX512BW__)
+	const __m512i mask = _mm512_set4_epi32(0x0f0c0d0e, 0x0b08090a, 0x07040506, 0x03000102);
+	for(; i + 64 <= bytes; i += 64) {
+		__m512i v = _mm512_loadu_si512((const void*)(src + i));
+		_mm512_storeu_si512((void*)(dst + i), _mm512_shuffle_epi8(v, mask));
+	}
+	if(i < bytes) {
+		__mmask64 tail = ~0ull >> (64 - (bytes - i));
+		__m512i v = _mm512_maskz_loadu_epi8(tail, src + i);
+		_mm512_mask_storeu_epi8(dst + i, tail, _mm512_shuffle_epi8(v, mask));
+		i = bytes;
+	}
+#elif defined(__AVX2__)
+	const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+																				2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	for(; i + 64 <= bytes; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+		_mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+	}
+	for(; i + 32 <= bytes; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+	}
+#elif defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	for(; i + 16 <= bytes; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(a, mask));
+	}
+#endif
+
+	for(; i < bytes; i += 4) {
+		dst[i + 0] = src[i + 2];
+		dst[i + 1] = src[i + 1];
+		dst[i + 2] = src[i + 0];
+		dst[i + 3] = src[i + 3];
+	}
+}
+
+// Expands `count` BGR pixels to RGBA with opaque alpha. `dst` and `src` must not overlap.
+// The vector loops never read past the last source pixel.
+internal void tga_expand_bgr_to_rgba(u8* dst, const u8* src, u64 count) {
+	u64 i = 0;
+
+#if defined(__AVX512BW__)
+	// 16 pixels per iteration: a masked 48 byte load, dwords spread so every
+	// 128-bit lane holds 4 source pixels, then one in-lane shuffle.
+	const __m512i spread = _mm512_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12);
+	const __m512i mask = _mm512_set4_epi32(0x80090a0b, 0x80060708, 0x80030405, 0x80000102);
+	const __m512i alpha = _mm512_set1_epi32((s32)0xff000000);
+	for(; i + 16 <= count; i += 16) {
+		__m512i v = _mm512_maskz_loadu_epi8(0xffffffffffffull, src + i * 3);
+		v = _mm512_maskz_permutexvar_epi32(0xffff, spread, v);
+		v = _mm512_or_si512(_mm512_shuffle_epi8(v, mask), alpha);
+		_mm512_storeu_si512((void*)(dst + i * 4), v);
+	}
+#elif defined(__AVX2__)
+	// 8 pixels per iteration from 24 source bytes. The 32 byte load is only
+	// done while at least 32 bytes remain.
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+	const __m256i mask = _mm256_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128,
+																				2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+	const __m256i alpha = _mm256_set1_epi32((s32)0xff000000);
+	for(; (i + 8) * 3 + 8 <= count * 3; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 3));
+		v = _mm256_permutevar8x32_epi32(v, spread);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), v);
+	}
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+	// 4 pixels from 12 source bytes, same over-read rule as above.
+	const __m128i mask4 = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+	const __m128i alpha4 = _mm_set1_epi32((s32)0xff000000);
+	for(; (i + 4) * 3 + 4 <= count * 3; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 3));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, mask4), alpha4));
+	}
+#endif
+
+	for(; i < count; i++) {
+		dst[i * 4 + 0] = src[i * 3 + 2];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 0];
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+// Writes `count` copies of one RGBA pixel.
+internal void tga_fill_rgba(u8* dst, u32 pixel, u64 count) {
+	u64 i = 0;
+#if defined(__AVX512F__)
+	__m512i v16 = _mm512_set1_epi32((s32)pixel);
+	for(; i + 16 <= count; i += 16) _mm512_storeu_si512((void*)(dst + i * 4), v16);
+#endif
+#if defined(__AVX2__)
+	__m256i v8 = _mm256_set1_epi32((s32)pixel);
+	for(; i + 8 <= count; i += 8) _mm256_storeu_si256((__m256i*)(dst + i * 4), v8);
+#endif
+	for(; i < count; i++) memcpy(dst + i * 4, &pixel, 4);
+}
+
+internal void tga_convert_pixels(u8* dst, const u8* src, u64 count, u32 bpp) {
+	if(bpp == 32) tga_swizzle_bgra_to_rgba(dst, src, count);
+	else          tga_expand_bgr_to_rgba(dst, src, count);
+}
+
+// Walks the RLE packet stream. Packets may span scanlines, so each packet is
+// split at row boundaries and every span goes through the same SIMD paths as
+// raw images: raw packets are converted in bulk and run packets are a vector fill.
+internal b32 tga_decode_rle_rgba8(const TGAImage* image, u8* dst, u64 dst_row_pitch) {
+	u32 pixel_bytes = image->bpp / 8;
+	const u8* at = image->pixels;
+	const u8* end = image->pixels + image->pixels_size;
+
+	u32 x = 0;
+	u32 y = 0;
+	u8* row = dst + (image->top_down ? 0 : (u64)(image->height - 1) * dst_row_pitch);
+	s64 row_step = image->top_down ? (s64)dst_row_pitch : -(s64)dst_row_pitch;
+
+	while(y < image->height) {
+		if(at >= end) return false;
+		u8 packet = *at++;
+		u32 count = (packet & 0x7f) + 1;
+		b32 run = (packet & 0x80) != 0;
+
+		u32 run_pixel = 0;
+		if(run) {
+			if(end - at < pixel_bytes) return false;
+			u8 rgba[4] = { at[2], at[1], at[0], pixel_bytes == 4 ? at[3] : (u8)0xff };
+			memcpy(&run_pixel, rgba, 4);
+			at += pixel_bytes;
+		} else {
+			if((u64)(end - at) < (u64)count * pixel_bytes) return false;
+		}
+
+		while(count > 0 && y < image->height) {
+			u32 span = Min(count, image->width - x);
+			if(run) {
+				tga_fill_rgba(row + (u64)x * 4, run_pixel, span);
+			} else {
+				tga_convert_pixels(row + (u64)x * 4, at, span, image->bpp);
+				at += (u64)span * pixel_bytes;
+			}
+			count -= span;
+			x += span;
+			if(x == image->width) {
+				x = 0;
+				y++;
+				row += row_step;
+			}
+		}
+	}
+	return true;
+}
+
+// Writes the image as top-down RGBA8 into `dst`, which must hold `height` rows of `dst_row_pitch` bytes.
+// Returns false if an RLE stream is truncated.
+internal b32 tga_decode_rgba8(const TGAImage* image, u8* dst, u64 dst_row_pitch) {
+	if(image->rle) return tga_decode_rle_rgba8(image, dst, dst_row_pitch);
+
+	u64 src_row_pitch = (u64)image->width * (image->bpp / 8);
+	for(u32 y = 0; y < image->height; y++) {
+		u32 src_y = image->top_down ? y : (image->height - 1 - y);
+		tga_convert_pixels(dst + y * dst_row_pitch, image->pixels + src_y * src_row_pitch, image->width, image->bpp);
+	}
+	return true;
+}
@@ -0,0 +1,530 @@
+// Benchmark for skeletal animation (scene/anim.h) and CPU skinning
+// (scene/skin.h).
+//
+// The skeleton is a root with chains of 16 bones fanning out from it like a
+// sea anemone, skinned by a tube of rings around every chain, and two looping
+// clips sway the chains at different speeds. Every frame each character:
+//   samples    both clips at its own time, anim_sample()
+//   blends     them with its own weight, anim_blend()
+//   palettes   model space and skinning matrices, anim_palette()
+// and then one character's mesh is skinned with each palette, one thread and
+// all of them. The scalar twins run on the same data and have to give the
+// same bits. Reports bones and vertices per second, and the quantization
+// error of the clips against the poses they were built from.
+//
+// Then the GPU path, gl/skin.h, is checked against skin_vertices(): its vertex
+// shader skins the mesh with a character's palette, and then a copy with four
+// influences a vertex spread over all ANIM_MAX_BONES bones of a random
+// palette, through the uvec4 bone attribute and the std140 palette block, and
+// transform feedback captures gl_Position, which has to be the CPU's position
+// times view_projection. Headless, EGL on Linux (llvmpipe works), a hidden GLFW
+// window on Windows; without a context, or with --no-gl, it is skipped.
+//
+// Usage: anim_bench [--characters=N] [--bones=N] [--rings=N] [--frames=N] [--threads=N] [--out=frame.tga] [--no-gl]
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+#include "raster/raster.h"
+#include "scene/anim.h"
+#include "scene/skin.h"
+
+#include "third_party/glad/glad.h"
+#include "third_party/glad/glad.c"
+
+#if OS_WINDOWS
+	#include "third_party/glfw/glfw3.h"
+	#pragma comment(lib, "../src/third_party/glfw/glfw3_mt")
+	#pragma comment(lib, "user32")
+	#pragma comment(lib, "gdi32")
+	#pragma comment(lib, "shell32")
+#else
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
+#include "gl/skin.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define CHAIN_LENGTH  16
+#define BONE_LENGTH   0.25f
+#define RING_SIDES    16
+#define CLIP_FRAMES   60
+#define GL_SKIN_TOLERANCE  1e-4f    // Of the clip space error, relative to w.
+
+// Root at the origin, chains of CHAIN_LENGTH bones leaning out from it.
+internal void build_skeleton(AnimSkeleton* skeleton, AnimPose* bind_pose, u32 bone_count) {
+	*skeleton = {};
+	u32 chain_count = Max((bone_count - 1) / CHAIN_LENGTH, 1u);
+	Mat4 model[ANIM_MAX_BONES];
+	for(u32 bone = 0; bone < bone_count; bone++) {
+		u32 parent = bone == 0 ? ANIM_NO_PARENT : ((bone - 1) % CHAIN_LENGTH == 0 ? 0 : bone - 1);
+		Quat rotation = quat_identity();
+		Vec3 translation = vec3(0.0f, BONE_LENGTH, 0.0f);
+		if(bone == 0) {
+			translation = vec3(0.0f, 0.0f, 0.0f);
+		} else if(parent == 0) {
+			f32 angle = 6.2831853f * (f32)((bone - 1) / CHAIN_LENGTH) / (f32)chain_count;
+			rotation = quat_mul(quat_from_axis_angle(vec3(1, 0, 0), 0.6f), quat_from_axis_angle(vec3(0, 1, 0), angle));
+		}
+		anim_pose_set(bind_pose, bone, rotation, translation);
+
+		Mat4 relative = mat4_affine(vec3(1, 1, 1), rotation, translation);
+		model[bone] = parent == ANIM_NO_PARENT ? relative : mat4_mul(&relative, &model[parent]);
+		anim_add_bone(skeleton, parent, &model[bone]);
+	}
+}
+
+// The bind pose with every chain bone swaying about its own x and z axes.
+internal void build_clip(AnimClip* clip, const AnimPose* bind_pose, u32 bone_count, f32 speed, Quat* rotations, Vec3* translations) {
+	for(u32 frame = 0; frame < CLIP_FRAMES; frame++) {
+		f32 phase = 6.2831853f * (f32)frame / CLIP_FRAMES;
+		for(u32 bone = 0; bone < bone_count; bone++) {
+			Quat sway = quat_mul(quat_from_axis_angle(vec3(1, 0, 0), 0.25f * sinf(speed * phase + 0.4f * bone)),
+			                     quat_from_axis_angle(vec3(0, 0, 1), 0.2f * cosf(speed * phase + 0.7f * bone)));
+			if(bone == 0) sway = quat_from_axis_angle(vec3(0, 1, 0), phase);
+			rotations[frame * bone_count + bone] = quat_mul(sway, anim_pose_rotation(bind_pose, bone));
+			translations[frame * bone_count + bone] = vec3(bind_pose->translation[0][bone], bind_pose->translation[1][bone] * (1.0f + 0.1f * sinf(phase)),
+			                                               bind_pose->translation[2][bone]);
+		}
+	}
+	anim_clip_build(clip, bone_count, CLIP_FRAMES, 30.0f, rotations, translations);
+}
+
+struct Mesh {
+	SkinVertex* vertices;
+	u32 vertex_count;
+	u16* indices;
+	u32 index_count;
+};
+
+// A tube of `rings` rings a bone around every chain, each vertex weighted
+// between the two bones nearest to it.
+internal void build_mesh(Mesh* mesh, u32 bone_count, u32 rings) {
+	u32 chain_count = Max((bone_count - 1) / CHAIN_LENGTH, 1u);
+	u32 rings_per_chain = CHAIN_LENGTH * rings + 1;
+	mesh->vertex_count = chain_count * rings_per_chain * RING_SIDES;
+	mesh->index_count = chain_count * (rings_per_chain - 1) * RING_SIDES * 6;
+	mesh->vertices = (SkinVertex*)os_alloc_pages((u64)mesh->vertex_count * sizeof(SkinVertex));
+	mesh->indices = (u16*)os_alloc_pages((u64)mesh->index_count * sizeof(u16));
+
+	AnimSkeleton skeleton;
+	AnimPose bind_pose;
+	build_skeleton(&skeleton, &bind_pose, bone_count);
+
+	SkinVertex* vertex = mesh->vertices;
+	u16* index = mesh->indices;
+	for(u32 chain = 0; chain < chain_count; chain++) {
+		u32 first_bone = 1 + chain * CHAIN_LENGTH;
+		u32 first_vertex = (u32)(vertex - mesh->vertices);
+		for(u32 ring = 0; ring < rings_per_chain; ring++) {
+			f32 along = (f32)ring / (f32)rings;          // In bones from the chain's start.
+			u32 bone = Min((u32)along, (u32)CHAIN_LENGTH - 1);
+			f32 t = Min(along - (f32)bone, 1.0f);
+			u32 next = Min(bone + 1, (u32)CHAIN_LENGTH - 1);
+			f32 radius = 0.08f * (1.0f - 0.8f * along / CHAIN_LENGTH);
+			Mat4 bind = mat4_inverse(&skeleton.inverse_bind[first_bone + bone], 0);
+			for(u32 side = 0; side < RING_SIDES; side++) {
+				f32 angle = 6.2831853f * (f32)side / RING_SIDES;
+				Vec3 p = vec3_transform_point(vec3(radius * cosf(angle), t * BONE_LENGTH, radius * sinf(angle)), &bind);
+				vertex->position[0] = p.x;
+				vertex->position[1] = p.y;
+				vertex->position[2] = p.z;
+				vertex->texture[0] = (f32)side / RING_SIDES * 2.0f;
+				vertex->texture[1] = along * 0.5f;
+				vertex->weights[0] = 1.0f - 0.5f * t;
+				vertex->weights[1] = 0.5f * t;
+				vertex->weights[2] = 0.0f;
+				vertex->weights[3] = 0.0f;
+				vertex->bones[0] = (u8)(first_bone + bone);
+				vertex->bones[1] = (u8)(first_bone + next);
+				vertex->bones[2] = 0;
+				vertex->bones[3] = 0;
+				vertex++;
+			}
+		}
+		for(u32 ring = 0; ring + 1 < rings_per_chain; ring++) {
+			for(u32 side = 0; side < RING_SIDES; side++) {
+				u16 a = (u16)(first_vertex + ring * RING_SIDES + side);
+				u16 b = (u16)(first_vertex + ring * RING_SIDES + (side + 1) % RING_SIDES);
+				u16 c = (u16)(a + RING_SIDES), d = (u16)(b + RING_SIDES);
+				*index++ = a; *index++ = c; *index++ = d;
+				*index++ = a; *index++ = d; *index++ = b;
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// GPU skinning check
+//------------------------------------------------------------------------
+
+#if OS_WINDOWS
+internal b32 create_context() {
+	if(!glfwInit()) return false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "anim_bench", nullptr, nullptr);
+	if(!window) return false;
+	glfwMakeContextCurrent(window);
+	return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+}
+#else
+internal b32 create_context() {
+	// Surfaceless first, it needs neither X nor a GPU node.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if(display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) return false;
+	if(!eglBindAPI(EGL_OPENGL_API)) return false;
+
+	EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+	EGLConfig config;
+	EGLint config_count = 0;
+	if(!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) return false;
+
+	EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return false;
+	return gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+}
+#endif
+
+// g_gl_skin_vertex_shader on its own, with gl_Position captured by transform feedback.
+internal gluint gl_skin_check_program() {
+	gluint shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader, 1, &g_gl_skin_vertex_shader, nullptr);
+	glCompileShader(shader);
+	glint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+	gluint program = glCreateProgram();
+	glAttachShader(program, shader);
+	const char* varying = "gl_Position";
+	glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+	glint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	char log[1024] = {};
+	if(!compiled)    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+	else if(!linked) glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+	glDetachShader(program, shader);
+	glDeleteShader(shader);
+	if(!compiled || !linked) {
+		printf("[ERROR] the skinning shader did not %s: %s\n", compiled ? "link" : "compile", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	gl_skin_bind_program(program);
+	return program;
+}
+
+// Skins `vertices` on the GPU and with skin_vertices(), and returns the
+// largest difference of the clip space positions relative to w.
+internal f32 gl_skin_error(gluint program, const Mat4* palette, u32 bone_count, const SkinVertex* vertices, u32 count,
+                           const Mat4* view_projection, u32 thread_count) {
+	gluint palette_buffer = gl_skin_palette_create();
+	gluint vertex_array, buffers[2];
+	glGenVertexArrays(1, &vertex_array);
+	glGenBuffers(2, buffers);
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, (u64)count * sizeof(SkinVertex), vertices, GL_STATIC_DRAW);
+	gl_skin_vertex_layout();
+	u64 captured_size = (u64)count * 4 * sizeof(f32);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffers[1]);
+	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, captured_size, nullptr, GL_STATIC_READ);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1]);
+
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "view_projection"), 1, GL_FALSE, &view_projection->m[0][0]);
+	gl_skin_palette_upload(palette_buffer, palette, bone_count);
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, count);
+	glEndTransformFeedback();
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	f32* captured = (f32*)os_alloc_pages(captured_size);
+	glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, captured_size, captured);
+	u64 skinned_size = (u64)count * sizeof(RasterVertex);
+	RasterVertex* skinned = (RasterVertex*)os_alloc_pages(skinned_size);
+	skin_vertices(palette, vertices, skinned, count, thread_count);
+
+	f32 error = glGetError() == GL_NO_ERROR ? 0.0f : INFINITY;
+	for(u32 i = 0; i < count; i++) {
+		const f32* p = skinned[i].position;
+		Vec4 expected = vec4_transform(vec4(p[0], p[1], p[2], 1.0f), view_projection);
+		const f32 e[4] = { expected.x, expected.y, expected.z, expected.w };
+		f32 scale = Max(fabsf(expected.w), 1.0f);
+		for(u32 k = 0; k < 4; k++) error = Max(error, fabsf(captured[i * 4 + k] - e[k]) / scale);
+	}
+
+	os_free_pages(skinned, skinned_size);
+	os_free_pages(captured, captured_size);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDeleteBuffers(2, buffers);
+	glDeleteVertexArrays(1, &vertex_array);
+	gl_skin_palette_destroy(palette_buffer);
+	return error;
+}
+
+// The character's mesh and palette, then every bone of a random palette.
+internal u32 gl_skin_check(const Mat4* palette, u32 bone_count, const Mesh* mesh, const Mat4* view_projection, u32 thread_count) {
+	gluint program = gl_skin_check_program();
+	if(!program) return 1;
+	printf("%s | %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	// Nothing is rasterized, but a surfaceless context still needs a complete framebuffer to draw.
+	gluint renderbuffer, framebuffer;
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+	f32 mesh_error = gl_skin_error(program, palette, bone_count, mesh->vertices, mesh->vertex_count, view_projection, thread_count);
+
+	Mat4 random_palette[ANIM_MAX_BONES];
+	u32 seed = 12345;
+	for(u32 bone = 0; bone < ANIM_MAX_BONES; bone++) {
+		f32 r[7];
+		for(u32 k = 0; k < 7; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = (f32)(seed >> 8) / 16777216.0f;
+		}
+		Vec3 axis = vec3_normalize(vec3(r[0] - 0.5f, r[1] - 0.5f, r[2] + 0.1f));
+		random_palette[bone] = mat4_affine(vec3(0.5f + r[3], 0.5f + r[3], 0.5f + r[3]), quat_from_axis_angle(axis, 6.2831853f * r[4]),
+		                                   vec3(r[5] - 0.5f, r[6] - 0.5f, r[4] - 0.5f));
+	}
+	u64 spread_size = (u64)mesh->vertex_count * sizeof(SkinVertex);
+	SkinVertex* spread = (SkinVertex*)os_alloc_pages(spread_size);
+	for(u32 i = 0; i < mesh->vertex_count; i++) {
+		spread[i] = mesh->vertices[i];
+		for(u32 k = 0; k < SKIN_INFLUENCES; k++) {
+			spread[i].bones[k] = (u8)((i * 37 + k * 64) % ANIM_MAX_BONES);
+			spread[i].weights[k] = 0.4f - 0.1f * k;
+		}
+	}
+	f32 spread_error = gl_skin_error(program, random_palette, ANIM_MAX_BONES, spread, mesh->vertex_count, view_projection, thread_count);
+	os_free_pages(spread, spread_size);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &renderbuffer);
+	glDeleteProgram(program);
+
+	b32 ok = mesh_error <= GL_SKIN_TOLERANCE && spread_error <= GL_SKIN_TOLERANCE;
+	printf("  gl skin   character %.2e, all %u bones %.2e of w   %s\n", mesh_error, ANIM_MAX_BONES, spread_error,
+				 ok ? "matches" : "DIFFERS");
+	if(!ok) printf("[ERROR] gl/skin.h differs from skin_vertices()\n");
+	return ok ? 0 : 1;
+}
+
+internal void report(const char* name, f64 items, const char* unit, f64 scalar_seconds, f64 simd_seconds, b32 match) {
+	printf("  %-9s scalar %8.1f M%s/s   simd %8.1f M%s/s   %5.2fx   %s\n", name, items / scalar_seconds / 1e6, unit,
+				 items / simd_seconds / 1e6, unit, scalar_seconds / simd_seconds, match ? "matches" : "DIFFERS");
+}
+
+int main(int argc, char** argv) {
+	u32 character_count = 1000;
+	u32 bone_count = 65;
+	u32 rings = 4;
+	u32 frames = 8;
+	u32 thread_count = 0;
+	const char* out_path = 0;
+	b32 gl = true;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--characters=", 13) == 0)  character_count = Max((u32)atoi(argv[i] + 13), 1u);
+		else if(strncmp(argv[i], "--bones=", 8) == 0)   bone_count = Clamp(1u + CHAIN_LENGTH, (u32)atoi(argv[i] + 8), (u32)ANIM_MAX_BONES);
+		else if(strncmp(argv[i], "--rings=", 8) == 0)   rings = Clamp(1u, (u32)atoi(argv[i] + 8), 8u);
+		else if(strncmp(argv[i], "--frames=", 9) == 0)  frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0) thread_count = (u32)atoi(argv[i] + 10);
+		else if(strncmp(argv[i], "--out=", 6) == 0)     out_path = argv[i] + 6;
+		else if(strcmp(argv[i], "--no-gl") == 0)        gl = false;
+		else {
+			printf("usage: anim_bench [--characters=N] [--bones=N] [--rings=N] [--frames=N] [--threads=N] [--out=frame.tga] [--no-gl]\n");
+			return 1;
+		}
+	}
+	// Whole chains only.
+	bone_count = 1 + (bone_count - 1) / CHAIN_LENGTH * CHAIN_LENGTH;
+
+	AnimSkeleton skeleton;
+	AnimPose* poses = (AnimPose*)os_alloc_pages(sizeof(AnimPose) * 6);
+	AnimPose* bind_pose = &poses[0];
+	build_skeleton(&skeleton, bind_pose, bone_count);
+
+	u64 key_count = (u64)CLIP_FRAMES * bone_count;
+	Quat* rotations = (Quat*)os_alloc_pages(key_count * sizeof(Quat) * 2);
+	Vec3* translations = (Vec3*)os_alloc_pages(key_count * sizeof(Vec3) * 2);
+	AnimClip clips[2];
+	build_clip(&clips[0], bind_pose, bone_count, 1.0f, rotations, translations);
+	build_clip(&clips[1], bind_pose, bone_count, 2.0f, rotations + key_count, translations + key_count);
+
+	// Quantization error at the keys, where sampling interpolates nothing.
+	f32 rotation_error = 0.0f, translation_error = 0.0f;
+	for(u32 clip = 0; clip < 2; clip++) {
+		for(u32 frame = 0; frame < CLIP_FRAMES; frame++) {
+			anim_sample(&clips[clip], (f32)frame / clips[clip].frame_rate, &poses[1]);
+			for(u32 bone = 0; bone < bone_count; bone++) {
+				Quat source = rotations[clip * key_count + frame * bone_count + bone];
+				f32 dot = fabsf(quat_dot(source, anim_pose_rotation(&poses[1], bone)));
+				rotation_error = Max(rotation_error, 2.0f * acosf(Min(dot, 1.0f)));
+				const Vec3* t = &translations[clip * key_count + frame * bone_count + bone];
+				const f32 v[3] = { t->x, t->y, t->z };
+				for(u32 k = 0; k < 3; k++) translation_error = Max(translation_error, fabsf(v[k] - poses[1].translation[k][bone]));
+			}
+		}
+	}
+
+	Mesh mesh;
+	build_mesh(&mesh, bone_count, rings);
+	u64 palette_size = (u64)character_count * bone_count * sizeof(Mat4);
+	Mat4* palettes = (Mat4*)os_alloc_pages(palette_size);
+	Mat4* model = (Mat4*)os_alloc_pages((u64)bone_count * sizeof(Mat4));
+	u64 skinned_size = (u64)mesh.vertex_count * sizeof(RasterVertex);
+	RasterVertex* skinned_scalar = (RasterVertex*)os_alloc_pages(skinned_size);
+	RasterVertex* skinned = (RasterVertex*)os_alloc_pages(skinned_size);
+
+	printf("%u characters of %u bones (%.1f KB of keys a clip), %u skinned vertices, %u frames\n", character_count, bone_count,
+				 clips[0].keys_size / 1024.0, mesh.vertex_count, frames);
+	printf("  quantization error %.2e radians, %.2e units\n", rotation_error, translation_error);
+
+	f64 sample_seconds[2] = {}, blend_seconds[2] = {}, palette_seconds = 0.0, skin_seconds[3] = {};
+	b32 sample_match = true, blend_match = true, skin_match = true;
+	u64 pose_bytes = sizeof(AnimPose);
+	for(u32 frame = 0; frame < frames; frame++) {
+		for(u32 c = 0; c < character_count; c++) {
+			f32 seconds = (f32)frame / 30.0f + (f32)c * 0.137f;
+			f32 weight = 0.5f + 0.5f * sinf((f32)c);
+
+			f64 start = os_now_seconds();
+			anim_sample_scalar(&clips[0], seconds, &poses[1]);
+			anim_sample_scalar(&clips[1], seconds * 1.3f, &poses[2]);
+			f64 middle = os_now_seconds();
+			anim_sample(&clips[0], seconds, &poses[3]);
+			anim_sample(&clips[1], seconds * 1.3f, &poses[4]);
+			f64 end = os_now_seconds();
+			sample_seconds[0] += middle - start;
+			sample_seconds[1] += end - middle;
+			sample_match = sample_match && memcmp(&poses[1], &poses[3], 2 * pose_bytes) == 0;
+
+			start = os_now_seconds();
+			anim_blend_scalar(&poses[5], &poses[1], &poses[2], bone_count, weight);
+			middle = os_now_seconds();
+			anim_blend(&poses[1], &poses[3], &poses[4], bone_count, weight);
+			end = os_now_seconds();
+			blend_seconds[0] += middle - start;
+			blend_seconds[1] += end - middle;
+			blend_match = blend_match && memcmp(&poses[1], &poses[5], pose_bytes) == 0;
+
+			start = os_now_seconds();
+			anim_palette(&skeleton, &poses[1], model, &palettes[(u64)c * bone_count]);
+			palette_seconds += os_now_seconds() - start;
+		}
+
+		// A handful of characters' worth of skinning per frame, each with its own palette.
+		u32 skinned_characters = Min(character_count, 16u);
+		for(u32 c = 0; c < skinned_characters; c++) {
+			const Mat4* palette = &palettes[(u64)c * bone_count];
+			f64 start = os_now_seconds();
+			skin_vertices_range_scalar(palette, mesh.vertices, skinned_scalar, mesh.vertex_count);
+			f64 middle = os_now_seconds();
+			skin_vertices(palette, mesh.vertices, skinned, mesh.vertex_count, 1);
+			f64 end = os_now_seconds();
+			skin_match = skin_match && memcmp(skinned, skinned_scalar, skinned_size) == 0;
+			skin_vertices(palette, mesh.vertices, skinned, mesh.vertex_count, thread_count);
+			f64 threaded = os_now_seconds();
+			skin_match = skin_match && memcmp(skinned, skinned_scalar, skinned_size) == 0;
+			skin_seconds[0] += middle - start;
+			skin_seconds[1] += end - middle;
+			skin_seconds[2] += threaded - end;
+		}
+	}
+
+	f64 bones = (f64)character_count * frames * bone_count;
+	report("sample", bones * 2, "bones", sample_seconds[0], sample_seconds[1], sample_match);
+	report("blend", bones, "bones", blend_seconds[0], blend_seconds[1], blend_match);
+	printf("  palette                          %8.1f Mbones/s\n", bones / palette_seconds / 1e6);
+	f64 pose_seconds = sample_seconds[1] + blend_seconds[1] + palette_seconds;
+	printf("  pose      two clips, blend and palette: %.1f Mbones/s, %.2f us a character\n", bones / pose_seconds / 1e6,
+				 pose_seconds * 1e6 / ((f64)character_count * frames));
+	f64 vertices = (f64)Min(character_count, 16u) * frames * mesh.vertex_count;
+	report("skin", vertices, "vertices", skin_seconds[0], skin_seconds[1], skin_match);
+	printf("  skin x%-2u                         %8.1f Mvertices/s\n", os_parallel_worker_count((mesh.vertex_count + SKIN_CHUNK - 1) / SKIN_CHUNK, thread_count),
+				 vertices / skin_seconds[2] / 1e6);
+
+	u32 width = 640, height = 480;
+	Mat4 view = mat4_look_at_lh(vec4(0, 3.0f, -4.5f, 1), vec4(0, 1.2f, 0, 1), vec4(0, 1, 0, 0));
+	Mat4 projection = mat4_perspective_fov_lh(3.14159265f / 3.0f, (f32)width / (f32)height, 0.1f, 100.0f);
+	u32 gl_failures = 0;
+	if(gl) {
+		Mat4 view_projection = mat4_mul(&view, &projection);
+		if(create_context()) gl_failures = gl_skin_check(palettes, bone_count, &mesh, &view_projection, thread_count);
+		else printf("no OpenGL 3.3 core context, the GL skinning check is skipped\n");
+	}
+
+	if(out_path) {
+		RasterTarget target;
+		raster_target_alloc(&target, width, height);
+		MipChain mips;
+		mip_chain_alloc(&mips, 64, 64);
+		u32* texels = (u32*)mip_level_data(&mips, 0);
+		for(u32 y = 0; y < 64; y++) {
+			for(u32 x = 0; x < 64; x++) texels[y * 64 + x] = ((x / 8 + y / 8) & 1) ? 0xff4a5ad0 : 0xff90a8f0;
+		}
+		MipSettings mip_settings = {};
+		mip_settings.filter = MipFilter_Box;
+		mip_generate(&mips, &mip_settings);
+		RasterTexture texture;
+		raster_texture_from_mips(&texture, &mips);
+
+		RasterContext context;
+		raster_context_init(&context, &target);
+		context.vertices = skinned;
+		context.vertex_count = mesh.vertex_count;
+		context.indices = mesh.indices;
+		context.texture = &texture;
+		context.constants[RasterConstantBuffer_Frame] = view;
+		context.constants[RasterConstantBuffer_Application] = projection;
+		const f32 background[4] = { 0.1f, 0.15f, 0.2f, 1.0f };
+		raster_clear(&target, background, 1.0f, 0);
+		raster_draw_indexed(&context, mesh.index_count, 0, 0);
+		if(!raster_write_colour_tga(&target, out_path)) printf("[ERROR] could not write %s\n", out_path);
+		else printf("  wrote     %s\n", out_path);
+		mip_chain_release(&mips);
+		raster_target_release(&target);
+	}
+
+	os_free_pages(skinned, skinned_size);
+	os_free_pages(skinned_scalar, skinned_size);
+	os_free_pages(model, (u64)bone_count * sizeof(Mat4));
+	os_free_pages(palettes, palette_size);
+	os_free_pages(mesh.indices, (u64)mesh.index_count * sizeof(u16));
+	os_free_pages(mesh.vertices, (u64)mesh.vertex_count * sizeof(SkinVertex));
+	anim_clip_release(&clips[1]);
+	anim_clip_release(&clips[0]);
+	os_free_pages(translations, key_count * sizeof(Vec3) * 2);
+	os_free_pages(rotations, key_count * sizeof(Quat) * 2);
+	os_free_pages(poses, sizeof(AnimPose) * 6);
+
+	if(!sample_match || !blend_match || !skin_match) {
+		printf("[ERROR] the SIMD paths differ from the scalar ones\n");
+		return 1;
+	}
+	return gl_failures ? 1 : 0;
+}
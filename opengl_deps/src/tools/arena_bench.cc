@@ -0,0 +1,189 @@
+// Benchmark for the arenas (basic/arena.h) and check that warm load and frame
+// code leaves the allocators alone.
+//
+// Two parts:
+//   pushes   many small allocations of random sizes a frame, malloc/free
+//            against arena_frame() and a reset at the end of the frame
+//   frames   a frame loop that does what loading and rendering do: a texture
+//            gets its Lanczos mip chain on --threads threads (scratch arenas
+//            and os_parallel_for() in mip_generate()), per-frame lists come
+//            from the frame arena, and a scratch temp is nested inside another
+// Every frame the requests to the OS (g_os_memory) and the calls to operator
+// new are counted, on every thread. After the first frame, which starts the
+// parallel for's threads, both have to stay at zero.
+//
+// Usage: arena_bench [--frames=N] [--allocations=N] [--texture=N] [--threads=N] [--large-pages]
+
+#include "basic/types.h"
+#include "basic/arena.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Heap allocations through new, on any thread.
+global std::atomic<u64> g_new_calls;
+
+void* operator new(size_t size) {
+	g_new_calls.fetch_add(1, std::memory_order_relaxed);
+	void* result = malloc(size ? size : 1);
+	if(!result) abort();
+	return result;
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal u64 counted_requests() {
+	return os_memory_requests() + g_new_calls.load(std::memory_order_relaxed);
+}
+
+int main(int argc, char** argv) {
+	u32 frames = 64;
+	u32 allocation_count = 10000;
+	u32 texture_size = 512;
+	u32 thread_count = 4;
+	b32 large_pages = false;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--frames=", 9) == 0)             frames = Max((u32)atoi(argv[i] + 9), 2u);
+		else if(strncmp(argv[i], "--allocations=", 14) == 0)  allocation_count = Max((u32)atoi(argv[i] + 14), 1u);
+		else if(strncmp(argv[i], "--texture=", 10) == 0)      texture_size = Clamp(16u, (u32)atoi(argv[i] + 10), 8192u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0)      thread_count = Max((u32)atoi(argv[i] + 10), 1u);
+		else if(strcmp(argv[i], "--large-pages") == 0)        large_pages = true;
+		else {
+			printf("usage: arena_bench [--frames=N] [--allocations=N] [--texture=N] [--threads=N] [--large-pages]\n");
+			return 1;
+		}
+	}
+
+	// Pushes: the same sizes both ways, touching every allocation once.
+	u32* sizes = (u32*)os_alloc_pages((u64)allocation_count * sizeof(u32));
+	void** pointers = (void**)os_alloc_pages((u64)allocation_count * sizeof(void*));
+	u32 seed = 0x1234567u;
+	for(u32 i = 0; i < allocation_count; i++) sizes[i] = 16 + next_random(&seed) % 1024;
+
+	Arena arena;
+	if(!arena_init(&arena, GB(1), large_pages ? ArenaFlag_LargePages : 0)) {
+		printf("[ERROR] could not reserve the arena\n");
+		return 1;
+	}
+
+	// The addresses feed the checksum, so the compiler cannot drop a malloc/free pair.
+	u64 checksum = 0;
+	f64 malloc_seconds = 0.0, arena_seconds = 0.0;
+	for(u32 frame = 0; frame < frames; frame++) {
+		f64 start = os_now_seconds();
+		for(u32 i = 0; i < allocation_count; i++) {
+			pointers[i] = malloc(sizes[i]);
+			*(u8*)pointers[i] = (u8)i;
+		}
+		for(u32 i = 0; i < allocation_count; i++) {
+			checksum += (u64)pointers[i];
+			free(pointers[i]);
+		}
+		f64 middle = os_now_seconds();
+		for(u32 i = 0; i < allocation_count; i++) {
+			pointers[i] = arena_push(&arena, sizes[i], ARENA_DEFAULT_ALIGN);
+			*(u8*)pointers[i] = (u8)i;
+		}
+		for(u32 i = 0; i < allocation_count; i++) checksum += (u64)pointers[i];
+		arena_reset(&arena);
+		f64 end = os_now_seconds();
+		malloc_seconds += middle - start;
+		arena_seconds += end - middle;
+	}
+	f64 pushes = (f64)allocation_count * frames;
+	printf("%u allocations of 16 to 1039 bytes a frame, %u frames%s\n", allocation_count, frames, large_pages ? ", large pages" : "");
+	printf("  malloc/free    %7.2f ns an allocation\n", malloc_seconds * 1e9 / pushes);
+	printf("  arena          %7.2f ns an allocation, %.2fx, %u commits, %.1f MB peak\n", arena_seconds * 1e9 / pushes,
+				 malloc_seconds / arena_seconds, arena.commits, arena.peak / (1024.0 * 1024.0));
+	arena_release(&arena);
+
+	// Frames.
+	MipChain mips;
+	if(!mip_chain_alloc(&mips, texture_size, texture_size)) {
+		printf("[ERROR] could not allocate a %ux%u mip chain\n", texture_size, texture_size);
+		return 1;
+	}
+	u32* texels = (u32*)mip_level_data(&mips, 0);
+	for(u32 i = 0; i < texture_size * texture_size; i++) texels[i] = next_random(&seed) | 0xff000000u;
+	MipSettings mip_settings = {};
+	mip_settings.filter = MipFilter_Lanczos;
+	mip_settings.srgb = true;
+	mip_settings.thread_count = thread_count;
+
+	u64 first_requests = 0, steady_requests = 0, worst_frame = 0;
+	f64 mip_seconds = 0.0;
+	for(u32 frame = 0; frame < frames; frame++) {
+		u64 before = counted_requests();
+
+		f64 start = os_now_seconds();
+		mip_generate(&mips, &mip_settings);
+		mip_seconds += os_now_seconds() - start;
+
+		// Per-frame lists of varying length, the first frame the longest.
+		Arena* frame_arena = arena_frame();
+		u32 item_count = frame == 0 ? 40000 : 20000 + next_random(&seed) % 20000;
+		u32* visible = ArenaPushArray(frame_arena, u32, item_count);
+		f32* keys = ArenaPushArray(frame_arena, f32, item_count);
+		for(u32 i = 0; i < item_count; i++) {
+			visible[i] = i;
+			keys[i] = (f32)(item_count - i);
+		}
+
+		ArenaTemp outer = arena_scratch_begin();
+		u64* sums = ArenaPushArrayZero(outer.arena, u64, 256);
+		ArenaTemp inner = arena_scratch_begin();
+		u32* bucket = ArenaPushArray(inner.arena, u32, item_count);
+		for(u32 i = 0; i < item_count; i++) bucket[i] = visible[i] & 255;
+		for(u32 i = 0; i < item_count; i++) sums[bucket[i]] += (u64)keys[i];
+		arena_scratch_end(inner);
+		for(u32 i = 0; i < 256; i++) checksum += sums[i];
+		arena_scratch_end(outer);
+
+		arena_frame_end();
+
+		u64 requests = counted_requests() - before;
+		if(frame == 0) first_requests = requests;
+		else {
+			steady_requests += requests;
+			worst_frame = Max(worst_frame, requests);
+		}
+	}
+
+	u32 scratch_arenas = 0;
+	u64 scratch_committed = 0;
+	for(u32 i = 0; i < ARENA_SCRATCH_COUNT; i++) {
+		if(!g_arena_scratch.arenas[i].base) continue;
+		scratch_arenas++;
+		scratch_committed += g_arena_scratch.arenas[i].committed;
+	}
+	printf("%u frames with a %ux%u Lanczos mip chain each on %u threads (checksum %llx)\n", frames, texture_size, texture_size, thread_count,
+				 (unsigned long long)checksum);
+	printf("  mip_generate   %7.3f ms a texture\n", mip_seconds * 1000.0 / frames);
+	printf("  first frame    %llu allocation requests\n", (unsigned long long)first_requests);
+	printf("  steady state   %llu allocation requests in %u frames, %llu at most in one\n", (unsigned long long)steady_requests, frames - 1,
+				 (unsigned long long)worst_frame);
+	printf("  frame arena    %.1f KB peak, %u commits; %u scratch arenas, %.1f KB committed\n", g_arena_frame_stats.peak / 1024.0,
+				 g_arena_frame.commits, scratch_arenas, scratch_committed / 1024.0);
+
+	mip_chain_release(&mips);
+	os_free_pages(pointers, (u64)allocation_count * sizeof(void*));
+	os_free_pages(sizes, (u64)allocation_count * sizeof(u32));
+
+	if(steady_requests != 0) {
+		printf("[ERROR] warm frames still allocate\n");
+		return 1;
+	}
+	return 0;
+}
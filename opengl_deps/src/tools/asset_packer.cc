@@ -0,0 +1,253 @@
+// Asset packer.
+//
+// Packs every file under a directory into one .pak (asset/pack.h), named by its
+// path relative to that directory ("shaders/textured_vs.cso"). The pack is then
+// reopened through the runtime path and every entry is looked up and compared
+// against its source file, which also times the lookups.
+//
+// Usage: asset_packer <input_dir> <output.pak> [--ext=.cso] [--ext=.ctex] ...
+//   --ext  only pack files with one of these extensions (all files by default)
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "asset/pack.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_ENTRIES    65536
+#define MAX_EXTENSIONS 32
+#define MAX_NAME_BYTES MB(4)
+
+struct PackerInput {
+	const char* path;   // As found on disk, relative to the root.
+	const char* name;   // Normalised, what goes into the pack.
+	u64 hash;
+};
+
+struct Packer {
+	PackerInput inputs[MAX_ENTRIES];
+	u32 input_count;
+	const char* extensions[MAX_EXTENSIONS];
+	u32 extension_count;
+	b32 overflow;
+
+	char strings[2 * MAX_NAME_BYTES];
+	u64 strings_used;
+
+	PackEntry entries[MAX_ENTRIES];
+	u32 buckets[(1 << 16) + 1];   // pack_bucket_bits(MAX_ENTRIES) == 16
+};
+
+global Packer g_packer;
+
+internal b32 has_extension(const char* path, const char* extension) {
+	u64 path_length = strlen(path);
+	u64 extension_length = strlen(extension);
+	if(path_length < extension_length) return false;
+	return pack_names_match(path + path_length - extension_length, extension);
+}
+
+internal void collect_file(void* user, const char* path) {
+	Packer* packer = (Packer*)user;
+	if(packer->extension_count) {
+		b32 wanted = false;
+		for(u32 i = 0; i < packer->extension_count && !wanted; i++) wanted = has_extension(path, packer->extensions[i]);
+		if(!wanted) return;
+	}
+	u64 length = strlen(path) + 1;
+	if(packer->input_count == MAX_ENTRIES || packer->strings_used + 2 * length > sizeof(packer->strings)) {
+		packer->overflow = true;
+		return;
+	}
+
+	PackerInput* input = &packer->inputs[packer->input_count++];
+	char* original = packer->strings + packer->strings_used;
+	char* name = original + length;
+	packer->strings_used += 2 * length;
+	for(u64 i = 0; i < length; i++) {
+		original[i] = path[i];
+		name[i] = pack_normalize_char(path[i]);
+	}
+	input->path = original;
+	input->name = name;
+	input->hash = pack_hash_name(name);
+}
+
+internal int compare_inputs(const void* a, const void* b) {
+	u64 ha = ((const PackerInput*)a)->hash;
+	u64 hb = ((const PackerInput*)b)->hash;
+	return ha < hb ? -1 : ha > hb ? 1 : 0;
+}
+
+internal b32 write_zeroes(FILE* file, u64 count) {
+	local u8 zeroes[PACK_ALIGN];
+	while(count) {
+		u64 chunk = Min(count, (u64)sizeof(zeroes));
+		if(fwrite(zeroes, 1, chunk, file) != chunk) return false;
+		count -= chunk;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		printf("usage: asset_packer <input_dir> <output.pak> [--ext=.cso] [--ext=.ctex] ...\n");
+		return 1;
+	}
+
+	const char* root = argv[1];
+	const char* output = argv[2];
+	Packer* packer = &g_packer;
+	for(s32 i = 3; i < argc; i++) {
+		if(strncmp(argv[i], "--ext=", 6) == 0 && packer->extension_count < MAX_EXTENSIONS) {
+			packer->extensions[packer->extension_count++] = argv[i] + 6;
+		} else {
+			printf("[ERROR] unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	f64 start = os_now_seconds();
+	if(!os_list_files(root, collect_file, packer) || packer->overflow) {
+		printf("[ERROR] could not list %s\n", root);
+		return 1;
+	}
+	if(packer->input_count == 0) {
+		printf("[ERROR] nothing to pack in %s\n", root);
+		return 1;
+	}
+
+	u32 count = packer->input_count;
+	qsort(packer->inputs, count, sizeof(PackerInput), compare_inputs);
+	for(u32 i = 1; i < count; i++) {
+		if(packer->inputs[i].hash == packer->inputs[i - 1].hash) {
+			printf("[ERROR] %s and %s have the same name hash, rename one of them\n", packer->inputs[i - 1].name, packer->inputs[i].name);
+			return 1;
+		}
+	}
+
+	// Table of contents, buckets and names.
+	PackHeader header = {};
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.entry_count = count;
+	header.bucket_bits = pack_bucket_bits(count);
+	u64 bucket_count = ((u64)1 << header.bucket_bits) + 1;
+
+	PackEntry* entries = packer->entries;
+	u32* buckets = packer->buckets;
+	u64 names_size = 0;
+	for(u32 i = 0; i < count; i++) names_size += strlen(packer->inputs[i].name) + 1;
+
+	header.toc_offset = sizeof(PackHeader);
+	header.buckets_offset = header.toc_offset + (u64)count * sizeof(PackEntry);
+	header.names_offset = header.buckets_offset + bucket_count * sizeof(u32);
+	header.names_size = names_size;
+
+	u64 name_at = 0;
+	u64 offset = AlignPow2(header.names_offset + names_size, PACK_ALIGN);
+	u64 payload_bytes = 0;
+	for(u32 i = 0; i < count; i++) {
+		const PackerInput* input = &packer->inputs[i];
+		char path[OS_MAX_PATH];
+		snprintf(path, sizeof(path), "%s/%s", root, input->path);
+
+		OS_FileMap file;
+		u64 size = os_file_map_open(&file, path) ? file.size : 0;
+		os_file_map_close(&file);
+
+		entries[i].hash = input->hash;
+		entries[i].offset = offset;
+		entries[i].size = size;
+		entries[i].name_offset = (u32)name_at;
+		name_at += strlen(input->name) + 1;
+
+		offset = AlignPow2(offset + size, PACK_ALIGN);
+		payload_bytes += size;
+	}
+	header.file_size = offset;
+
+	// Bucket b covers the entries whose top hash bits equal b, sorted order makes them contiguous.
+	u32 entry = 0;
+	for(u64 b = 0; b < bucket_count; b++) {
+		while(entry < count && pack_bucket(entries[entry].hash, header.bucket_bits) < b) entry++;
+		buckets[b] = entry;
+	}
+	buckets[bucket_count - 1] = count;
+
+	FILE* file = fopen(output, "wb");
+	if(!file) {
+		printf("[ERROR] could not write %s\n", output);
+		return 1;
+	}
+	b32 ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+					 fwrite(entries, sizeof(PackEntry), count, file) == count &&
+					 fwrite(buckets, sizeof(u32), bucket_count, file) == bucket_count;
+	for(u32 i = 0; ok && i < count; i++) {
+		u64 length = strlen(packer->inputs[i].name) + 1;
+		ok = fwrite(packer->inputs[i].name, 1, length, file) == length;
+	}
+	u64 written = header.names_offset + names_size;
+	for(u32 i = 0; ok && i < count; i++) {
+		ok = write_zeroes(file, entries[i].offset - written);
+		written = entries[i].offset;
+		if(!ok || entries[i].size == 0) continue;
+
+		char path[OS_MAX_PATH];
+		snprintf(path, sizeof(path), "%s/%s", root, packer->inputs[i].path);
+		OS_FileMap source;
+		ok = os_file_map_open(&source, path) && source.size == entries[i].size &&
+				 fwrite(source.data, 1, source.size, file) == source.size;
+		os_file_map_close(&source);
+		written += entries[i].size;
+	}
+	ok = ok && write_zeroes(file, header.file_size - written);
+	fclose(file);
+	if(!ok) {
+		printf("[ERROR] failed writing %s\n", output);
+		return 1;
+	}
+	f64 packed = os_now_seconds();
+
+	// Verify through the runtime path: every name resolves to the bytes of its source.
+	Pack pack;
+	if(!pack_open(&pack, output)) {
+		printf("[ERROR] %s does not validate\n", output);
+		return 1;
+	}
+	for(u32 i = 0; i < count; i++) {
+		char path[OS_MAX_PATH];
+		snprintf(path, sizeof(path), "%s/%s", root, packer->inputs[i].path);
+		PackSpan span = pack_find(&pack, packer->inputs[i].name);
+		OS_FileMap source;
+		b32 same = span.data && (u64)span.data % PACK_ALIGN == 0;
+		if(same && span.size) {
+			same = os_file_map_open(&source, path) && source.size == span.size && memcmp(source.data, span.data, span.size) == 0;
+			os_file_map_close(&source);
+		}
+		if(!same) {
+			printf("[ERROR] %s does not round trip\n", packer->inputs[i].name);
+			return 1;
+		}
+	}
+
+	u32 lookups = 0;
+	u64 found = 0;
+	f64 lookup_start = os_now_seconds();
+	for(u32 round = 0; round < 64; round++) {
+		for(u32 i = 0; i < count; i++, lookups++) found += pack_find_hash(&pack, packer->inputs[i].hash).size;
+	}
+	f64 lookup_seconds = os_now_seconds() - lookup_start;
+	pack_close(&pack);
+	if(found != payload_bytes * 64) {
+		printf("[ERROR] hash lookups in %s do not resolve every entry\n", output);
+		return 1;
+	}
+
+	printf("%s -> %s: %u entries, %.2f KB payload, %.2f KB file, %u buckets, pack %.2f ms, lookup %.1f ns\n", root, output,
+				 count, (f64)payload_bytes / 1024.0, (f64)header.file_size / 1024.0, (u32)(bucket_count - 1),
+				 (packed - start) * 1000.0, lookup_seconds * 1e9 / lookups);
+	return 0;
+}
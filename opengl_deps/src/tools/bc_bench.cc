@@ -0,0 +1,309 @@
+// Benchmark for the BC1/BC3/BC7 encoder in texture/bc.h.
+//
+// Compresses one image with every format and quality preset on all cores and
+// reports encode throughput in Mpix/s together with the RGB(A) PSNR of the
+// decoded result. The decoder below only has to understand what the encoder
+// emits (BC1 four colour, BC3, BC7 modes 1 and 6); anything else counts as a
+// failure.
+//
+// Usage: bc_bench <file.tga> [threads] [--dds]
+//        bc_bench --synth <size> [threads] [--dds]
+//   --dds  also writes every result as bc_bench_<format>_<quality>.dds
+//          so it can be checked in an external viewer/decoder.
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/tga.h"
+#include "texture/bc.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+global const char* g_format_names[BCFormat_COUNT] = { "bc1", "bc3", "bc7" };
+global const char* g_quality_names[BCQuality_COUNT] = { "fast", "normal", "high" };
+
+//------------------------------------------------------------------------
+// Decoding
+//------------------------------------------------------------------------
+
+internal void decode_bc1_colour(const u8* in, u8 out[16][4]) {
+	u16 c0, c1;
+	u32 indices;
+	memcpy(&c0, in + 0, 2);
+	memcpy(&c1, in + 2, 2);
+	memcpy(&indices, in + 4, 4);
+
+	f32 palette[4][4];
+	bc1_palette(c0, c1, palette);
+	for(u32 i = 0; i < 16; i++) {
+		u32 index = (indices >> (i * 2)) & 3;
+		for(u32 c = 0; c < 3; c++) out[i][c] = (u8)(palette[index][c] + 0.5f);
+		out[i][3] = 255;
+	}
+}
+
+internal void decode_bc3_alpha(const u8* in, u8 out[16][4]) {
+	f32 palette[8][4];
+	bc4_palette(in[0], in[1], palette);
+	u64 indices = 0;
+	for(u32 i = 0; i < 6; i++) indices |= (u64)in[2 + i] << (i * 8);
+	for(u32 i = 0; i < 16; i++) out[i][3] = (u8)(palette[(indices >> (i * 3)) & 7][3] + 0.5f);
+}
+
+internal u32 read_bits(const u8* in, u32* position, u32 count) {
+	u32 value = 0;
+	for(u32 i = 0; i < count; i++, (*position)++) value |= (u32)((in[*position >> 3] >> (*position & 7)) & 1) << i;
+	return value;
+}
+
+internal u32 expand_bits(u32 value, u32 bits) {
+	return (value << (8 - bits)) | (value >> (2 * bits - 8));
+}
+
+internal b32 decode_bc7(const u8* in, u8 out[16][4]) {
+	u32 position = 0;
+	if(in[0] & 0x40 && !(in[0] & 0x3f)) {
+		position = 7;
+		u32 e[2][4];
+		for(u32 c = 0; c < 4; c++) {
+			e[0][c] = read_bits(in, &position, 7);
+			e[1][c] = read_bits(in, &position, 7);
+		}
+		u32 p0 = read_bits(in, &position, 1), p1 = read_bits(in, &position, 1);
+		for(u32 c = 0; c < 4; c++) {
+			e[0][c] = (e[0][c] << 1) | p0;
+			e[1][c] = (e[1][c] << 1) | p1;
+		}
+		for(u32 i = 0; i < 16; i++) {
+			u32 index = read_bits(in, &position, i == 0 ? 3 : 4);
+			for(u32 c = 0; c < 4; c++) out[i][c] = (u8)bc7_interpolate(e[0][c], e[1][c], g_bc7_weights4_int[index]);
+		}
+		return true;
+	}
+
+	if((in[0] & 3) == 2) {
+		position = 2;
+		u32 partition = read_bits(in, &position, 6);
+		u32 e[4][3];
+		for(u32 c = 0; c < 3; c++) {
+			for(u32 k = 0; k < 4; k++) e[k][c] = read_bits(in, &position, 6);
+		}
+		u32 pbits[2] = { read_bits(in, &position, 1), read_bits(in, &position, 1) };
+		for(u32 k = 0; k < 4; k++) {
+			for(u32 c = 0; c < 3; c++) e[k][c] = expand_bits((e[k][c] << 1) | pbits[k / 2], 7);
+		}
+		for(u32 i = 0; i < 16; i++) {
+			b32 anchor = i == 0 || i == g_bc7_anchors2[partition];
+			u32 index = read_bits(in, &position, anchor ? 2 : 3);
+			u32 s = (g_bc7_partitions2[partition] >> i) & 1;
+			for(u32 c = 0; c < 3; c++) out[i][c] = (u8)bc7_interpolate(e[s * 2][c], e[s * 2 + 1][c], g_bc7_weights3_int[index]);
+			out[i][3] = 255;
+		}
+		return true;
+	}
+	return false;
+}
+
+// Decodes the whole image and returns the PSNR over the channels the format stores.
+internal f64 measure_psnr(const u8* rgba, u32 width, u32 height, const u8* blocks, BCFormat format, b32* valid) {
+	u32 blocks_wide = (width + 3) / 4;
+	u32 blocks_high = (height + 3) / 4;
+	u32 channels = format == BCFormat_BC1 ? 3 : 4;
+	f64 squared = 0.0;
+	*valid = true;
+
+	for(u32 by = 0; by < blocks_high; by++) {
+		for(u32 bx = 0; bx < blocks_wide; bx++) {
+			const u8* block = blocks + ((u64)by * blocks_wide + bx) * bc_block_size(format);
+			u8 decoded[16][4];
+			switch(format) {
+				case BCFormat_BC1: decode_bc1_colour(block, decoded); break;
+				case BCFormat_BC3: decode_bc1_colour(block + 8, decoded); decode_bc3_alpha(block, decoded); break;
+				case BCFormat_BC7: if(!decode_bc7(block, decoded)) *valid = false; break;
+				default: break;
+			}
+
+			for(u32 y = 0; y < 4 && by * 4 + y < height; y++) {
+				for(u32 x = 0; x < 4 && bx * 4 + x < width; x++) {
+					const u8* source = rgba + ((u64)(by * 4 + y) * width + bx * 4 + x) * 4;
+					for(u32 c = 0; c < channels; c++) {
+						f64 d = (f64)source[c] - (f64)decoded[y * 4 + x][c];
+						squared += d * d;
+					}
+				}
+			}
+		}
+	}
+
+	f64 mse = squared / ((f64)width * height * channels);
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+//------------------------------------------------------------------------
+// DDS output
+//------------------------------------------------------------------------
+
+#pragma pack(push, 1)
+struct DDSHeader {
+	u32 magic;
+	u32 size;
+	u32 flags;
+	u32 height;
+	u32 width;
+	u32 pitch_or_linear_size;
+	u32 depth;
+	u32 mip_count;
+	u32 reserved[11];
+	u32 pf_size;
+	u32 pf_flags;
+	u32 pf_fourcc;
+	u32 pf_rgb_bits;
+	u32 pf_masks[4];
+	u32 caps[4];
+	u32 reserved2;
+	// DX10 extension, only written for BC7.
+	u32 dxgi_format;
+	u32 dimension;
+	u32 misc_flag;
+	u32 array_size;
+	u32 misc_flags2;
+};
+#pragma pack(pop)
+
+internal b32 write_dds(const char* path, BCFormat format, u32 width, u32 height, const u8* blocks, u64 size) {
+	DDSHeader header = {};
+	header.magic = 0x20534444;        // "DDS "
+	header.size = 124;
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000;
+	header.height = height;
+	header.width = width;
+	header.pitch_or_linear_size = (u32)size;
+	header.mip_count = 1;
+	header.pf_size = 32;
+	header.pf_flags = 0x4;            // DDPF_FOURCC
+	header.caps[0] = 0x1000;          // DDSCAPS_TEXTURE
+
+	u64 header_size = sizeof(header) - 20;
+	switch(format) {
+		case BCFormat_BC1: header.pf_fourcc = 0x31545844; break;  // "DXT1"
+		case BCFormat_BC3: header.pf_fourcc = 0x35545844; break;  // "DXT5"
+		case BCFormat_BC7: {
+			header.pf_fourcc = 0x30315844;                         // "DX10"
+			header.dxgi_format = 98;                               // DXGI_FORMAT_BC7_UNORM
+			header.dimension = 3;                                  // TEXTURE2D
+			header.array_size = 1;
+			header_size = sizeof(header);
+		} break;
+		default: break;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if(!file) return false;
+	b32 ok = fwrite(&header, 1, header_size, file) == header_size && fwrite(blocks, 1, size, file) == size;
+	fclose(file);
+	return ok;
+}
+
+//------------------------------------------------------------------------
+
+internal void fill_synthetic(u8* rgba, u32 size) {
+	// Smooth gradients with a band of noise and a soft alpha ramp, so every
+	// path (smooth, edges, alpha) gets exercised.
+	u32 seed = 0x1234567u;
+	for(u32 y = 0; y < size; y++) {
+		for(u32 x = 0; x < size; x++) {
+			u8* p = rgba + ((u64)y * size + x) * 4;
+			seed = seed * 1664525u + 1013904223u;
+			b32 noisy = (y * 4 / size) == 1;
+			p[0] = (u8)(x * 255 / size);
+			p[1] = (u8)(y * 255 / size);
+			p[2] = noisy ? (u8)(seed >> 24) : (u8)((x ^ y) & 0xc0);
+			p[3] = (u8)(((x + y) * 255) / (2 * size));
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		printf("usage: bc_bench <file.tga> [threads] [--dds]\n");
+		printf("       bc_bench --synth <size> [threads] [--dds]\n");
+		return 1;
+	}
+
+	b32 write_files = false;
+	s32 positional[3] = {};
+	s32 positional_count = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--dds") == 0) write_files = true;
+		else if(positional_count < 3) positional[positional_count++] = i;
+	}
+
+	u32 width = 0, height = 0;
+	u8* rgba = 0;
+	const char* name = 0;
+	u32 threads = 0;
+
+	if(strcmp(argv[positional[0]], "--synth") == 0) {
+		u32 size = positional_count > 1 ? (u32)atoi(argv[positional[1]]) : 2048;
+		if(positional_count > 2) threads = (u32)atoi(argv[positional[2]]);
+		width = height = size;
+		rgba = (u8*)os_alloc_pages((u64)size * size * 4);
+		fill_synthetic(rgba, size);
+		name = "synthetic";
+	} else {
+		name = argv[positional[0]];
+		if(positional_count > 1) threads = (u32)atoi(argv[positional[1]]);
+
+		OS_FileMap file;
+		TGAImage image;
+		if(!os_file_map_open(&file, name) || !tga_parse(&image, file.data, file.size)) {
+			printf("[ERROR] %s is not a supported TGA\n", name);
+			return 1;
+		}
+		width = image.width;
+		height = image.height;
+		rgba = (u8*)os_alloc_pages((u64)width * height * 4);
+		tga_decode_rgba8(&image, rgba, (u64)width * 4);
+		os_file_map_close(&file);
+	}
+
+	u32 thread_count = threads ? threads : os_logical_core_count();
+	f64 mpix = (f64)width * height / 1e6;
+	printf("%s: %ux%u, %.2f Mpix, %u threads\n", name, width, height, mpix, thread_count);
+	printf("  format  quality        ms      Mpix/s    PSNR dB\n");
+
+	u64 capacity = bc_compressed_size(BCFormat_BC7, width, height);
+	u8* blocks = (u8*)os_alloc_pages(capacity);
+
+	for(u32 f = 0; f < BCFormat_COUNT; f++) {
+		for(u32 q = 0; q < BCQuality_COUNT; q++) {
+			BCSettings settings = {};
+			settings.format = (BCFormat)f;
+			settings.quality = (BCQuality)q;
+			settings.thread_count = thread_count;
+
+			f64 start = os_now_seconds();
+			bc_compress_image(rgba, width, height, width * 4, blocks, &settings);
+			f64 seconds = os_now_seconds() - start;
+
+			b32 valid;
+			f64 psnr = measure_psnr(rgba, width, height, blocks, settings.format, &valid);
+			printf("  %-6s  %-7s %9.2f %11.2f %10.2f%s\n", g_format_names[f], g_quality_names[q],
+						 seconds * 1000.0, mpix / seconds, psnr, valid ? "" : "  [INVALID BLOCKS]");
+
+			if(write_files) {
+				char path[64];
+				snprintf(path, sizeof(path), "bc_bench_%s_%s.dds", g_format_names[f], g_quality_names[q]);
+				if(!write_dds(path, settings.format, width, height, blocks, bc_compressed_size(settings.format, width, height))) {
+					printf("[ERROR] could not write %s\n", path);
+				}
+			}
+		}
+	}
+
+	os_free_pages(blocks, capacity);
+	os_free_pages(rgba, (u64)width * height * 4);
+	return 0;
+}
@@ -0,0 +1,135 @@
+// Benchmark for frustum culling (scene/cull.h).
+//
+// Scatters spheres and boxes of 0.5 to 4 units over a 2000 x 200 x 2000 unit
+// world and culls them against a 60 degree camera in the middle, turning on
+// the spot over the frames, so about a quarter of them stay visible. For
+// 10k, 100k and 1M volumes of each shape it runs every kernel the CPU supports
+// on one thread and the best kernel on all worker threads, reports volumes per
+// second, and checks every run writes the same visible list as the scalar one.
+//
+// Usage: cull_bench [--frames=N] [--threads=N] [--counts=N,N,...]
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "scene/cull.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_COUNTS 8
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+internal void scatter(CullVolumes* volumes, CullShape shape, u32 count, u32 seed) {
+	cull_volumes_alloc(volumes, shape, count);
+	for(u32 i = 0; i < count; i++) {
+		f32 centre[3] = { random_range(&seed, -1000.0f, 1000.0f), random_range(&seed, -100.0f, 100.0f), random_range(&seed, -1000.0f, 1000.0f) };
+		if(shape == CullShape_Sphere) {
+			cull_add_sphere(volumes, centre, random_range(&seed, 0.5f, 4.0f));
+		} else {
+			f32 min[3], max[3];
+			for(u32 k = 0; k < 3; k++) {
+				f32 extent = random_range(&seed, 0.25f, 2.0f);
+				min[k] = centre[k] - extent;
+				max[k] = centre[k] + extent;
+			}
+			cull_add_box(volumes, min, max);
+		}
+	}
+}
+
+internal CullFrustum camera_frustum(u32 frame, u32 frames) {
+	f32 angle = 6.2831853f * (f32)frame / (f32)frames;
+	Mat4 view = mat4_look_at_lh(vec4(0, 10, 0, 1), vec4(sinf(angle), 10, cosf(angle), 1), vec4(0, 1, 0, 0));
+	Mat4 projection = mat4_perspective_fov_lh(3.14159265f / 3.0f, 16.0f / 9.0f, 0.5f, 1500.0f);
+	Mat4 view_projection = mat4_mul(&view, &projection);
+	return cull_frustum(&view_projection);
+}
+
+int main(int argc, char** argv) {
+	u32 frames = 16;
+	u32 thread_count = 0;
+	u32 counts[MAX_COUNTS] = { 10000, 100000, 1000000 };
+	u32 count_count = 3;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--frames=", 9) == 0)         frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0)  thread_count = (u32)atoi(argv[i] + 10);
+		else if(strncmp(argv[i], "--counts=", 9) == 0) {
+			count_count = 0;
+			for(const char* c = argv[i] + 9; *c && count_count < MAX_COUNTS; c++) {
+				counts[count_count++] = Max((u32)atoi(c), 1u);
+				while(c[1] && *c != ',') c++;
+			}
+		} else {
+			printf("usage: cull_bench [--frames=N] [--threads=N] [--counts=N,N,...]\n");
+			return 1;
+		}
+	}
+
+	CullKernel best = cull_kernel_best();
+	printf("%u frames, best kernel %s, %u logical cores\n", frames, cull_kernel_name(best), os_logical_core_count());
+
+	b32 all_match = true;
+	for(u32 c = 0; c < count_count; c++) {
+		for(u32 shape = 0; shape < CullShape_COUNT; shape++) {
+			CullVolumes volumes;
+			scatter(&volumes, (CullShape)shape, counts[c], 0x9e3779b9u + c);
+			u64 list_size = (u64)volumes.capacity * sizeof(u32);
+			u32* reference = (u32*)os_alloc_pages(list_size);
+			u32* visible = (u32*)os_alloc_pages(list_size);
+
+			printf("%8u %s\n", counts[c], shape == CullShape_Sphere ? "spheres" : "boxes");
+			f64 scalar_seconds = 0.0;
+			for(u32 run = 0; run <= CullKernel_COUNT; run++) {
+				// The last run is the best kernel on every worker.
+				CullKernel kernel = run < CullKernel_COUNT ? (CullKernel)run : best;
+				if(!cull_kernel_supported(kernel)) continue;
+				cull_kernel_select(kernel);
+				u32 threads = run < CullKernel_COUNT ? 1 : thread_count;
+
+				f64 seconds = 0.0;
+				u64 total_visible = 0;
+				b32 match = true;
+				for(u32 frame = 0; frame < frames; frame++) {
+					CullFrustum frustum = camera_frustum(frame, frames);
+					u32 reference_count = g_cull_kernels[CullKernel_Scalar][shape](&frustum, &volumes, 0, volumes.count, reference);
+					f64 start = os_now_seconds();
+					u32 visible_count = cull_volumes(&frustum, &volumes, visible, threads);
+					seconds += os_now_seconds() - start;
+					total_visible += visible_count;
+					match = match && visible_count == reference_count && memcmp(visible, reference, visible_count * sizeof(u32)) == 0;
+				}
+				all_match = all_match && match;
+				if(run == CullKernel_Scalar) scalar_seconds = seconds;
+
+				f64 tested = (f64)volumes.count * frames;
+				u32 chunk_count = (volumes.count + cull_chunk_size(volumes.count) - 1) / cull_chunk_size(volumes.count);
+				u32 workers = chunk_count > 1 ? os_parallel_worker_count(chunk_count, threads) : 1;
+				char name[32];
+				snprintf(name, sizeof(name), "%s x%u", cull_kernel_name(kernel), workers);
+				printf("  %-12s %8.3f ms/frame  %8.1f Mvolumes/s  %6.2f ns/volume  %5.2fx  %4.1f%% visible  %s\n", name,
+							 seconds * 1000.0 / frames, tested / seconds / 1e6, seconds * 1e9 / tested, scalar_seconds / seconds,
+							 100.0 * total_visible / tested, match ? "matches" : "DIFFERS");
+			}
+
+			os_free_pages(visible, list_size);
+			os_free_pages(reference, list_size);
+			cull_volumes_release(&volumes);
+		}
+	}
+
+	if(!all_match) {
+		printf("[ERROR] a kernel kept different volumes than the scalar one\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,290 @@
+// Benchmark and self-check for the job system (basic/jobs.h).
+//
+// Checks first, each against the single-threaded result:
+//   parallel for   every index of a big range runs exactly once
+//   nested         jobs that run parallel fors of their own and wait on them
+//   stages         a second pass reading what the first wrote, ordered by
+//                  waiting on the first pass's counter
+//   outside        jobs submitted and waited for from a thread that is not a
+//                  worker, while worker 0 keeps running jobs
+// Then the cost of scheduling: empty jobs one index at a time, and a short
+// parallel for issued many times over, against os_parallel_for(), which
+// wakes its pool threads on every call. Last, scaling: skinning a big mesh
+// (skin_vertices_range() in chunks) on 1, 2, 4... workers up to --workers,
+// with the speedup and efficiency over one worker.
+//
+// Usage: jobs_bench [--workers=N] [--vertices=N] [--repeats=N]
+
+#include "basic/types.h"
+#include "basic/jobs.h"
+#include "platform/os.h"
+#include "scene/skin.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+global JobSystem g_jobs;
+
+//------------------------------------------------------------------------
+// Checks
+//------------------------------------------------------------------------
+
+struct FillJob {
+	u32* out;
+	std::atomic<u32>* runs;
+};
+
+internal void fill_job(void* user, u32 index, u32 worker) {
+	FillJob* job = (FillJob*)user;
+	job->out[index] = index * 3 + 1;
+	job->runs[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+struct NestedJob {
+	JobSystem* system;
+	u32* out;
+	u32 inner;
+};
+
+internal void nested_inner_job(void* user, u32 index, u32 worker) {
+	u32* out = (u32*)user;
+	out[index] += index;
+}
+
+internal void nested_job(void* user, u32 index, u32 worker) {
+	NestedJob* job = (NestedJob*)user;
+	u32* out = job->out + (u64)index * job->inner;
+	job_parallel_for(job->system, job->inner, 16, nested_inner_job, out);
+	// Only valid once every inner job is done.
+	for(u32 i = 0; i < job->inner; i++) out[i] *= 2;
+}
+
+struct StageJob {
+	const u32* in;
+	u32* out;
+	u32 count;
+};
+
+internal void stage_job(void* user, u32 index, u32 worker) {
+	StageJob* job = (StageJob*)user;
+	// The neighbours were mostly written by other jobs of the first stage.
+	u32 left = job->in[index == 0 ? job->count - 1 : index - 1];
+	u32 right = job->in[index + 1 == job->count ? 0 : index + 1];
+	job->out[index] = left + right;
+}
+
+internal b32 filled_once(const u32* out, const std::atomic<u32>* runs, u32 count) {
+	b32 ok = true;
+	for(u32 i = 0; i < count; i++) ok = ok && out[i] == i * 3 + 1 && runs[i].load() == 1;
+	return ok;
+}
+
+internal b32 run_checks(JobSystem* system, u32 count) {
+	u32* out = (u32*)os_alloc_pages((u64)count * sizeof(u32) * 2);
+	u32* second = out + count;
+	std::atomic<u32>* runs = (std::atomic<u32>*)os_alloc_pages((u64)count * sizeof(std::atomic<u32>));
+
+	FillJob fill = { out, runs };
+	job_parallel_for(system, count, 64, fill_job, &fill);
+	b32 once = filled_once(out, runs, count);
+	printf("  parallel for   %s\n", once ? "ok" : "FAILED");
+
+	const u32 outer = 64, inner = 1000;
+	memset(out, 0, (u64)outer * inner * sizeof(u32));
+	NestedJob nested = { system, out, inner };
+	job_parallel_for(system, outer, 1, nested_job, &nested);
+	b32 nested_ok = true;
+	for(u32 i = 0; i < outer * inner; i++) nested_ok = nested_ok && out[i] == (i % inner) * 2;
+	printf("  nested         %s\n", nested_ok ? "ok" : "FAILED");
+
+	JobCounter first_stage;
+	first_stage.pending = 0;
+	job_run_range(system, count, 256, fill_job, &fill, &first_stage);
+	job_wait(system, &first_stage);
+	StageJob stage = { out, second, count };
+	job_parallel_for(system, count, 256, stage_job, &stage);
+	b32 stages_ok = true;
+	for(u32 i = 0; i < count; i++) {
+		u32 left = i == 0 ? count - 1 : i - 1, right = i + 1 == count ? 0 : i + 1;
+		stages_ok = stages_ok && second[i] == (left * 3 + 1) + (right * 3 + 1);
+	}
+	printf("  stages         %s\n", stages_ok ? "ok" : "FAILED");
+
+	// Worker 0 waits on a counter the outsider releases, running the
+	// injected jobs meanwhile (with a single worker nobody else would).
+	memset(out, 0, (u64)count * sizeof(u32));
+	for(u32 i = 0; i < count; i++) runs[i] = 0;
+	JobCounter outsider_done;
+	outsider_done.pending = 1;
+	std::thread outsider([system, &fill, &outsider_done, count] {
+		JobCounter counter;
+		counter.pending = 0;
+		u32 part = count / 4;
+		for(u32 p = 0; p < 4; p++) job_submit(system, fill_job, &fill, p * part, p == 3 ? count : (p + 1) * part, 64, &counter);
+		job_wait(system, &counter);
+		outsider_done.pending.fetch_sub(1, std::memory_order_release);
+	});
+	job_wait(system, &outsider_done);
+	outsider.join();
+	b32 outside_ok = filled_once(out, runs, count);
+	printf("  outside        %s\n", outside_ok ? "ok" : "FAILED");
+
+	os_free_pages(runs, (u64)count * sizeof(std::atomic<u32>));
+	os_free_pages(out, (u64)count * sizeof(u32) * 2);
+	return once && nested_ok && stages_ok && outside_ok;
+}
+
+//------------------------------------------------------------------------
+// Overhead
+//------------------------------------------------------------------------
+
+internal void empty_job(void* user, u32 index, u32 worker) {
+	std::atomic<u32>* counter = (std::atomic<u32>*)user;
+	counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+internal void empty_parallel(void* user, u32 index) {
+	empty_job(user, index, 0);
+}
+
+//------------------------------------------------------------------------
+// Scaling
+//------------------------------------------------------------------------
+
+struct SkinPass {
+	const Mat4* palette;
+	const SkinVertex* in;
+	RasterVertex* out;
+	u32 count;
+};
+
+internal void skin_chunk_job(void* user, u32 index, u32 worker) {
+	SkinPass* pass = (SkinPass*)user;
+	u32 first = index * SKIN_CHUNK;
+	skin_vertices_range(pass->palette, pass->in + first, pass->out + first, Min((u32)SKIN_CHUNK, pass->count - first));
+}
+
+internal void skin_chunk_parallel(void* user, u32 index) {
+	skin_chunk_job(user, index, 0);
+}
+
+int main(int argc, char** argv) {
+	u32 max_workers = os_logical_core_count();
+	u32 vertex_count = 1u << 20;
+	u32 repeats = 8;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--workers=", 10) == 0)        max_workers = Clamp(1u, (u32)atoi(argv[i] + 10), (u32)JOB_MAX_WORKERS);
+		else if(strncmp(argv[i], "--vertices=", 11) == 0)  vertex_count = Max((u32)atoi(argv[i] + 11), 1u);
+		else if(strncmp(argv[i], "--repeats=", 10) == 0)   repeats = Max((u32)atoi(argv[i] + 10), 1u);
+		else {
+			printf("usage: jobs_bench [--workers=N] [--vertices=N] [--repeats=N]\n");
+			return 1;
+		}
+	}
+
+	if(!job_system_start(&g_jobs, max_workers)) {
+		printf("[ERROR] could not start %u workers\n", max_workers);
+		return 1;
+	}
+	printf("%u workers on %u logical cores\n", g_jobs.worker_count, os_logical_core_count());
+	b32 checks_ok = run_checks(&g_jobs, 1u << 20);
+
+	// Empty jobs, each index its own job.
+	const u32 empty_count = 1u << 20;
+	std::atomic<u32> executed(0);
+	f64 start = os_now_seconds();
+	job_parallel_for(&g_jobs, empty_count, 1, empty_job, &executed);
+	f64 empty_seconds = os_now_seconds() - start;
+	b32 empty_ok = executed.load() == empty_count;
+
+	// A short parallel for issued over and over, e.g. once per system per frame.
+	const u32 calls = 1000;
+	u32 short_count = g_jobs.worker_count * 4;
+	executed = 0;
+	start = os_now_seconds();
+	for(u32 c = 0; c < calls; c++) job_parallel_for(&g_jobs, short_count, 1, empty_job, &executed);
+	f64 jobs_call_seconds = os_now_seconds() - start;
+	start = os_now_seconds();
+	for(u32 c = 0; c < calls; c++) os_parallel_for(short_count, g_jobs.worker_count, empty_parallel, &executed);
+	f64 os_call_seconds = os_now_seconds() - start;
+	empty_ok = empty_ok && executed.load() == 2 * calls * short_count;
+	job_system_stop(&g_jobs);
+	JobStats overhead_stats = g_jobs.stats;
+
+	printf("  empty jobs     %7.1f ns a job, %llu steals, %llu sleeps, %s\n", empty_seconds * 1e9 / empty_count,
+				 (unsigned long long)overhead_stats.steals, (unsigned long long)overhead_stats.sleeps, empty_ok ? "ok" : "FAILED");
+	printf("  short for      %7.2f us a call with jobs, %7.2f us with os_parallel_for (%u indices), %.1fx\n",
+				 jobs_call_seconds * 1e6 / calls, os_call_seconds * 1e6 / calls, short_count, os_call_seconds / jobs_call_seconds);
+
+	// Scaling.
+	u64 in_size = (u64)vertex_count * sizeof(SkinVertex), out_size = (u64)vertex_count * sizeof(RasterVertex);
+	SkinVertex* vertices = (SkinVertex*)os_alloc_pages(in_size);
+	RasterVertex* skinned = (RasterVertex*)os_alloc_pages(out_size);
+	RasterVertex* reference = (RasterVertex*)os_alloc_pages(out_size);
+	Mat4 palette[64];
+	u32 seed = 0x1234567u;
+	for(u32 b = 0; b < 64; b++) {
+		Quat rotation = quat_from_axis_angle(vec3(random_range(&seed, -1, 1), 1.0f, random_range(&seed, -1, 1)), random_range(&seed, -1, 1));
+		palette[b] = mat4_affine(vec3(1, 1, 1), rotation, vec3(random_range(&seed, -1, 1), random_range(&seed, -1, 1), random_range(&seed, -1, 1)));
+	}
+	for(u32 i = 0; i < vertex_count; i++) {
+		SkinVertex* v = &vertices[i];
+		for(u32 k = 0; k < 3; k++) v->position[k] = random_range(&seed, -1.0f, 1.0f);
+		v->texture[0] = v->texture[1] = 0.0f;
+		f32 w = random_range(&seed, 0.0f, 1.0f);
+		v->weights[0] = w;
+		v->weights[1] = 1.0f - w;
+		v->weights[2] = v->weights[3] = 0.0f;
+		for(u32 k = 0; k < 4; k++) v->bones[k] = (u8)(next_random(&seed) % 64);
+	}
+	skin_vertices_range(palette, vertices, reference, vertex_count);
+
+	SkinPass pass = { palette, vertices, skinned, vertex_count };
+	u32 chunk_count = (vertex_count + SKIN_CHUNK - 1) / SKIN_CHUNK;
+	printf("skinning %u vertices in %u chunks, best of %u\n", vertex_count, chunk_count, repeats);
+	printf("  workers   jobs ms  speedup  efficiency   os_parallel_for ms  steals\n");
+	f64 single_seconds = 0.0;
+	b32 scaling_ok = true;
+	for(u32 workers = 1; ; workers = Min(workers * 2, max_workers)) {
+		job_system_start(&g_jobs, workers);
+		f64 best = 1e30, best_os = 1e30;
+		for(u32 r = 0; r < repeats; r++) {
+			memset(skinned, 0, out_size);
+			start = os_now_seconds();
+			job_parallel_for(&g_jobs, chunk_count, 1, skin_chunk_job, &pass);
+			best = Min(best, os_now_seconds() - start);
+			scaling_ok = scaling_ok && memcmp(skinned, reference, out_size) == 0;
+
+			start = os_now_seconds();
+			os_parallel_for(chunk_count, workers, skin_chunk_parallel, &pass);
+			best_os = Min(best_os, os_now_seconds() - start);
+		}
+		job_system_stop(&g_jobs);
+		if(workers == 1) single_seconds = best;
+		printf("  %7u  %8.3f  %6.2fx  %9.0f%%  %19.3f  %6llu\n", workers, best * 1000.0, single_seconds / best,
+					 100.0 * single_seconds / best / workers, best_os * 1000.0, (unsigned long long)g_jobs.stats.steals);
+		if(workers == max_workers) break;
+	}
+
+	os_free_pages(reference, out_size);
+	os_free_pages(skinned, out_size);
+	os_free_pages(vertices, in_size);
+
+	if(!checks_ok || !empty_ok || !scaling_ok) {
+		printf("[ERROR] the job system lost, repeated or reordered work\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+// Benchmark for batch PNG decoding (texture/png.h).
+//
+// Decodes the given PNGs (each repeated --copies times, to stand in for a
+// level's worth of textures) first the way a plain loader would, one
+// stbi_load_from_memory() after the other on the heap, and then through
+// png_decode_batch() at 1, 2, 4 .. N threads. Reports images/s, Mpix/s, the
+// time until the first image is ready, scratch usage and heap fallbacks, and
+// checks that every batch produced the same pixels as the serial decode.
+//
+// Usage: png_bench <a.png> [b.png ...] [--copies=N] [--threads=N]
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/png.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_FILES 256
+
+internal u64 hash_pixels(const u8* pixels, u64 size) {
+	u64 hash = 0xcbf29ce484222325ull;
+	for(u64 i = 0; i < size; i++) hash = (hash ^ pixels[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+struct FirstDone {
+	f64 start;
+	std::atomic<u32> seen;
+	f64 seconds;
+};
+
+internal void on_png_done(void* user, PNGBatchItem* item, u32 index) {
+	FirstDone* first = (FirstDone*)user;
+	if(first->seen.fetch_add(1) == 0) first->seconds = os_now_seconds() - first->start;
+}
+
+int main(int argc, char** argv) {
+	OS_FileMap files[MAX_FILES];
+	u32 file_count = 0;
+	u32 copies = 8;
+	u32 max_threads = os_logical_core_count();
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--copies=", 9) == 0)      copies = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0) max_threads = Max((u32)atoi(argv[i] + 10), 1u);
+		else if(file_count < MAX_FILES) {
+			if(!os_file_map_open(&files[file_count], argv[i])) {
+				printf("[ERROR] could not open %s\n", argv[i]);
+				return 1;
+			}
+			file_count++;
+		}
+	}
+	if(file_count == 0) {
+		printf("usage: png_bench <a.png> [b.png ...] [--copies=N] [--threads=N]\n");
+		return 1;
+	}
+
+	u32 count = file_count * copies;
+	PNGBatchItem* items = (PNGBatchItem*)os_alloc_pages(sizeof(PNGBatchItem) * count);
+	u64* expected = (u64*)os_alloc_pages(sizeof(u64) * file_count);
+
+	// Serial heap decode, the way a simple loader would do it.
+	f64 pixels = 0.0;
+	f64 start = os_now_seconds();
+	for(u32 i = 0; i < count; i++) {
+		const OS_FileMap* file = &files[i % file_count];
+		int w, h, channels;
+		stbi_uc* decoded = stbi_load_from_memory(file->data, (int)file->size, &w, &h, &channels, 4);
+		if(!decoded) {
+			printf("[ERROR] input %u is not a PNG stb_image can decode\n", i % file_count);
+			return 1;
+		}
+		if(i < file_count) expected[i] = hash_pixels(decoded, (u64)w * h * 4);
+		pixels += (f64)w * h;
+		stbi_image_free(decoded);
+	}
+	f64 serial = os_now_seconds() - start;
+
+	printf("%u images (%u files x %u), %.2f Mpix\n", count, file_count, copies, pixels / 1e6);
+	printf("  mode        threads        ms   images/s     Mpix/s  first ms  scratch MB  heap  speedup\n");
+	printf("  serial            1 %9.2f %10.1f %10.2f\n", serial * 1000.0, count / serial, pixels / 1e6 / serial);
+
+	for(u32 threads = 1;; threads = Min(threads * 2, max_threads)) {
+		for(u32 i = 0; i < count; i++) {
+			items[i] = {};
+			items[i].data = files[i % file_count].data;
+			items[i].size = files[i % file_count].size;
+		}
+
+		FirstDone first;
+		first.start = os_now_seconds();
+		first.seen = 0;
+		first.seconds = 0.0;
+
+		PNGBatchSettings settings = {};
+		settings.thread_count = threads;
+		settings.on_done = on_png_done;
+		settings.user = &first;
+
+		PNGBatch batch;
+		if(!png_decode_batch(&batch, items, count, &settings)) {
+			printf("[ERROR] batch decode failed for %u of %u images\n", batch.failed_count, count);
+			return 1;
+		}
+
+		b32 match = true;
+		for(u32 i = 0; i < count; i++) {
+			match = match && hash_pixels(items[i].pixels, (u64)items[i].width * items[i].height * 4) == expected[i % file_count];
+		}
+
+		printf("  batch     %7u %9.2f %10.1f %10.2f %9.2f %11.2f %5u %7.2fx%s\n", batch.worker_count, batch.seconds * 1000.0,
+					 count / batch.seconds, pixels / 1e6 / batch.seconds, first.seconds * 1000.0,
+					 (f64)batch.scratch_peak / (f64)MB(1), batch.heap_fallbacks, serial / batch.seconds,
+					 match ? "" : "  [MISMATCH]");
+		png_batch_release(&batch);
+
+		if(threads == max_threads) break;
+	}
+
+	os_free_pages(expected, sizeof(u64) * file_count);
+	os_free_pages(items, sizeof(PNGBatchItem) * count);
+	for(u32 i = 0; i < file_count; i++) os_file_map_close(&files[i]);
+	return 0;
+}
@@ -0,0 +1,322 @@
+// Benchmark and self-check for the handle pools (basic/pool.h) and the GPU
+// resource front end on top of them (gfx/resources.h).
+//
+// Pool: --items 64-byte items, created, then churned for --rounds rounds (half
+// of them destroyed and created again at random each round), looked up in
+// random order and walked. The same against a table of pointers to objects
+// from new/delete, the way lone globals grow into a scene. Checks along the
+// way: a destroyed handle never resolves again, even after its slot is
+// reused or its generation wraps around; a full pool refuses; handle 0 never
+// resolves; and the pool makes no OS requests after pool_init().
+//
+// Resources: thousands of meshes and streamed-in textures created, churned
+// and released through the null backend (gfx/null.h), which has to end up
+// with nothing alive. Buffer updates out of bounds (offset + size wrapping
+// included) and partial constant buffer updates must not reach the backend.
+//
+// Usage: pool_bench [--items=N] [--rounds=N] [--meshes=N] [--textures=N]
+
+#include "basic/types.h"
+#include "basic/pool.h"
+#include "gfx/resources.h"
+#include "gfx/null.h"
+#include "platform/os.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+struct BenchItem {
+	f32 transform[12];
+	u32 id;
+	u32 flags;
+	u64 user;
+};
+
+internal void bench_item_fill(BenchItem* item, u32 id) {
+	for(u32 i = 0; i < 12; i++) item->transform[i] = (f32)(id + i);
+	item->id = id;
+}
+
+// Reuses one slot until its generation wraps back to that of a handle destroyed
+// at the start, with the slot free again. The old handle must neither resolve
+// nor destroy anything. The slot's free list link is a dense position below
+// count, so following it would land on a live item.
+internal b32 check_generation_wrap() {
+	Pool pool;
+	if(!pool_init(&pool, sizeof(BenchItem), 4)) return false;
+	PoolHandle handles[4];
+	for(u32 i = 0; i < 4; i++) handles[i] = pool_create(&pool, nullptr);
+	pool_destroy(&pool, handles[1]);
+	pool_destroy(&pool, handles[0]);
+
+	u32 slot = pool_handle_slot(handles[0]);
+	u32 reuses = 0;
+	while(pool.slots[slot].generation != pool_handle_generation(handles[0]) && reuses <= POOL_GENERATION_MASK) {
+		pool_destroy(&pool, pool_create(&pool, nullptr));
+		reuses++;
+	}
+
+	b32 ok = pool.free_head == slot && pool.slots[slot].dense < pool.count && reuses < POOL_GENERATION_MASK;
+	if(!ok) printf("[ERROR] the generation wrap check did not set up (%u reuses)\n", reuses);
+	if(pool_get(&pool, handles[0])) {
+		printf("[ERROR] a handle resolved to a free slot after its generation wrapped\n");
+		ok = false;
+	}
+	if(pool_destroy(&pool, handles[0]) || pool.count != 2 || !pool_get(&pool, handles[2]) || !pool_get(&pool, handles[3])) {
+		printf("[ERROR] destroying a wrapped handle changed the pool\n");
+		ok = false;
+	}
+	pool_release(&pool);
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	u32 item_count = 65536;
+	u32 rounds = 16;
+	u32 mesh_count = 4096;
+	u32 texture_count = 4096;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--items=", 8) == 0)          item_count = Clamp(2u, (u32)atoi(argv[i] + 8), (u32)POOL_MAX_ITEMS);
+		else if(strncmp(argv[i], "--rounds=", 9) == 0)    rounds = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--meshes=", 9) == 0)    mesh_count = Clamp(1u, (u32)atoi(argv[i] + 9), (u32)GFX_MAX_MESHES);
+		else if(strncmp(argv[i], "--textures=", 11) == 0) texture_count = Clamp(1u, (u32)atoi(argv[i] + 11), (u32)GFX_MAX_TEXTURES);
+		else {
+			printf("usage: pool_bench [--items=N] [--rounds=N] [--meshes=N] [--textures=N]\n");
+			return 1;
+		}
+	}
+
+	Pool pool;
+	if(!pool_init(&pool, sizeof(BenchItem), item_count)) {
+		printf("[ERROR] could not allocate a pool of %u items\n", item_count);
+		return 1;
+	}
+	PoolHandle* handles = (PoolHandle*)os_alloc_pages((u64)item_count * sizeof(PoolHandle));
+	BenchItem** objects = (BenchItem**)os_alloc_pages((u64)item_count * sizeof(BenchItem*));
+	u32* order = (u32*)os_alloc_pages((u64)item_count * sizeof(u32));
+	u32* churn = (u32*)os_alloc_pages((u64)item_count / 2 * sizeof(u32));
+	PoolHandle* replaced = (PoolHandle*)os_alloc_pages((u64)item_count / 2 * sizeof(PoolHandle));
+	u32 seed = 0x1234567u;
+	for(u32 i = 0; i < item_count; i++) order[i] = next_random(&seed) % item_count;
+	u32 failures = check_generation_wrap() ? 0 : 1;
+	u64 os_requests = os_memory_requests();
+
+	// Create.
+	f64 start = os_now_seconds();
+	for(u32 i = 0; i < item_count; i++) {
+		BenchItem* item;
+		handles[i] = pool_create(&pool, (void**)&item);
+		bench_item_fill(item, i);
+	}
+	f64 pool_create_seconds = os_now_seconds() - start;
+	start = os_now_seconds();
+	for(u32 i = 0; i < item_count; i++) {
+		objects[i] = new BenchItem();
+		bench_item_fill(objects[i], i);
+	}
+	f64 heap_create_seconds = os_now_seconds() - start;
+
+	if(pool_create(&pool, nullptr) != 0) {
+		printf("[ERROR] a full pool created an item\n");
+		failures++;
+	}
+	if(pool_get(&pool, 0)) {
+		printf("[ERROR] handle 0 resolved\n");
+		failures++;
+	}
+
+	// Churn, the same victims both ways. Every replaced handle must stop resolving.
+	f64 pool_churn_seconds = 0.0, heap_churn_seconds = 0.0;
+	u32 stale_resolved = 0;
+	for(u32 round = 0; round < rounds; round++) {
+		for(u32 j = 0; j < item_count / 2; j++) churn[j] = next_random(&seed) % item_count;
+
+		start = os_now_seconds();
+		for(u32 j = 0; j < item_count / 2; j++) {
+			u32 i = churn[j];
+			replaced[j] = handles[i];
+			pool_destroy(&pool, handles[i]);
+			BenchItem* item;
+			handles[i] = pool_create(&pool, (void**)&item);
+			bench_item_fill(item, i);
+		}
+		pool_churn_seconds += os_now_seconds() - start;
+		for(u32 j = 0; j < item_count / 2; j++) stale_resolved += pool_get(&pool, replaced[j]) != nullptr;
+
+		start = os_now_seconds();
+		for(u32 j = 0; j < item_count / 2; j++) {
+			u32 i = churn[j];
+			delete objects[i];
+			objects[i] = new BenchItem();
+			bench_item_fill(objects[i], i);
+		}
+		heap_churn_seconds += os_now_seconds() - start;
+	}
+	if(stale_resolved) {
+		printf("[ERROR] %u destroyed handles still resolved\n", stale_resolved);
+		failures++;
+	}
+
+	// Lookups in random order, and whole walks.
+	u64 pool_sum = 0, heap_sum = 0;
+	start = os_now_seconds();
+	for(u32 round = 0; round < rounds; round++) {
+		for(u32 k = 0; k < item_count; k++) pool_sum += PoolGet(&pool, BenchItem, handles[order[k]])->id;
+	}
+	f64 pool_lookup_seconds = os_now_seconds() - start;
+	start = os_now_seconds();
+	for(u32 round = 0; round < rounds; round++) {
+		for(u32 k = 0; k < item_count; k++) heap_sum += objects[order[k]]->id;
+	}
+	f64 heap_lookup_seconds = os_now_seconds() - start;
+
+	f32 pool_total = 0.0f, heap_total = 0.0f;
+	start = os_now_seconds();
+	for(u32 round = 0; round < rounds; round++) {
+		for(u32 i = 0; i < pool.count; i++) pool_total += PoolItemAt(&pool, BenchItem, i)->transform[3];
+	}
+	f64 pool_walk_seconds = os_now_seconds() - start;
+	start = os_now_seconds();
+	for(u32 round = 0; round < rounds; round++) {
+		for(u32 i = 0; i < item_count; i++) heap_total += objects[i]->transform[3];
+	}
+	f64 heap_walk_seconds = os_now_seconds() - start;
+
+	if(pool_sum != heap_sum || pool.count != item_count) {
+		printf("[ERROR] the pool lost items (%u of %u live)\n", pool.count, item_count);
+		failures++;
+	}
+	for(u32 i = 0; i < item_count; i++) {
+		BenchItem* item = PoolGet(&pool, BenchItem, handles[i]);
+		if(!item || item->id != i) {
+			printf("[ERROR] handle %u resolves to the wrong item\n", i);
+			failures++;
+			break;
+		}
+	}
+	if(os_memory_requests() != os_requests) {
+		printf("[ERROR] the pool went to the OS after pool_init()\n");
+		failures++;
+	}
+
+	f64 churns = (f64)rounds * (item_count / 2);
+	f64 lookups = (f64)rounds * item_count;
+	printf("%u items of %u bytes, %u rounds of churning half of them (checksum %llx)\n", item_count, (u32)sizeof(BenchItem), rounds,
+				 (unsigned long long)pool_sum + (u64)(pool_total + heap_total));
+	printf("                 %10s %10s\n", "pool", "new/delete");
+	printf("  create         %7.2f ns %7.2f ns\n", pool_create_seconds * 1e9 / item_count, heap_create_seconds * 1e9 / item_count);
+	printf("  destroy+create %7.2f ns %7.2f ns\n", pool_churn_seconds * 1e9 / churns, heap_churn_seconds * 1e9 / churns);
+	printf("  random lookup  %7.2f ns %7.2f ns\n", pool_lookup_seconds * 1e9 / lookups, heap_lookup_seconds * 1e9 / lookups);
+	printf("  walk           %7.2f ns %7.2f ns an item\n", pool_walk_seconds * 1e9 / lookups, heap_walk_seconds * 1e9 / lookups);
+	printf("  pool memory    %.1f KB, %u slots used\n", pool.memory_size / 1024.0, pool.slot_count);
+
+	for(u32 i = 0; i < item_count; i++) delete objects[i];
+	pool_release(&pool);
+
+	// Resources through the null backend.
+	GfxNullDevice device = {};
+	GfxBackend backend = gfx_null_backend(&device);
+	GfxResources resources;
+	if(!gfx_resources_init(&resources, &backend)) {
+		printf("[ERROR] could not allocate the resource pools\n");
+		return 1;
+	}
+	f32 vertices[4 * 5] = {};
+	u16 indices[6] = { 0, 1, 2, 2, 1, 3 };
+	u8 texels[256 * 4] = {};
+	GfxMeshHandle* meshes = (GfxMeshHandle*)os_alloc_pages((u64)mesh_count * sizeof(GfxMeshHandle));
+	GfxTextureHandle* textures = (GfxTextureHandle*)os_alloc_pages((u64)texture_count * sizeof(GfxTextureHandle));
+	GfxTextureDesc texture_desc = { CookedFormat_RGBA8, true, 256, 256, 9 };
+
+	start = os_now_seconds();
+	for(u32 i = 0; i < mesh_count; i++) meshes[i] = gfx_mesh_create(&resources, vertices, 4, 5 * sizeof(f32), indices, 6, sizeof(u16));
+	for(u32 i = 0; i < texture_count; i++) {
+		textures[i] = gfx_texture_create(&resources, &texture_desc);
+		for(s32 level = texture_desc.level_count - 1; level >= 0; level--) {
+			gfx_texture_upload_rows(&resources, textures[i], level, 0, gfx_texture_level_rows(&texture_desc, level), texels, 256 * 4);
+		}
+	}
+	f64 resource_create_seconds = os_now_seconds() - start;
+
+	u32 not_ready = 0;
+	for(u32 i = 0; i < texture_count; i++) not_ready += gfx_texture_get(&resources, textures[i])->levels_ready != texture_desc.level_count;
+	if(resources.stats.failed || not_ready) {
+		printf("[ERROR] %llu creates failed, %u textures incomplete\n", (unsigned long long)resources.stats.failed, not_ready);
+		failures++;
+	}
+
+	// Replace every other mesh; the old handles and their buffers have to be gone.
+	u32 buffers_before = resources.buffers.count;
+	start = os_now_seconds();
+	for(u32 i = 0; i < mesh_count; i += 2) {
+		GfxMeshHandle old = meshes[i];
+		GfxBufferHandle old_vertices = gfx_mesh_get(&resources, old)->vertices;
+		gfx_mesh_destroy(&resources, old);
+		meshes[i] = gfx_mesh_create(&resources, vertices, 4, 5 * sizeof(f32), indices, 6, sizeof(u16));
+		if(gfx_mesh_get(&resources, old) || gfx_buffer_get(&resources, old_vertices)) stale_resolved++;
+	}
+	f64 resource_churn_seconds = os_now_seconds() - start;
+	if(stale_resolved || resources.buffers.count != buffers_before) {
+		printf("[ERROR] replaced meshes still resolve or leaked buffers\n");
+		failures++;
+	}
+	gfx_mesh_destroy(&resources, GfxMeshHandle{});
+	u64 stale_before = resources.stats.stale;
+	gfx_texture_upload_rows(&resources, GfxTextureHandle{ textures[0].value ^ (1u << POOL_INDEX_BITS) }, 0, 0, 1, texels, 256 * 4);
+	if(resources.stats.stale != stale_before + 1) {
+		printf("[ERROR] an upload through a stale texture handle was not caught\n");
+		failures++;
+	}
+
+	// Updates the front end has to drop.
+	GfxBufferDesc constant_desc = { GfxBuffer_Constant, 64, 0, true };
+	GfxBufferHandle constant = gfx_buffer_create(&resources, &constant_desc, nullptr);
+	GfxBufferDesc odd_desc = { GfxBuffer_Constant, 60, 0, true };
+	u64 failed_before = resources.stats.failed;
+	if(!constant.value || gfx_buffer_create(&resources, &odd_desc, nullptr).value || resources.stats.failed != failed_before + 1) {
+		printf("[ERROR] constant buffer sizes are not checked\n");
+		failures++;
+	}
+	u64 bytes_before = device.buffer_bytes;
+	gfx_buffer_update(&resources, constant, 16, 16, texels);
+	gfx_buffer_update(&resources, constant, 0, 32, texels);
+	gfx_buffer_update(&resources, constant, 32, 0xffffffe0u, texels);
+	gfx_buffer_update(&resources, gfx_mesh_get(&resources, meshes[0])->vertices, 16, 0xfffffff8u, texels);
+	if(device.buffer_bytes != bytes_before) {
+		printf("[ERROR] out of bounds or partial constant buffer updates reached the backend\n");
+		failures++;
+	}
+	gfx_buffer_update(&resources, constant, 0, 64, texels);
+	if(device.buffer_bytes != bytes_before + 64) {
+		printf("[ERROR] a whole constant buffer update was dropped\n");
+		failures++;
+	}
+	gfx_buffer_destroy(&resources, constant);
+
+	u64 objects_created = device.next_name;
+	gfx_resources_release(&resources);
+	printf("%u meshes and %u textures (256x256, 9 levels) through the %s backend\n", mesh_count, texture_count, backend.name);
+	printf("  create         %7.2f us a mesh or texture, with its uploads\n", resource_create_seconds * 1e6 / (mesh_count + texture_count));
+	printf("  replace mesh   %7.2f us\n", resource_churn_seconds * 1e6 / ((mesh_count + 1) / 2));
+	printf("  backend        %llu objects, %llu calls, %llu alive after release\n", (unsigned long long)objects_created,
+				 (unsigned long long)device.calls, (unsigned long long)(device.live_buffers + device.live_textures));
+	if(device.live_buffers || device.live_textures) {
+		printf("[ERROR] gfx_resources_release() left backend objects alive\n");
+		failures++;
+	}
+
+	os_free_pages(textures, (u64)texture_count * sizeof(GfxTextureHandle));
+	os_free_pages(meshes, (u64)mesh_count * sizeof(GfxMeshHandle));
+	os_free_pages(replaced, (u64)item_count / 2 * sizeof(PoolHandle));
+	os_free_pages(churn, (u64)item_count / 2 * sizeof(u32));
+	os_free_pages(order, (u64)item_count * sizeof(u32));
+	os_free_pages(objects, (u64)item_count * sizeof(BenchItem*));
+	os_free_pages(handles, (u64)item_count * sizeof(PoolHandle));
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,318 @@
+// Benchmark for the OpenGL program-binary cache (gl/program_cache.h).
+//
+// Builds --programs=N variants of a lit material (different defines each) four
+// times against a cache directory:
+//   cold          empty cache, everything is compiled from GLSL and stored
+//   warm          every program comes back through glProgramBinary
+//   new driver    the driver hash is changed, as after a driver update: every
+//                 entry is rejected, rebuilt from source and replaced
+//   after update  warm again for the new driver
+// Reports time, hits, misses, rejections, hit rate and the time saved, and
+// renders a small image with every program to check that cached binaries
+// draw the same thing as freshly compiled ones. Also checks that compile and
+// link failures keep their log inside error buffers too small for it.
+//
+// Runs headless: EGL on Linux (llvmpipe works), a hidden GLFW window on Windows.
+// Mesa only exposes binary formats while its own shader disk cache is on, so
+// on Linux that cache is pointed at <dir>/mesa and emptied first, keeping
+// "cold" really cold (the "new driver" pass still benefits from it). With
+// --mesa-cache the user's Mesa cache is left alone.
+//
+// Usage: program_cache_bench [--programs=N] [--dir=program_cache] [--mesa-cache]
+
+#include "basic/types.h"
+#include "platform/os.h"
+
+#include "third_party/glad/glad.h"
+#include "third_party/glad/glad.c"
+
+#if OS_WINDOWS
+	#include "third_party/glfw/glfw3.h"
+	#pragma comment(lib, "../src/third_party/glfw/glfw3_mt")
+	#pragma comment(lib, "user32")
+	#pragma comment(lib, "gdi32")
+	#pragma comment(lib, "shell32")
+#else
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
+#include "gl/program_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_PROGRAMS 1024
+#define IMAGE_SIZE   32
+
+//------------------------------------------------------------------------
+// Headless context
+//------------------------------------------------------------------------
+
+#if OS_WINDOWS
+internal b32 create_context() {
+	if(!glfwInit()) return false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow* window = glfwCreateWindow(IMAGE_SIZE, IMAGE_SIZE, "program_cache_bench", nullptr, nullptr);
+	if(!window) return false;
+	glfwMakeContextCurrent(window);
+	return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+}
+#else
+internal b32 create_context() {
+	// Surfaceless first, it needs neither X nor a GPU node.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if(display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) return false;
+	if(!eglBindAPI(EGL_OPENGL_API)) return false;
+
+	EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+	EGLConfig config;
+	EGLint config_count = 0;
+	if(!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) return false;
+
+	EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return false;
+	return gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+}
+#endif
+
+//------------------------------------------------------------------------
+// Programs
+//------------------------------------------------------------------------
+
+local const char* g_vertex_source =
+	"#version 410 core\n"
+	"out vec2 uv;\n"
+	"void main() {\n"
+	"	uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"	gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// Enough work per variant (lights, a noise loop, fog) that compiling is not trivially cheap.
+local const char* g_fragment_source =
+	"#version 410 core\n"
+	"in vec2 uv;\n"
+	"out vec4 colour;\n"
+	"float hash(vec2 p) { return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453); }\n"
+	"float noise(vec2 p) {\n"
+	"	vec2 i = floor(p), f = fract(p);\n"
+	"	vec2 u = f * f * (3.0 - 2.0 * f);\n"
+	"	return mix(mix(hash(i), hash(i + vec2(1, 0)), u.x), mix(hash(i + vec2(0, 1)), hash(i + vec2(1, 1)), u.x), u.y);\n"
+	"}\n"
+	"void main() {\n"
+	"	vec3 n = normalize(vec3(uv - 0.5, 1.0));\n"
+	"	float height = 0.0, amplitude = 0.5;\n"
+	"	vec2 p = uv * 8.0;\n"
+	"	for(int octave = 0; octave < OCTAVES; octave++) { height += amplitude * noise(p); p *= 2.03; amplitude *= 0.5; }\n"
+	"	vec3 albedo = mix(vec3(0.3, 0.25, 0.2), vec3(0.6, 0.6, 0.55), height);\n"
+	"	vec3 lit = vec3(0.05);\n"
+	"	for(int i = 0; i < LIGHT_COUNT; i++) {\n"
+	"		float angle = float(i) * 2.399;\n"
+	"		vec3 l = normalize(vec3(cos(angle), sin(angle), 1.5));\n"
+	"		vec3 h = normalize(l + vec3(0, 0, 1));\n"
+	"		float diffuse = max(dot(n, l), 0.0);\n"
+	"		float specular = pow(max(dot(n, h), 0.0), 32.0) * SPECULAR;\n"
+	"		lit += albedo * diffuse / float(LIGHT_COUNT) + vec3(specular);\n"
+	"	}\n"
+	"#if USE_FOG\n"
+	"	lit = mix(lit, vec3(0.5, 0.6, 0.7), smoothstep(0.2, 1.0, length(uv - 0.5)));\n"
+	"#endif\n"
+	"	colour = vec4(lit, 1.0);\n"
+	"}\n";
+
+struct Variant {
+	char defines[256];
+	u64 image_hash;
+};
+
+global Variant g_variants[MAX_PROGRAMS];
+
+internal u64 render_hash(gluint program) {
+	u8 pixels[IMAGE_SIZE * IMAGE_SIZE * 4];
+	glUseProgram(program);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	return gl_program_hash_bytes(0xcbf29ce484222325ull, pixels, sizeof(pixels));
+}
+
+struct Pass {
+	GLProgramCacheStats stats;
+	f64 seconds;
+	u32 mismatches;
+};
+
+// Gets every variant through the cache. The first pass records what each one
+// renders, later passes compare against it.
+internal b32 run_pass(GLProgramCache* cache, u32 count, b32 record, Pass* pass) {
+	GLShaderStage stages[2] = { { GL_VERTEX_SHADER, g_vertex_source }, { GL_FRAGMENT_SHADER, g_fragment_source } };
+	gluint programs[MAX_PROGRAMS];
+
+	cache->stats = {};
+	f64 start = os_now_seconds();
+	for(u32 i = 0; i < count; i++) {
+		GLProgramDesc desc = { "material", stages, ArrayCount(stages), g_variants[i].defines };
+		programs[i] = gl_program_cache_get(cache, &desc);
+		if(!programs[i]) {
+			printf("[ERROR] %s\n", cache->error);
+			return false;
+		}
+	}
+	glFinish();
+	pass->seconds = os_now_seconds() - start;
+	pass->stats = cache->stats;
+
+	pass->mismatches = 0;
+	for(u32 i = 0; i < count; i++) {
+		u64 hash = render_hash(programs[i]);
+		if(record) g_variants[i].image_hash = hash;
+		else       pass->mismatches += hash != g_variants[i].image_hash;
+		glDeleteProgram(programs[i]);
+	}
+	return true;
+}
+
+internal void print_pass(const char* name, const Pass* pass) {
+	const GLProgramCacheStats* stats = &pass->stats;
+	printf("  %-13s %9.2f %5u %7u %9u %8.0f%% %9.2f %8.2f %s\n", name, pass->seconds * 1000.0,
+				 stats->hits, stats->misses, stats->rejected, gl_program_cache_hit_rate(stats) * 100.0,
+				 stats->saved_seconds * 1000.0, stats->build_seconds * 1000.0,
+				 pass->mismatches ? "[IMAGE MISMATCH]" : "");
+}
+
+// Fails a compile and a link with a name longer than the error buffer and with
+// buffers from 1 byte up, checking the message stays inside and terminated and
+// that the info log is asked for with a valid size.
+internal u32 check_error_truncation() {
+	const char* bad_compile = "#version 330 core\nvoid main() { gl_Position = undefined_name; }\n";
+	const char* bad_link = "#version 330 core\nvoid missing();\nvoid main() { missing(); gl_Position = vec4(0.0); }\n";
+	const char* long_name = "a_material_name_longer_than_the_small_error_buffers";
+	u32 failures = 0;
+	for(u32 which = 0; which < 2; which++) {
+		GLShaderStage stage = { GL_VERTEX_SHADER, which ? bad_link : bad_compile };
+		for(u32 size = 1; size <= 96; size += size < 8 ? 1 : 11) {
+			const u32 guard = 64;
+			char buffer[96 + 2 * 64];
+			memset(buffer, 0x5a, sizeof(buffer));
+			GLProgramDesc desc = { size & 1 ? long_name : "m", &stage, 1, nullptr };
+			while(glGetError() != GL_NO_ERROR) {}
+			gluint program = gl_program_build(&desc, false, buffer + guard, size);
+			b32 terminated = memchr(buffer + guard, 0, size) != nullptr;
+			b32 intact = true;
+			for(u32 i = 0; i < sizeof(buffer); i++) {
+				if(i >= guard && i < guard + size) continue;
+				intact &= buffer[i] == 0x5a;
+			}
+			glenum gl_error = glGetError();
+			if(program || !terminated || !intact || gl_error != GL_NO_ERROR) {
+				printf("[ERROR] %s failure with a %u byte error buffer: %s\n", which ? "link" : "compile", size,
+							 program ? "built" : !terminated ? "log not terminated" : !intact ? "wrote outside the buffer" :
+							 "bad info log size");
+				failures++;
+			}
+			if(program) glDeleteProgram(program);
+		}
+	}
+	return failures;
+}
+
+internal void remove_file(void* user, const char* path) {
+	char full_path[OS_MAX_PATH];
+	snprintf(full_path, sizeof(full_path), "%s/%s", (const char*)user, path);
+	remove(full_path);
+}
+
+int main(int argc, char** argv) {
+	u32 count = 64;
+	const char* directory = "program_cache";
+	b32 mesa_cache = false;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--programs=", 11) == 0) count = Clamp(1u, (u32)atoi(argv[i] + 11), (u32)MAX_PROGRAMS);
+		else if(strncmp(argv[i], "--dir=", 6) == 0)  directory = argv[i] + 6;
+		else if(strcmp(argv[i], "--mesa-cache") == 0) mesa_cache = true;
+		else {
+			printf("usage: program_cache_bench [--programs=N] [--dir=program_cache] [--mesa-cache]\n");
+			return 1;
+		}
+	}
+
+	os_make_directory(directory);
+	os_list_files(directory, remove_file, (void*)directory);
+#if OS_LINUX
+	char mesa_directory[OS_MAX_PATH];
+	snprintf(mesa_directory, sizeof(mesa_directory), "%s/mesa", directory);
+	if(!mesa_cache) {
+		setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+		setenv("MESA_SHADER_CACHE_DIR", mesa_directory, 1);
+	}
+#endif
+	if(!create_context()) {
+		printf("[ERROR] could not create an OpenGL 4.1 core context\n");
+		return 1;
+	}
+
+	GLProgramCache cache;
+	if(!gl_program_cache_init(&cache, directory)) {
+		printf("[ERROR] %s: no program binary formats or cannot create %s\n", (const char*)glGetString(GL_RENDERER), directory);
+		return 1;
+	}
+
+	for(u32 i = 0; i < count; i++) {
+		snprintf(g_variants[i].defines, sizeof(g_variants[i].defines),
+						 "#define LIGHT_COUNT %u\n#define OCTAVES %u\n#define SPECULAR %u.%u\n#define USE_FOG %u\n",
+						 1 + i % 8, 1 + (i / 8) % 6, 1 + i / 48, i % 10, (i / 3) & 1);
+	}
+
+	// Render target for the image comparison.
+	gluint texture, framebuffer, vertex_array;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, IMAGE_SIZE, IMAGE_SIZE);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+	glViewport(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+
+	printf("%s | %s, %u binary format(s), %u programs\n", (const char*)glGetString(GL_RENDERER),
+				 (const char*)glGetString(GL_VERSION), cache.format_count, count);
+	printf("  pass                 ms  hits  misses  rejected  hit rate  saved ms  build ms\n");
+
+	Pass cold, warm, updated, after_update;
+	if(!run_pass(&cache, count, true, &cold)) return 1;
+	print_pass("cold", &cold);
+	if(!run_pass(&cache, count, false, &warm)) return 1;
+	print_pass("warm", &warm);
+
+	cache.driver ^= 0x5a5a5a5a5a5a5a5aull;
+	if(!run_pass(&cache, count, false, &updated)) return 1;
+	print_pass("new driver", &updated);
+	if(!run_pass(&cache, count, false, &after_update)) return 1;
+	print_pass("after update", &after_update);
+
+	printf("  warm start %.2fx faster than cold (%.2f ms per program vs %.2f ms)\n", cold.seconds / warm.seconds,
+				 warm.seconds * 1000.0 / count, cold.seconds * 1000.0 / count);
+
+	u32 truncation_failures = check_error_truncation();
+	printf("  error log truncation %s\n", truncation_failures ? "FAILED" : "ok");
+
+	b32 ok = !truncation_failures && warm.stats.hits == count && updated.stats.rejected == count && after_update.stats.hits == count &&
+					 !warm.mismatches && !updated.mismatches && !after_update.mismatches;
+	if(!ok) printf("[ERROR] unexpected cache behaviour\n");
+	return ok ? 0 : 1;
+}
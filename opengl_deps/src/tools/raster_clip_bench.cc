@@ -0,0 +1,189 @@
+// Benchmark for the rasterizer's front end: vertex positions, guard-band
+// classification, clipping and setup (raster_assemble_triangles()).
+//
+// The scene is a large tessellated ground plane seen from a camera standing on
+// it and turning on the spot, so every frame has triangles behind the camera
+// (rejected), crossing the near plane next to it and beyond the far plane
+// (clipped), running off the sides of the screen (rasterized whole inside the
+// guard band) and inside. Each frame goes through the front end twice:
+//   single     raster_assemble_triangle(), one triangle at a time
+//   batched    raster_assemble_triangles(), RASTER_CLIP_BATCH at a time
+// and both streams of set-up triangles have to match bit for bit. Reports
+// input triangles per second and what happened to them.
+//
+// Usage: raster_clip_bench [--frames=N] [--grid=N] [--size=WxH] [--out=frame.tga]
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+#include "raster/raster.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_GRID 255            // Vertices per side, 65025 in all, within a u16 index.
+
+struct Ground {
+	RasterVertex* vertices;
+	u32 vertex_count;
+	u16* indices;
+	u32 index_count;
+};
+
+// `grid` x `grid` vertices over 400x400 units around the origin, with a few
+// bumps so the triangles are not all coplanar.
+internal void build_ground(Ground* ground, u32 grid) {
+	ground->vertex_count = grid * grid;
+	ground->index_count = (grid - 1) * (grid - 1) * 6;
+	ground->vertices = (RasterVertex*)os_alloc_pages((u64)ground->vertex_count * sizeof(RasterVertex));
+	ground->indices = (u16*)os_alloc_pages((u64)ground->index_count * sizeof(u16));
+	for(u32 z = 0; z < grid; z++) {
+		for(u32 x = 0; x < grid; x++) {
+			RasterVertex* vertex = &ground->vertices[z * grid + x];
+			f32 fx = ((f32)x / (f32)(grid - 1) - 0.5f) * 400.0f;
+			f32 fz = ((f32)z / (f32)(grid - 1) - 0.5f) * 400.0f;
+			vertex->position[0] = fx;
+			vertex->position[1] = 0.3f * sinf(fx * 0.37f) * cosf(fz * 0.29f);
+			vertex->position[2] = fz;
+			vertex->texture[0] = fx * 0.25f;
+			vertex->texture[1] = fz * 0.25f;
+		}
+	}
+	u16* index = ground->indices;
+	for(u32 z = 0; z + 1 < grid; z++) {
+		for(u32 x = 0; x + 1 < grid; x++) {
+			u16 a = (u16)(z * grid + x), b = (u16)(a + 1), c = (u16)(a + grid), d = (u16)(c + 1);
+			*index++ = a; *index++ = c; *index++ = d;
+			*index++ = a; *index++ = d; *index++ = b;
+		}
+	}
+}
+
+internal void set_camera(RasterContext* context, u32 frame, u32 frames) {
+	f32 angle = 6.2831853f * (f32)frame / (f32)frames + 0.3f;
+	Vec4 eye = vec4(0.0f, 1.7f, 0.0f, 1.0f);
+	Vec4 focus = vec4(sinf(angle), 1.2f, cosf(angle), 1.0f);
+	context->constants[RasterConstantBuffer_Frame] = mat4_look_at_lh(eye, focus, vec4(0, 1, 0, 0));
+}
+
+int main(int argc, char** argv) {
+	u32 frames = 16;
+	u32 grid = MAX_GRID;
+	u32 width = 1280;
+	u32 height = 720;
+	const char* out_path = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--frames=", 9) == 0)      frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--grid=", 7) == 0)   grid = Clamp(2u, (u32)atoi(argv[i] + 7), (u32)MAX_GRID);
+		else if(strncmp(argv[i], "--size=", 7) == 0)   sscanf(argv[i] + 7, "%ux%u", &width, &height);
+		else if(strncmp(argv[i], "--out=", 6) == 0)    out_path = argv[i] + 6;
+		else {
+			printf("usage: raster_clip_bench [--frames=N] [--grid=N] [--size=WxH] [--out=frame.tga]\n");
+			return 1;
+		}
+	}
+
+	RasterTarget target;
+	if(!raster_target_alloc(&target, width, height)) {
+		printf("[ERROR] invalid target size %ux%u\n", width, height);
+		return 1;
+	}
+
+	Ground ground;
+	build_ground(&ground, grid);
+	u32 triangle_count = ground.index_count / 3;
+
+	RasterContext context;
+	raster_context_init(&context, &target);
+	context.vertices = ground.vertices;
+	context.vertex_count = ground.vertex_count;
+	context.indices = ground.indices;
+	context.constants[RasterConstantBuffer_Application] = mat4_perspective_fov_lh(3.14159265f / 2.0f, (f32)width / (f32)height, 0.1f, 120.0f);
+
+	// Room for every triangle to turn into a full fan.
+	u64 stream_size = ((u64)triangle_count + RASTER_CLIP_BATCH) * (RASTER_MAX_CLIP_VERTS - 2) * sizeof(RasterTriangle);
+	RasterTriangle* single = (RasterTriangle*)os_alloc_pages(stream_size);
+	RasterTriangle* batched = (RasterTriangle*)os_alloc_pages(stream_size);
+	memset(single, 0, stream_size);
+	memset(batched, 0, stream_size);
+
+	printf("%u triangles at %ux%u, %u frames, guard band %d pixels\n", triangle_count, width, height, frames, RASTER_GUARD_BAND);
+
+	f64 single_seconds = 0.0, batched_seconds = 0.0;
+	RasterStats total = {};
+	b32 all_match = true;
+	for(u32 frame = 0; frame < frames; frame++) {
+		set_camera(&context, frame, frames);
+
+		RasterStats single_stats = {};
+		u32 single_count = 0;
+		f64 start = os_now_seconds();
+		for(u32 t = 0; t < triangle_count; t++) {
+			single_count += raster_assemble_triangle(&context, t * 3, 0, &single[single_count], &single_stats);
+		}
+		f64 middle = os_now_seconds();
+		RasterStats batched_stats = {};
+		u32 batched_count = 0;
+		for(u32 t = 0; t < triangle_count; t += RASTER_CLIP_BATCH) {
+			u32 batch = Min(triangle_count - t, (u32)RASTER_CLIP_BATCH);
+			batched_count += raster_assemble_triangles(&context, t * 3, batch, 0, &batched[batched_count], &batched_stats);
+		}
+		f64 end = os_now_seconds();
+		single_seconds += middle - start;
+		batched_seconds += end - middle;
+
+		b32 match = single_count == batched_count && memcmp(single, batched, (u64)single_count * sizeof(RasterTriangle)) == 0 &&
+								memcmp(&single_stats, &batched_stats, sizeof(RasterStats)) == 0;
+		all_match = all_match && match;
+		printf("  frame %2u  %6llu culled, %5llu clipped, %5llu in the guard band, %6u set up, %s\n", frame,
+					 (unsigned long long)batched_stats.triangles_culled, (unsigned long long)batched_stats.triangles_clipped,
+					 (unsigned long long)batched_stats.triangles_guard_band, batched_count, match ? "matches" : "DIFFERS");
+		total.triangles += batched_stats.triangles;
+		total.triangles_culled += batched_stats.triangles_culled;
+		total.triangles_clipped += batched_stats.triangles_clipped;
+		total.triangles_guard_band += batched_stats.triangles_guard_band;
+	}
+
+	f64 input = (f64)triangle_count * frames;
+	printf("  single    %8.2f ms/frame, %6.2f Mtriangles/s\n", single_seconds * 1000.0 / frames, input / single_seconds / 1e6);
+	printf("  batched   %8.2f ms/frame, %6.2f Mtriangles/s, %.2fx\n", batched_seconds * 1000.0 / frames, input / batched_seconds / 1e6,
+				 single_seconds / batched_seconds);
+	printf("  %.1f%% culled, %.2f%% clipped, %.2f%% kept whole by the guard band instead of clipped\n",
+				 100.0 * total.triangles_culled / total.triangles, 100.0 * total.triangles_clipped / total.triangles,
+				 100.0 * total.triangles_guard_band / total.triangles);
+
+	if(out_path) {
+		MipChain mips;
+		mip_chain_alloc(&mips, 64, 64);
+		u32* texels = (u32*)mip_level_data(&mips, 0);
+		for(u32 y = 0; y < 64; y++) {
+			for(u32 x = 0; x < 64; x++) texels[y * 64 + x] = ((x / 8 + y / 8) & 1) ? 0xff3c7a4a : 0xff8cc08c;
+		}
+		MipSettings mip_settings = {};
+		mip_settings.filter = MipFilter_Box;
+		mip_generate(&mips, &mip_settings);
+		RasterTexture texture;
+		raster_texture_from_mips(&texture, &mips);
+
+		const f32 sky[4] = { 0.55f, 0.7f, 0.9f, 1.0f };
+		raster_clear(&target, sky, 1.0f, 0);
+		context.texture = &texture;
+		raster_draw_indexed(&context, ground.index_count, 0, 0);
+		if(!raster_write_colour_tga(&target, out_path)) printf("[ERROR] could not write %s\n", out_path);
+		else printf("  wrote     %s\n", out_path);
+		mip_chain_release(&mips);
+	}
+
+	os_free_pages(batched, stream_size);
+	os_free_pages(single, stream_size);
+	os_free_pages(ground.indices, (u64)ground.index_count * sizeof(u16));
+	os_free_pages(ground.vertices, (u64)ground.vertex_count * sizeof(RasterVertex));
+	raster_target_release(&target);
+
+	if(!all_match) {
+		printf("[ERROR] the batched front end differs from the single one\n");
+		return 1;
+	}
+	return 0;
+}
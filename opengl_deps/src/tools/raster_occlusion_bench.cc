@@ -0,0 +1,263 @@
+// Benchmark for software occlusion culling of draws (raster/occlusion.h).
+//
+// The scene is the field of spinning textured cubes of raster_tiles_bench
+// with a few large walls between it and the camera. Every frame is rendered
+// twice with raster_draw_indexed(), one draw per cube:
+//   all        every wall and every cube is drawn
+//   culled     the walls go into the occlusion buffer first, every cube's box
+//              is tested and only the visible ones are drawn
+// Nothing the walls hide is visible through a gap narrower than a buffer
+// pixel here, so both frames have to match bit for bit. Reports the
+// culled/visible counts, the CPU cost of the occluders and of the box tests,
+// and the frame time of both.
+//
+// Usage: raster_occlusion_bench [--cubes=N] [--frames=N] [--size=WxH] [--buffer=WxH]
+//                               [--out=frame.tga] [--hiz=tiles.tga]
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+#include "raster/raster.h"
+#include "raster/occlusion.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// hello.cc's cube, one quad per face so every face gets the whole texture.
+global const f32 g_corners[8][3] = {
+	{ -1.0f, -1.0f, -1.0f }, { -1.0f,  1.0f, -1.0f }, {  1.0f,  1.0f, -1.0f }, {  1.0f, -1.0f, -1.0f },
+	{ -1.0f, -1.0f,  1.0f }, { -1.0f,  1.0f,  1.0f }, {  1.0f,  1.0f,  1.0f }, {  1.0f, -1.0f,  1.0f },
+};
+global const u32 g_faces[6][4] = {
+	{ 0, 1, 2, 3 }, { 4, 7, 6, 5 }, { 4, 5, 1, 0 }, { 3, 2, 6, 7 }, { 1, 5, 6, 2 }, { 4, 0, 3, 7 },
+};
+
+global RasterVertex g_vertices[24];
+global u16 g_indices[36];
+
+internal void build_cube() {
+	const f32 uv[4][2] = { { 0.0f, 1.0f }, { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } };
+	for(u32 face = 0; face < 6; face++) {
+		for(u32 k = 0; k < 4; k++) {
+			RasterVertex* vertex = &g_vertices[face * 4 + k];
+			memcpy(vertex->position, g_corners[g_faces[face][k]], sizeof(vertex->position));
+			vertex->texture[0] = uv[k][0];
+			vertex->texture[1] = uv[k][1];
+		}
+		const u16 quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for(u32 k = 0; k < 6; k++) g_indices[face * 6 + k] = (u16)(face * 4 + quad[k]);
+	}
+}
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+struct Cube {
+	f32 position[3];
+	f32 scale;
+	f32 phase;
+};
+
+// Walls as scaled cubes: centre and half extents.
+global const f32 g_walls[][6] = {
+	{ -24.0f,   0.0f, 10.0f,  18.0f, 30.0f, 1.0f },
+	{  24.0f,   0.0f, 10.0f,  18.0f, 30.0f, 1.0f },
+	{   0.0f, -14.0f, 12.0f,  10.0f, 12.0f, 1.0f },
+	{   0.0f,  16.0f, 14.0f,  10.0f,  8.0f, 1.0f },
+};
+
+struct Scene {
+	Cube* cubes;
+	u32 cube_count;
+	Mat4 walls[ArrayCount(g_walls)];
+	RasterOcclusionBox* boxes;
+	b8* visible;
+	RasterContext context;
+};
+
+internal Mat4 cube_world(const Cube* cube, u32 frame) {
+	f32 angle = cube->phase + 3.0f * (f32)frame;
+	Mat4 scale = mat4_scaling(cube->scale, cube->scale, cube->scale);
+	Mat4 rotation = mat4_rotation_axis(2.0f, 1.0f, 0.0f, angle * 3.14159265f / 180.0f);
+	Mat4 translation = mat4_translation(cube->position[0], cube->position[1], cube->position[2]);
+	Mat4 world = mat4_mul(&scale, &rotation);
+	return mat4_mul(&world, &translation);
+}
+
+global const f32 g_clear_colour[4] = { 0.1f, 0.1f, 0.15f, 1.0f };
+
+// Walls first, then the cubes whose `visible` flag is set (all when null).
+internal void render_frame(Scene* scene, RasterTarget* target, u32 frame, const b8* visible) {
+	raster_clear(target, g_clear_colour, 1.0f, 0);
+	scene->context.stats = {};
+	for(u32 i = 0; i < ArrayCount(g_walls); i++) {
+		scene->context.constants[RasterConstantBuffer_Object] = scene->walls[i];
+		raster_draw_indexed(&scene->context, ArrayCount(g_indices), 0, 0);
+	}
+	for(u32 i = 0; i < scene->cube_count; i++) {
+		if(visible && !visible[i]) continue;
+		scene->context.constants[RasterConstantBuffer_Object] = cube_world(&scene->cubes[i], frame);
+		raster_draw_indexed(&scene->context, ArrayCount(g_indices), 0, 0);
+	}
+}
+
+internal void cull_frame(Scene* scene, RasterOcclusion* occlusion, u32 frame) {
+	raster_occlusion_begin(occlusion, &scene->context.constants[RasterConstantBuffer_Frame],
+												 &scene->context.constants[RasterConstantBuffer_Application]);
+	for(u32 i = 0; i < ArrayCount(g_walls); i++) {
+		raster_occlusion_add_occluder(occlusion, &scene->walls[i], g_vertices, ArrayCount(g_vertices), g_indices, ArrayCount(g_indices));
+	}
+	raster_occlusion_build(occlusion);
+
+	for(u32 i = 0; i < scene->cube_count; i++) {
+		RasterOcclusionBox* box = &scene->boxes[i];
+		box->world = cube_world(&scene->cubes[i], frame);
+		for(u32 k = 0; k < 3; k++) {
+			box->min[k] = -1.0f;
+			box->max[k] = 1.0f;
+		}
+	}
+	raster_occlusion_test_boxes(occlusion, scene->boxes, scene->cube_count, scene->visible);
+}
+
+int main(int argc, char** argv) {
+	u32 cube_count = 4000;
+	u32 frames = 5;
+	u32 width = 1280;
+	u32 height = 720;
+	u32 buffer_width = 320;
+	u32 buffer_height = 184;
+	const char* out_path = 0;
+	const char* hiz_path = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--cubes=", 8) == 0)        cube_count = Max((u32)atoi(argv[i] + 8), 1u);
+		else if(strncmp(argv[i], "--frames=", 9) == 0)  frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--size=", 7) == 0)    sscanf(argv[i] + 7, "%ux%u", &width, &height);
+		else if(strncmp(argv[i], "--buffer=", 9) == 0)  sscanf(argv[i] + 9, "%ux%u", &buffer_width, &buffer_height);
+		else if(strncmp(argv[i], "--out=", 6) == 0)     out_path = argv[i] + 6;
+		else if(strncmp(argv[i], "--hiz=", 6) == 0)     hiz_path = argv[i] + 6;
+		else {
+			printf("usage: raster_occlusion_bench [--cubes=N] [--frames=N] [--size=WxH] [--buffer=WxH] [--out=frame.tga] [--hiz=tiles.tga]\n");
+			return 1;
+		}
+	}
+
+	RasterTarget reference, target;
+	if(!raster_target_alloc(&reference, width, height) || !raster_target_alloc(&target, width, height)) {
+		printf("[ERROR] invalid target size %ux%u\n", width, height);
+		return 1;
+	}
+	RasterOcclusion occlusion;
+	if(!raster_occlusion_init(&occlusion, buffer_width, buffer_height)) {
+		printf("[ERROR] invalid occlusion buffer size %ux%u (multiples of %u)\n", buffer_width, buffer_height, RASTER_BLOCK_SIZE);
+		return 1;
+	}
+
+	MipChain mips;
+	mip_chain_alloc(&mips, 256, 256);
+	u32* texels = (u32*)mip_level_data(&mips, 0);
+	for(u32 y = 0; y < 256; y++) {
+		for(u32 x = 0; x < 256; x++) texels[y * 256 + x] = ((x / 32 + y / 32) & 1) ? 0xffc06030 : 0xffe0e0e0;
+	}
+	MipSettings mip_settings = {};
+	mip_settings.filter = MipFilter_Box;
+	mip_generate(&mips, &mip_settings);
+	RasterTexture texture;
+	raster_texture_from_mips(&texture, &mips);
+
+	build_cube();
+	Scene scene = {};
+	scene.cube_count = cube_count;
+	scene.cubes = (Cube*)os_alloc_pages(cube_count * sizeof(Cube));
+	scene.boxes = (RasterOcclusionBox*)os_alloc_pages(cube_count * sizeof(RasterOcclusionBox));
+	scene.visible = (b8*)os_alloc_pages(cube_count);
+	u32 seed = 1234;
+	for(u32 i = 0; i < cube_count; i++) {
+		Cube* cube = &scene.cubes[i];
+		cube->position[0] = random_range(&seed, -40.0f, 40.0f);
+		cube->position[1] = random_range(&seed, -22.0f, 22.0f);
+		cube->position[2] = random_range(&seed, 20.0f, 60.0f);
+		cube->scale = random_range(&seed, 0.4f, 1.2f);
+		cube->phase = random_range(&seed, 0.0f, 360.0f);
+	}
+	for(u32 i = 0; i < ArrayCount(g_walls); i++) {
+		const f32* wall = g_walls[i];
+		Mat4 scale = mat4_scaling(wall[3], wall[4], wall[5]);
+		Mat4 translation = mat4_translation(wall[0], wall[1], wall[2]);
+		scene.walls[i] = mat4_mul(&scale, &translation);
+	}
+
+	RasterContext* context = &scene.context;
+	raster_context_init(context, &reference);
+	context->vertices = g_vertices;
+	context->vertex_count = ArrayCount(g_vertices);
+	context->indices = g_indices;
+	context->texture = &texture;
+	context->cull = RasterCull_Back;
+	context->constants[RasterConstantBuffer_Application] = mat4_perspective_fov_lh(3.14159265f / 2.0f, (f32)width / (f32)height, 0.1f, 1000.0f);
+	context->constants[RasterConstantBuffer_Frame] = mat4_look_at_lh(vec4(0, 0, -10, 1), vec4(0, 0, 0, 1), vec4(0, 1, 0, 0));
+
+	printf("%u cubes behind %u walls at %ux%u, %u frames, occlusion buffer %ux%u (%ux%u tiles, %u levels)\n", cube_count,
+				 (u32)ArrayCount(g_walls), width, height, frames, buffer_width, buffer_height, occlusion.tiles_x, occlusion.tiles_y,
+				 occlusion.level_count);
+
+	f64 all_seconds = 0.0, culled_seconds = 0.0, occluder_seconds = 0.0, test_seconds = 0.0;
+	u64 visible_total = 0, occluded_total = 0, outside_total = 0;
+	b32 all_match = true;
+	for(u32 frame = 0; frame < frames; frame++) {
+		context->target = &reference;
+		f64 start = os_now_seconds();
+		render_frame(&scene, &reference, frame, 0);
+		all_seconds += os_now_seconds() - start;
+
+		context->target = &target;
+		start = os_now_seconds();
+		cull_frame(&scene, &occlusion, frame);
+		render_frame(&scene, &target, frame, scene.visible);
+		culled_seconds += os_now_seconds() - start;
+
+		const RasterOcclusionStats* stats = &occlusion.stats;
+		occluder_seconds += stats->occluder_seconds;
+		test_seconds += stats->test_seconds;
+		visible_total += stats->visible;
+		occluded_total += stats->occluded;
+		outside_total += stats->outside;
+
+		b32 match = memcmp(target.colour, reference.colour, (u64)width * height * 4) == 0 &&
+								memcmp(target.depth, reference.depth, (u64)width * height * 4) == 0;
+		all_match = all_match && match;
+		printf("  frame %2u   %5llu visible, %5llu occluded, %5llu outside, occluders %.3f ms (%llu triangles), tests %.3f ms, %s\n",
+					 frame, (unsigned long long)stats->visible, (unsigned long long)stats->occluded, (unsigned long long)stats->outside,
+					 stats->occluder_seconds * 1000.0, (unsigned long long)stats->occluder_triangles, stats->test_seconds * 1000.0,
+					 match ? "matches" : "DIFFERS");
+	}
+
+	u64 tested = (u64)cube_count * frames;
+	printf("  culled    %.1f%% of the cubes (%.1f%% occluded, %.1f%% outside)\n", 100.0 * (occluded_total + outside_total) / tested,
+				 100.0 * occluded_total / tested, 100.0 * outside_total / tested);
+	printf("  cost      occluders %.3f ms/frame, tests %.3f ms/frame (%.1f ns per box)\n", occluder_seconds * 1000.0 / frames,
+				 test_seconds * 1000.0 / frames, test_seconds * 1e9 / tested);
+	printf("  all       %8.2f ms/frame (%u draws)\n", all_seconds * 1000.0 / frames, cube_count + (u32)ArrayCount(g_walls));
+	printf("  culled    %8.2f ms/frame (%.0f draws, test included), %.2fx\n", culled_seconds * 1000.0 / frames,
+				 (f64)visible_total / frames + ArrayCount(g_walls), all_seconds / culled_seconds);
+
+	if(out_path && !raster_write_colour_tga(&target, out_path)) printf("[ERROR] could not write %s\n", out_path);
+	if(hiz_path && !raster_occlusion_write_tga(&occlusion, hiz_path)) printf("[ERROR] could not write %s\n", hiz_path);
+	if(!all_match) printf("[ERROR] culled frames differ from the full ones\n");
+
+	os_free_pages(scene.visible, cube_count);
+	os_free_pages(scene.boxes, cube_count * sizeof(RasterOcclusionBox));
+	os_free_pages(scene.cubes, cube_count * sizeof(Cube));
+	raster_occlusion_release(&occlusion);
+	mip_chain_release(&mips);
+	raster_target_release(&target);
+	raster_target_release(&reference);
+	return all_match ? 0 : 1;
+}
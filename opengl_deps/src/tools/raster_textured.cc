@@ -0,0 +1,251 @@
+// Headless run of the textured sample on the software rasterizer (raster/raster.h).
+//
+// Sets up the scene of d3d11/src/textured.cc: the same triangle, camera,
+// 90 degree projection and spin around Y at 90 degrees a second, the three
+// matrix constant buffers, a LESS depth test and a trilinear WRAP sampler
+// over the stone texture with its mip chain. Renders --frames frames at the
+// sample's fixed 1/30 s step, times each one, writes the last frame out as a
+// TGA and optionally checks it against a golden image.
+//
+// The texture is loaded up front instead of streamed, every run renders the
+// same frames.
+//
+// Usage: raster_textured <data.pak|texture.tga|texture.ctex> [--frames=N] [--size=WxH]
+//                        [--out=frame.tga] [--depth=depth.tga] [--golden=golden.tga] [--tolerance=N]
+//   data.pak     uses stone01.ctex when it is RGBA8, stone01.tga otherwise
+//   --frames     frames to render, 100 by default (the last one is written)
+//   --size       target size, 1280x720 (the sample's window) by default
+//   --golden     fails when any channel of any pixel differs by more than --tolerance (default 0)
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "asset/pack.h"
+#include "texture/tga.h"
+#include "texture/mips.h"
+#include "texture/cooked.h"
+#include "raster/raster.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+global RasterVertex g_vertices[3] = {
+	{ { -1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f } }, // Bottom-left
+	{ {  0.0f,  1.0f, 0.0f }, { 0.5f, 0.0f } }, // Top-center
+	{ {  1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f } }  // Bottom-right
+};
+
+global u16 g_indices[3] = { 0, 1, 2 };
+
+internal b32 has_extension(const char* path, const char* extension) {
+	u64 path_length = strlen(path);
+	u64 extension_length = strlen(extension);
+	if(path_length < extension_length) return false;
+	const char* at = path + path_length - extension_length;
+	for(u64 i = 0; i < extension_length; i++) {
+		char c = at[i];
+		if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		if(c != extension[i]) return false;
+	}
+	return true;
+}
+
+// Decodes a TGA and builds its chain the way the streamer does (Lanczos, sRGB).
+internal b32 load_tga(MipChain* chain, const u8* data, u64 size) {
+	TGAImage image;
+	if(!tga_parse(&image, data, size) || !mip_chain_alloc(chain, image.width, image.height)) return false;
+	if(!tga_decode_rgba8(&image, mip_level_data(chain, 0), chain->levels[0].row_pitch)) {
+		mip_chain_release(chain);
+		return false;
+	}
+	MipSettings settings = {};
+	settings.filter = MipFilter_Lanczos;
+	settings.srgb = true;
+	mip_generate(chain, &settings);
+	return true;
+}
+
+struct TextureSource {
+	OS_FileMap file;
+	Pack pack;
+	CookedTexture cooked;
+	MipChain mips;
+};
+
+internal b32 load_texture(RasterTexture* texture, TextureSource* source, const char* path) {
+	*source = {};
+	if(has_extension(path, ".pak")) {
+		if(!pack_open(&source->pack, path)) return false;
+		PackSpan cooked = pack_find(&source->pack, "stone01.ctex");
+		if(cooked.data && cooked_texture_from_memory(&source->cooked, cooked.data, cooked.size) &&
+			 raster_texture_from_cooked(texture, &source->cooked)) {
+			return true;
+		}
+		PackSpan tga = pack_find(&source->pack, "stone01.tga");
+		if(!tga.data || !load_tga(&source->mips, tga.data, tga.size)) return false;
+	} else if(has_extension(path, ".ctex")) {
+		return cooked_texture_open(&source->cooked, path) && raster_texture_from_cooked(texture, &source->cooked);
+	} else {
+		if(!os_file_map_open(&source->file, path)) return false;
+		if(!load_tga(&source->mips, source->file.data, source->file.size)) return false;
+	}
+	raster_texture_from_mips(texture, &source->mips);
+	return true;
+}
+
+internal void release_texture(TextureSource* source) {
+	if(source->mips.data) mip_chain_release(&source->mips);
+	cooked_texture_close(&source->cooked);
+	pack_close(&source->pack);
+	os_file_map_close(&source->file);
+}
+
+// Per channel comparison of the colour target against a TGA. Returns the
+// number of pixels that are off by more than `tolerance`, or -1 if the golden
+// image can not be read or has a different size.
+internal s64 compare_golden(const RasterTarget* target, const char* path, u32 tolerance, u32* max_difference) {
+	OS_FileMap file;
+	if(!os_file_map_open(&file, path)) return -1;
+
+	TGAImage image;
+	u8* pixels = 0;
+	u64 size = (u64)target->width * target->height * 4;
+	b32 ok = tga_parse(&image, file.data, file.size) && image.width == target->width && image.height == target->height;
+	if(ok) {
+		pixels = (u8*)os_alloc_pages(size);
+		ok = tga_decode_rgba8(&image, pixels, (u64)image.width * 4);
+	}
+	os_file_map_close(&file);
+
+	s64 mismatched = -1;
+	*max_difference = 0;
+	if(ok) {
+		mismatched = 0;
+		const u8* rendered = (const u8*)target->colour;
+		for(u64 i = 0; i < size; i += 4) {
+			u32 worst = 0;
+			for(u32 c = 0; c < 4; c++) worst = Max(worst, (u32)abs((s32)rendered[i + c] - (s32)pixels[i + c]));
+			*max_difference = Max(*max_difference, worst);
+			if(worst > tolerance) mismatched++;
+		}
+	}
+	if(pixels) os_free_pages(pixels, size);
+	return mismatched;
+}
+
+int main(int argc, char** argv) {
+	const char* path = 0;
+	const char* out_path = "raster_textured.tga";
+	const char* depth_path = 0;
+	const char* golden_path = 0;
+	u32 frames = 100;
+	u32 width = 1280;
+	u32 height = 720;
+	u32 tolerance = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--frames=", 9) == 0)          frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--size=", 7) == 0)       sscanf(argv[i] + 7, "%ux%u", &width, &height);
+		else if(strncmp(argv[i], "--out=", 6) == 0)        out_path = argv[i] + 6;
+		else if(strncmp(argv[i], "--depth=", 8) == 0)      depth_path = argv[i] + 8;
+		else if(strncmp(argv[i], "--golden=", 9) == 0)     golden_path = argv[i] + 9;
+		else if(strncmp(argv[i], "--tolerance=", 12) == 0) tolerance = (u32)atoi(argv[i] + 12);
+		else path = argv[i];
+	}
+	if(!path) {
+		printf("usage: raster_textured <data.pak|texture.tga|texture.ctex> [--frames=N] [--size=WxH]\n"
+					 "                       [--out=frame.tga] [--depth=depth.tga] [--golden=golden.tga] [--tolerance=N]\n");
+		return 1;
+	}
+
+	RasterTexture texture;
+	TextureSource source;
+	if(!load_texture(&texture, &source, path)) {
+		printf("[ERROR] could not load the stone texture from %s\n", path);
+		return 1;
+	}
+
+	RasterTarget target;
+	if(!raster_target_alloc(&target, width, height)) {
+		printf("[ERROR] invalid target size %ux%u\n", width, height);
+		return 1;
+	}
+
+	RasterContext context;
+	raster_context_init(&context, &target);
+	context.vertices = g_vertices;
+	context.vertex_count = ArrayCount(g_vertices);
+	context.indices = g_indices;
+	context.texture = &texture;
+
+	// setup_projection()
+	const f32 pi = 3.14159265358979f;
+	context.constants[RasterConstantBuffer_Application] = mat4_perspective_fov_lh(90.0f * pi / 180.0f, (f32)width / (f32)height, 0.1f, 10.0f);
+
+	const f32 dt = 1.0f / 30.0f;
+	f32 angle = 0.0f;
+	f64 total = 0.0, fastest = 1e9, slowest = 0.0;
+	for(u32 frame = 0; frame < frames; frame++) {
+		f64 start = os_now_seconds();
+
+		// Update()
+		context.constants[RasterConstantBuffer_Frame] = mat4_look_at_lh(vec4(0, 0, 2.6f, 1), vec4(0, 0, 0, 1), vec4(0, 1, 1, 0));
+		angle += 90.0f * dt;
+		if(angle > 360.0f) angle -= 360.0f;
+		context.constants[RasterConstantBuffer_Object] = mat4_rotation_axis(0, 1, 0, angle * pi / 180.0f);
+
+		// Render()
+		f32 black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		context.stats = {};
+		raster_clear(&target, black, 1.0f, 0);
+		raster_draw_indexed(&context, ArrayCount(g_indices), 0, 0);
+
+		f64 elapsed = os_now_seconds() - start;
+		total += elapsed;
+		fastest = Min(fastest, elapsed);
+		slowest = Max(slowest, elapsed);
+	}
+
+	const RasterStats* stats = &context.stats;
+	printf("%u frames at %ux%u, %u texture levels of %ux%u\n", frames, width, height, texture.level_count,
+				 texture.levels[0].width, texture.levels[0].height);
+	printf("  frame     %8.3f ms avg, %.3f ms min, %.3f ms max (%.0f fps)\n", total * 1000.0 / frames, fastest * 1000.0,
+				 slowest * 1000.0, frames / total);
+	printf("  last      angle %.1f, %llu triangles (%llu clipped, %llu culled), %llu pixels covered, %llu depth failed, %llu written\n",
+				 angle, (unsigned long long)stats->triangles, (unsigned long long)stats->triangles_clipped,
+				 (unsigned long long)stats->triangles_culled, (unsigned long long)stats->pixels_covered,
+				 (unsigned long long)stats->pixels_depth_failed, (unsigned long long)stats->pixels_written);
+
+	int result = 0;
+	if(!raster_write_colour_tga(&target, out_path)) {
+		printf("[ERROR] could not write %s\n", out_path);
+		result = 1;
+	} else {
+		printf("  wrote     %s\n", out_path);
+	}
+	if(depth_path) {
+		if(!raster_write_depth_tga(&target, depth_path)) {
+			printf("[ERROR] could not write %s\n", depth_path);
+			result = 1;
+		} else {
+			printf("  wrote     %s\n", depth_path);
+		}
+	}
+
+	if(golden_path) {
+		u32 max_difference;
+		s64 mismatched = compare_golden(&target, golden_path, tolerance, &max_difference);
+		if(mismatched < 0) {
+			printf("[ERROR] could not read %s or its size is not %ux%u\n", golden_path, width, height);
+			result = 1;
+		} else if(mismatched > 0) {
+			printf("[ERROR] %lld pixels differ from %s by more than %u (max %u)\n", (long long)mismatched, golden_path, tolerance, max_difference);
+			result = 1;
+		} else {
+			printf("  golden    matches %s (max difference %u)\n", golden_path, max_difference);
+		}
+	}
+
+	raster_target_release(&target);
+	release_texture(&source);
+	return result;
+}
@@ -0,0 +1,264 @@
+// Benchmark for tile-binned rasterization (raster/bin.h).
+//
+// Draws a field of the textured cubes of d3d11/src/hello.cc (same corners
+// and index order, back faces culled, 90 degree projection looking down +Z
+// from z = -10), every one spinning about (2, 1, 0) with its own world matrix
+// and draw call. The scene is rendered once through raster_draw_indexed() as
+// the single threaded reference, then through the binner with 1, 2, 4, ...
+// up to --threads workers. Every binned frame has to match the reference bit
+// for bit. Reports frame, front end and tile pass times with the speedup
+// over one worker, and the per-tile timing of the widest run as a
+// distribution and a map of the screen.
+//
+// Usage: raster_tiles_bench [--cubes=N] [--frames=N] [--threads=N] [--size=WxH] [--out=frame.tga]
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/mips.h"
+#include "raster/raster.h"
+#include "raster/bin.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// hello.cc's cube, one quad per face (corners a, b, c, d drawn as abc, acd) so
+// every face gets the whole texture.
+global const f32 g_corners[8][3] = {
+	{ -1.0f, -1.0f, -1.0f }, { -1.0f,  1.0f, -1.0f }, {  1.0f,  1.0f, -1.0f }, {  1.0f, -1.0f, -1.0f },
+	{ -1.0f, -1.0f,  1.0f }, { -1.0f,  1.0f,  1.0f }, {  1.0f,  1.0f,  1.0f }, {  1.0f, -1.0f,  1.0f },
+};
+global const u32 g_faces[6][4] = {
+	{ 0, 1, 2, 3 }, { 4, 7, 6, 5 }, { 4, 5, 1, 0 }, { 3, 2, 6, 7 }, { 1, 5, 6, 2 }, { 4, 0, 3, 7 },
+};
+
+global RasterVertex g_vertices[24];
+global u16 g_indices[36];
+
+internal void build_cube() {
+	const f32 uv[4][2] = { { 0.0f, 1.0f }, { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } };
+	for(u32 face = 0; face < 6; face++) {
+		for(u32 k = 0; k < 4; k++) {
+			RasterVertex* vertex = &g_vertices[face * 4 + k];
+			memcpy(vertex->position, g_corners[g_faces[face][k]], sizeof(vertex->position));
+			vertex->texture[0] = uv[k][0];
+			vertex->texture[1] = uv[k][1];
+		}
+		const u16 quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for(u32 k = 0; k < 6; k++) g_indices[face * 6 + k] = (u16)(face * 4 + quad[k]);
+	}
+}
+
+struct Cube {
+	f32 position[3];
+	f32 scale;
+	f32 phase;
+};
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+struct Scene {
+	Cube* cubes;
+	u32 cube_count;
+	RasterContext context;
+};
+
+internal void set_cube(Scene* scene, u32 index, u32 frame) {
+	const Cube* cube = &scene->cubes[index];
+	f32 angle = cube->phase + 3.0f * (f32)frame;
+	Mat4 scale = mat4_scaling(cube->scale, cube->scale, cube->scale);
+	Mat4 rotation = mat4_rotation_axis(2.0f, 1.0f, 0.0f, angle * 3.14159265f / 180.0f);
+	Mat4 translation = mat4_translation(cube->position[0], cube->position[1], cube->position[2]);
+	Mat4 world = mat4_mul(&scale, &rotation);
+	scene->context.constants[RasterConstantBuffer_Object] = mat4_mul(&world, &translation);
+}
+
+global const f32 g_clear_colour[4] = { 0.1f, 0.1f, 0.15f, 1.0f };
+
+internal void render_reference(Scene* scene, RasterTarget* target, u32 frame) {
+	raster_clear(target, g_clear_colour, 1.0f, 0);
+	scene->context.stats = {};
+	for(u32 i = 0; i < scene->cube_count; i++) {
+		set_cube(scene, i, frame);
+		raster_draw_indexed(&scene->context, ArrayCount(g_indices), 0, 0);
+	}
+}
+
+internal b32 render_binned(Scene* scene, RasterBinner* binner, u32 frame) {
+	raster_bin_clear(binner, g_clear_colour, 1.0f, 0);
+	for(u32 i = 0; i < scene->cube_count; i++) {
+		set_cube(scene, i, frame);
+		if(!raster_bin_draw_indexed(binner, &scene->context, ArrayCount(g_indices), 0, 0)) return false;
+	}
+	return raster_bin_flush(binner);
+}
+
+internal int compare_f64(const void* a, const void* b) {
+	f64 x = *(const f64*)a, y = *(const f64*)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	u32 cube_count = 4000;
+	u32 frames = 5;
+	u32 max_threads = os_logical_core_count();
+	u32 width = 1280;
+	u32 height = 720;
+	const char* out_path = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--cubes=", 8) == 0)          cube_count = Max((u32)atoi(argv[i] + 8), 1u);
+		else if(strncmp(argv[i], "--frames=", 9) == 0)    frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0)  max_threads = Clamp(1u, (u32)atoi(argv[i] + 10), (u32)RASTER_MAX_WORKERS);
+		else if(strncmp(argv[i], "--size=", 7) == 0)      sscanf(argv[i] + 7, "%ux%u", &width, &height);
+		else if(strncmp(argv[i], "--out=", 6) == 0)       out_path = argv[i] + 6;
+		else {
+			printf("usage: raster_tiles_bench [--cubes=N] [--frames=N] [--threads=N] [--size=WxH] [--out=frame.tga]\n");
+			return 1;
+		}
+	}
+
+	RasterTarget reference, target;
+	if(!raster_target_alloc(&reference, width, height) || !raster_target_alloc(&target, width, height)) {
+		printf("[ERROR] invalid target size %ux%u\n", width, height);
+		return 1;
+	}
+
+	// A 256x256 checker with a full chain, so minification goes through the mips.
+	MipChain mips;
+	mip_chain_alloc(&mips, 256, 256);
+	u32* texels = (u32*)mip_level_data(&mips, 0);
+	for(u32 y = 0; y < 256; y++) {
+		for(u32 x = 0; x < 256; x++) texels[y * 256 + x] = ((x / 32 + y / 32) & 1) ? 0xffc06030 : 0xffe0e0e0;
+	}
+	MipSettings mip_settings = {};
+	mip_settings.filter = MipFilter_Box;
+	mip_generate(&mips, &mip_settings);
+	RasterTexture texture;
+	raster_texture_from_mips(&texture, &mips);
+
+	build_cube();
+	Scene scene = {};
+	scene.cube_count = cube_count;
+	scene.cubes = (Cube*)os_alloc_pages(cube_count * sizeof(Cube));
+	u32 seed = 1234;
+	for(u32 i = 0; i < cube_count; i++) {
+		Cube* cube = &scene.cubes[i];
+		cube->position[0] = random_range(&seed, -40.0f, 40.0f);
+		cube->position[1] = random_range(&seed, -22.0f, 22.0f);
+		cube->position[2] = random_range(&seed, 5.0f, 60.0f);
+		cube->scale = random_range(&seed, 0.4f, 1.2f);
+		cube->phase = random_range(&seed, 0.0f, 360.0f);
+	}
+
+	RasterContext* context = &scene.context;
+	raster_context_init(context, &reference);
+	context->vertices = g_vertices;
+	context->vertex_count = ArrayCount(g_vertices);
+	context->indices = g_indices;
+	context->texture = &texture;
+	context->cull = RasterCull_Back;
+	context->constants[RasterConstantBuffer_Application] = mat4_perspective_fov_lh(3.14159265f / 2.0f, (f32)width / (f32)height, 0.1f, 1000.0f);
+	context->constants[RasterConstantBuffer_Frame] = mat4_look_at_lh(vec4(0, 0, -10, 1), vec4(0, 0, 0, 1), vec4(0, 1, 0, 0));
+
+	printf("%u cubes (%u triangles) at %ux%u, %u frames, %ux%u tiles of %u pixels\n", cube_count, cube_count * 12, width, height,
+				 frames, (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE, (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE, RASTER_TILE_SIZE);
+
+	// Reference, last frame kept for comparison.
+	f64 reference_seconds = 0.0;
+	for(u32 frame = 0; frame < frames; frame++) {
+		f64 start = os_now_seconds();
+		render_reference(&scene, &reference, frame);
+		reference_seconds += os_now_seconds() - start;
+	}
+	const RasterStats* stats = &context->stats;
+	printf("  triangles %llu, %llu culled, %llu clipped, %llu pixels covered, %llu depth failed, %llu written\n",
+				 (unsigned long long)stats->triangles, (unsigned long long)stats->triangles_culled,
+				 (unsigned long long)stats->triangles_clipped, (unsigned long long)stats->pixels_covered,
+				 (unsigned long long)stats->pixels_depth_failed, (unsigned long long)stats->pixels_written);
+	printf("  reference     %8.2f ms/frame (raster_draw_indexed, one thread)\n", reference_seconds * 1000.0 / frames);
+
+	u32 counts[16];
+	u32 count_total = 0;
+	for(u32 threads = 1; threads < max_threads && count_total < ArrayCount(counts) - 1; threads *= 2) counts[count_total++] = threads;
+	counts[count_total++] = max_threads;
+
+	RasterBinner binner;
+	f64 single_seconds = 0.0;
+	b32 all_match = true;
+	for(u32 c = 0; c < count_total; c++) {
+		u32 threads = counts[c];
+		if(!raster_binner_init(&binner, &target, threads)) {
+			printf("[ERROR] could not allocate the binner\n");
+			return 1;
+		}
+		f64 total = 0.0, front_end = 0.0, back_end = 0.0;
+		for(u32 frame = 0; frame < frames; frame++) {
+			f64 start = os_now_seconds();
+			if(!render_binned(&scene, &binner, frame)) {
+				printf("[ERROR] out of memory binning frame %u\n", frame);
+				return 1;
+			}
+			total += os_now_seconds() - start;
+			front_end += binner.front_end_seconds;
+			back_end += binner.back_end_seconds;
+		}
+		if(threads == 1) single_seconds = total;
+
+		b32 match = memcmp(target.colour, reference.colour, (u64)width * height * 4) == 0 &&
+								memcmp(target.depth, reference.depth, (u64)width * height * 4) == 0;
+		all_match = all_match && match;
+		printf("  %2u threads    %8.2f ms/frame (front end %6.2f, tiles %6.2f), %5.2fx over 1 thread, %.2fx over reference, %s\n",
+					 threads, total * 1000.0 / frames, front_end * 1000.0 / frames, back_end * 1000.0 / frames,
+					 single_seconds / total, reference_seconds / total, match ? "matches" : "DIFFERS");
+		if(c + 1 < count_total) raster_binner_release(&binner);
+	}
+
+	// Per-tile timing of the widest run's last frame.
+	u32 tile_count = binner.tile_count;
+	f64* sorted = (f64*)os_alloc_pages(tile_count * sizeof(f64));
+	f64 tile_sum = 0.0;
+	u32 most_triangles = 0;
+	for(u32 i = 0; i < tile_count; i++) {
+		sorted[i] = binner.tile_timings[i].seconds;
+		tile_sum += sorted[i];
+		most_triangles = Max(most_triangles, binner.tile_timings[i].triangles);
+	}
+	qsort(sorted, tile_count, sizeof(f64), compare_f64);
+	f64 slowest = sorted[tile_count - 1];
+	printf("  tiles         %u, %.3f ms min, %.3f ms median, %.3f ms p95, %.3f ms max, %.3f ms sum; %llu binned, %u max per tile\n",
+				 tile_count, sorted[0] * 1000.0, sorted[tile_count / 2] * 1000.0, sorted[(tile_count * 95) / 100] * 1000.0,
+				 slowest * 1000.0, tile_sum * 1000.0, (unsigned long long)binner.binned, most_triangles);
+	printf("                slowest tile is %.1f%% of the tile pass on %u threads (ideal share %.1f%%)\n",
+				 100.0 * slowest / Max(binner.back_end_seconds, 1e-9), max_threads, 100.0 / max_threads);
+
+	// Tile cost map, one character per tile, relative to the slowest one.
+	const char ramp[] = " .:-=+*#%@";
+	for(u32 ty = 0; ty < binner.tiles_y; ty++) {
+		char line[256];
+		u32 length = 0;
+		for(u32 tx = 0; tx < binner.tiles_x && length < sizeof(line) - 1; tx++) {
+			f64 t = binner.tile_timings[ty * binner.tiles_x + tx].seconds / Max(slowest, 1e-12);
+			line[length++] = ramp[Min((u32)(t * (ArrayCount(ramp) - 2) + 0.5), (u32)ArrayCount(ramp) - 2)];
+		}
+		line[length] = 0;
+		printf("                |%s|\n", line);
+	}
+
+	if(out_path && !raster_write_colour_tga(&target, out_path)) printf("[ERROR] could not write %s\n", out_path);
+	if(!all_match) printf("[ERROR] binned frames differ from the reference\n");
+
+	os_free_pages(sorted, tile_count * sizeof(f64));
+	raster_binner_release(&binner);
+	os_free_pages(scene.cubes, cube_count * sizeof(Cube));
+	mip_chain_release(&mips);
+	raster_target_release(&reference);
+	raster_target_release(&target);
+	return all_match ? 0 : 1;
+}
@@ -0,0 +1,670 @@
+// Benchmark and self-check for the redundant-state cache (gfx/state.h,
+// gl/state.h).
+//
+// A scene of --draws quads, each with a random program, texture and mesh out
+// of --shaders, --textures and --meshes, each in its own cell of a grid, so
+// the image does not depend on the order they are drawn in. It is drawn
+// three ways:
+//   every draw    each draw binds everything it uses (framebuffer, viewport,
+//                 depth and blend, program, uniform buffer, vertex array,
+//                 texture), straight to GL
+//   + cache       the same binds through the cache
+//   queue + cache sorted and submitted by gfx/queue.h, frame-wide state bound
+//                 once a frame, everything through the cache
+// Every GL entry point the scene uses is wrapped to count the calls that
+// reach the driver. Reported per frame: those calls, what the cache let
+// through and dropped, and the time.
+//
+// The GL run is headless, EGL on Linux (llvmpipe works), a hidden GLFW window
+// on Windows, into a framebuffer that is read back after every way of
+// drawing: the images must be the same. After the cached runs, what the cache
+// believes is bound is compared with what GL reports. Without a context, or
+// with --null, GL is left out: the counting wrappers are the whole driver and
+// resources come from gfx/null.h, which still measures the calls and the
+// cache's own cost.
+//
+// Usage: state_bench [--draws=N] [--shaders=N] [--textures=N] [--meshes=N] [--frames=N] [--null]
+
+#include "basic/types.h"
+#include "gfx/resources.h"
+#include "gfx/queue.h"
+#include "gfx/null.h"
+#include "gfx/state.h"
+#include "platform/os.h"
+
+#include "third_party/glad/glad.h"
+#include "third_party/glad/glad.c"
+
+#if OS_WINDOWS
+	#include "third_party/glfw/glfw3.h"
+	#pragma comment(lib, "../src/third_party/glfw/glfw3_mt")
+	#pragma comment(lib, "user32")
+	#pragma comment(lib, "gdi32")
+	#pragma comment(lib, "shell32")
+#else
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
+#include "gl/gfx.h"
+#include "gl/state.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_SHADERS  64
+#define IMAGE_SIZE   256
+
+//------------------------------------------------------------------------
+// Headless context
+//------------------------------------------------------------------------
+
+#if OS_WINDOWS
+internal b32 create_context() {
+	if(!glfwInit()) return false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow* window = glfwCreateWindow(IMAGE_SIZE, IMAGE_SIZE, "state_bench", nullptr, nullptr);
+	if(!window) return false;
+	glfwMakeContextCurrent(window);
+	return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+}
+#else
+internal b32 create_context() {
+	// Surfaceless first, it needs neither X nor a GPU node.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if(display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) return false;
+	if(!eglBindAPI(EGL_OPENGL_API)) return false;
+
+	EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+	EGLConfig config;
+	EGLint config_count = 0;
+	if(!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) return false;
+
+	EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return false;
+	return gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+}
+#endif
+
+//------------------------------------------------------------------------
+// Counted entry points
+//------------------------------------------------------------------------
+
+// Every call the scene makes lands here first. Without a context the real
+// entry points are null and the count is all that happens.
+global u64 g_api_calls;
+
+#define COUNTED_GL(name, type, params, args) \
+	global type real_##name; \
+	internal void APIENTRY counted_##name params { g_api_calls++; if(real_##name) real_##name args; }
+
+COUNTED_GL(glUseProgram, PFNGLUSEPROGRAMPROC, (GLuint program), (program))
+COUNTED_GL(glBindVertexArray, PFNGLBINDVERTEXARRAYPROC, (GLuint array), (array))
+COUNTED_GL(glActiveTexture, PFNGLACTIVETEXTUREPROC, (GLenum unit), (unit))
+COUNTED_GL(glBindTexture, PFNGLBINDTEXTUREPROC, (GLenum target, GLuint texture), (target, texture))
+COUNTED_GL(glBindBufferBase, PFNGLBINDBUFFERBASEPROC, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer))
+COUNTED_GL(glBindFramebuffer, PFNGLBINDFRAMEBUFFERPROC, (GLenum target, GLuint framebuffer), (target, framebuffer))
+COUNTED_GL(glViewport, PFNGLVIEWPORTPROC, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+COUNTED_GL(glEnable, PFNGLENABLEPROC, (GLenum capability), (capability))
+COUNTED_GL(glDisable, PFNGLDISABLEPROC, (GLenum capability), (capability))
+COUNTED_GL(glClear, PFNGLCLEARPROC, (GLbitfield mask), (mask))
+COUNTED_GL(glUniform2f, PFNGLUNIFORM2FPROC, (GLint location, GLfloat x, GLfloat y), (location, x, y))
+COUNTED_GL(glDrawElements, PFNGLDRAWELEMENTSPROC, (GLenum mode, GLsizei count, GLenum type, const void* indices),
+					 (mode, count, type, indices))
+
+#define INSTALL_COUNTED_GL(name) real_##name = glad_##name; glad_##name = counted_##name
+
+internal void install_counted_gl() {
+	INSTALL_COUNTED_GL(glUseProgram);
+	INSTALL_COUNTED_GL(glBindVertexArray);
+	INSTALL_COUNTED_GL(glActiveTexture);
+	INSTALL_COUNTED_GL(glBindTexture);
+	INSTALL_COUNTED_GL(glBindBufferBase);
+	INSTALL_COUNTED_GL(glBindFramebuffer);
+	INSTALL_COUNTED_GL(glViewport);
+	INSTALL_COUNTED_GL(glEnable);
+	INSTALL_COUNTED_GL(glDisable);
+	INSTALL_COUNTED_GL(glClear);
+	INSTALL_COUNTED_GL(glUniform2f);
+	INSTALL_COUNTED_GL(glDrawElements);
+}
+
+//------------------------------------------------------------------------
+// Cache checks
+//------------------------------------------------------------------------
+
+internal u32 check(b32 condition, const char* what) {
+	if(condition) return 0;
+	printf("[ERROR] %s\n", what);
+	return 1;
+}
+
+internal u32 check_cache() {
+	GfxStateCache cache = {};
+	u32 failures = 0;
+	failures += check(gfx_state_set(&cache, GfxState_PixelShader, 7), "the first set is not issued");
+	failures += check(!gfx_state_set(&cache, GfxState_PixelShader, 7), "setting the same value again is issued");
+	failures += check(gfx_state_set(&cache, GfxState_PixelShader, 8), "a different value is filtered");
+	failures += check(gfx_state_set(&cache, GfxState_VertexShader, 8), "states are not independent");
+	failures += check(gfx_state_set(&cache, gfx_state_texture(GfxStage_Pixel, 1), 8), "texture slots are not independent");
+	failures += check(gfx_state_set(&cache, gfx_state_texture(GfxStage_Vertex, 1), 8), "stages are not independent");
+	failures += check(gfx_state_set(&cache, GfxState_IndexBuffer, 0), "binding null first is filtered");
+	failures += check(gfx_state_set2(&cache, GfxState_IndexBuffer, 0, 2), "a different extra value is filtered");
+	failures += check(!gfx_state_set2(&cache, GfxState_IndexBuffer, 0, 2), "the same extra value is issued");
+
+	gfx_state_forget(&cache, GfxState_PixelShader);
+	failures += check(gfx_state_set(&cache, GfxState_PixelShader, 8), "a forgotten state is filtered");
+	failures += check(!gfx_state_set(&cache, GfxState_VertexShader, 8), "forgetting one state forgot another");
+	gfx_state_forget_value(&cache, gfx_state_texture(GfxStage_Pixel, 0), GFX_STATE_TEXTURES, 8);
+	failures += check(gfx_state_set(&cache, gfx_state_texture(GfxStage_Pixel, 1), 8), "a destroyed texture is still known");
+	failures += check(!gfx_state_set(&cache, gfx_state_texture(GfxStage_Vertex, 1), 8), "forgetting a value left its range");
+
+	u64 buffers[3] = { 1, 2, 3 };
+	u32 first = gfx_state_constant_buffer(GfxStage_Vertex, 0);
+	failures += check(gfx_state_set_range(&cache, first, 3, buffers), "the first range set is not issued");
+	failures += check(!gfx_state_set_range(&cache, first, 3, buffers), "the same range is issued");
+	buffers[2] = 4;
+	failures += check(gfx_state_set_range(&cache, first, 3, buffers), "a range with one change is filtered");
+	failures += check(!gfx_state_set(&cache, first + 2, 4), "a range set is not recorded per slot");
+
+	gfx_state_invalidate(&cache);
+	failures += check(gfx_state_set(&cache, GfxState_VertexShader, 8), "an invalidated state is filtered");
+	failures += check(cache.stats.issued + cache.stats.filtered == 18, "the stats do not count every call");
+	failures += check(cache.stats.filtered == 6, "the stats miscount what was filtered");
+	return failures;
+}
+
+//------------------------------------------------------------------------
+// Scene
+//------------------------------------------------------------------------
+
+local const char* g_vertex_source =
+	"#version 410 core\n"
+	"layout(location = 0) in vec2 position;\n"
+	"layout(location = 1) in vec2 vertex_uv;\n"
+	"layout(std140) uniform Frame { vec4 cell; };\n"
+	"uniform vec2 offset;\n"
+	"out vec2 uv;\n"
+	"void main() {\n"
+	"	uv = vertex_uv;\n"
+	"	gl_Position = vec4((offset + position * cell.xy) * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// Compiled after a line that defines TINT.
+local const char* g_fragment_source =
+	"in vec2 uv;\n"
+	"uniform sampler2D image;\n"
+	"out vec4 colour;\n"
+	"void main() { colour = texture(image, uv) * TINT; }\n";
+
+struct SceneDraw {
+	GfxMeshHandle mesh;
+	GfxTextureHandle texture;
+	u32 shader;
+	f32 x, y;                // Cell corner.
+};
+
+enum Config : u32 {
+	Config_EveryDraw,
+	Config_EveryDrawCached,
+	Config_QueueCached,
+	Config_COUNT
+};
+
+local const char* g_config_names[Config_COUNT] = { "every draw", "+ cache", "queue + cache" };
+
+struct Bench {
+	b32 gl;
+	GfxStateCache* cache;    // 0 in Config_EveryDraw.
+	GfxResources resources;
+	GfxRenderQueue queue;
+	SceneDraw* scene;
+	u32 draw_count;
+	GfxMeshHandle* meshes;
+	gluint* vertex_arrays;   // Per mesh, in creation order.
+	u32 mesh_count;
+	gluint programs[MAX_SHADERS];
+	s32 offset_locations[MAX_SHADERS];
+	gluint uniform_buffer;
+	gluint framebuffer;
+};
+
+internal gluint compile_program(u32 shader, u32 shader_count) {
+	char tint[128];
+	f32 t = (f32)(shader + 1) / shader_count;
+	snprintf(tint, sizeof(tint), "#define TINT vec4(%f, %f, %f, 1.0)\n", t, 1.0f - t, 0.5f + 0.5f * t);
+	const char* fragment_sources[3] = { "#version 410 core\n", tint, g_fragment_source };
+
+	gluint vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex, 1, &g_vertex_source, nullptr);
+	glCompileShader(vertex);
+	gluint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment, 3, fragment_sources, nullptr);
+	glCompileShader(fragment);
+	gluint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if(!linked) {
+		char log[1024] = {};
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		printf("[ERROR] program %u: %s\n", shader, log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Frame"), 0);
+	return program;
+}
+
+//------------------------------------------------------------------------
+// Drawing
+//------------------------------------------------------------------------
+
+internal void draw_mesh(Bench* bench, const SceneDraw* draw, const GfxMesh* mesh) {
+	glUniform2f(bench->offset_locations[draw->shader], draw->x, draw->y);
+	glDrawElements(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_SHORT, 0);
+}
+
+// Meshes are never destroyed here, so a mesh's place in the pool is its place in vertex_arrays.
+internal gluint mesh_vertex_array(Bench* bench, const GfxMesh* mesh) {
+	return bench->vertex_arrays[mesh - (const GfxMesh*)bench->resources.meshes.items];
+}
+
+// Config_EveryDraw: what a renderer without any filtering sends.
+internal void draw_every_bind(Bench* bench) {
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bench->framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT);
+	for(u32 i = 0; i < bench->draw_count; i++) {
+		const SceneDraw* draw = &bench->scene[i];
+		const GfxMesh* mesh = gfx_mesh_get(&bench->resources, draw->mesh);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bench->framebuffer);
+		glViewport(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		glUseProgram(bench->programs[draw->shader]);
+		glBindBufferBase(GL_UNIFORM_BUFFER, 0, bench->uniform_buffer);
+		glBindVertexArray(mesh_vertex_array(bench, mesh));
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, (gluint)gfx_texture_get(&bench->resources, draw->texture)->native.value);
+		draw_mesh(bench, draw, mesh);
+	}
+}
+
+// Config_EveryDrawCached: the same binds, through the cache.
+internal void draw_every_bind_cached(Bench* bench) {
+	GfxStateCache* cache = bench->cache;
+	gl_state_bind_framebuffer(cache, bench->framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT);
+	for(u32 i = 0; i < bench->draw_count; i++) {
+		const SceneDraw* draw = &bench->scene[i];
+		const GfxMesh* mesh = gfx_mesh_get(&bench->resources, draw->mesh);
+		gl_state_bind_framebuffer(cache, bench->framebuffer);
+		gl_state_viewport(cache, 0, 0, IMAGE_SIZE, IMAGE_SIZE);
+		gl_state_depth_test(cache, false);
+		gl_state_blend(cache, false);
+		gl_state_use_program(cache, bench->programs[draw->shader]);
+		gl_state_bind_uniform_buffer(cache, 0, bench->uniform_buffer);
+		gl_state_bind_vertex_array(cache, mesh_vertex_array(bench, mesh));
+		gl_state_bind_texture(cache, 0, (gluint)gfx_texture_get(&bench->resources, draw->texture)->native.value);
+		draw_mesh(bench, draw, mesh);
+	}
+}
+
+internal void queue_bind_shader(void* user, u32 shader) {
+	Bench* bench = (Bench*)user;
+	gl_state_use_program(bench->cache, bench->programs[shader]);
+}
+
+internal void queue_bind_texture(void* user, const GfxTexture* texture) {
+	Bench* bench = (Bench*)user;
+	gl_state_bind_texture(bench->cache, 0, texture ? (gluint)texture->native.value : 0);
+}
+
+internal void queue_bind_mesh(void* user, GfxResources* resources, const GfxMesh* mesh) {
+	Bench* bench = (Bench*)user;
+	gl_state_bind_vertex_array(bench->cache, mesh_vertex_array(bench, mesh));
+}
+
+internal void queue_draw(void* user, const GfxDrawPacket* packet, const GfxMesh* mesh) {
+	Bench* bench = (Bench*)user;
+	draw_mesh(bench, &bench->scene[packet->object], mesh);
+}
+
+// Config_QueueCached: frame-wide state once, the draws sorted.
+internal void draw_queue_cached(Bench* bench) {
+	GfxStateCache* cache = bench->cache;
+	gl_state_bind_framebuffer(cache, bench->framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT);
+	gl_state_viewport(cache, 0, 0, IMAGE_SIZE, IMAGE_SIZE);
+	gl_state_depth_test(cache, false);
+	gl_state_blend(cache, false);
+	gl_state_bind_uniform_buffer(cache, 0, bench->uniform_buffer);
+
+	gfx_queue_begin(&bench->queue);
+	for(u32 i = 0; i < bench->draw_count; i++) {
+		const SceneDraw* draw = &bench->scene[i];
+		u64 key = gfx_sort_key(GfxPass_Opaque, draw->shader, gfx_material_id(draw->texture), gfx_mesh_id(draw->mesh), 0.0f);
+		gfx_queue_draw(&bench->queue, key, draw->mesh, draw->texture, draw->shader, i);
+	}
+	GfxDrawFuncs funcs = { bench, queue_bind_shader, queue_bind_texture, queue_bind_mesh, queue_draw };
+	gfx_queue_submit(&bench->queue, &bench->resources, &funcs);
+}
+
+internal u64 hash_bytes(const u8* bytes, u64 size) {
+	u64 hash = 0xcbf29ce484222325ull;
+	for(u64 i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+// What the cache believes against what GL reports, for every state it knows.
+internal u32 check_driver_state(const GfxStateCache* cache) {
+	GLint value = 0, viewport[4] = {};
+	u32 failures = 0;
+	if(gfx_state_is_known(cache, GfxState_VertexShader)) {
+		glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+		failures += check((u64)value == cache->values[GfxState_VertexShader][0], "the cached program is not GL's");
+	}
+	if(gfx_state_is_known(cache, GfxState_InputLayout)) {
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+		failures += check((u64)value == cache->values[GfxState_InputLayout][0], "the cached vertex array is not GL's");
+	}
+	if(gfx_state_is_known(cache, GfxState_RenderTargets)) {
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+		failures += check((u64)value == cache->values[GfxState_RenderTargets][0], "the cached framebuffer is not GL's");
+	}
+	if(gfx_state_is_known(cache, GfxState_Viewport)) {
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		u64 origin = ((u64)(u32)viewport[1] << 32) | (u32)viewport[0];
+		u64 size = ((u64)(u32)viewport[3] << 32) | (u32)viewport[2];
+		failures += check(origin == cache->values[GfxState_Viewport][0] && size == cache->values[GfxState_Viewport][1],
+											"the cached viewport is not GL's");
+	}
+	if(gfx_state_is_known(cache, GfxState_DepthStencil)) {
+		failures += check((u64)glIsEnabled(GL_DEPTH_TEST) == cache->values[GfxState_DepthStencil][0], "the cached depth test is not GL's");
+	}
+	if(gfx_state_is_known(cache, GfxState_Blend)) {
+		failures += check((u64)glIsEnabled(GL_BLEND) == cache->values[GfxState_Blend][0], "the cached blend is not GL's");
+	}
+	u32 uniform_buffer = gfx_state_constant_buffer(GfxStage_Vertex, 0);
+	if(gfx_state_is_known(cache, uniform_buffer)) {
+		glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, 0, &value);
+		failures += check((u64)value == cache->values[uniform_buffer][0], "the cached uniform buffer is not GL's");
+	}
+	// Only the active unit's texture can be asked for without changing the active unit.
+	if(gfx_state_is_known(cache, GfxState_ActiveTexture)) {
+		u32 unit = (u32)cache->values[GfxState_ActiveTexture][0];
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+		failures += check((u32)value == GL_TEXTURE0 + unit, "the cached active texture unit is not GL's");
+		u32 texture = gfx_state_texture(GfxStage_Pixel, unit);
+		if(gfx_state_is_known(cache, texture)) {
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+			failures += check((u64)value == cache->values[texture][0], "the cached texture is not GL's");
+		}
+	}
+	return failures;
+}
+
+struct Result {
+	u64 api_calls;
+	u64 issued;
+	u64 filtered;
+	f64 seconds;
+	u64 image_hash;
+};
+
+internal Result run_config(Bench* bench, Config config, u32 frames, GfxStateCache* cache) {
+	bench->cache = config == Config_EveryDraw ? nullptr : cache;
+	// The uncached run changed everything behind the cache's back.
+	gfx_state_invalidate(cache);
+	gfx_state_reset_stats(cache);
+
+	Result result = {};
+	u64 calls_before = g_api_calls;
+	f64 start = os_now_seconds();
+	for(u32 frame = 0; frame < frames; frame++) {
+		switch(config) {
+			case Config_EveryDraw:       draw_every_bind(bench); break;
+			case Config_EveryDrawCached: draw_every_bind_cached(bench); break;
+			case Config_QueueCached:     draw_queue_cached(bench); break;
+			default: break;
+		}
+		if(bench->gl) glFinish();
+	}
+	result.seconds = os_now_seconds() - start;
+	result.api_calls = g_api_calls - calls_before;
+	result.issued = bench->cache ? cache->stats.issued : 0;
+	result.filtered = bench->cache ? cache->stats.filtered : 0;
+
+	if(bench->gl) {
+		u8* pixels = (u8*)os_alloc_pages(IMAGE_SIZE * IMAGE_SIZE * 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, bench->framebuffer);
+		glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		result.image_hash = hash_bytes(pixels, IMAGE_SIZE * IMAGE_SIZE * 4);
+		os_free_pages(pixels, IMAGE_SIZE * IMAGE_SIZE * 4);
+	}
+	return result;
+}
+
+//------------------------------------------------------------------------
+// Setup
+//------------------------------------------------------------------------
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal b32 create_scene(Bench* bench, u32 shader_count, u32 texture_count, GfxNullDevice* device, GfxStateCache* cache) {
+	GfxBackend backend = bench->gl ? gl_gfx_backend(cache) : gfx_null_backend(device);
+	if(!gfx_resources_init(&bench->resources, &backend) || !gfx_queue_init(&bench->queue, bench->draw_count)) {
+		printf("[ERROR] could not allocate the resource pools or the queue\n");
+		return false;
+	}
+
+	for(u32 i = 0; i < shader_count; i++) {
+		bench->programs[i] = bench->gl ? compile_program(i, shader_count) : i + 1;
+		if(!bench->programs[i]) return false;
+		bench->offset_locations[i] = bench->gl ? glGetUniformLocation(bench->programs[i], "offset") : 0;
+	}
+
+	// Quads over a cell, the texture mapped a different number of times on each.
+	bench->meshes = (GfxMeshHandle*)os_alloc_pages((u64)bench->mesh_count * (sizeof(GfxMeshHandle) + sizeof(gluint)));
+	bench->vertex_arrays = (gluint*)(bench->meshes + bench->mesh_count);
+	u16 indices[6] = { 0, 1, 2, 2, 1, 3 };
+	for(u32 i = 0; i < bench->mesh_count; i++) {
+		f32 repeat = (f32)(1 + i % 4);
+		f32 vertices[4 * 4] = {
+			0.0f, 0.0f, 0.0f, 0.0f,
+			1.0f, 0.0f, repeat, 0.0f,
+			0.0f, 1.0f, 0.0f, repeat,
+			1.0f, 1.0f, repeat, repeat,
+		};
+		bench->meshes[i] = gfx_mesh_create(&bench->resources, vertices, 4, 4 * sizeof(f32), indices, 6, sizeof(u16));
+		GfxMesh* mesh = gfx_mesh_get(&bench->resources, bench->meshes[i]);
+		if(!mesh) {
+			printf("[ERROR] could not create mesh %u\n", i);
+			return false;
+		}
+		if(!bench->gl) {
+			bench->vertex_arrays[i] = i + 1;
+			continue;
+		}
+		glGenVertexArrays(1, &bench->vertex_arrays[i]);
+		glBindVertexArray(bench->vertex_arrays[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, (gluint)gfx_buffer_get(&bench->resources, mesh->vertices)->native.value);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (gluint)gfx_buffer_get(&bench->resources, mesh->indices)->native.value);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(f32), (void*)0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(f32), (void*)(2 * sizeof(f32)));
+	}
+
+	// 4x4 textures of random texels.
+	u32 seed = 0x51a7eu;
+	GfxTextureHandle* textures = (GfxTextureHandle*)os_alloc_pages((u64)texture_count * sizeof(GfxTextureHandle));
+	GfxTextureDesc texture_desc = { CookedFormat_RGBA8, false, 4, 4, 1 };
+	for(u32 i = 0; i < texture_count; i++) {
+		u32 texels[16];
+		for(u32 j = 0; j < 16; j++) texels[j] = next_random(&seed) | 0xff000000u;
+		textures[i] = gfx_texture_create(&bench->resources, &texture_desc);
+		gfx_texture_upload_rows(&bench->resources, textures[i], 0, 0, 4, (const u8*)texels, 4 * sizeof(u32));
+		if(!gfx_texture_get(&bench->resources, textures[i])) {
+			printf("[ERROR] could not create texture %u\n", i);
+			return false;
+		}
+	}
+
+	u32 grid = (u32)ceilf(sqrtf((f32)bench->draw_count));
+	f32 cell[4] = { 1.0f / grid, 1.0f / grid, 0.0f, 0.0f };
+	if(bench->gl) {
+		glGenBuffers(1, &bench->uniform_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, bench->uniform_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(cell), cell, GL_STATIC_DRAW);
+
+		gluint target;
+		glGenTextures(1, &target);
+		glBindTexture(GL_TEXTURE_2D, target);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, IMAGE_SIZE, IMAGE_SIZE);
+		glGenFramebuffers(1, &bench->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, bench->framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			printf("[ERROR] the render target is not complete\n");
+			return false;
+		}
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	} else {
+		bench->uniform_buffer = 1;
+		bench->framebuffer = 1;
+	}
+
+	bench->scene = (SceneDraw*)os_alloc_pages((u64)bench->draw_count * sizeof(SceneDraw));
+	for(u32 i = 0; i < bench->draw_count; i++) {
+		SceneDraw* draw = &bench->scene[i];
+		draw->mesh = bench->meshes[next_random(&seed) % bench->mesh_count];
+		draw->texture = textures[next_random(&seed) % texture_count];
+		draw->shader = next_random(&seed) % shader_count;
+		draw->x = (f32)(i % grid) / grid;
+		draw->y = (f32)(i / grid) / grid;
+	}
+	os_free_pages(textures, (u64)texture_count * sizeof(GfxTextureHandle));
+	return true;
+}
+
+internal void destroy_scene(Bench* bench, u32 shader_count) {
+	if(bench->gl) {
+		glDeleteVertexArrays(bench->mesh_count, bench->vertex_arrays);
+		for(u32 i = 0; i < shader_count; i++) glDeleteProgram(bench->programs[i]);
+		glDeleteBuffers(1, &bench->uniform_buffer);
+	}
+	gfx_queue_release(&bench->queue);
+	gfx_resources_release(&bench->resources);
+	os_free_pages(bench->scene, (u64)bench->draw_count * sizeof(SceneDraw));
+	os_free_pages(bench->meshes, (u64)bench->mesh_count * (sizeof(GfxMeshHandle) + sizeof(gluint)));
+}
+
+//------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------
+
+internal u32 run(b32 gl, u32 draw_count, u32 shader_count, u32 texture_count, u32 mesh_count, u32 frames) {
+	GfxNullDevice device = {};
+	GfxStateCache cache = {};
+	Bench bench = {};
+	bench.gl = gl;
+	bench.draw_count = draw_count;
+	bench.mesh_count = mesh_count;
+	if(!create_scene(&bench, shader_count, texture_count, &device, &cache)) return 1;
+
+	if(gl) printf("%s | %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	else   printf("null driver\n");
+	printf("  %u draws of %u programs, %u textures, %u meshes, %u frames\n", draw_count, shader_count, texture_count, mesh_count, frames);
+	printf("  %-14s %10s %10s %10s %10s\n", "", "GL calls", "issued", "filtered", "ms/frame");
+
+	u32 failures = 0;
+	Result results[Config_COUNT];
+	for(u32 config = 0; config < Config_COUNT; config++) {
+		Result* result = &results[config];
+		*result = run_config(&bench, (Config)config, frames, &cache);
+		printf("  %-14s %10llu %10llu %10llu %10.3f\n", g_config_names[config], (unsigned long long)(result->api_calls / frames),
+					 (unsigned long long)(result->issued / frames), (unsigned long long)(result->filtered / frames),
+					 result->seconds * 1000.0 / frames);
+		if(config == Config_EveryDrawCached) {
+			printf("  %-14s", "  filtered");
+			for(u32 state = 0; state < GfxState_COUNT; state++) {
+				if(cache.stats.filtered_by_state[state]) printf(" %s %u", gfx_state_name(state), cache.stats.filtered_by_state[state] / frames);
+			}
+			printf("\n");
+		}
+		if(gl && config != Config_EveryDraw) failures += check_driver_state(&cache);
+		if(gl && result->image_hash != results[0].image_hash) {
+			printf("[ERROR] %s draws a different image\n", g_config_names[config]);
+			failures++;
+		}
+		// What the cache let through, and a clear a frame and a uniform and a draw a quad.
+		if(config != Config_EveryDraw) {
+			failures += check(result->api_calls == result->issued + (u64)frames * (2 * draw_count + 1), "GL saw other calls than the cache issued");
+		}
+	}
+	printf("  %.1fx fewer GL calls through the cache, %.1fx with the queue\n",
+				 (f64)results[Config_EveryDraw].api_calls / Max(results[Config_EveryDrawCached].api_calls, 1ull),
+				 (f64)results[Config_EveryDraw].api_calls / Max(results[Config_QueueCached].api_calls, 1ull));
+
+	destroy_scene(&bench, shader_count);
+	if(!gl && (device.live_buffers || device.live_textures)) failures += check(false, "resources leaked");
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	u32 draw_count = 4096;
+	u32 shader_count = 8;
+	u32 texture_count = 32;
+	u32 mesh_count = 16;
+	u32 frames = 16;
+	b32 null_only = false;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--draws=", 8) == 0)          draw_count = Clamp(1u, (u32)atoi(argv[i] + 8), 1u << 20);
+		else if(strncmp(argv[i], "--shaders=", 10) == 0)  shader_count = Clamp(1u, (u32)atoi(argv[i] + 10), (u32)MAX_SHADERS);
+		else if(strncmp(argv[i], "--textures=", 11) == 0) texture_count = Clamp(1u, (u32)atoi(argv[i] + 11), (u32)GFX_MAX_TEXTURES);
+		else if(strncmp(argv[i], "--meshes=", 9) == 0)    mesh_count = Clamp(1u, (u32)atoi(argv[i] + 9), (u32)GFX_MAX_MESHES);
+		else if(strncmp(argv[i], "--frames=", 9) == 0)    frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strcmp(argv[i], "--null") == 0)           null_only = true;
+		else {
+			printf("usage: state_bench [--draws=N] [--shaders=N] [--textures=N] [--meshes=N] [--frames=N] [--null]\n");
+			return 1;
+		}
+	}
+
+	u32 failures = check_cache();
+	install_counted_gl();
+	failures += run(false, draw_count, shader_count, texture_count, mesh_count, frames);
+	if(!null_only) {
+		if(create_context()) {
+			install_counted_gl();
+			failures += run(true, draw_count, shader_count, texture_count, mesh_count, frames);
+		} else {
+			printf("no OpenGL 4.1 core context, the GL run is skipped\n");
+		}
+	}
+	return failures ? 1 : 0;
+}
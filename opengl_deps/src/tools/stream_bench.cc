@@ -0,0 +1,175 @@
+// Benchmark for background texture streaming (asset/stream.h).
+//
+// Loads every .ctex and .tga in a pack (--copies times each) two ways:
+//   sync      on the calling thread before the first frame, the way the
+//             textured sample used to, which is one long stall
+//   streamed  requested up front and drained by a frame loop that calls
+//             stream_pump() with a per-frame upload budget and then spins
+//             for --frame-ms to stand in for rendering
+// The upload callback copies each band of rows into a block per texture,
+// standing in for UpdateSubresource. Reports the stall of the sync path against the worst
+// frame of the streamed one, bytes per frame against the budget, and when
+// textures first became usable and fully resident.
+//
+// Usage: stream_bench <data.pak> [--copies=N] [--budget=KB] [--threads=N] [--frame-ms=N]
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "asset/pack.h"
+#include "asset/stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct GPUStandIn {
+	u8* memory;
+	u64 size;
+	u64 offsets[MIP_MAX_LEVELS];
+};
+
+struct UploadLog {
+	GPUStandIn textures[STREAM_MAX_TEXTURES];
+	f64 start;
+	f64 first_usable;        // First texture with a level on the "GPU".
+	f64 usable_sum;          // Request to first level, summed.
+	u32 usable_count;
+};
+
+global UploadLog g_log;
+
+internal void upload_rows(void* user, StreamTexture* texture, u32 level, u32 row, u32 row_count) {
+	UploadLog* log = (UploadLog*)user;
+	GPUStandIn* gpu = (GPUStandIn*)texture->user;
+	if(!gpu) {
+		// First (smallest) level: "create the texture".
+		gpu = &log->textures[log->usable_count];
+		u64 size = 0;
+		for(u32 i = 0; i < texture->level_count; i++) {
+			gpu->offsets[i] = size;
+			size = AlignPow2(size + texture->levels[i].size, (u64)256);
+		}
+		gpu->size = size;
+		gpu->memory = (u8*)os_alloc_pages(size);
+		texture->user = gpu;
+
+		f64 now = os_now_seconds();
+		if(log->usable_count == 0) log->first_usable = now - log->start;
+		log->usable_sum += now - texture->requested_at;
+		log->usable_count++;
+	}
+	const StreamLevel* source = &texture->levels[level];
+	u64 offset = (u64)row * source->row_pitch;
+	memcpy(gpu->memory + gpu->offsets[level] + offset, source->data + offset, (u64)row_count * source->row_pitch);
+}
+
+internal void release_gpu(UploadLog* log) {
+	for(u32 i = 0; i < log->usable_count; i++) os_free_pages(log->textures[i].memory, log->textures[i].size);
+}
+
+global Streamer g_streamer;
+
+int main(int argc, char** argv) {
+	const char* path = 0;
+	u32 copies = 4;
+	u64 budget = KB(512);
+	u32 threads = 0;
+	f64 frame_seconds = 0.004;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--copies=", 9) == 0)        copies = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--budget=", 9) == 0)   budget = KB(Max(atoi(argv[i] + 9), 1));
+		else if(strncmp(argv[i], "--threads=", 10) == 0) threads = (u32)atoi(argv[i] + 10);
+		else if(strncmp(argv[i], "--frame-ms=", 11) == 0) frame_seconds = atof(argv[i] + 11) / 1000.0;
+		else path = argv[i];
+	}
+
+	Pack pack;
+	if(!path || !pack_open(&pack, path)) {
+		printf("usage: stream_bench <data.pak> [--copies=N] [--budget=KB] [--threads=N] [--frame-ms=N]\n");
+		return 1;
+	}
+
+	const char* names[STREAM_MAX_TEXTURES];
+	u32 name_count = 0;
+	for(u32 c = 0; c < copies; c++) {
+		for(u32 i = 0; i < pack.header->entry_count && name_count < STREAM_MAX_TEXTURES; i++) {
+			const char* name = pack_entry_name(&pack, i);
+			if(stream_has_extension(name, ".ctex") || stream_has_extension(name, ".tga")) names[name_count++] = name;
+		}
+	}
+	if(name_count == 0) {
+		printf("[ERROR] no .ctex or .tga entries in %s\n", path);
+		return 1;
+	}
+
+	// Sync: everything on this thread before the "first frame".
+	StreamTexture* sync = &g_streamer.textures[0];
+	u64 sync_bytes = 0;
+	g_log = {};
+	g_log.start = os_now_seconds();
+	for(u32 i = 0; i < name_count; i++) {
+		strcpy(sync->name, names[i]);
+		sync->mips = {};
+		sync->user = 0;
+		sync->requested_at = os_now_seconds();
+		PackSpan file = pack_find(&pack, names[i]);
+		b32 ok = stream_has_extension(names[i], ".ctex") ? stream_load_cooked(sync, file) : stream_load_tga(sync, file);
+		if(!ok) {
+			printf("[ERROR] %s does not load\n", names[i]);
+			return 1;
+		}
+		for(u32 level = sync->level_count; level-- > 0;) {
+			upload_rows(&g_log, sync, level, 0, sync->levels[level].row_count);
+			sync_bytes += sync->levels[level].size;
+		}
+		mip_chain_release(&sync->mips);
+	}
+	f64 sync_seconds = os_now_seconds() - g_log.start;
+	release_gpu(&g_log);
+
+	// Streamed: requests go out at once, the frame loop never waits on them.
+	g_log = {};
+	stream_start(&g_streamer, &pack, threads);
+	g_log.start = os_now_seconds();
+	for(u32 i = 0; i < name_count; i++) stream_request_texture(&g_streamer, names[i]);
+
+	f64 worst_frame = 0.0;
+	u32 frames = 0;
+	while(!stream_idle(&g_streamer)) {
+		f64 frame_start = os_now_seconds();
+		stream_pump(&g_streamer, budget, upload_rows, &g_log);
+		while(os_now_seconds() - frame_start < frame_seconds) {}
+		worst_frame = Max(worst_frame, os_now_seconds() - frame_start);
+		frames++;
+	}
+	f64 stream_seconds = os_now_seconds() - g_log.start;
+
+	const StreamStats* stats = &g_streamer.stats;
+	f64 resident_sum = 0.0;
+	for(u32 i = 0; i < g_streamer.texture_count; i++) {
+		resident_sum += g_streamer.textures[i].resident_at - g_streamer.textures[i].requested_at;
+	}
+	u32 workers = g_streamer.worker_count;
+	stream_stop(&g_streamer);
+	release_gpu(&g_log);
+
+	printf("%u textures (%u entries x %u), %.2f MB of levels, budget %.0f KB/frame, %u workers, %.1f ms frames\n",
+				 name_count, name_count / copies, copies, (f64)sync_bytes / (f64)MB(1), (f64)budget / 1024.0, workers,
+				 frame_seconds * 1000.0);
+	printf("  sync      stall before first frame %8.2f ms\n", sync_seconds * 1000.0);
+	printf("  streamed  worst frame %8.2f ms (pump %.3f ms peak, %.3f ms avg), %u frames, all resident after %.2f ms\n",
+				 worst_frame * 1000.0, stats->peak_pump_seconds * 1000.0, stats->pump_seconds * 1000.0 / Max(stats->frames, 1u),
+				 frames, stream_seconds * 1000.0);
+	printf("            peak %.1f KB/frame over %u uploading frames, %u rows over budget, worker load %.2f ms\n",
+				 (f64)stats->peak_frame_bytes / 1024.0, stats->frames_uploading, stats->over_budget_rows,
+				 stats->load_seconds * 1000.0);
+	printf("            first texture usable after %.2f ms, request to usable %.2f ms avg, to resident %.2f ms avg\n",
+				 g_log.first_usable * 1000.0, g_log.usable_sum * 1000.0 / Max(g_log.usable_count, 1u),
+				 resident_sum * 1000.0 / g_streamer.texture_count);
+
+	b32 ok = stats->failed == 0 && stats->resident == name_count && stats->bytes_uploaded == sync_bytes &&
+					 (stats->peak_frame_bytes <= budget || stats->over_budget_rows > 0);
+	if(!ok) printf("[ERROR] streaming did not upload every texture within budget\n");
+	pack_close(&pack);
+	return ok ? 0 : 1;
+}
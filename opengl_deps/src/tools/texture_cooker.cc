@@ -0,0 +1,187 @@
+// Offline texture cooker.
+//
+// Turns a TGA or PNG into a cooked .ctex (texture/cooked.h): RGBA8 or BCn
+// top-down, full mip chain built with texture/mips.h and compressed with
+// texture/bc.h, every level 64-byte aligned, so the runtime only has to map the
+// file and hand level pointers to the GPU.
+//
+// Usage: texture_cooker <input.tga|input.png> <output.ctex> [--filter=box|lanczos] [--linear]
+//                       [--format=rgba8|bc1|bc3|bc7] [--quality=fast|normal|high]
+//   --filter   mip filter, lanczos by default
+//   --linear   treat colour as linear data (normal maps, masks) instead of sRGB
+//   --format   payload format, rgba8 by default. BCn needs a multiple of 4 at level 0.
+//   --quality  BCn encoder preset, normal by default
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/tga.h"
+#include "texture/mips.h"
+#include "texture/png.h"
+#include "texture/bc.h"
+#include "texture/cooked.h"
+
+#include <cstdio>
+#include <cstring>
+
+internal b32 has_extension(const char* path, const char* extension) {
+	u64 path_length = strlen(path);
+	u64 extension_length = strlen(extension);
+	if(path_length < extension_length) return false;
+	const char* at = path + path_length - extension_length;
+	for(u64 i = 0; i < extension_length; i++) {
+		char c = at[i];
+		if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		if(c != extension[i]) return false;
+	}
+	return true;
+}
+
+// Decodes the source image into level 0 of a freshly allocated chain.
+internal b32 load_source(MipChain* chain, const char* path) {
+	OS_FileMap file;
+	if(!os_file_map_open(&file, path)) {
+		printf("[ERROR] could not open %s\n", path);
+		return false;
+	}
+
+	b32 ok = false;
+	if(has_extension(path, ".tga")) {
+		TGAImage image;
+		ok = tga_parse(&image, file.data, file.size) &&
+				 mip_chain_alloc(chain, image.width, image.height) &&
+				 tga_decode_rgba8(&image, mip_level_data(chain, 0), chain->levels[0].row_pitch);
+	} else if(has_extension(path, ".png")) {
+		// A batch of one, so the image goes straight into level 0.
+		PNGBatchItem item = {};
+		item.data = file.data;
+		item.size = file.size;
+		if(png_info(file.data, file.size, &item.width, &item.height) && mip_chain_alloc(chain, item.width, item.height)) {
+			item.pixels = mip_level_data(chain, 0);
+			item.row_pitch = chain->levels[0].row_pitch;
+
+			PNGBatch batch;
+			PNGBatchSettings settings = {};
+			ok = png_decode_batch(&batch, &item, 1, &settings);
+			png_batch_release(&batch);
+		}
+	} else {
+		printf("[ERROR] %s: unsupported source format, expected .tga or .png\n", path);
+	}
+
+	os_file_map_close(&file);
+	if(!ok) printf("[ERROR] failed to decode %s\n", path);
+	return ok;
+}
+
+// Compresses every level of the chain. Returns the blocks of all levels in one
+// allocation of `*size` bytes, level i starting at `offsets[i]`.
+internal u8* compress_chain(const MipChain* chain, const BCSettings* settings, u64 offsets[MIP_MAX_LEVELS], u64* size) {
+	u64 total = 0;
+	for(u32 i = 0; i < chain->level_count; i++) {
+		offsets[i] = total;
+		total += bc_compressed_size(settings->format, chain->levels[i].width, chain->levels[i].height);
+	}
+
+	u8* blocks = (u8*)os_alloc_pages(total);
+	if(!blocks) return 0;
+	for(u32 i = 0; i < chain->level_count; i++) {
+		const MipLevel* level = &chain->levels[i];
+		bc_compress_image(mip_level_data(chain, i), level->width, level->height, level->row_pitch, blocks + offsets[i], settings);
+	}
+	*size = total;
+	return blocks;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		printf("usage: texture_cooker <input.tga|input.png> <output.ctex> [--filter=box|lanczos] [--linear]\n");
+		printf("                      [--format=rgba8|bc1|bc3|bc7] [--quality=fast|normal|high]\n");
+		return 1;
+	}
+
+	const char* input = argv[1];
+	const char* output = argv[2];
+
+	MipSettings settings = {};
+	settings.filter = MipFilter_Lanczos;
+	settings.srgb = true;
+	CookedFormat format = CookedFormat_RGBA8;
+	BCSettings bc_settings = {};
+	bc_settings.quality = BCQuality_Normal;
+	for(s32 i = 3; i < argc; i++) {
+		if(strcmp(argv[i], "--filter=box") == 0)          settings.filter = MipFilter_Box;
+		else if(strcmp(argv[i], "--filter=lanczos") == 0) settings.filter = MipFilter_Lanczos;
+		else if(strcmp(argv[i], "--linear") == 0)         settings.srgb = false;
+		else if(strcmp(argv[i], "--format=rgba8") == 0)   format = CookedFormat_RGBA8;
+		else if(strcmp(argv[i], "--format=bc1") == 0)     format = CookedFormat_BC1;
+		else if(strcmp(argv[i], "--format=bc3") == 0)     format = CookedFormat_BC3;
+		else if(strcmp(argv[i], "--format=bc7") == 0)     format = CookedFormat_BC7;
+		else if(strcmp(argv[i], "--quality=fast") == 0)   bc_settings.quality = BCQuality_Fast;
+		else if(strcmp(argv[i], "--quality=normal") == 0) bc_settings.quality = BCQuality_Normal;
+		else if(strcmp(argv[i], "--quality=high") == 0)   bc_settings.quality = BCQuality_High;
+		else {
+			printf("[ERROR] unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	f64 start = os_now_seconds();
+
+	MipChain chain;
+	if(!load_source(&chain, input)) return 1;
+	f64 decoded = os_now_seconds();
+
+	mip_generate(&chain, &settings);
+	f64 filtered = os_now_seconds();
+
+	if(cooked_format_is_block_compressed(format) && (chain.width % 4 != 0 || chain.height % 4 != 0)) {
+		printf("[ERROR] %s: %ux%u is not a multiple of 4, BCn needs whole blocks at level 0\n", input, chain.width, chain.height);
+		return 1;
+	}
+
+	u32 flags = settings.srgb ? CookedFlag_SRGB : 0;
+	CookedLevelSource levels[MIP_MAX_LEVELS];
+	u8* blocks = 0;
+	u64 blocks_size = 0;
+	if(format == CookedFormat_RGBA8) {
+		for(u32 i = 0; i < chain.level_count; i++) {
+			levels[i].data = mip_level_data(&chain, i);
+			levels[i].width = chain.levels[i].width;
+			levels[i].height = chain.levels[i].height;
+		}
+	} else {
+		bc_settings.format = format == CookedFormat_BC1 ? BCFormat_BC1 : format == CookedFormat_BC3 ? BCFormat_BC3 : BCFormat_BC7;
+		u64 offsets[MIP_MAX_LEVELS];
+		blocks = compress_chain(&chain, &bc_settings, offsets, &blocks_size);
+		if(!blocks) {
+			printf("[ERROR] out of memory compressing %s\n", input);
+			return 1;
+		}
+		for(u32 i = 0; i < chain.level_count; i++) {
+			levels[i].data = blocks + offsets[i];
+			levels[i].width = chain.levels[i].width;
+			levels[i].height = chain.levels[i].height;
+		}
+	}
+	f64 compressed = os_now_seconds();
+
+	if(!cooked_texture_write(output, format, flags, levels, chain.level_count)) {
+		printf("[ERROR] could not write %s\n", output);
+		return 1;
+	}
+	f64 written = os_now_seconds();
+
+	printf("%s -> %s: %ux%u, %u levels, decode %.2f ms, mips %.2f ms, write %.2f ms\n", input, output,
+				 chain.width, chain.height, chain.level_count,
+				 (decoded - start) * 1000.0, (filtered - decoded) * 1000.0, (written - compressed) * 1000.0);
+	if(blocks) {
+		u64 pixels = 0;
+		for(u32 i = 0; i < chain.level_count; i++) pixels += (u64)chain.levels[i].width * chain.levels[i].height;
+		f64 seconds = compressed - filtered;
+		printf("  compress %.2f ms, %.2f Mpix/s\n", seconds * 1000.0, (f64)pixels / 1e6 / seconds);
+		os_free_pages(blocks, blocks_size);
+	}
+
+	mip_chain_release(&chain);
+	return 0;
+}
@@ -0,0 +1,334 @@
+// Micro-benchmark for the TGA load path.
+//
+// Compares the original textured.cc loader (fread into a heap buffer, then a
+// per-byte swizzle/flip loop into a second buffer) against the mapped loader in
+// texture/tga.h. Both paths are timed end to end, file open to RGBA8 ready for
+// upload, and throughput is reported in MB/s of decoded pixels.
+//
+// The decoded image is then re-encoded as raw/RLE at 24 and 32 bits and each
+// variant is decoded through the mapped path, to compare file size and
+// decode speed against the uncompressed 32-bit read. "rle 32 x" lets packets
+// run across scanlines, as some exporters write them. Before any of that, a
+// small fixture of such packets must decode to the same pixels as its raw copy.
+//
+// Usage: tga_bench <file.tga> [iterations]
+//        tga_bench --synth <size> [iterations]   (writes and loads a size x size image)
+
+#include "basic/types.h"
+#include "platform/os.h"
+#include "texture/tga.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Straight port of load_tga32bit() from d3d11/src/textured.cc, minus the leak.
+internal b32 reference_load_tga(const char* path, u8* dst, u32* out_width, u32* out_height) {
+	FILE* file = fopen(path, "rb");
+	if(!file) return false;
+
+	TGAHeader header;
+	if(fread(&header, sizeof(header), 1, file) != 1) { fclose(file); return false; }
+	if(header.bpp != 32) { fclose(file); return false; }
+
+	s32 width = header.width;
+	s32 height = header.height;
+	s32 image_size = width * height * 4;
+	u8* tga_image = new u8[image_size];
+	u32 count = (u32)fread(tga_image, 1, image_size, file);
+	fclose(file);
+	if(count != (u32)image_size) { delete[] tga_image; return false; }
+
+	s32 index = 0;
+	s32 k = (width * height * 4) - (width * 4);
+	for(s32 j = 0; j < height; j++) {
+		for(s32 i = 0; i < width; i++) {
+			dst[index + 0] = tga_image[k + 2];
+			dst[index + 1] = tga_image[k + 1];
+			dst[index + 2] = tga_image[k + 0];
+			dst[index + 3] = tga_image[k + 3];
+			k += 4;
+			index += 4;
+		}
+		k -= (width * 8);
+	}
+
+	delete[] tga_image;
+	*out_width = (u32)width;
+	*out_height = (u32)height;
+	return true;
+}
+
+internal b32 mapped_load_tga(const char* path, u8* dst) {
+	OS_FileMap map;
+	if(!os_file_map_open(&map, path)) return false;
+
+	TGAImage image;
+	b32 ok = tga_parse(&image, map.data, map.size) && tga_decode_rgba8(&image, dst, (u64)image.width * 4);
+
+	os_file_map_close(&map);
+	return ok;
+}
+
+internal b32 write_synthetic_tga(const char* path, u32 size) {
+	FILE* file = fopen(path, "wb");
+	if(!file) return false;
+
+	TGAHeader header = {};
+	header.image_type = TGAImageType_TrueColour;
+	header.width = (u16)size;
+	header.height = (u16)size;
+	header.bpp = 32;
+	header.descriptor = 8;
+	fwrite(&header, sizeof(header), 1, file);
+
+	// Left half is a noisy gradient, right half flat 32 pixel blocks, so the RLE
+	// variants see both incompressible and highly compressible spans.
+	u8* row = (u8*)malloc((u64)size * 4);
+	for(u32 y = 0; y < size; y++) {
+		for(u32 x = 0; x < size * 4; x++) {
+			row[x] = (x < size * 2) ? (u8)(x * 7 + y * 13) : (u8)(((x / 128) * 37 + (y / 32) * 11) | (x & 3));
+		}
+		fwrite(row, 1, (u64)size * 4, file);
+	}
+	free(row);
+	fclose(file);
+	return true;
+}
+
+// Encodes `count` RGBA8 pixels as TGA packets (or plain pixels when not
+// compressing) into `at`, returns the end. `row_width` is only for counting the
+// packets that continue past the end of a scanline into `crossings`.
+internal u8* encode_tga_pixels(u8* at, const u8* pixels, u64 count, u32 bpp, b32 rle, u32 row_width, u32* crossings) {
+	for(u64 x = 0; x < count;) {
+		const u8* p = pixels + x * 4;
+		u32 run = 1;
+		while(rle && x + run < count && run < 128 && memcmp(p, p + run * 4, 4) == 0) run++;
+
+		if(!rle) run = 0;
+		if(run >= 2) {
+			*at++ = (u8)(0x80 | (run - 1));
+			*at++ = p[2]; *at++ = p[1]; *at++ = p[0];
+			if(bpp == 32) *at++ = p[3];
+			*crossings += x / row_width != (x + run - 1) / row_width;
+			x += run;
+			continue;
+		}
+
+		// Raw packet up to the next run of 2+ (or everything when not compressing).
+		u64 packet = 0;
+		while(x + packet < count && (!rle || packet < 128)) {
+			const u8* q = pixels + (x + packet) * 4;
+			if(rle && x + packet + 1 < count && memcmp(q, q + 4, 4) == 0) break;
+			packet++;
+		}
+		if(packet == 0) packet = 1;
+		if(rle) *at++ = (u8)(packet - 1);
+		for(u64 i = 0; i < packet; i++) {
+			const u8* q = pixels + (x + i) * 4;
+			*at++ = q[2]; *at++ = q[1]; *at++ = q[0];
+			if(bpp == 32) *at++ = q[3];
+		}
+		if(rle) *crossings += x / row_width != (x + packet - 1) / row_width;
+		x += packet;
+	}
+	return at;
+}
+
+// Writes top-down RGBA8 pixels as a bottom-up TGA, optionally run-length encoded.
+// RLE packets stay within a scanline, which is what most exporters produce,
+// unless `span_rows`: then the image is one stream and packets run on into the
+// next row wherever the pixels allow. Counts those packets into `crossings`.
+internal u64 write_tga(const char* path, const u8* rgba, u32 width, u32 height, u32 bpp, b32 rle, b32 span_rows = false,
+											 u32* crossings = nullptr) {
+	FILE* file = fopen(path, "wb");
+	if(!file) return 0;
+
+	TGAHeader header = {};
+	header.image_type = rle ? TGAImageType_TrueColourRLE : TGAImageType_TrueColour;
+	header.width = (u16)width;
+	header.height = (u16)height;
+	header.bpp = (u8)bpp;
+	header.descriptor = bpp == 32 ? 8 : 0;
+	fwrite(&header, sizeof(header), 1, file);
+
+	// Rows in file order, bottom first.
+	u64 pixel_count = (u64)width * height;
+	u8* ordered = (u8*)malloc(pixel_count * 4);
+	for(u32 y = 0; y < height; y++) memcpy(ordered + (u64)y * width * 4, rgba + (u64)(height - 1 - y) * width * 4, (u64)width * 4);
+
+	u32 pixel_bytes = bpp / 8;
+	u32 crossed = 0;
+	if(span_rows) {
+		u8* out = (u8*)malloc(pixel_count * (pixel_bytes + 1) + 1);
+		u8* at = encode_tga_pixels(out, ordered, pixel_count, bpp, rle, width, &crossed);
+		fwrite(out, 1, (u64)(at - out), file);
+		free(out);
+	} else {
+		u8* out = (u8*)malloc((u64)width * (pixel_bytes + 1) + 1);
+		for(u32 y = 0; y < height; y++) {
+			u8* at = encode_tga_pixels(out, ordered + (u64)y * width * 4, width, bpp, rle, width, &crossed);
+			fwrite(out, 1, (u64)(at - out), file);
+		}
+		free(out);
+	}
+	free(ordered);
+	if(crossings) *crossings = crossed;
+
+	u64 size = (u64)ftell(file);
+	fclose(file);
+	return size;
+}
+
+// Packets that run from one scanline into the next, decoded against the same
+// pixels written raw. A 37 pixel wide image of runs and noise whose lengths
+// do not divide the width, so both kinds of packet land across row ends.
+internal b32 check_cross_row_rle() {
+	const u32 width = 37, height = 11;
+	u8 rgba[width * height * 4];
+	u32 seed = 0x2545f491u;
+	for(u32 i = 0; i < width * height; i++) {
+		u32 block = i / 23;
+		u32 colour = (block & 1) ? (block * 0x9e3779b9u) : (seed = seed * 1664525u + 1013904223u);
+		memcpy(rgba + i * 4, &colour, 4);
+	}
+
+	b32 ok = true;
+	const u32 bpps[2] = { 32, 24 };
+	for(u32 b = 0; b < ArrayCount(bpps); b++) {
+		u8 raw[width * height * 4], rle[width * height * 4];
+		u32 crossings = 0;
+		const char* raw_path = "tga_bench_span_raw.tga";
+		const char* rle_path = "tga_bench_span_rle.tga";
+		b32 written = write_tga(raw_path, rgba, width, height, bpps[b], false) &&
+									write_tga(rle_path, rgba, width, height, bpps[b], true, true, &crossings);
+		b32 decoded = written && mapped_load_tga(raw_path, raw) && mapped_load_tga(rle_path, rle);
+		if(!decoded || crossings == 0 || memcmp(raw, rle, sizeof(raw)) != 0) {
+			printf("[ERROR] %u-bit RLE packets across scanlines (%u of them) decode differently from raw\n", bpps[b], crossings);
+			ok = false;
+		}
+		remove(raw_path);
+		remove(rle_path);
+	}
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		printf("usage: tga_bench <file.tga> [iterations]\n");
+		printf("       tga_bench --synth <size> [iterations]\n");
+		return 1;
+	}
+
+	if(!check_cross_row_rle()) return 1;
+
+	const char* path = argv[1];
+	s32 iterations = 20;
+	if(strcmp(argv[1], "--synth") == 0) {
+		if(argc < 3) return 1;
+		u32 size = (u32)atoi(argv[2]);
+		if(size == 0 || size > 65535) return 1;
+		path = "tga_bench_synth.tga";
+		if(!write_synthetic_tga(path, size)) {
+			printf("[ERROR] could not write %s\n", path);
+			return 1;
+		}
+		if(argc > 3) iterations = atoi(argv[3]);
+	} else if(argc > 2) {
+		iterations = atoi(argv[2]);
+	}
+	if(iterations < 1) iterations = 1;
+
+	// Probe the header for the destination size.
+	OS_FileMap probe;
+	TGAImage image;
+	if(!os_file_map_open(&probe, path) || !tga_parse(&image, probe.data, probe.size)) {
+		printf("[ERROR] %s is not a supported TGA\n", path);
+		return 1;
+	}
+	os_file_map_close(&probe);
+
+	u64 bytes = (u64)image.width * image.height * 4;
+	u8* reference = (u8*)malloc(bytes);
+	u8* mapped = (u8*)malloc(bytes);
+
+	f64 mb = (f64)bytes / (f64)MB(1);
+	printf("%s: %ux%u, %.2f MB, best of %d\n", path, image.width, image.height, mb, iterations);
+
+	if(!mapped_load_tga(path, mapped)) {
+		printf("[ERROR] failed to load %s\n", path);
+		return 1;
+	}
+
+	// The old loader only understands raw 32-bit images.
+	if(!image.rle && image.bpp == 32) {
+		// Warm the page cache and check both paths agree before timing anything.
+		u32 width, height;
+		if(!reference_load_tga(path, reference, &width, &height)) {
+			printf("[ERROR] failed to load %s\n", path);
+			return 1;
+		}
+		if(image.top_down || memcmp(reference, mapped, bytes) != 0) {
+			printf("[WARNING] outputs differ (the reference loop ignores the TGA origin bit)\n");
+		}
+
+		f64 best_reference = 1e30;
+		f64 best_mapped = 1e30;
+		for(s32 i = 0; i < iterations; i++) {
+			f64 t0 = os_now_seconds();
+			reference_load_tga(path, reference, &width, &height);
+			f64 t1 = os_now_seconds();
+			mapped_load_tga(path, mapped);
+			f64 t2 = os_now_seconds();
+			best_reference = Min(best_reference, t1 - t0);
+			best_mapped = Min(best_mapped, t2 - t1);
+		}
+
+		printf("  byte loop : %8.3f ms  %9.1f MB/s\n", best_reference * 1000.0, mb / best_reference);
+		printf("  mapped    : %8.3f ms  %9.1f MB/s  (%.2fx)\n", best_mapped * 1000.0, mb / best_mapped, best_reference / best_mapped);
+	}
+
+	// Same pixels in every format the loader understands.
+	struct Variant { const char* name; const char* path; u32 bpp; b32 rle; b32 span_rows; };
+	Variant variants[] = {
+		{ "raw 32",   "tga_bench_raw32.tga",   32, false, false },
+		{ "raw 24",   "tga_bench_raw24.tga",   24, false, false },
+		{ "rle 32",   "tga_bench_rle32.tga",   32, true,  false },
+		{ "rle 24",   "tga_bench_rle24.tga",   24, true,  false },
+		{ "rle 32 x", "tga_bench_rle32x.tga",  32, true,  true  },
+	};
+
+	u8* decoded = (u8*)malloc(bytes);
+	printf("  format      file size   decode ms       MB/s   vs raw 32\n");
+	f64 raw32_time = 0.0;
+	for(u32 v = 0; v < ArrayCount(variants); v++) {
+		Variant* variant = &variants[v];
+		u64 file_size = write_tga(variant->path, mapped, image.width, image.height, variant->bpp, variant->rle, variant->span_rows);
+		if(!file_size || !mapped_load_tga(variant->path, decoded)) {
+			printf("[ERROR] could not round trip %s\n", variant->path);
+			continue;
+		}
+
+		// 24-bit variants drop alpha, so only compare colour there.
+		b32 match = true;
+		for(u64 i = 0; i < bytes && match; i += 4) {
+			match = memcmp(decoded + i, mapped + i, 3) == 0 && (variant->bpp == 24 || decoded[i + 3] == mapped[i + 3]);
+		}
+
+		f64 best = 1e30;
+		for(s32 i = 0; i < iterations; i++) {
+			f64 t0 = os_now_seconds();
+			mapped_load_tga(variant->path, decoded);
+			best = Min(best, os_now_seconds() - t0);
+		}
+		if(v == 0) raw32_time = best;
+
+		printf("  %-8s %9.2f MB  %10.3f  %9.1f   %6.2fx%s\n", variant->name, (f64)file_size / (f64)MB(1),
+					 best * 1000.0, mb / best, raw32_time / best, match ? "" : "  [MISMATCH]");
+		remove(variant->path);
+	}
+	free(decoded);
+
+	free(reference);
+	free(mapped);
+	return 0;
+}
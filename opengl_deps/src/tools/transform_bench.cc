@@ -0,0 +1,158 @@
+// Benchmark for the transform hierarchy (scene/transform.h).
+//
+// Builds a forest of models, each a root with a random tree of nodes under
+// it, and runs frames of four workloads through transform_update():
+//   static     nothing moves
+//   animated   1% of all nodes get a new local matrix
+//   roots      10% of the models move as a whole
+//   all        every model moves
+// against a full rebuild that recomputes every world matrix from its local
+// one each frame, the way the samples do it. Every frame's world matrices
+// have to match the rebuild's bit for bit. Reports milliseconds per frame
+// and how many nodes were recomputed.
+//
+// Usage: transform_bench [--models=N] [--nodes=N] [--frames=N] [--threads=N]
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+#include "scene/transform.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+internal Mat4 random_local(u32* seed, f32 distance) {
+	Vec3 axis = vec3(random_range(seed, -1.0f, 1.0f), random_range(seed, 0.1f, 1.0f), random_range(seed, -1.0f, 1.0f));
+	Quat rotation = quat_from_axis_angle(axis, random_range(seed, -0.5f, 0.5f));
+	Vec3 translation = vec3(random_range(seed, -distance, distance), random_range(seed, -distance, distance), random_range(seed, -distance, distance));
+	return mat4_affine(vec3(1.0f, 1.0f, 1.0f), rotation, translation);
+}
+
+// What the samples do: every world matrix from scratch, every frame.
+internal void rebuild(const TransformHierarchy* hierarchy, Mat4* world) {
+	for(u32 i = 0; i < hierarchy->count; i++) {
+		u32 parent = hierarchy->parent[i];
+		world[i] = parent == TRANSFORM_NONE ? hierarchy->locals[i] : mat4_mul_scalar(&hierarchy->locals[i], &world[parent]);
+	}
+}
+
+enum Workload : u32 {
+	Workload_Static,
+	Workload_Animated,
+	Workload_Roots,
+	Workload_All,
+	Workload_COUNT,
+};
+
+int main(int argc, char** argv) {
+	u32 model_count = 1000;
+	u32 nodes_per_model = 100;
+	u32 frames = 64;
+	u32 thread_count = 0;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--models=", 9) == 0)         model_count = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--nodes=", 8) == 0)     nodes_per_model = Max((u32)atoi(argv[i] + 8), 1u);
+		else if(strncmp(argv[i], "--frames=", 9) == 0)    frames = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--threads=", 10) == 0)  thread_count = (u32)atoi(argv[i] + 10);
+		else {
+			printf("usage: transform_bench [--models=N] [--nodes=N] [--frames=N] [--threads=N]\n");
+			return 1;
+		}
+	}
+
+	u32 node_count = model_count * nodes_per_model;
+	TransformHierarchy hierarchy;
+	if(!transform_hierarchy_alloc(&hierarchy, node_count)) {
+		printf("[ERROR] could not allocate %u nodes\n", node_count);
+		return 1;
+	}
+	u32* roots = (u32*)os_alloc_pages((u64)model_count * sizeof(u32));
+	u32 seed = 0x1234567u;
+	for(u32 m = 0; m < model_count; m++) {
+		Mat4 placement = mat4_translation(random_range(&seed, -500.0f, 500.0f), 0.0f, random_range(&seed, -500.0f, 500.0f));
+		roots[m] = transform_add(&hierarchy, TRANSFORM_NONE, &placement);
+		for(u32 n = 1; n < nodes_per_model; n++) {
+			// Mostly chains with some branching, like a skeleton.
+			u32 back = next_random(&seed) % 4;
+			u32 parent = hierarchy.count - 1 - Min(back, n - 1);
+			Mat4 matrix = random_local(&seed, 1.0f);
+			transform_add(&hierarchy, parent, &matrix);
+		}
+	}
+
+	u64 world_size = (u64)node_count * sizeof(Mat4);
+	Mat4* reference = (Mat4*)os_alloc_pages(world_size);
+
+	// The first update computes everything and cuts the islands.
+	f64 start = os_now_seconds();
+	transform_update(&hierarchy, thread_count);
+	f64 first_seconds = os_now_seconds() - start;
+	printf("%u models of %u nodes, %u islands, %u frames\n", model_count, nodes_per_model, hierarchy.stats.islands, frames);
+	printf("  first update   %8.3f ms, %u nodes\n", first_seconds * 1000.0, hierarchy.stats.nodes_updated);
+
+	f64 rebuild_seconds = 0.0;
+	for(u32 frame = 0; frame < frames; frame++) {
+		start = os_now_seconds();
+		rebuild(&hierarchy, reference);
+		rebuild_seconds += os_now_seconds() - start;
+	}
+	printf("  full rebuild   %8.3f ms/frame, %u nodes\n", rebuild_seconds * 1000.0 / frames, node_count);
+
+	const char* names[Workload_COUNT] = { "static", "animated", "roots", "all" };
+	b32 all_match = true;
+	for(u32 workload = 0; workload < Workload_COUNT; workload++) {
+		f64 seconds = 0.0;
+		u64 updated = 0, visited = 0, jobs = 0;
+		b32 match = true;
+		for(u32 frame = 0; frame < frames; frame++) {
+			if(workload == Workload_Animated) {
+				for(u32 k = 0; k < node_count / 100; k++) {
+					u32 node = next_random(&seed) % node_count;
+					Mat4 matrix = random_local(&seed, 1.0f);
+					transform_set_local(&hierarchy, node, &matrix);
+				}
+			} else if(workload != Workload_Static) {
+				u32 moved = workload == Workload_All ? model_count : Max(model_count / 10, 1u);
+				for(u32 k = 0; k < moved; k++) {
+					u32 model = workload == Workload_All ? k : next_random(&seed) % model_count;
+					Mat4 placement = random_local(&seed, 500.0f);
+					transform_set_local(&hierarchy, roots[model], &placement);
+				}
+			}
+
+			start = os_now_seconds();
+			transform_update(&hierarchy, thread_count);
+			seconds += os_now_seconds() - start;
+			updated += hierarchy.stats.nodes_updated;
+			visited += hierarchy.stats.nodes_visited;
+			jobs += hierarchy.stats.jobs;
+
+			rebuild(&hierarchy, reference);
+			match = match && memcmp(reference, hierarchy.worlds, world_size) == 0;
+		}
+		all_match = all_match && match;
+		printf("  %-10s     %8.3f ms/frame, %8.1f nodes updated, %8.1f visited, %5.1f jobs, %6.1fx the rebuild, %s\n", names[workload],
+					 seconds * 1000.0 / frames, (f64)updated / frames, (f64)visited / frames, (f64)jobs / frames,
+					 rebuild_seconds / Max(seconds, 1e-9), match ? "matches" : "DIFFERS");
+	}
+
+	os_free_pages(reference, world_size);
+	os_free_pages(roots, (u64)model_count * sizeof(u32));
+	transform_hierarchy_release(&hierarchy);
+
+	if(!all_match) {
+		printf("[ERROR] the incremental world matrices differ from a full rebuild\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,180 @@
+// Benchmark for the SIMD paths of basic/vecmath.h against their scalar twins.
+//
+// Runs each operation over the same batch of random affine matrices (a scale,
+// a rotation and a translation each) and points:
+//   mul          mat4_mul(), one pair at a time
+//   mul pairs    mat4_mul_pairs(), out[i] = a[i] * b[i]
+//   mul array    mat4_mul_array(), out[i] = a[i] * view_projection
+//   inverse      mat4_inverse(), one at a time
+//   points       mat4_transform_points(), structure-of-arrays points
+// The multiplies and the point transform have to match the scalar code bit
+// for bit; the inverse is checked by how far a * inverse(a) lands from the
+// identity. Reports millions of operations per second and the speedup.
+//
+// Usage: vecmath_bench [--matrices=N] [--points=N] [--passes=N]
+
+#include "basic/types.h"
+#include "basic/vecmath.h"
+#include "platform/os.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+internal u32 next_random(u32* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+internal f32 random_range(u32* state, f32 low, f32 high) {
+	return low + (high - low) * (f32)next_random(state) / (f32)(1u << 24);
+}
+
+internal Mat4 random_affine(u32* seed) {
+	Vec3 axis = vec3(random_range(seed, -1.0f, 1.0f), random_range(seed, -1.0f, 1.0f), random_range(seed, 0.1f, 1.0f));
+	Quat rotation = quat_from_axis_angle(axis, random_range(seed, -3.14159265f, 3.14159265f));
+	Vec3 scale = vec3(random_range(seed, 0.5f, 2.0f), random_range(seed, 0.5f, 2.0f), random_range(seed, 0.5f, 2.0f));
+	Vec3 translation = vec3(random_range(seed, -100.0f, 100.0f), random_range(seed, -100.0f, 100.0f), random_range(seed, -100.0f, 100.0f));
+	return mat4_affine(scale, rotation, translation);
+}
+
+internal void report(const char* name, f64 operations, f64 scalar_seconds, f64 simd_seconds, const char* check) {
+	printf("  %-10s  scalar %8.2f M/s   simd %8.2f M/s   %5.2fx   %s\n", name, operations / scalar_seconds / 1e6,
+				 operations / simd_seconds / 1e6, scalar_seconds / simd_seconds, check);
+}
+
+int main(int argc, char** argv) {
+	u32 matrix_count = 4096;
+	u32 point_count = 1u << 20;
+	u32 passes = 64;
+	for(s32 i = 1; i < argc; i++) {
+		if(strncmp(argv[i], "--matrices=", 11) == 0)     matrix_count = Max((u32)atoi(argv[i] + 11), 1u);
+		else if(strncmp(argv[i], "--points=", 9) == 0)   point_count = Max((u32)atoi(argv[i] + 9), 1u);
+		else if(strncmp(argv[i], "--passes=", 9) == 0)   passes = Max((u32)atoi(argv[i] + 9), 1u);
+		else {
+			printf("usage: vecmath_bench [--matrices=N] [--points=N] [--passes=N]\n");
+			return 1;
+		}
+	}
+
+	u64 matrix_size = (u64)matrix_count * sizeof(Mat4);
+	Mat4* a = (Mat4*)os_alloc_pages(matrix_size);
+	Mat4* b = (Mat4*)os_alloc_pages(matrix_size);
+	Mat4* scalar = (Mat4*)os_alloc_pages(matrix_size);
+	Mat4* simd = (Mat4*)os_alloc_pages(matrix_size);
+	u32 seed = 0x2545f491u;
+	for(u32 i = 0; i < matrix_count; i++) {
+		a[i] = random_affine(&seed);
+		b[i] = random_affine(&seed);
+	}
+	Mat4 view = mat4_look_at_lh(vec4(0, 30, -200, 1), vec4(0, 0, 0, 1), vec4(0, 1, 0, 0));
+	Mat4 projection = mat4_perspective_fov_lh(3.14159265f / 3.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	Mat4 view_projection = mat4_mul(&view, &projection);
+
+	u64 point_size = (u64)point_count * sizeof(f32);
+	Vec3Array points, scalar_points, simd_points;
+	Vec3Array* arrays[] = { &points, &scalar_points, &simd_points };
+	for(u32 i = 0; i < ArrayCount(arrays); i++) {
+		arrays[i]->x = (f32*)os_alloc_pages(point_size);
+		arrays[i]->y = (f32*)os_alloc_pages(point_size);
+		arrays[i]->z = (f32*)os_alloc_pages(point_size);
+	}
+	for(u32 i = 0; i < point_count; i++) {
+		points.x[i] = random_range(&seed, -10.0f, 10.0f);
+		points.y[i] = random_range(&seed, -10.0f, 10.0f);
+		points.z[i] = random_range(&seed, -10.0f, 10.0f);
+	}
+
+	printf("%u matrices, %u points, %u passes, %s\n", matrix_count, point_count, passes,
+				 VECMATH_AVX ? "SSE + AVX" : VECMATH_SSE ? "SSE" : "scalar only");
+	b32 all_match = true;
+	f64 operations = (f64)matrix_count * passes;
+
+	// mul
+	f64 start = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) {
+		for(u32 i = 0; i < matrix_count; i++) scalar[i] = mat4_mul_scalar(&a[i], &b[i]);
+	}
+	f64 middle = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) {
+		for(u32 i = 0; i < matrix_count; i++) simd[i] = mat4_mul(&a[i], &b[i]);
+	}
+	f64 end = os_now_seconds();
+	b32 match = memcmp(scalar, simd, matrix_size) == 0;
+	all_match = all_match && match;
+	report("mul", operations, middle - start, end - middle, match ? "matches" : "DIFFERS");
+
+	// mul pairs
+	start = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_mul_pairs_scalar(scalar, a, b, matrix_count);
+	middle = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_mul_pairs(simd, a, b, matrix_count);
+	end = os_now_seconds();
+	match = memcmp(scalar, simd, matrix_size) == 0;
+	all_match = all_match && match;
+	report("mul pairs", operations, middle - start, end - middle, match ? "matches" : "DIFFERS");
+
+	// mul array
+	start = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_mul_array_scalar(scalar, a, &view_projection, matrix_count);
+	middle = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_mul_array(simd, a, &view_projection, matrix_count);
+	end = os_now_seconds();
+	match = memcmp(scalar, simd, matrix_size) == 0;
+	all_match = all_match && match;
+	report("mul array", operations, middle - start, end - middle, match ? "matches" : "DIFFERS");
+
+	// inverse
+	start = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) {
+		for(u32 i = 0; i < matrix_count; i++) scalar[i] = mat4_inverse_scalar(&a[i], 0);
+	}
+	middle = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_inverse_array(simd, a, matrix_count);
+	end = os_now_seconds();
+	f32 scalar_error = 0.0f, simd_error = 0.0f;
+	for(u32 i = 0; i < matrix_count; i++) {
+		Mat4 scalar_identity = mat4_mul_scalar(&a[i], &scalar[i]);
+		Mat4 simd_identity = mat4_mul_scalar(&a[i], &simd[i]);
+		for(u32 r = 0; r < 4; r++) {
+			for(u32 c = 0; c < 4; c++) {
+				f32 expected = r == c ? 1.0f : 0.0f;
+				scalar_error = Max(scalar_error, fabsf(scalar_identity.m[r][c] - expected));
+				simd_error = Max(simd_error, fabsf(simd_identity.m[r][c] - expected));
+			}
+		}
+	}
+	char inverse_check[64];
+	snprintf(inverse_check, sizeof(inverse_check), "|a * inverse - I| %.1e scalar, %.1e simd", scalar_error, simd_error);
+	b32 inverse_ok = simd_error < 1e-4f;
+	all_match = all_match && inverse_ok;
+	report("inverse", operations, middle - start, end - middle, inverse_check);
+
+	// points
+	start = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_transform_points_scalar(scalar_points, points, &a[pass % matrix_count], point_count);
+	middle = os_now_seconds();
+	for(u32 pass = 0; pass < passes; pass++) mat4_transform_points(simd_points, points, &a[pass % matrix_count], point_count);
+	end = os_now_seconds();
+	match = memcmp(scalar_points.x, simd_points.x, point_size) == 0 && memcmp(scalar_points.y, simd_points.y, point_size) == 0 &&
+					memcmp(scalar_points.z, simd_points.z, point_size) == 0;
+	all_match = all_match && match;
+	report("points", (f64)point_count * passes, middle - start, end - middle, match ? "matches" : "DIFFERS");
+
+	for(u32 i = 0; i < ArrayCount(arrays); i++) {
+		os_free_pages(arrays[i]->x, point_size);
+		os_free_pages(arrays[i]->y, point_size);
+		os_free_pages(arrays[i]->z, point_size);
+	}
+	os_free_pages(simd, matrix_size);
+	os_free_pages(scalar, matrix_size);
+	os_free_pages(b, matrix_size);
+	os_free_pages(a, matrix_size);
+
+	if(!all_match) {
+		printf("[ERROR] the SIMD paths differ from the scalar ones\n");
+		return 1;
+	}
+	return 0;
+}